@@ -10,30 +10,67 @@
 // *************************************************************************************************
 
 uniform mat4 viewMatInv;
+
+attribute float parIdx;
+
+#ifdef _H3D_PARTICLE_TEX_
+
+// The engine stores the particles of an emitter in a float texture with three texels per particle:
+// position and size, color, rotation; parTexParams holds the first texel of the current batch and
+// the reciprocal texture size
+uniform sampler2D parTex;
+uniform vec4 parTexParams;
+
+vec4 getParticleTexel( const float offset )
+{
+	float texel = parTexParams.x + parIdx * 3.0 + offset;
+	float row = floor( texel * parTexParams.z );
+	vec2 coords = vec2( texel - row / parTexParams.z + 0.5, row + 0.5 ) * parTexParams.zw;
+	return texture2DLod( parTex, coords, 0.0 );
+}
+
+vec4 getParticlePosAndSize() { return getParticleTexel( 0.0 ); }
+vec4 getParticleColor() { return getParticleTexel( 1.0 ); }
+float getParticleRotation() { return getParticleTexel( 2.0 ).x; }
+
+#else
+
 uniform vec3 parPosArray[64];
 uniform vec2 parSizeAndRotArray[64];
 uniform vec4 parColorArray[64];
 
-attribute float parIdx;
-
+vec4 getParticlePosAndSize()
+{
+	int index = int( parIdx );
+	return vec4( parPosArray[index], parSizeAndRotArray[index].x );
+}
 
 vec4 getParticleColor()
 {
 	return parColorArray[int( parIdx )];
 }
 
+float getParticleRotation()
+{
+	return parSizeAndRotArray[int( parIdx )].y;
+}
+
+#endif
+
+
 vec3 calcParticlePos( const vec2 texCoords )
 {
-	int index = int( parIdx );
+	vec4 posAndSize = getParticlePosAndSize();
 	vec3 camAxisX = viewMatInv[0].xyz;
 	vec3 camAxisY = viewMatInv[1].xyz;
 	
 	vec2 cornerPos = texCoords - vec2( 0.5, 0.5 );
 	
 	// Apply rotation
-	float s = sin( parSizeAndRotArray[index].y );
-	float c = cos( parSizeAndRotArray[index].y );
+	float rotation = getParticleRotation();
+	float s = sin( rotation );
+	float c = cos( rotation );
 	cornerPos = mat2( c, -s, s, c ) * cornerPos;
 	
-	return parPosArray[index] + (camAxisX * cornerPos.x + camAxisY * cornerPos.y) * parSizeAndRotArray[index].x;
+	return posAndSize.xyz + (camAxisX * cornerPos.x + camAxisY * cornerPos.y) * posAndSize.w;
 }
\ No newline at end of file
@@ -9,16 +9,41 @@
 //
 // *************************************************************************************************
 
-uniform 	vec4 skinMatRows[75*3];
 attribute 	vec4 joints, weights;
 
+#ifdef _H3D_SKIN_PALETTE_
+
+// The engine stores the matrices of all models in one texture; skinPalette holds the first texel
+// of the model and the reciprocal texture size
+uniform 	sampler2D skinPaletteTex;
+uniform 	vec4 skinPalette;
+
+vec4 getSkinMatRow( const int index )
+{
+	float texel = skinPalette.x + float( index );
+	float row = floor( texel * skinPalette.z );
+	vec2 coords = vec2( texel - row / skinPalette.z + 0.5, row + 0.5 ) * skinPalette.zw;
+	return texture2DLod( skinPaletteTex, coords, 0.0 );
+}
+
+#else
+
+uniform 	vec4 skinMatRows[75*3];
+
+vec4 getSkinMatRow( const int index )
+{
+	return skinMatRows[index];
+}
+
+#endif
+
 
 mat4 getJointMat( const int jointIndex )
 {
 	// Note: This matrix is transposed so vec/mat multiplications need to be done in reversed order
-	return mat4( skinMatRows[jointIndex * 3],
-				 skinMatRows[jointIndex * 3 + 1],
-				 skinMatRows[jointIndex * 3 + 2],
+	return mat4( getSkinMatRow( jointIndex * 3 ),
+				 getSkinMatRow( jointIndex * 3 + 1 ),
+				 getSkinMatRow( jointIndex * 3 + 2 ),
 				 vec4( 0, 0, 0, 1 ) );
 }
 
@@ -195,9 +195,14 @@ void hordeUpdate(float tSimulation, float curFPS)
         h3dSetModelAnimParams( _knight, 0, tSimulation * 24.0f, _weight );
         h3dSetModelAnimParams( _knight, 1, tSimulation * 24.0f, 1.0f - _weight );
 
-        // Animate particle systems (several emitters in a group node)
-        unsigned int cnt = h3dFindNodes( _particleSys, "", H3DNodeTypes::Emitter );
-        for( unsigned int i = 0; i < cnt; ++i ) h3dUpdateEmitter( h3dGetNodeFindResult( i ), 1.0f / curFPS );
+        // Animate particle systems (several emitters in a group node) in one parallel batch
+        int cnt = h3dFindNodes( _particleSys, "", H3DNodeTypes::Emitter );
+        if (cnt > 0) {
+                H3DNode* emitters = (H3DNode*) mxMalloc(cnt * sizeof(H3DNode));
+                for( int i = 0; i < cnt; ++i ) emitters[i] = h3dGetNodeFindResult( i );
+                h3dUpdateEmitters( cnt, emitters, 1.0f / curFPS );
+                mxFree(emitters);
+        }
 
         // Render scene
         h3dRender( _cam );
@@ -382,12 +387,29 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 mexPrintf("%s('AdvanceEmitterTime', emitterNode, timeDelta);\n", me);
                 mexPrintf("%s('UpdateEmitter', emitterNode, timeDelta);\n", me);
                 mexPrintf("-- Advances the time value of an Emitter node with timeDelta being the time elapsed since the last call of this function.\n\n");
+                mexPrintf("%s('UpdateEmitters', emitterNodes, timeDelta);\n", me);
+                mexPrintf("-- Advances the time value of all Emitter nodes in vector 'emitterNodes' by timeDelta and simulates their particles in parallel.\n\n");
                 mexPrintf("%s('HasEmitterFinished', emitterNode);\n", me);
                 mexPrintf("-- Checks if an Emitter node is still alive and has living particles or will spawn new particles.\n\n");
+                mexPrintf("particles = %s('GetEmitterParticles', emitterNode);\n", me);
+                mexPrintf("-- Returns the live particles of an Emitter node as 9-by-n matrix. Each column is [x, y, z, size, rotation, r, g, b, a] of one particle.\n\n");
+                mexPrintf("handle = %s('AddDotFieldNode', parent, name, materialRes, dotCount);\n", me);
+                mexPrintf("-- Creates a new DotField node (random dot kinematogram) and attaches it to the specified parent node. Its parameters are set with 'SetNodeParamI' and 'SetNodeParamF'.\n\n");
+                mexPrintf("%s('UpdateDotField', dotFieldNode, timeDelta);\n", me);
+                mexPrintf("-- Moves the dots of a DotField node by one step with timeDelta being the time elapsed since the last call of this function.\n\n");
+                mexPrintf("dots = %s('GetDotFieldDots', dotFieldNode);\n", me);
+                mexPrintf("-- Returns the dots of a DotField node as 4-by-n matrix. Each column is [x, y, z, isSignal] of one dot.\n\n");
                 mexPrintf("handle = %s('AddResource', resId, resName);\n", me);
                 mexPrintf("-- Add a resource of type 'resId' from file with name 'resName', return a 'handle' to it.\n\n");
                 mexPrintf("%s('LoadResources', basePath);\n", me);
                 mexPrintf("-- Load all resources defined by previous 'AddResource' calls from the base directory 'basePath'\n\n");
+                mexPrintf("%s('StartLoadResources', basePath);\n", me);
+                mexPrintf("-- Start loading all resources defined by previous 'AddResource' calls from the base directory 'basePath' in the background and return immediately.\n\n");
+                mexPrintf("[progress, loaded, total] = %s('PollLoadResources' [, maxTimeMsecs=-1]);\n", me);
+                mexPrintf("-- Pass the resources loaded in the background to the engine, spending at most about 'maxTimeMsecs' on it. Returns 'progress' between 0 and 1,\n");
+                mexPrintf("-- where 1 means done, and the number of 'loaded' and of all known resources 'total'. Call repeatedly, e.g., once per frame, until 'progress' is 1.\n\n");
+                mexPrintf("%s('FinishLoadResources');\n", me);
+                mexPrintf("-- Wait until all resources loaded in the background are loaded.\n\n");
                 mexPrintf("handle = %s('AddCamera', Name, pipelineId);\n", me);
                 mexPrintf("-- Add a camera node with name 'Name' and rendering pipeline resource 'pipelineId', return a 'handle' to it.\n\n");
                 mexPrintf("handle = %s('AddNodes', parentNode, sceneGraphHandle);\n", me);
@@ -404,6 +426,9 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 mexPrintf("%s('SetupModelAnimStage', H3DNode, trackIdx, animationResourceHandle, startNodeName, additiveFlag);\n", me);
                 mexPrintf("-- Assign animation resource 'animationResourceHandle' as motion track 'trackIdx' to scenegraph node 'H3DNode'. 'startNodeName' is name of\n");
                 mexPrintf("first node to apply to or an empty string if animation should apply to first node of model. Animation is additive if 'additiveFlag' is non-zero.\n\n");
+                mexPrintf("%s('PrewarmModelAnim', H3DNode, animationResourceHandle [, startNodeName]);\n", me);
+                mexPrintf("-- Match animation resource 'animationResourceHandle' with the skeleton of model 'H3DNode' in advance, e.g., at load time. The result is shared by all models\n");
+                mexPrintf("with the same skeleton, so later 'SetupModelAnimStage' calls with the same 'startNodeName' for any of these models are very cheap.\n\n");
                 mexPrintf("handles = %s('FindNodes', parentNode, name, type);\n", me);
                 mexPrintf("-- Find nodes with name 'name' of type 'type' within the scene graph rooted at 'parentNode'. Return a vector containing 'handles' of all found nodes, or an empty vector if none are found.\n\n");
                 mexPrintf("handle = %s('AddLightNode', parentNode, name, materialHandle, lightContext, shadowContext);\n", me);
@@ -422,10 +447,17 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 mexPrintf("-- Set parameters for motiontrack: For model 'modelNode', motiontrack 'trackIdx', set simulation time to 'time' and morphWeight to 'weight'.\n\n");
                 mexPrintf("%s('SetModelsAnimParameters', params);\n", me);
                 mexPrintf("-- Set parameters for motiontrack: 'params' is a 4-by-n matrix with one column per parameter set 'modelNode', motiontrack 'trackIdx', simulation time 'time' and morphWeight 'weight'.\n\n");
+                mexPrintf("%s('UpdateModels', modelNodes, trackIdx [, times][, weights][, flags]);\n", me);
+                mexPrintf("-- Set motiontrack 'trackIdx' of all models in vector 'modelNodes' to the corresponding entries of vectors 'times' and 'weights' and update them in parallel.\n");
+                mexPrintf("-- Empty or omitted 'times' or 'weights' keep the current values. 'flags' selects animation (1) and/or geometry (2) update, default 3 for both.\n\n");
                 mexPrintf("%s('Render', camera);\n", me);
                 mexPrintf("-- Perform update & render cycle into current active window with camera 'camera'.\n\n");
                 mexPrintf("%s('FinalizeFrame');\n", me);
                 mexPrintf("-- Mark this frame done.\n\n");
+                mexPrintf("%s('BeginFrame');\n", me);
+                mexPrintf("-- Start scene update for a new frame. Model, emitter and dot field updates until 'EndFrame' are recorded if option ThreadedUpdate is enabled.\n\n");
+                mexPrintf("%s('EndFrame');\n", me);
+                mexPrintf("-- End scene update for a new frame. With option ThreadedUpdate enabled, waits for the update of the previous frame, then runs the model and emitter updates since 'BeginFrame' in the background, e.g., during Screen('Flip') and while the next frame is rendered from a snapshot. All other commands that access the scene wait for it. Call while the OpenGL context is bound.\n\n");
                 mexPrintf("%s('DumpMessages');\n", me);
                 mexPrintf("-- Dump all pending diagnostic messages to logfile.\n\n");
                 mexPrintf("%s('UpdateRender', simulationTime, currentFPS);\n", me);
@@ -556,6 +588,42 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 h3dutDumpMessages();
         }
 
+        if (IsCommand((char*)"StartLoadResources")) {
+                if (nrhs < 1) mexErrMsgTxt("Horde3D: StartLoadResources: Basepath missing!");
+
+                // Get resource path:
+                str[0] = 0;
+                mxGetString(prhs[1], (char*) &str, MAX_STR_LENGTH-1);
+
+                // Start loading resources on the loader threads:
+                h3dutStartLoadingResourcesFromDisk( str );
+        }
+
+        if (IsCommand((char*)"PollLoadResources")) {
+                // Optional time budget, default is to load all resources which are ready:
+                v[0] = (nrhs >= 1) ? (float) mxGetScalar(prhs[1]) : -1.0f;
+
+                // Pass loaded resources to the engine and return progress:
+                v[1] = h3dutPollResourceLoading( v[0], &i1, &i2 );
+                plhs[0] = mxCreateDoubleMatrix(1, 1, mxREAL);
+                *(mxGetPr(plhs[0])) = (double) v[1];
+                plhs[1] = mxCreateDoubleMatrix(1, 1, mxREAL);
+                *(mxGetPr(plhs[1])) = (double) i1;
+                plhs[2] = mxCreateDoubleMatrix(1, 1, mxREAL);
+                *(mxGetPr(plhs[2])) = (double) i2;
+                h3dutDumpMessages();
+        }
+
+        if (IsCommand((char*)"FinishLoadResources")) {
+                // Wait for all resources loaded in the background:
+                if (!h3dutFinishLoadingResources()) {
+                        h3dutDumpMessages();
+                        mexPrintf("Failed to load at least one of the requested Resources.\n");
+                        mexErrMsgTxt("Horde3D: FinishLoadResources: FAILED!");
+                }
+                h3dutDumpMessages();
+        }
+
         if (IsCommand((char*)"AddCamera")) {
                 if (nrhs < 1) mexErrMsgTxt("Horde3D: AddCamera: 'camera name' and 'resource handle' for rendering pipeline missing!");
                 if (nrhs < 2) mexErrMsgTxt("Horde3D: AddCamera: 'resource handle' for rendering pipeline missing!");
@@ -692,6 +760,19 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 h3dSetupModelAnimStage( i1, i2, i3, 0, str, (i4 > 0) ? true : false);
         }
 
+        if (IsCommand((char*)"PrewarmModelAnim")) {
+                if (nrhs < 1) mexErrMsgTxt("Horde3D: PrewarmModelAnim: Required parameters 'modelNode' and 'animationRes' missing!");
+                if (nrhs < 2) mexErrMsgTxt("Horde3D: PrewarmModelAnim: Required parameter 'animationRes' missing!");
+
+                i1 = (int) mxGetScalar(prhs[1]);
+                i2 = (int) mxGetScalar(prhs[2]);
+                // Optional start node name:
+                str[0] = 0;
+                if (nrhs >= 3) mxGetString(prhs[3], (char*) &str, MAX_STR_LENGTH-1);
+
+                h3dPrewarmModelAnim(i1, i2, str);
+        }
+
         if (IsCommand((char*)"FindNodes")) {
                 if (nrhs < 1) mexErrMsgTxt("Horde3D: FindNodes: Required parameters 'startNode', 'name' and 'type' missing!");
                 if (nrhs < 2) mexErrMsgTxt("Horde3D: FindNodes: Required parameters 'name' and 'type' missing!");
@@ -809,6 +890,41 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 }
         }
 
+        if (IsCommand((char*)"UpdateModels")) {
+                if (nrhs < 1) mexErrMsgTxt("Horde3D: UpdateModels: Required parameters 'modelNodes' and 'trackIdx' missing!");
+                if (nrhs < 2) mexErrMsgTxt("Horde3D: UpdateModels: Required parameter 'trackIdx' missing!");
+
+                i1 = (int) mxGetNumberOfElements(prhs[1]);
+                if (i1 < 1) mexErrMsgTxt("Horde3D: UpdateModels: 'modelNodes' is empty!");
+                if ((nrhs >= 3 && !mxIsEmpty(prhs[3]) && (int) mxGetNumberOfElements(prhs[3]) != i1) ||
+                    (nrhs >= 4 && !mxIsEmpty(prhs[4]) && (int) mxGetNumberOfElements(prhs[4]) != i1))
+                        mexErrMsgTxt("Horde3D: UpdateModels: 'times' and 'weights' must have the same number of elements as 'modelNodes'!");
+
+                i2 = (int) mxGetScalar(prhs[2]);
+                i3 = (nrhs >= 5) ? (int) mxGetScalar(prhs[5]) : H3DModelUpdateFlags::Animation | H3DModelUpdateFlags::Geometry;
+
+                // Convert to engine types, one allocation for all three arrays:
+                int* handles = (int*) mxMalloc(i1 * (sizeof(int) + 2 * sizeof(float)));
+                float* times = (float*) (handles + i1);
+                float* weights = times + i1;
+
+                p = mxGetPr(prhs[1]);
+                for (i4 = 0; i4 < i1; i4++) handles[i4] = (int) p[i4];
+                if (nrhs >= 3 && !mxIsEmpty(prhs[3])) {
+                        p = mxGetPr(prhs[3]);
+                        for (i4 = 0; i4 < i1; i4++) times[i4] = (float) p[i4];
+                }
+                else times = NULL;
+                if (nrhs >= 4 && !mxIsEmpty(prhs[4])) {
+                        p = mxGetPr(prhs[4]);
+                        for (i4 = 0; i4 < i1; i4++) weights[i4] = (float) p[i4];
+                }
+                else weights = NULL;
+
+                h3dUpdateModels(i1, handles, i2, times, weights, i3);
+                mxFree(handles);
+        }
+
         if (IsCommand((char*)"Render")) {
                 if (nrhs < 1) mexErrMsgTxt("Horde3D: Render: Required parameter 'cameraNode' missing!");
 
@@ -833,6 +949,16 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 h3dFinalizeFrame();
         }
 
+        if (IsCommand((char*)"BeginFrame")) {
+                // Start recording updates:
+                h3dBeginFrame();
+        }
+
+        if (IsCommand((char*)"EndFrame")) {
+                // Submit recorded model and emitter updates:
+                h3dEndFrame();
+        }
+
         if (IsCommand((char*)"GetMessage")) {
                 // if (nrhs < 2) mexErrMsgTxt("Horde3D: GetMessage: One of the 2 required parameters missing!");
                 // Gets the next message from the message queue
@@ -1473,6 +1599,20 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                 h3dUpdateEmitter(i1, (float) mxGetScalar(prhs[2]));
         }
 
+        if (IsCommand((char*)"UpdateEmitters")) {
+                if (nrhs < 2) mexErrMsgTxt("Horde3D: UpdateEmitters: One of the 2 required parameters missing!");
+
+                i1 = (int) mxGetNumberOfElements(prhs[1]);
+                if (i1 > 0) {
+                        int* handles = (int*) mxMalloc(i1 * sizeof(int));
+                        p = mxGetPr(prhs[1]);
+                        for (i4 = 0; i4 < i1; i4++) handles[i4] = (int) p[i4];
+
+                        h3dUpdateEmitters(i1, handles, (float) mxGetScalar(prhs[2]));
+                        mxFree(handles);
+                }
+        }
+
         if (IsCommand((char*)"HasEmitterFinished")) {
                 if (nrhs < 1) mexErrMsgTxt("Horde3D: HasEmitterFinished: One required parameter missing!");
                 i1 = (int) mxGetScalar(prhs[1]);
@@ -1481,6 +1621,69 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray*prhs[])
                         mexErrMsgTxt("Horde3d: HasEmitterFinished: The specified emitter node is not active.");
         }
 
+        if (IsCommand((char*)"GetEmitterParticles")) {
+                if (nrhs < 1) mexErrMsgTxt("Horde3D: GetEmitterParticles: One required parameter missing!");
+                i1 = (int) mxGetScalar(prhs[1]);
+
+                // No more particles than the maximal count can be alive:
+                i2 = h3dGetNodeParamI(i1, H3DEmitter::MaxCountI);
+                float* pos = (float*) mxMalloc((i2 + 1) * 9 * sizeof(float));
+                float* sizeRot = pos + (i2 + 1) * 3;
+                float* col = sizeRot + (i2 + 1) * 2;
+                i3 = h3dGetEmitterParticleData(i1, i2, pos, sizeRot, col);
+                if (i3 > i2) i3 = i2;
+
+                plhs[0] = mxCreateDoubleMatrix(9, i3, mxREAL);
+                p = mxGetPr(plhs[0]);
+                for (i4 = 0; i4 < i3; i4++) {
+                        *(p++) = pos[i4 * 3 + 0]; *(p++) = pos[i4 * 3 + 1]; *(p++) = pos[i4 * 3 + 2];
+                        *(p++) = sizeRot[i4 * 2 + 0]; *(p++) = sizeRot[i4 * 2 + 1];
+                        for (i5 = 0; i5 < 4; i5++) *(p++) = col[i4 * 4 + i5];
+                }
+                mxFree(pos);
+        }
+
+        if (IsCommand((char*)"AddDotFieldNode")) {
+                if (nrhs < 4) mexErrMsgTxt("Horde3D: AddDotFieldNode: One of the 4 required parameters missing!");
+                i1 = (int) mxGetScalar(prhs[1]);
+                str[0] = 0;
+                mxGetString(prhs[2], (char*) &str, MAX_STR_LENGTH-1);
+                i2 = (int) mxGetScalar(prhs[3]);
+                // Adds a DotField node to the scene.
+                i4 = (int)h3dAddDotFieldNode(i1, str, i2, (int) mxGetScalar(prhs[4]));
+                plhs[0] = mxCreateDoubleMatrix(1, 1, mxREAL);
+                *(mxGetPr(plhs[0])) = i4;
+                if (i4 == 0)
+                        mexErrMsgTxt("Horde3d: AddDotFieldNode: The specified dot field node could not be added to the scene.");
+        }
+
+        if (IsCommand((char*)"UpdateDotField")) {
+                if (nrhs < 2) mexErrMsgTxt("Horde3D: UpdateDotField: One of the 2 required parameters missing!");
+                i1 = (int) mxGetScalar(prhs[1]);
+                // Moves the dots of a DotField node by one step.
+                h3dUpdateDotField(i1, (float) mxGetScalar(prhs[2]));
+        }
+
+        if (IsCommand((char*)"GetDotFieldDots")) {
+                if (nrhs < 1) mexErrMsgTxt("Horde3D: GetDotFieldDots: One required parameter missing!");
+                i1 = (int) mxGetScalar(prhs[1]);
+
+                // Query the count first, dots only exist after the first update:
+                i2 = h3dGetDotFieldData(i1, 0, NULL, NULL);
+                float* pos = (float*) mxMalloc((i2 + 1) * 4 * sizeof(float));
+                float* sig = pos + (i2 + 1) * 3;
+                i3 = h3dGetDotFieldData(i1, i2, pos, sig);
+                if (i3 > i2) i3 = i2;
+
+                plhs[0] = mxCreateDoubleMatrix(4, i3, mxREAL);
+                p = mxGetPr(plhs[0]);
+                for (i4 = 0; i4 < i3; i4++) {
+                        *(p++) = pos[i4 * 3 + 0]; *(p++) = pos[i4 * 3 + 1]; *(p++) = pos[i4 * 3 + 2];
+                        *(p++) = sig[i4];
+                }
+                mxFree(pos);
+        }
+
         if (IsCommand((char*)"DumpMessages")) {
                 // Write all mesages to log file
                 h3dutDumpMessages();
@@ -13,6 +13,7 @@
 #include "egModules.h"
 #include "egCom.h"
 #include "egRenderer.h"
+#include "egFrame.h"
 #include "extension.h"
 #include "terrain.h"
 
@@ -71,6 +72,8 @@ std::string safeStr( const char *str )
 DLLEXP NodeHandle h3dextAddTerrainNode( NodeHandle parent, const char *name, ResHandle heightMapRes,
                                         ResHandle materialRes )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	if( parentNode == 0x0 ) return 0;
 	
@@ -91,6 +94,8 @@ DLLEXP NodeHandle h3dextAddTerrainNode( NodeHandle parent, const char *name, Res
 
 DLLEXP ResHandle h3dextCreateTerrainGeoRes( NodeHandle node, const char *name, float meshQuality )
 {	
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	if( sn != 0x0 && sn->getType() == SNT_TerrainNode )
 		return ((TerrainNode *)sn)->createGeometryResource( safeStr( name ), 1.0f / meshQuality );
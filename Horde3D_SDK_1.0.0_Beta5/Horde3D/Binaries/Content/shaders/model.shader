@@ -68,6 +68,15 @@ context LIGHTING
 	BlendMode = Add;
 }
 
+context CLUSTERED_LIGHTING
+{
+	VertexShader = compile GLSL VS_GENERAL;
+	PixelShader = compile GLSL FS_CLUSTERED_LIGHTING;
+	
+	ZWriteEnable = false;
+	BlendMode = Add;
+}
+
 context AMBIENT
 {
 	VertexShader = compile GLSL VS_GENERAL;
@@ -373,6 +382,81 @@ void main( void )
 }
 
 
+[[FS_CLUSTERED_LIGHTING]]
+// =================================================================================================
+
+#ifdef _F03_ParallaxMapping
+	#define _F02_NormalMapping
+#endif
+
+#include "shaders/utilityLib/fragClusteredLighting.glsl"
+
+uniform vec4 matDiffuseCol;
+uniform vec4 matSpecParams;
+uniform sampler2D albedoMap;
+
+#ifdef _F02_NormalMapping
+	uniform sampler2D normalMap;
+#endif
+
+varying vec4 pos, vsPos;
+varying vec2 texCoords;
+
+#ifdef _F02_NormalMapping
+	varying mat3 tsbMat;
+#else
+	varying vec3 tsbNormal;
+#endif
+#ifdef _F03_ParallaxMapping
+	varying vec3 eyeTS;
+#endif
+
+void main( void )
+{
+	vec3 newCoords = vec3( texCoords, 0 );
+	
+#ifdef _F03_ParallaxMapping	
+	const float plxScale = 0.03;
+	const float plxBias = -0.015;
+	
+	// Iterative parallax mapping
+	vec3 eye = normalize( eyeTS );
+	for( int i = 0; i < 4; ++i )
+	{
+		vec4 nmap = texture2D( normalMap, newCoords.st * vec2( 1, -1 ) );
+		float height = nmap.a * plxScale + plxBias;
+		newCoords += (height - newCoords.p) * nmap.z * eye;
+	}
+#endif
+
+	// Flip texture vertically to match the GL coordinate system
+	newCoords.t *= -1.0;
+
+	vec4 albedo = texture2D( albedoMap, newCoords.st ) * matDiffuseCol;
+	
+#ifdef _F05_AlphaTest
+	if( albedo.a < 0.01 ) discard;
+#endif
+	
+#ifdef _F02_NormalMapping
+	vec3 normalMap = texture2D( normalMap, newCoords.st ).rgb * 2.0 - 1.0;
+	vec3 normal = tsbMat * normalMap;
+#else
+	vec3 normal = tsbNormal;
+#endif
+
+	vec3 newPos = pos.xyz;
+
+#ifdef _F03_ParallaxMapping
+	newPos += vec3( 0.0, newCoords.p, 0.0 );
+#endif
+	
+	gl_FragColor.rgb =
+		calcClusteredPhongLighting( newPos, normalize( normal ), albedo.rgb, matSpecParams.rgb,
+		                            matSpecParams.a, -vsPos.z );
+}
+
+
 [[FS_AMBIENT]]	
 // =================================================================================================
 
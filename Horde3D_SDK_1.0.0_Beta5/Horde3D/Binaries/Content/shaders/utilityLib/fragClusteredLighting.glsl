@@ -0,0 +1,84 @@
+// *************************************************************************************************
+// Horde3D Shader Utility Library
+// --------------------------------------
+//		- Clustered forward lighting functions -
+//
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// You may use the following code in projects based on the Horde3D graphics engine.
+//
+// *************************************************************************************************
+
+uniform 	vec3 viewerPos;
+uniform 	sampler2D clusterLightTex;
+uniform 	sampler2D clusterGridTex;
+uniform 	vec4 clusterDims;
+uniform 	vec4 clusterDepthParams;
+uniform 	vec4 clusterViewport;
+
+// Layout of the engine-side textures
+const vec2 clusterLightTexSize = vec2( 256.0, 4.0 );
+const vec2 clusterGridTexSize = vec2( 1024.0, 16.0 );
+const int maxClusterLights = 32;
+
+
+vec4 fetchClusterGrid( const float index )
+{
+	float row = floor( index / clusterGridTexSize.x );
+	vec2 coords = vec2( index - row * clusterGridTexSize.x, row ) + 0.5;
+
+	return texture2D( clusterGridTex, coords / clusterGridTexSize );
+}
+
+
+vec3 calcClusteredPhongLighting( const vec3 pos, const vec3 normal, const vec3 albedo, const vec3 specColor,
+                                 const float gloss, const float viewDist )
+{
+	// Find cluster of fragment
+	vec2 tile = floor( (gl_FragCoord.xy - clusterViewport.xy) / clusterViewport.zw * clusterDims.xy );
+	float depth = clusterDepthParams.z > 0.5 ? log( max( viewDist, 0.0001 ) ) : viewDist;
+	float slice = floor( depth * clusterDepthParams.x + clusterDepthParams.y );
+
+	tile = clamp( tile, vec2( 0.0 ), clusterDims.xy - 1.0 );
+	slice = clamp( slice, 0.0, clusterDims.z - 1.0 );
+	vec4 cluster = fetchClusterGrid( (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x );
+
+	vec3 view = normalize( viewerPos - pos );
+	float specExp = exp2( 10.0 * gloss + 1.0 );
+	vec3 result = vec3( 0.0 );
+
+	for( int i = 0; i < maxClusterLights; ++i )
+	{
+		if( float( i ) >= cluster.y ) break;
+
+		float u = (fetchClusterGrid( cluster.x + float( i ) ).x + 0.5) / clusterLightTexSize.x;
+		vec4 lightPos = texture2D( clusterLightTex, vec2( u, 0.125 ) );
+		vec4 lightDir = texture2D( clusterLightTex, vec2( u, 0.375 ) );
+		vec3 lightColor = texture2D( clusterLightTex, vec2( u, 0.625 ) ).rgb;
+
+		vec3 light = lightPos.xyz - pos;
+		float lightLen = length( light );
+		light /= lightLen;
+
+		// Distance attenuation
+		float lightDepth = lightLen / lightPos.w;
+		float atten = max( 1.0 - lightDepth * lightDepth, 0.0 );
+
+		// Spotlight falloff
+		float angle = dot( lightDir.xyz, -light );
+		atten *= clamp( (angle - lightDir.w) / 0.2, 0.0, 1.0 );
+
+		// Lambert diffuse
+		atten *= max( dot( normal, light ), 0.0 );
+
+		// Blinn-Phong specular with energy conservation
+		vec3 halfVec = normalize( light + view );
+		vec3 specular = specColor * pow( max( dot( halfVec, normal ), 0.0 ), specExp );
+		specular *= (specExp * 0.125 + 0.25);  // Normalization factor (n+2)/8
+
+		// Note: Shadows are not supported in the clustered path
+		result += (albedo + specular) * lightColor * atten;
+	}
+
+	return result;
+}
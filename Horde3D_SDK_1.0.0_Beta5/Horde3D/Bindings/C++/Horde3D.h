@@ -46,11 +46,13 @@
 /* Group: Typedefs and constants */
 
 /*	Constants: Typedefs
-	H3DRes   - handle to resource (type: int32)
-	H3DNode  - handle to scene node (type: int32)
+	H3DRes         - handle to resource (type: int32)
+	H3DNode        - handle to scene node (type: int32)
+	H3DDecodedRes  - handle to decoded resource data (type: opaque pointer)
 */
 typedef int H3DRes;
 typedef int H3DNode;
+typedef struct H3DDecodedResData *H3DDecodedRes;
 
 
 /*	Constants: Predefined constants
@@ -85,6 +87,16 @@ struct H3DOptions
 		DumpFailedShaders   - Enables or disables storing of shader code that failed to compile in a text file; this can be
 		                      useful in combination with the line numbers given back by the shader compiler. (Values: 0, 1; Default: 0)
 		GatherTimeStats     - Enables or disables gathering of time stats that are useful for profiling (Values: 0, 1; Default: 1)
+		ThreadedUpdate      - Enables or disables running model and emitter updates that are issued between h3dBeginFrame
+		                      and h3dEndFrame on a background thread while the next frame is rendered from a
+		                      snapshot of the scene (Values: 0, 1; Default: 0)
+		WorkerThreads       - Number of worker threads used in addition to the calling thread for batched updates like
+		                      h3dUpdateModels; 0 runs everything on the calling thread (Default: number of CPU cores - 1)
+		AnimCompression     - Enables or disables storing animations as quantized and reduced key tracks; only affects
+		                      animations that are loaded after setting the option. (Values: 0, 1; Default: 0)
+		AnimPoseCache       - Enables or disables sharing evaluated poses between models with the same skeleton that
+		                      play the same animations with equal times and weights in a frame, e.g. a crowd
+		                      animated in lockstep (Values: 0, 1; Default: 0)
 	*/
 	enum List
 	{
@@ -101,7 +113,11 @@ struct H3DOptions
 		WireframeMode,
 		DebugViewMode,
 		DumpFailedShaders,
-		GatherTimeStats
+		GatherTimeStats,
+		ThreadedUpdate,
+		WorkerThreads,
+		AnimCompression,
+		AnimPoseCache
 	};
 };
 
@@ -123,6 +139,29 @@ struct H3DStats
 		ParticleGPUTime   - GPU time in ms spent for drawing particles
 		TextureVMem       - Estimated amount of video memory used by textures (in Mb)
 		GeometryVMem      - Estimated amount of video memory used by geometry (in Mb)
+		SWOccCulledCount  - Number of renderables rejected by software occlusion culling
+		ShaderChangesSubmitted      - Number of shader binds requested from the render device
+		ShaderChangesApplied        - Number of shader binds that actually changed the GL state
+		RenderStateChangesSubmitted - Number of raster, blend and depth state changes requested
+		RenderStateChangesApplied   - Number of raster, blend and depth states that were actually changed
+		TextureChangesSubmitted     - Number of texture unit bindings requested
+		TextureChangesApplied       - Number of texture unit bindings that were actually changed
+		SamplerChangesSubmitted     - Number of sampler states requested along with texture bindings
+		SamplerChangesApplied       - Number of sampler states that were actually changed
+		VertLayoutChangesSubmitted  - Number of vertex layout setups requested
+		VertLayoutChangesApplied    - Number of vertex layout setups that were actually performed
+		IndexBufChangesSubmitted    - Number of index buffer bindings requested
+		IndexBufChangesApplied      - Number of index buffer bindings that were actually changed
+		ViewportChangesSubmitted    - Number of viewport and scissor rectangle changes requested
+		ViewportChangesApplied      - Number of viewport and scissor rectangle changes actually applied
+		PoseCacheHitCount           - Number of model animation updates that reused a pose from the pose cache;
+		                              updated by h3dFinalizeFrame
+		PoseCacheMissCount          - Number of model animation updates that had to evaluate their pose although
+		                              the pose cache was enabled; updated by h3dFinalizeFrame
+		EmitterLodSkipCount         - Number of emitter updates that were not simulated because of
+		                              H3DEmitter::LodUpdateIntervalI; their time is added to the next step
+		EmitterCullSkipCount        - Number of emitter updates that were not simulated because the emitter
+		                              was culled for more than H3DEmitter::CullFramesI frames
 	*/
 	enum List
 	{
@@ -138,7 +177,26 @@ struct H3DStats
 		ShadowsGPUTime,
 		ParticleGPUTime,
 		TextureVMem,
-		GeometryVMem
+		GeometryVMem,
+		SWOccCulledCount,
+		ShaderChangesSubmitted,
+		ShaderChangesApplied,
+		RenderStateChangesSubmitted,
+		RenderStateChangesApplied,
+		TextureChangesSubmitted,
+		TextureChangesApplied,
+		SamplerChangesSubmitted,
+		SamplerChangesApplied,
+		VertLayoutChangesSubmitted,
+		VertLayoutChangesApplied,
+		IndexBufChangesSubmitted,
+		IndexBufChangesApplied,
+		ViewportChangesSubmitted,
+		ViewportChangesApplied,
+		PoseCacheHitCount,
+		PoseCacheMissCount,
+		EmitterLodSkipCount,
+		EmitterCullSkipCount
 	};
 };
 
@@ -378,7 +436,13 @@ struct H3DPartEffRes
 		PartLifeMaxF     - Maximum value of random life time (in seconds)
 		ChanStartMinF    - Minimum for selecting initial random value of channel
 		ChanStartMaxF    - Maximum for selecting initial random value of channel
-		ChanEndRateF     - Remaining percentage of initial value when particle is dying
+		ChanEndRateF     - Remaining percentage of initial value when particle is dying; setting it removes
+		                   the curve of the channel
+		ChanDragElem     - Drag channel
+		ChanCurveF       - Factor of the initial value at a sample of the normalized particle age, which
+		                   replaces the linear change of ChanEndRateF; the component index is the sample
+		                   in [0, 255]. Setting a sample of a channel without a curve converts its linear
+		                   change into a curve first.
 	*/
 	enum List
 	{
@@ -395,7 +459,8 @@ struct H3DPartEffRes
 		ChanStartMinF,
 		ChanStartMaxF,
 		ChanEndRateF,
-		ChanDragElem
+		ChanDragElem,
+		ChanCurveF
 	};
 };
 
@@ -430,6 +495,7 @@ struct H3DNodeTypes
 		Light      - Light source
 		Camera     - Camera giving view on scene
 		Emitter    - Particle system emitter
+		DotField   - Random dot kinematogram
 	*/
 	enum List
 	{
@@ -440,7 +506,8 @@ struct H3DNodeTypes
 		Joint,
 		Light,
 		Camera,
-		Emitter
+		Emitter,
+		DotField
 	};
 };
 
@@ -454,13 +521,15 @@ struct H3DNodeFlags
 		NoRayQuery     - Excludes scene node from ray intersection queries
 		Inactive       - Deactivates scene node so that it is completely ignored
 		                 (combination of all flags above)
+		Occluder       - Marks mesh as occluder for software occlusion culling (see H3DCamera::SWOccCullingI)
 	*/
 	enum List
 	{
 		NoDraw = 1,
 		NoCastShadow = 2,
 		NoRayQuery = 4,
-		Inactive = 7  // NoDraw | NoCastShadow | NoRayQuery
+		Inactive = 7,  // NoDraw | NoCastShadow | NoRayQuery
+		Occluder = 8
 	};
 };
 
@@ -497,6 +566,13 @@ struct H3DModel
 		LodDist4F    - Distance to camera from which on LOD4 is used
 		               (may not be smaller than LodDist3) (default: infinite)
 		AnimCountI   - Number of active animation stages [read-only]
+		LazyAnimI    - Enables or disables lazy animation (default: 0); if enabled, h3dUpdateModel only
+		               records that the animation changed and enlarges the bounding boxes of the meshes so
+		               that they contain the model for any time and weight of the current animation stages;
+		               the pose is only evaluated, together with pending geometry updates, when a mesh of the
+		               model passes the culling of a render pass. Joint transformations of models that are
+		               not rendered remain outdated. Models with additive stages are always animated
+		               immediately.
 	*/
 	enum List
 	{
@@ -506,7 +582,8 @@ struct H3DModel
 		LodDist2F,
 		LodDist3F,
 		LodDist4F,
-		AnimCountI
+		AnimCountI,
+		LazyAnimI
 	};
 };
 
@@ -598,6 +675,9 @@ struct H3DCamera
 		ViewportHeightI  - Height of the viewport rectangle (default: 240)
 		OrthoI           - Flag for setting up an orthographic frustum instead of a perspective one (default: 0)
 		OccCullingI      - Flag for enabling occlusion culling (default: 0)
+		SWOccCullingI    - Flag for enabling software occlusion culling: meshes with the Occluder flag are
+		                   rasterized on the CPU into a low resolution depth buffer and renderables hidden
+		                   behind them are removed before they reach the render queue (default: 0)
 	*/
 	enum List
 	{
@@ -615,7 +695,8 @@ struct H3DCamera
 		ViewportWidthI,
 		ViewportHeightI,
 		OrthoI,
-		OccCullingI
+		OccCullingI,
+		SWOccCullingI
 	};
 };
 
@@ -627,11 +708,35 @@ struct H3DEmitter
 		MatResI        - Material resource used for rendering
 		PartEffResI    - ParticleEffect resource which configures particle properties
 		MaxCountI      - Maximal number of particles living at the same time
-		RespawnCountI  - Number of times a single particle is recreated after dying (-1 for infinite)
+		RespawnCountI  - Number of times a particle is recreated after dying (-1 for infinite); this is a
+		                 budget of the whole emitter, which creates at most MaxCountI * RespawnCountI
+		                 particles and may reuse any free slot while budget is left (older versions
+		                 counted the respawns of each slot separately)
 		DelayF         - Time in seconds before emitter begins creating particles (default: 0.0)
 		EmissionRateF  - Maximal number of particles to be created per second (default: 0.0)
 		SpreadAngleF   - Angle of cone for random emission direction (default: 0.0)
 		ForceF3        - Force vector XYZ applied to particles (default: 0.0, 0.0, 0.0)
+		SeedI          - Seed of the random numbers used for the start values of particles; the same seed
+		                 yields the same particles on every run and the stream is restarted when the seed
+		                 is set (default: seed drawn from the C library rand() function). The numbers
+		                 come from the counter-based Philox2x32-10 generator, which is vectorized with
+		                 SSE2 on x86; on ARM the scalar version is used, with identical results
+		GPUSimulationI - Flag indicating whether the particles are kept in GPU memory and simulated by the
+		                 GPU with transform feedback; the CPU only spawns particles and the bounding box is
+		                 a conservative estimate. Requires support for EXT_transform_feedback and vertex
+		                 texture fetch, and a particle shader that reads its attributes from the particle
+		                 texture (_H3D_PARTICLE_TEX_). Changing the flag restarts the emitter (default: 0)
+		DepthSortI     - Flag indicating whether the particles are rendered back to front for each camera,
+		                 which is required for correct alpha blending; the order is updated on worker
+		                 threads when the emitter is rendered. Not supported for GPUSimulationI (default: 0)
+		LodDistF       - Distance from the nearest camera that rendered the emitter in the last frame it was
+		                 visible, from which on the LOD settings below apply; 0 disables them (default: 0.0)
+		LodUpdateIntervalI - Number of updates from which only the last one is simulated beyond LodDistF;
+		                 the time of the skipped updates is added to the simulated one (default: 1)
+		LodCountScaleF - Factor for the emission rate beyond LodDistF (default: 1.0)
+		CullFramesI    - Number of rendered frames after which an emitter whose bounding box was culled in all
+		                 of them is paused; updates are skipped until it is visible again and their time is
+		                 not caught up. 0 keeps the emitter simulated (default: 0)
 	*/
 	enum List
 	{
@@ -642,7 +747,71 @@ struct H3DEmitter
 		DelayF,
 		EmissionRateF,
 		SpreadAngleF,
-		ForceF3
+		ForceF3,
+		SeedI,
+		GPUSimulationI,
+		DepthSortI,
+		LodDistF,
+		LodUpdateIntervalI,
+		LodCountScaleF,
+		CullFramesI
+	};
+};
+
+struct H3DDotField
+{
+	/*	Enum: H3DDotField
+			The available DotField node parameters.
+		
+		A dot field is a random dot kinematogram: DotCountI dots inside an aperture, of which the
+		fraction CoherenceF are signal dots moving in a common direction while the others are noise dots.
+		A dot leaving the aperture enters it again on the opposite side, along its line of motion for an
+		ellipsoid. All random values are a function of the seed, the number of steps since the dots were
+		placed and the index of the dot, so a seed reproduces the same stimulus on every run, kernel and
+		number of worker threads. The dots are rendered like particles with the material, each as a
+		quad of size DotSizeF facing the camera; they are in the local space of the node and follow
+		its transformation when the field is updated.
+		
+		MatResI         - Material resource used for rendering
+		DotCountI       - Number of dots; setting it places all dots again
+		SeedI           - Seed of the random numbers; setting it places all dots again, so that the same
+		                  seed yields the same stimulus (default: seed drawn from the C library rand()
+		                  function)
+		ApertureShapeI  - Shape of the aperture, 0 for a box, 1 for an ellipse or ellipsoid; setting
+		                  it places all dots again (default: 1)
+		NoiseTypeI      - Motion of noise dots: 0 for a random direction that each dot keeps until it is
+		                  placed again, 1 for a random walk with a new direction in every step, 2 for a new
+		                  random position in every step (default: 0)
+		DepthSortI      - Flag indicating whether the dots are rendered back to front for each camera
+		                  (default: 0)
+		ApertureF3      - Half extents XYZ of the aperture in local space; a zero Z extent makes a planar
+		                  field in the XY plane. Setting it places all dots again (default: 1.0, 1.0, 0.0)
+		DirectionF3     - Direction XYZ of the signal dots in local space, normalized by the engine
+		                  (default: 1.0, 0.0, 0.0)
+		SpeedF          - Speed of signal and noise dots in local units per second (default: 1.0)
+		CoherenceF      - Fraction of signal dots; the signal dots are a fixed random subset that changes
+		                  when dots are placed again, so a limited lifetime mixes them (default: 1.0)
+		LifetimeF       - Lifetime in seconds after which a dot is placed at a new random position, 0 for
+		                  an infinite lifetime. Setting it spreads the remaining lifetimes of the dots
+		                  evenly over the new lifetime (default: 0.0)
+		DotSizeF        - Size of the dots in world units (default: 0.02)
+		ColorF4         - Color RGBA of the dots (default: 1.0, 1.0, 1.0, 1.0)
+	*/
+	enum List
+	{
+		MatResI = 800,
+		DotCountI,
+		SeedI,
+		ApertureShapeI,
+		NoiseTypeI,
+		DepthSortI,
+		ApertureF3,
+		DirectionF3,
+		SpeedF,
+		CoherenceF,
+		LifetimeF,
+		DotSizeF,
+		ColorF4
 	};
 };
 
@@ -650,7 +819,7 @@ struct H3DEmitter
 struct H3DModelUpdateFlags
 {
 	/*	Enum: H3DModelUpdateFlags
-			The available flags for h3dUpdateModel.
+			The available flags for h3dUpdateModel and h3dUpdateModels.
 		
 		Animation  - Apply animation
 		Geometry   - Apply morphers and software skinning
@@ -752,7 +921,9 @@ DLL void h3dRelease();
 	Details:
 		This is the main function of the engine. It executes all the rendering, animation and other
 		tasks. The function can be called several times per frame, for example in order to write to different
-		output buffers.
+		output buffers. While a background update started by h3dEndFrame is running, the updated nodes are
+		rendered from the snapshot that h3dEndFrame took of them, so the function does not wait for the
+		update (see h3dEndFrame).
 	
 	Parameters:
 		cameraNode  - camera node used for rendering scene
@@ -767,7 +938,8 @@ DLL void h3dRender( H3DNode cameraNode );
 	
 	Details:
 		This function tells the engine that the current frame is finished and that all
-		subsequent rendering operations will be for the next frame.
+		subsequent rendering operations will be for the next frame. Like h3dRender, it does not wait for a
+		background update.
 	
 	Parameters:
 		none
@@ -777,6 +949,59 @@ DLL void h3dRender( H3DNode cameraNode );
 */
 DLL void h3dFinalizeFrame();
 
+/* Function: h3dBeginFrame
+		Marks the start of the scene update for a new frame.
+	
+	Details:
+		All h3dUpdateModel, h3dUpdateEmitter and h3dUpdateDotField calls between h3dBeginFrame and
+		h3dEndFrame are recorded instead of being executed immediately, provided that the ThreadedUpdate
+		option is enabled. Without that option, the function has no effect. It does not wait for a
+		background update that was started by the previous h3dEndFrame.
+		
+		A typical frame loop looks like this:
+		
+		h3dBeginFrame(); h3dRender( cam ); h3dFinalizeFrame(); <update scene>; h3dEndFrame(); <swap buffers>
+		
+		The update that h3dEndFrame starts runs while the buffers are swapped and while the next frame is
+		culled and drawn, so the application does not have to wait for animation, skinning and particle
+		simulation. The results become visible in the frame after that, which adds one frame of latency.
+	
+	Parameters:
+		none
+		
+	Returns:
+		nothing
+*/
+DLL void h3dBeginFrame();
+
+/* Function: h3dEndFrame
+		Marks the end of the scene update for a new frame.
+	
+	Details:
+		This function submits the model, emitter and dot field updates recorded since h3dBeginFrame. If the
+		ThreadedUpdate option is enabled, it first waits for the update of the previous frame and uploads
+		its vertex data, so it has to be called while the OpenGL context of the engine is current. Then it
+		takes a snapshot of the render state of the updated nodes and their descendants, i.e. absolute
+		transformations, bounding boxes, skinning matrices and particle and dot buffers, starts the update
+		on a background thread and returns. Emitters that are simulated on the GPU are updated immediately.
+		
+		h3dRender and h3dFinalizeFrame draw the updated nodes from the snapshot while the update is
+		running. Culling still runs on the calling thread, but against the snapshot. If an updated node
+		has descendants like lights or cameras that are not part of the snapshot, h3dRender waits for the
+		update instead.
+		
+		*Note: All other functions that query or modify scene nodes or resources wait for the background
+		update before they proceed. Calling them before the next h3dEndFrame is safe, but the update does
+		not run in parallel to the application anymore.*
+	
+	Parameters:
+		none
+		
+	Returns:
+		nothing
+*/
+DLL void h3dEndFrame();
+
 /* Function: h3dClear
 		Removes all resources and scene nodes.
 	
@@ -1043,7 +1268,8 @@ DLL bool h3dIsResLoaded( H3DRes res );
 		If data is a NULL-pointer the resource manager is told that the resource doesn't have any data
 		(e.g. the corresponding file was not found). In this case, the resource remains in the unloaded state
 		but is no more returned when querying unloaded resources. When the specified resource is already loaded,
-		the function returns false.
+		the function returns false. Data that was decoded in advance with h3dDecodeResourceData is loaded
+		with h3dLoadDecodedResource instead.
 	
 	Parameters:
 		res   - handle to the resource for which data will be loaded
@@ -1055,6 +1281,65 @@ DLL bool h3dIsResLoaded( H3DRes res );
 */
 DLL bool h3dLoadResource( H3DRes res, const char *data, int size );
 
+/* Function: h3dDecodeResourceData
+		Decodes resource data in advance.
+	
+	Details:
+		This function performs the part of loading a resource that does not require OpenGL, so that it
+		can be done ahead of h3dLoadDecodedResource on another thread. The images of Texture resources are
+		decoded, Geometry files are parsed and the XML documents of SceneGraph, Material, ParticleEffect and
+		Pipeline resources are parsed; creating the OpenGL buffers and adding the referenced resources is
+		left to h3dLoadDecodedResource. For other types and for data that is already in a directly
+		uploadable format like DDS, nothing is done and NULL is returned, in which case the original data
+		has to be passed to h3dLoadResource. Otherwise the returned handle has to be freed with
+		h3dFreeDecodedResourceData. The function does not access the state of the engine and may be called
+		from any thread, also concurrently. Invalid data is not reported here but when the original data
+		is loaded.
+	
+	Parameters:
+		type  - type of the resource the data belongs to
+		data  - pointer to the data of the resource
+		size  - size of the data block
+		
+	Returns:
+		handle to the decoded data or NULL if there is nothing to decode
+*/
+DLL H3DDecodedRes h3dDecodeResourceData( int type, const char *data, int size );
+
+/* Function: h3dLoadDecodedResource
+		Loads a resource from decoded data.
+	
+	Details:
+		This function loads a resource like h3dLoadResource from data that was decoded in advance with
+		h3dDecodeResourceData for the same resource type. The decoded data is taken over by the resource,
+		so a handle can only be loaded once; loading it again fails. The handle still has to be freed with
+		h3dFreeDecodedResourceData. When the specified resource is already loaded, the function returns
+		false and the decoded data can still be loaded into another resource.
+	
+	Parameters:
+		res         - handle to the resource for which data will be loaded
+		decodedRes  - handle to the decoded data
+		
+	Returns:
+		true in case of success, otherwise false
+*/
+DLL bool h3dLoadDecodedResource( H3DRes res, H3DDecodedRes decodedRes );
+
+/* Function: h3dFreeDecodedResourceData
+		Frees data returned by h3dDecodeResourceData.
+	
+	Details:
+		This function frees the memory of decoded resource data, whether it was loaded or not. It may be
+		called from any thread.
+	
+	Parameters:
+		decodedRes  - handle to the decoded data (can be NULL)
+		
+	Returns:
+		nothing
+*/
+DLL void h3dFreeDecodedResourceData( H3DDecodedRes decodedRes );
+
 /* Function: h3dUnloadResource
 		Unloads a resource.
 	
@@ -1932,6 +2217,29 @@ DLL H3DNode h3dAddModelNode( H3DNode parent, const char *name, H3DRes geometryRe
 DLL void h3dSetupModelAnimStage( H3DNode modelNode, int stage, H3DRes animationRes, int layer,
                                  const char *startNode, bool additive );
 
+/* Function: h3dPrewarmModelAnim
+		Resolves an animation for the skeleton of a Model node in advance.
+	
+	Details:
+		When an animation is assigned to a model, the animated Joint and Mesh nodes of the model have to be
+		matched with the tracks of the animation. The result is cached in the Animation resource and shared
+		by all models with the same node hierarchy, so that assigning the animation to further identical
+		characters with h3dSetupModelAnimStage is very cheap. This function builds the cache entry for the
+		specified model and start node without changing any animation stage. It can be used at load time so
+		that setting up animation stages later does not cause any hitches. The animation must be loaded when
+		the function is called.
+	
+	Parameters:
+		modelNode     - handle to the Model node whose node hierarchy is used
+		animationRes  - handle to Animation resource
+		startNode     - name of first node to which the animation will be applied (or empty string);
+		                see h3dSetupModelAnimStage
+		
+	Returns:
+		nothing
+*/
+DLL void h3dPrewarmModelAnim( H3DNode modelNode, H3DRes animationRes, const char *startNode );
+
 /* Function: h3dGetModelAnimParams
 		Gets the animation stage parameters of a Model node.
 	
@@ -2006,7 +2314,8 @@ DLL bool h3dSetModelMorpher( H3DNode modelNode, const char *target, float weight
 		This function applies skeletal animation and geometry updates to the specified model, depending on
 		the specified update flags. Geometry updates include morph targets and software skinning if enabled.
 		If the animation or morpher parameters did not change, the function returns immediately. This function
-		has to be called so that changed animation or morpher parameters will take effect.
+		has to be called so that changed animation or morpher parameters will take effect. Between h3dBeginFrame
+		and h3dEndFrame, the update is deferred to h3dEndFrame when the ThreadedUpdate option is enabled.
 	
 	Parameters:
 		modelNode  - handle to the Model node to be updated
@@ -2017,6 +2326,32 @@ DLL bool h3dSetModelMorpher( H3DNode modelNode, const char *target, float weight
 */
 DLL void h3dUpdateModel( H3DNode modelNode, int flags );
 
+/* Function: h3dUpdateModels
+		Sets the animation parameters of several models and updates them in parallel.
+	
+	Details:
+		This function is the batched counterpart of h3dSetModelAnimParams and h3dUpdateModel, meant for
+		scenes with many animated characters. It first sets time and weight of the specified animation stage
+		for each model and then runs animation, joint hierarchy update and morphing/software skinning of the
+		models on the worker threads of the engine (see option WorkerThreads). If times or weights is NULL,
+		the corresponding parameter is left unchanged. Models that are attached below another model of the
+		same batch are updated serially afterwards. Between h3dBeginFrame and h3dEndFrame, the updates are
+		deferred to h3dEndFrame when the ThreadedUpdate option is enabled.
+	
+	Parameters:
+		count       - number of models
+		modelNodes  - array of count Model node handles
+		stage       - index of the animation stage whose parameters are set
+		times       - array of count animation times or NULL
+		weights     - array of count animation weights or NULL
+		flags       - combination of H3DModelUpdateFlags
+		
+	Returns:
+		nothing
+*/
+DLL void h3dUpdateModels( int count, const H3DNode *modelNodes, int stage, const float *times,
+                          const float *weights, int flags );
+
 
 /* Group: Mesh-specific scene graph functions */
 /* Function: h3dAddMeshNode
@@ -2167,7 +2502,8 @@ DLL void h3dSetCameraProjMat( H3DNode cameraNode, float *projMat );
 		materialRes        - handle to Material resource used for rendering
 		particleEffectRes  - handle to ParticleEffect resource used for configuring particle properties
 		maxParticleCount   - maximal number of particles living at the same time
-		respawnCount       - number of times a single particle is recreated after dying (-1 for infinite)
+		respawnCount       - number of times a particle is recreated after dying (-1 for infinite); the
+		                     emitter creates at most maxParticleCount * respawnCount particles in total
 		
 		
 	Returns:
@@ -2182,7 +2518,8 @@ DLL H3DNode h3dAddEmitterNode( H3DNode parent, const char *name, H3DRes material
 	Details:
 		This function advances the simulation time of a particle system and performs the particle simulation
 		with timeDelta being the time elapsed since the last call of this function. The specified
-		node must be an Emitter node.
+		node must be an Emitter node. Between h3dBeginFrame and h3dEndFrame, the update is deferred to
+		h3dEndFrame when the ThreadedUpdate option is enabled.
 	
 	Parameters:
 		emitterNode  - handle to the Emitter node which will be updated
@@ -2193,6 +2530,28 @@ DLL H3DNode h3dAddEmitterNode( H3DNode parent, const char *name, H3DRes material
 */
 DLL void h3dUpdateEmitter( H3DNode emitterNode, float timeDelta );
 
+/* Function: h3dUpdateEmitters
+		Advances the time of several emitters and simulates their particles in parallel.
+	
+	Details:
+		This function is the batched counterpart of h3dUpdateEmitter. Emission is handled for each emitter
+		in turn, while spawning and simulation of the particles run on the worker threads of the engine
+		(see option WorkerThreads). Emitters with many particles are split into several work items, so
+		a single large emitter also benefits from the threads. The result is the same as with separate
+		h3dUpdateEmitter calls since every emitter has its own random number stream (see SeedI). Between
+		h3dBeginFrame and h3dEndFrame, the updates are deferred to h3dEndFrame when the ThreadedUpdate
+		option is enabled.
+	
+	Parameters:
+		count         - number of emitters
+		emitterNodes  - array of count Emitter node handles
+		timeDelta     - time delta in seconds
+		
+	Returns:
+		nothing
+*/
+DLL void h3dUpdateEmitters( int count, const H3DNode *emitterNodes, float timeDelta );
+
 /* Function: h3dHasEmitterFinished
 		Checks if an Emitter node is still alive.
 	
@@ -2200,7 +2559,8 @@ DLL void h3dUpdateEmitter( H3DNode emitterNode, float timeDelta );
 		This function checks if a particle system is still active and has living particles or
 		will spawn new particles. The specified node must be an Emitter node. The function can be
 		used to check when a not infinitely running emitter for an effect like an explosion can be
-		removed from the scene.
+		removed from the scene. An emitter with a finite respawn count has finished when all
+		MaxCountI * RespawnCountI particles were created and none of them is alive anymore.
 	
 	Parameters:
 		emitterNode  - handle to the Emitter node which is checked
@@ -2209,3 +2569,92 @@ DLL void h3dUpdateEmitter( H3DNode emitterNode, float timeDelta );
 		true if Emitter will no more emit any particles, otherwise or in case of failure false
 */
 DLL bool h3dHasEmitterFinished( H3DNode emitterNode );
+
+/* Function: h3dGetEmitterParticleData
+		Copies the render data of the live particles of an Emitter node.
+	
+	Details:
+		This function writes position, size and rotation as well as color of the currently living
+		particles to the specified arrays, e.g. to record the stimulus of an experiment. Any of the arrays
+		can be NULL. For emitters with GPUSimulationI enabled, the pending simulation steps are run and
+		the particles are read back from the GPU, so the function has to be called from the thread that
+		owns the OpenGL context and is comparatively slow. The order of the particles is unspecified.
+	
+	Parameters:
+		emitterNode        - handle to the Emitter node
+		maxCount           - maximal number of particles that are written
+		positions          - array of 3 * maxCount floats for the xyz positions or NULL
+		sizesAndRotations  - array of 2 * maxCount floats for size and rotation or NULL
+		colors             - array of 4 * maxCount floats for the RGBA colors or NULL
+		
+	Returns:
+		number of live particles, which can be larger than maxCount; 0 in case of failure
+*/
+DLL int h3dGetEmitterParticleData( H3DNode emitterNode, int maxCount, float *positions,
+                                   float *sizesAndRotations, float *colors );
+
+/* Group: DotField-specific scene graph functions */
+/* Function: h3dAddDotFieldNode
+		Adds a DotField node to the scene.
+	
+	Details:
+		This function creates a new DotField node and attaches it to the specified parent node. The dots
+		are placed in the aperture immediately, but they are only rendered after the first call of
+		h3dUpdateDotField.
+	
+	Parameters:
+		parent       - handle to parent node to which the new node will be attached
+		name         - name of the node
+		materialRes  - handle to Material resource used for rendering, e.g. a particle material
+		dotCount     - number of dots
+		
+	Returns:
+		handle to the created node or 0 in case of failure
+*/
+DLL H3DNode h3dAddDotFieldNode( H3DNode parent, const char *name, H3DRes materialRes, int dotCount );
+
+/* Function: h3dUpdateDotField
+		Moves the dots of a dot field by one step.
+	
+	Details:
+		This function moves the dots of a DotField node with timeDelta being the time elapsed since the
+		last call of this function, wraps the dots that leave the aperture and places the dots that reach
+		the end of their lifetime again. The dots are split into chunks that are processed on the worker
+		threads of the engine (see option WorkerThreads). A timeDelta of 0 only applies the current
+		transformation of the node to the dots. Between h3dBeginFrame and h3dEndFrame, the update is
+		deferred to h3dEndFrame when the ThreadedUpdate option is enabled.
+		
+		On a single thread, a step of one million dots with fixed noise directions and an infinite
+		lifetime takes about three quarters of a frame of a 120 Hz display. Random walk and random
+		position noise and limited lifetimes need new random numbers for many dots in every step and
+		take about one to one and a half such frames, so they need at least one worker thread to fit
+		into a frame. The random numbers only depend on the seed, the step and the dot, so the dots are
+		the same for any number of worker threads.
+	
+	Parameters:
+		dotFieldNode  - handle to the DotField node which will be updated
+		timeDelta     - time delta in seconds
+		
+	Returns:
+		nothing
+*/
+DLL void h3dUpdateDotField( H3DNode dotFieldNode, float timeDelta );
+
+/* Function: h3dGetDotFieldData
+		Copies the dots of a DotField node.
+	
+	Details:
+		This function writes the world space positions of the dots as of the last h3dUpdateDotField call
+		and whether they were signal dots in that step, e.g. to record the stimulus of an experiment.
+		Any of the arrays can be NULL.
+	
+	Parameters:
+		dotFieldNode  - handle to the DotField node
+		maxCount      - maximal number of dots that are written
+		positions     - array of 3 * maxCount floats for the xyz positions or NULL
+		signal        - array of maxCount floats that are 1 for signal and 0 for noise dots or NULL
+		
+	Returns:
+		number of dots, which can be larger than maxCount; 0 before the first update or in case of failure
+*/
+DLL int h3dGetDotFieldData( H3DNode dotFieldNode, int maxCount, float *positions, float *signal );
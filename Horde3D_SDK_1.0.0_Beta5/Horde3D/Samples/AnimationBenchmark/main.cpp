@@ -0,0 +1,314 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Compares memory footprint, reconstruction error and sampling cost of animation entities stored
+// as full frames against quantized and reduced key tracks. The input is a synthetic 120 Hz clip
+// with smooth joint motion and a small amount of sensor noise, similar to motion capture data.
+// Afterwards the SoA pose blending kernels are compared against blending node by node.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include "egAnimation.h"
+#include "egAnimBlend.h"
+#include "utTimer.h"
+
+using namespace Horde3D;
+
+// Configuration
+const uint32 jointCount = 60;
+const uint32 frameRate = 120;
+const uint32 frameCount = frameRate * 60;
+const float noise = 0.0001f;
+const uint32 sampleCount = 2000000;
+const uint32 blendIterations = 20000;
+
+
+static float randf()
+{
+	return (float)rand() / (float)RAND_MAX;
+}
+
+
+static float rotError( const Quaternion &a, const Quaternion &b )
+{
+	float s = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1.0f : 1.0f;
+	Vec4f d( a.x - b.x * s, a.y - b.y * s, a.z - b.z * s, a.w - b.w * s );
+	return 4 * asinf( minf( sqrtf( d.x * d.x + d.y * d.y + d.z * d.z + d.w * d.w ) * 0.5f, 1 ) );
+}
+
+
+static void sampleFrames( const AnimResEntity &entity, float time, Quaternion &rotQuat, Vec3f &transVec,
+                          Vec3f &scaleVec )
+{
+	// Standard path of AnimationController::animate
+	uint32 f0 = (uint32)time;
+	float amount = time - f0;
+	f0 = f0 % entity.frameCount;
+	uint32 f1 = std::min( f0 + 1, entity.frameCount - 1 );
+
+	const Frame &frame0 = entity.frames[f0], &frame1 = entity.frames[f1];
+	transVec = frame0.transVec.lerp( frame1.transVec, amount );
+	scaleVec = frame0.scaleVec.lerp( frame1.scaleVec, amount );
+	rotQuat = frame0.rotQuat.nlerp( frame1.rotQuat, amount );
+}
+
+
+static void compressEntities( const std::vector< AnimResEntity > &entities, float rotTolerance,
+                              std::vector< AnimResEntity > &compEntities )
+{
+	for( size_t i = 0; i < entities.size(); ++i )
+	{
+		const AnimResEntity &entity = entities[i];
+		std::vector< Quaternion > rotQuats( entity.frameCount );
+		std::vector< Vec3f > transVecs( entity.frameCount ), scaleVecs( entity.frameCount );
+		for( uint32 j = 0; j < entity.frameCount; ++j )
+		{
+			rotQuats[j] = entity.frames[j].rotQuat;
+			transVecs[j] = entity.frames[j].transVec;
+			scaleVecs[j] = entity.frames[j].scaleVec;
+		}
+
+		AnimResEntity &compEntity = compEntities[i];
+		compEntity.frameCount = entity.frameCount;
+		compressKeyTrack( rotQuats, rotTolerance, compEntity.rotTrack );
+		compressKeyTrack( transVecs, AnimCompression::DefaultTransTolerance, compEntity.transTrack );
+		compressKeyTrack( scaleVecs, AnimCompression::DefaultScaleTolerance, compEntity.scaleTrack );
+	}
+}
+
+
+static void benchmarkBlending( const std::vector< AnimResEntity > &entities )
+{
+	// Two stages with inter-frame interpolation, the second one blended in with a weight of 0.3
+	const uint32 stride = (jointCount + AnimPoseBatchSize - 1) / AnimPoseBatchSize * AnimPoseBatchSize;
+	const uint32 poseSize = stride * AnimPoseChannels::Count;
+	const float amount = 0.4f, weight = 0.3f;
+	const uint32 frames[2][2] = { { 100, 101 }, { 2000, 2001 } };
+
+	std::vector< float > stagePoses( poseSize * 4, 0.0f );
+	for( uint32 i = 0; i < jointCount; ++i )
+	{
+		for( uint32 j = 0; j < 4; ++j )
+		{
+			const Frame &frame = entities[i].frames[frames[j / 2][j % 2]];
+			float values[AnimPoseChannels::Count] = { frame.rotQuat.x, frame.rotQuat.y, frame.rotQuat.z,
+				frame.rotQuat.w, frame.transVec.x, frame.transVec.y, frame.transVec.z,
+				frame.scaleVec.x, frame.scaleVec.y, frame.scaleVec.z };
+			for( uint32 c = 0; c < AnimPoseChannels::Count; ++c )
+				stagePoses[poseSize * j + c * stride + i] = values[c];
+		}
+	}
+
+	// Reference: node by node like before the SoA restructuring
+	std::vector< Matrix4f > refMats( jointCount ), mats( jointCount );
+	Timer timer;
+	timer.setEnabled( true );
+	for( uint32 it = 0; it < blendIterations; ++it )
+	{
+		for( uint32 i = 0; i < jointCount; ++i )
+		{
+			const AnimResEntity &entity = entities[i];
+			Quaternion nodeRotQuat;
+			Vec3f nodeTransVec, nodeScaleVec;
+			for( uint32 s = 0; s < 2; ++s )
+			{
+				const Frame &frame0 = entity.frames[frames[s][0]], &frame1 = entity.frames[frames[s][1]];
+				Vec3f transVec = frame0.transVec.lerp( frame1.transVec, amount );
+				Vec3f scaleVec = frame0.scaleVec.lerp( frame1.scaleVec, amount );
+				Quaternion rotQuat = frame0.rotQuat.nlerp( frame1.rotQuat, amount );
+				if( s == 0 )
+				{
+					nodeRotQuat = rotQuat; nodeTransVec = transVec; nodeScaleVec = scaleVec;
+				}
+				else
+				{
+					nodeRotQuat = nodeRotQuat.nlerp( rotQuat, weight );
+					nodeTransVec = nodeTransVec.lerp( transVec, weight );
+					nodeScaleVec = nodeScaleVec.lerp( scaleVec, weight );
+				}
+			}
+
+			Matrix4f mat( Math::NO_INIT );
+			Matrix4f::fastMult43( mat, Matrix4f( nodeRotQuat ),
+				Matrix4f::ScaleMat( nodeScaleVec.x, nodeScaleVec.y, nodeScaleVec.z ) );
+			Matrix4f::fastMult43( refMats[i], Matrix4f::TransMat( nodeTransVec.x, nodeTransVec.y, nodeTransVec.z ), mat );
+		}
+	}
+	timer.setEnabled( false );
+	double refTime = timer.getElapsedTimeMS() * 1.0e6 / ((double)blendIterations * jointCount);
+	printf( "blending %u joints, 2 stages\n", jointCount );
+	printf( "%-10s %8.2f ns/joint\n", "per node", refTime );
+
+	std::vector< float > nodePose( poseSize ), samplePose( poseSize ), weights( stride * 2, 0.0f );
+	std::vector< Matrix4f * > dest( stride, (Matrix4f *)0x0 );
+	for( uint32 i = 0; i < jointCount; ++i )
+	{
+		weights[i] = 1.0f;
+		weights[stride + i] = weight;
+		dest[i] = &mats[i];
+	}
+
+	for( int kernel = 0; kernel < AnimBlendKernels::Count; ++kernel )
+	{
+		const AnimBlendFuncs *funcs = getAnimBlendFuncs( kernel );
+		if( funcs == 0x0 ) continue;
+
+		timer.reset();
+		timer.setEnabled( true );
+		for( uint32 it = 0; it < blendIterations; ++it )
+		{
+			for( uint32 c = 0; c < AnimPoseChannels::Count; ++c )
+			{
+				float value = (c == AnimPoseChannels::RotW || c >= AnimPoseChannels::ScaleX) ? 1.0f : 0.0f;
+				std::fill( nodePose.begin() + c * stride, nodePose.begin() + (c + 1) * stride, value );
+			}
+			for( uint32 s = 0; s < 2; ++s )
+			{
+				std::copy( stagePoses.begin() + poseSize * s * 2, stagePoses.begin() + poseSize * (s * 2 + 1),
+				           samplePose.begin() );
+				funcs->interpolate( &samplePose[0], &stagePoses[poseSize * (s * 2 + 1)], amount, stride );
+				funcs->blend( &nodePose[0], &samplePose[0], &weights[stride * s], stride );
+			}
+			funcs->compose( &nodePose[0], stride, &dest[0] );
+		}
+		timer.setEnabled( false );
+		double time = timer.getElapsedTimeMS() * 1.0e6 / ((double)blendIterations * jointCount);
+
+		float error = 0;
+		for( uint32 i = 0; i < jointCount; ++i )
+		{
+			for( uint32 j = 0; j < 16; ++j ) error = std::max( error, fabsf( mats[i].x[j] - refMats[i].x[j] ) );
+		}
+
+		printf( "%-10s %8.2f ns/joint  speedup %.2fx  max error %g%s\n", getAnimBlendKernelName( kernel ),
+		        time, refTime / time, error, kernel == getBestAnimBlendKernel() ? "  (selected)" : "" );
+	}
+}
+
+
+int main( int argc, char** argv )
+{
+	srand( 1 );
+
+	// Each joint rotates by a sum of sines with random frequencies; only the root is translated
+	std::vector< AnimResEntity > entities( jointCount );
+	for( uint32 i = 0; i < jointCount; ++i )
+	{
+		float freqs[3], amps[3], phases[3];
+		for( uint32 j = 0; j < 3; ++j )
+		{
+			freqs[j] = 0.1f + randf() * 0.9f;
+			amps[j] = randf() * 0.6f;
+			phases[j] = randf() * Math::TwoPi;
+		}
+		Vec3f boneOffset( randf() * 0.3f, randf() * 0.3f, randf() * 0.3f );
+
+		AnimResEntity &entity = entities[i];
+		entity.frameCount = frameCount;
+		entity.frames.resize( frameCount );
+		for( uint32 j = 0; j < frameCount; ++j )
+		{
+			float t = (float)j / frameRate;
+			Frame &frame = entity.frames[j];
+			frame.rotQuat = Quaternion( amps[0] * sinf( freqs[0] * t * Math::TwoPi + phases[0] ) + (randf() - 0.5f) * noise,
+			                            amps[1] * sinf( freqs[1] * t * Math::TwoPi + phases[1] ) + (randf() - 0.5f) * noise,
+			                            amps[2] * sinf( freqs[2] * t * Math::TwoPi + phases[2] ) + (randf() - 0.5f) * noise );
+			frame.transVec = i == 0 ? Vec3f( t * 1.2f, 0.9f + 0.05f * sinf( t * 11.0f ), 0 ) : boneOffset;
+			frame.scaleVec = Vec3f( 1, 1, 1 );
+		}
+	}
+
+	printf( "%u joints, %u frames at %u Hz, frames use %.2f KB\n\n", jointCount, frameCount, frameRate,
+	        jointCount * (sizeof( AnimResEntity ) + frameCount * sizeof( Frame )) / 1024.0 );
+	printf( "rot tolerance  key tracks     ratio  rot keys  max rot error  max trans error  compression\n" );
+
+	// Compress with different rotation tolerances
+	const float rotTolerances[] = { 0.0002f, 0.0005f, AnimCompression::DefaultRotTolerance, 0.002f, 0.005f };
+	const uint32 numTolerances = sizeof( rotTolerances ) / sizeof( float );
+	std::vector< AnimResEntity > compEntities( jointCount );
+	for( uint32 t = 0; t < numTolerances; ++t )
+	{
+		Timer timer;
+		timer.setEnabled( true );
+		compressEntities( entities, rotTolerances[t], compEntities );
+		timer.setEnabled( false );
+
+		// Memory footprint and reconstruction error
+		size_t frameMem = 0, trackMem = 0, keyCount = 0;
+		float maxRotError = 0, maxTransError = 0;
+		for( uint32 i = 0; i < jointCount; ++i )
+		{
+			const AnimResEntity &entity = entities[i], &compEntity = compEntities[i];
+			frameMem += sizeof( AnimResEntity ) + entity.frames.size() * sizeof( Frame );
+			trackMem += sizeof( AnimResEntity ) + compEntity.rotTrack.getMemSize() +
+			            compEntity.transTrack.getMemSize() + compEntity.scaleTrack.getMemSize();
+			keyCount += compEntity.rotTrack.keys.size();
+
+			for( uint32 j = 0; j < frameCount; ++j )
+			{
+				Quaternion rotQuat;
+				Vec3f transVec, scaleVec;
+				compEntity.sampleKeyTracks( (float)j, rotQuat, transVec, scaleVec );
+				maxRotError = std::max( maxRotError, rotError( rotQuat, entity.frames[j].rotQuat ) );
+				maxTransError = std::max( maxTransError, (transVec - entity.frames[j].transVec).length() );
+			}
+		}
+
+		printf( "%13.4f  %10.2f KB  %5.1f:1  %7.1f%%  %13.6f  %15.6f  %8.2f ms\n", rotTolerances[t],
+		        trackMem / 1024.0, (double)frameMem / trackMem, 100.0 * keyCount / ((double)jointCount * frameCount),
+		        maxRotError, maxTransError, timer.getElapsedTimeMS() );
+	}
+	printf( "\n" );
+
+	// Sampling with the default tolerance
+	compressEntities( entities, AnimCompression::DefaultRotTolerance, compEntities );
+
+	// Sampling cost at random fractional times
+	std::vector< float > times( sampleCount );
+	for( uint32 i = 0; i < sampleCount; ++i ) times[i] = randf() * (frameCount - 1);
+
+	Quaternion rotQuat;
+	Vec3f transVec, scaleVec, checksum;
+	Timer timer;
+	timer.setEnabled( true );
+	for( uint32 i = 0; i < sampleCount; ++i )
+	{
+		sampleFrames( entities[i % jointCount], times[i], rotQuat, transVec, scaleVec );
+		checksum += transVec + Vec3f( rotQuat.x, rotQuat.y, rotQuat.z );
+	}
+	timer.setEnabled( false );
+	double frameTime = timer.getElapsedTimeMS() * 1.0e6 / sampleCount;
+
+	timer.reset();
+	timer.setEnabled( true );
+	for( uint32 i = 0; i < sampleCount; ++i )
+	{
+		compEntities[i % jointCount].sampleKeyTracks( times[i], rotQuat, transVec, scaleVec );
+		checksum += transVec + Vec3f( rotQuat.x, rotQuat.y, rotQuat.z );
+	}
+	timer.setEnabled( false );
+	double trackTime = timer.getElapsedTimeMS() * 1.0e6 / sampleCount;
+
+	printf( "sampling frames      %8.2f ns\n", frameTime );
+	printf( "sampling key tracks  %8.2f ns  (%.2fx)\n", trackTime, trackTime / frameTime );
+	printf( "(checksum %g)\n\n", checksum.x + checksum.y + checksum.z );
+
+	benchmarkBlending( entities );
+
+	return 0;
+}
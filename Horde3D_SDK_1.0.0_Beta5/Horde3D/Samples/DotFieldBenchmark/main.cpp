@@ -0,0 +1,246 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Measures the update of dot fields with one million dots for the different noise types, aperture
+// shapes and lifetimes and compares it with the budget of a 120 Hz display. The steps are timed on
+// the calling thread alone and with the default worker threads, and the median step is reported,
+// so that single slow steps on a busy machine don't count. After the timed steps, every dot has to
+// be inside the aperture, and a second field with the same seed that is updated with a different
+// number of worker threads has to yield exactly the same dots. The OpenGL context required by the
+// engine is created with EGL without a window. Returns 0 if all checks pass.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "Horde3D.h"
+#include "utTimer.h"
+
+using namespace Horde3D;
+
+// Configuration
+const int dotCount = 1000000;
+const int numSteps = 60;
+const float timeDelta = 1.0f / 120.0f;
+const float budgetMS = 1000.0f / 120.0f;
+const float speed = 5.0f;  // Fast enough that many dots are wrapped in every step
+const float tolerance = 1.0e-4f;
+const int seed = 4711;
+
+static const char *materialXML = "<Material class=\"Translucent.Particle\" />";
+
+struct Config
+{
+	const char  *name;
+	int         shape, noiseType;
+	float       coherence, lifetime;
+};
+
+const Config configs[] = {
+	{ "ellipse, direction noise",            1, 0, 0.5f, 0.0f },
+	{ "ellipse, direction noise, lifetime",  1, 0, 0.5f, 0.2f },
+	{ "ellipse, random walk",                1, 1, 0.5f, 0.0f },
+	{ "ellipse, random position",            1, 2, 0.5f, 0.0f },
+	{ "ellipse, random walk, coherence 0",   1, 1, 0.0f, 0.0f },
+	{ "box, direction noise",                0, 0, 0.5f, 0.0f },
+	{ "box, direction noise, lifetime",      0, 0, 0.5f, 0.2f },
+	{ "ellipsoid, direction noise",          1, 0, 0.5f, 0.0f }  // Gets a z extent below
+};
+
+
+static bool createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	EGLDisplay display = getPlatformDisplay != 0x0 ?
+		getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0x0 ) :
+		eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) ) return false;
+	if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs ) || numConfigs == 0 ) return false;
+
+	EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT, 0x0 );
+	if( context == EGL_NO_CONTEXT ) return false;
+
+	EGLint surfaceAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface( display, config, surfaceAttribs );
+	if( surface == EGL_NO_SURFACE ) return false;
+
+	return eglMakeCurrent( display, surface, surface, context ) == EGL_TRUE;
+}
+
+
+static void printMessages()
+{
+	int level;
+	float time;
+	const char *msg;
+	while( (msg = h3dGetMessage( &level, &time ))[0] != '\0' )
+	{
+		if( level <= 2 ) printf( "Engine: %s\n", msg );
+	}
+}
+
+
+// Updates the field numSteps times with the given number of worker threads and returns the median
+// time of a step
+static double timeSteps( H3DNode node, int workerThreads )
+{
+	h3dSetOption( H3DOptions::WorkerThreads, (float)workerThreads );
+	std::vector< double > times( numSteps );
+	Timer timer;
+
+	for( int step = 0; step < numSteps; ++step )
+	{
+		timer.reset();
+		timer.setEnabled( true );
+		h3dUpdateDotField( node, timeDelta );
+		timer.setEnabled( false );
+		times[step] = timer.getElapsedTimeMS();
+	}
+
+	std::sort( times.begin(), times.end() );
+	return times[numSteps / 2];
+}
+
+
+static H3DNode addField( H3DRes matRes, const Config &config, float apertureZ )
+{
+	H3DNode node = h3dAddDotFieldNode( H3DRootNode, config.name, matRes, dotCount );
+	h3dSetNodeParamI( node, H3DDotField::SeedI, seed );
+	h3dSetNodeParamI( node, H3DDotField::ApertureShapeI, config.shape );
+	h3dSetNodeParamI( node, H3DDotField::NoiseTypeI, config.noiseType );
+	h3dSetNodeParamF( node, H3DDotField::ApertureF3, 0, 2.0f );
+	h3dSetNodeParamF( node, H3DDotField::ApertureF3, 1, 1.0f );
+	h3dSetNodeParamF( node, H3DDotField::ApertureF3, 2, apertureZ );
+	h3dSetNodeParamF( node, H3DDotField::DirectionF3, 0, 1.0f );
+	h3dSetNodeParamF( node, H3DDotField::DirectionF3, 1, 1.0f );
+	h3dSetNodeParamF( node, H3DDotField::SpeedF, 0, speed );
+	h3dSetNodeParamF( node, H3DDotField::CoherenceF, 0, config.coherence );
+	h3dSetNodeParamF( node, H3DDotField::LifetimeF, 0, config.lifetime );
+
+	return node;
+}
+
+
+// Returns the number of dots outside of the aperture of addField; the node is not transformed
+static int countOutside( const std::vector< float > &positions, int shape, float apertureZ )
+{
+	const float ext[3] = { 2.0f, 1.0f, apertureZ };
+	int outside = 0;
+
+	for( int i = 0; i < dotCount; ++i )
+	{
+		const float *p = &positions[i * 3];
+		if( shape == 0 )
+		{
+			bool inside = true;
+			for( int c = 0; c < 3; ++c )
+				inside &= fabsf( p[c] ) <= ext[c] * (1.0f + tolerance) + tolerance;
+			outside += inside ? 0 : 1;
+		}
+		else
+		{
+			float d = (p[0] / ext[0]) * (p[0] / ext[0]) + (p[1] / ext[1]) * (p[1] / ext[1]);
+			if( ext[2] > 0 ) d += (p[2] / ext[2]) * (p[2] / ext[2]);
+			else if( fabsf( p[2] ) > tolerance ) d = 2.0f;
+			outside += d <= 1.0f + tolerance ? 0 : 1;
+		}
+	}
+
+	return outside;
+}
+
+
+int main( int argc, char** argv )
+{
+	if( !createContext() )
+	{
+		printf( "Failed to create an OpenGL context with EGL\n" );
+		return 1;
+	}
+	if( !h3dInit() )
+	{
+		printMessages();
+		printf( "Failed to initialize the engine\n" );
+		return 1;
+	}
+	printMessages();
+
+	H3DRes matRes = h3dAddResource( H3DResTypes::Material, "DotFieldBenchmark.material.xml", 0 );
+	h3dLoadResource( matRes, materialXML, (int)strlen( materialXML ) );
+
+	int workerThreads = (int)h3dGetOption( H3DOptions::WorkerThreads );
+	printf( "%i dots, %i steps of %.2f ms, median ms per step without and with %i worker threads, budget %.2f ms per step\n",
+	        dotCount, numSteps, timeDelta * 1000.0f, workerThreads, budgetMS );
+	if( workerThreads == 0 ) printf( "Only one core, so the scaling with worker threads is not measured\n" );
+	printf( "\n" );
+
+	std::vector< float > positions( dotCount * 3 ), otherPositions( dotCount * 3 );
+	std::vector< float > signal( dotCount ), otherSignal( dotCount );
+	bool failed = false;
+
+	for( size_t i = 0; i < sizeof( configs ) / sizeof( configs[0] ); ++i )
+	{
+		const Config &config = configs[i];
+		float apertureZ = i + 1 == sizeof( configs ) / sizeof( configs[0] ) ? 0.5f : 0.0f;
+
+		H3DNode node = addField( matRes, config, apertureZ );
+		h3dUpdateDotField( node, 0 );
+
+		double singleTime = timeSteps( node, 0 );
+		double time = workerThreads > 0 ? timeSteps( node, workerThreads ) : singleTime;
+		int numTimedSteps = workerThreads > 0 ? 2 * numSteps : numSteps;
+
+		h3dGetDotFieldData( node, dotCount, &positions[0], &signal[0] );
+		int outside = countOutside( positions, config.shape, apertureZ );
+
+		// The same steps with a different number of worker threads, which splits the work differently
+		h3dSetOption( H3DOptions::WorkerThreads, (float)(workerThreads + 3) );
+		H3DNode other = addField( matRes, config, apertureZ );
+		h3dUpdateDotField( other, 0 );
+		for( int step = 0; step < numTimedSteps; ++step )
+			h3dUpdateDotField( other, timeDelta );
+		h3dSetOption( H3DOptions::WorkerThreads, (float)workerThreads );
+
+		h3dGetDotFieldData( other, dotCount, &otherPositions[0], &otherSignal[0] );
+		bool reproduced = positions == otherPositions && signal == otherSignal;
+
+		int signalCount = 0;
+		for( int k = 0; k < dotCount; ++k ) signalCount += signal[k] != 0 ? 1 : 0;
+
+		printf( "%-38s %6.2f %6.2f ms  %5.1f%% of budget  signal %5.3f  outside %i  %s\n", config.name, singleTime,
+		        time, 100.0 * time / budgetMS, (float)signalCount / dotCount, outside, reproduced ? "reproduced" : "DIFFERENT" );
+		if( outside != 0 || !reproduced ) failed = true;
+
+		h3dRemoveNode( node );
+		h3dRemoveNode( other );
+		printMessages();
+	}
+
+	h3dRelease();
+	return failed ? 1 : 0;
+}
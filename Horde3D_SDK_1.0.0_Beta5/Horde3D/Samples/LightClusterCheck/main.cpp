@@ -0,0 +1,198 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Checks the light lists of the clustered forward pass. Lights with known positions are binned with
+// LightClusterGrid for a perspective, an off-axis and an orthographic projection, and the cluster
+// lists are compared with the expected ones: a small light lands in exactly the cluster computed
+// from its projection, lights behind the camera or beyond the far plane are in no list, a light
+// around the camera is in every list and overflowing clusters count the dropped lights. Then random
+// lights are binned and points inside their spheres are sampled; every point in the frustum has to
+// find its light in the list of its cluster, so no light is missing where it contributes. Returns 0
+// if all checks pass.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include "egLightCluster.h"
+
+using namespace Horde3D;
+
+// Configuration
+const int numRandomLights = 200;
+const int samplesPerLight = 400;
+
+typedef LightClusterGrid Grid;
+
+
+static float randomFloat( float min, float max )
+{
+	return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+
+static bool clusterHasLight( const Grid &grid, uint32 cluster, uint32 light )
+{
+	const std::vector< uint32 > &indices = grid.getLightIndices();
+	for( uint32 i = 0; i < grid.getClusterLightCount( cluster ); ++i )
+	{
+		if( indices[grid.getClusterOffset( cluster ) + i] == light ) return true;
+	}
+	return false;
+}
+
+
+static uint32 countClustersWithLight( const Grid &grid, uint32 light )
+{
+	uint32 count = 0;
+	for( uint32 i = 0; i < Grid::NumClusters; ++i )
+	{
+		if( clusterHasLight( grid, i, light ) ) ++count;
+	}
+	return count;
+}
+
+
+static int check( bool condition, const char *what )
+{
+	if( !condition ) printf( "  FAILED: %s\n", what );
+	return condition ? 0 : 1;
+}
+
+
+static int checkKnownLights( const Matrix4f &projMat, float farDist )
+{
+	Grid grid;
+	grid.setup( projMat );
+	int failures = 0;
+
+	// A light with a tiny radius in the middle of a cluster, which is computed here from the
+	// projection and the slice mapping independently of findCluster
+	uint32 tx = 5, ty = 2, tz = 9;
+	float ndcX = (tx + 0.5f) / Grid::DimX * 2 - 1, ndcY = (ty + 0.5f) / Grid::DimY * 2 - 1;
+	float sliceDepth = grid.hasLogSlices() ?
+		expf( (tz + 0.5f - grid.getSliceBias()) / grid.getSliceScale() ) :
+		(tz + 0.5f - grid.getSliceBias()) / grid.getSliceScale();
+	Vec4f p = projMat.inverted() * Vec4f( ndcX, ndcY, 0, 1 );
+	Vec3f dir( p.x / p.w, p.y / p.w, p.z / p.w );
+	// Move along the view ray for perspective and along the view axis for orthographic projections
+	Vec3f center = projMat.c[3][3] == 0 ? dir * (sliceDepth / -dir.z) : Vec3f( dir.x, dir.y, -sliceDepth );
+	grid.addLight( center, 0.001f );
+
+	// Behind the camera, beyond the far plane and outside of the frustum to the side
+	grid.addLight( Vec3f( 0, 0, 5 ), 1.0f );
+	grid.addLight( Vec3f( 0, 0, -farDist - 2 ), 1.0f );
+	grid.addLight( Vec3f( farDist * 4, 0, -farDist * 0.5f ), 1.0f );
+
+	// Around the camera and reaching beyond the far corners of the frustum
+	grid.addLight( Vec3f( 0, 0, 0 ), farDist * 4 );
+	grid.build();
+
+	uint32 expectedCluster = Grid::getClusterIndex( tx, ty, tz );
+	failures += check( grid.findCluster( center ) == (int)expectedCluster, "findCluster of the small light" );
+	failures += check( clusterHasLight( grid, expectedCluster, 0 ), "small light in its cluster" );
+	failures += check( countClustersWithLight( grid, 0 ) == 1, "small light only in one cluster" );
+	failures += check( countClustersWithLight( grid, 1 ) == 0, "light behind the camera in no cluster" );
+	failures += check( countClustersWithLight( grid, 2 ) == 0, "light beyond the far plane in no cluster" );
+	failures += check( countClustersWithLight( grid, 3 ) == 0, "light beside the frustum in no cluster" );
+	failures += check( countClustersWithLight( grid, 4 ) == Grid::NumClusters, "large light in all clusters" );
+	failures += check( grid.getDroppedCount() == 0, "no dropped lights" );
+
+	// More lights than a cluster can hold at the same spot
+	grid.clearLights();
+	const uint32 stacked = Grid::MaxLightsPerCluster + 8;
+	for( uint32 i = 0; i < stacked; ++i ) grid.addLight( center, 0.001f );
+	grid.build();
+	failures += check( grid.getClusterLightCount( expectedCluster ) == Grid::MaxLightsPerCluster, "full cluster" );
+	failures += check( grid.getDroppedCount() == stacked - Grid::MaxLightsPerCluster, "dropped count" );
+
+	return failures;
+}
+
+
+static int checkRandomLights( const Matrix4f &projMat, float nearDist, float farDist, float halfWidth )
+{
+	Grid grid;
+	grid.setup( projMat );
+
+	std::vector< Vec4f > lights;
+	for( int i = 0; i < numRandomLights; ++i )
+	{
+		// Some lights cross the near plane or the borders of the frustum
+		float depth = randomFloat( nearDist * 0.5f, farDist * 1.1f );
+		float extent = halfWidth * (projMat.c[3][3] == 0 ? depth / nearDist : 1.0f) * 1.2f;
+		Vec3f pos( randomFloat( -extent, extent ), randomFloat( -extent, extent ) * 0.5f, -depth );
+		float radius = randomFloat( 0.05f, 0.2f ) * (farDist - nearDist) * (randomFloat( 0, 1 ) < 0.2f ? 1.0f : 0.1f);
+		lights.push_back( Vec4f( pos.x, pos.y, pos.z, radius ) );
+		grid.addLight( pos, radius );
+	}
+	grid.build();
+
+	int missing = 0, sampled = 0;
+	for( uint32 i = 0; i < lights.size(); ++i )
+	{
+		for( int j = 0; j < samplesPerLight; ++j )
+		{
+			// Uniform point in the sphere
+			Vec3f d;
+			do d = Vec3f( randomFloat( -1, 1 ), randomFloat( -1, 1 ), randomFloat( -1, 1 ) );
+			while( d.x * d.x + d.y * d.y + d.z * d.z > 1 );
+			Vec3f pos = Vec3f( lights[i].x, lights[i].y, lights[i].z ) + d * lights[i].w;
+
+			int cluster = grid.findCluster( pos );
+			if( cluster < 0 ) continue;
+			++sampled;
+			if( !clusterHasLight( grid, (uint32)cluster, i ) ) ++missing;
+		}
+	}
+
+	printf( "  %d random lights, %u light indices, %u dropped, %d points in the frustum, %d missing\n",
+	        numRandomLights, (uint32)grid.getLightIndices().size(), grid.getDroppedCount(), sampled, missing );
+
+	int failures = check( sampled > 0, "points in the frustum" );
+	failures += check( grid.getDroppedCount() > 0 || missing == 0, "lights missing from clusters" );
+	return failures;
+}
+
+
+int main( int argc, char** argv )
+{
+	struct Projection
+	{
+		const char  *name;
+		Matrix4f    mat;
+		float       nearDist, farDist, halfWidth;
+	};
+
+	Projection projections[3] = {
+		{ "perspective", Matrix4f::PerspectiveMat( -0.8f, 0.8f, -0.45f, 0.45f, 0.5f, 100.0f ), 0.5f, 100.0f, 0.8f },
+		{ "off-axis perspective", Matrix4f::PerspectiveMat( -0.3f, 1.1f, -0.6f, 0.2f, 0.5f, 60.0f ), 0.5f, 60.0f, 1.1f },
+		{ "orthographic", Matrix4f::OrthoMat( -20.0f, 20.0f, -10.0f, 10.0f, 0.0f, 80.0f ), 0.0f, 80.0f, 20.0f }
+	};
+
+	int failures = 0;
+	for( int i = 0; i < 3; ++i )
+	{
+		const Projection &proj = projections[i];
+		printf( "%s:\n", proj.name );
+		failures += checkKnownLights( proj.mat, proj.farDist );
+		// Near plane at 0 for the random placement of orthographic lights
+		failures += checkRandomLights( proj.mat, proj.nearDist > 0 ? proj.nearDist : 1.0f, proj.farDist, proj.halfWidth );
+	}
+
+	printf( failures == 0 ? "Light clusters are correct\n" : "%d checks FAILED\n", failures );
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Checks that software occlusion culling is conservative: small boxes are placed behind a tilted
+// wall that is marked as occluder, many of them so close to its silhouette that they stick out by
+// less than a pixel of the occlusion buffer. Every layout is rendered with and without
+// H3DCamera::SWOccCullingI and the images have to be identical, while the culled count shows that
+// the hidden boxes are removed. The OpenGL context is created with EGL without a window, e.g. with
+// Mesa's llvmpipe renderer, which is also the headless case the culling is meant for. Returns 0 if
+// the check passes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "Horde3D.h"
+#include "Horde3DUtils.h"
+
+// Configuration
+const int width = 1024, height = 512;  // Four screen pixels per occlusion buffer pixel
+const int numLayouts = 40;
+const int numBoxes = 400;
+const float wallDist = 10.0f;
+const float wallHalfWidth = 3.0f, wallHalfHeight = 1.5f;
+
+static const char *shaderFX =
+	"[[FX]]\n"
+	"float4 matDiffuseCol = {1.0, 1.0, 1.0, 1.0};\n"
+	"context FLAT\n"
+	"{\n"
+	"	VertexShader = compile GLSL VS_FLAT;\n"
+	"	PixelShader = compile GLSL FS_FLAT;\n"
+	"}\n"
+	"[[VS_FLAT]]\n"
+	"uniform mat4 viewProjMat;\n"
+	"uniform mat4 worldMat;\n"
+	"attribute vec3 vertPos;\n"
+	"void main() { gl_Position = viewProjMat * worldMat * vec4( vertPos, 1.0 ); }\n"
+	"[[FS_FLAT]]\n"
+	"uniform vec4 matDiffuseCol;\n"
+	"void main() { gl_FragColor = matDiffuseCol; }\n";
+
+static const char *pipelineXML =
+	"<Pipeline>\n"
+	"	<CommandQueue>\n"
+	"		<Stage id=\"Geometry\">\n"
+	"			<ClearTarget depthBuf=\"true\" colBuf0=\"true\" />\n"
+	"			<DrawGeometry context=\"FLAT\" />\n"
+	"		</Stage>\n"
+	"	</CommandQueue>\n"
+	"</Pipeline>\n";
+
+static const char *wallMaterialXML =
+	"<Material>\n"
+	"	<Shader source=\"OcclusionCheck.shader\" />\n"
+	"	<Uniform name=\"matDiffuseCol\" a=\"0.3\" b=\"0.3\" c=\"0.3\" d=\"1.0\" />\n"
+	"</Material>\n";
+
+static const char *boxMaterialXML =
+	"<Material>\n"
+	"	<Shader source=\"OcclusionCheck.shader\" />\n"
+	"	<Uniform name=\"matDiffuseCol\" a=\"1.0\" b=\"0.8\" c=\"0.2\" d=\"1.0\" />\n"
+	"</Material>\n";
+
+
+static bool createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	EGLDisplay display = getPlatformDisplay != 0x0 ?
+		getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0x0 ) :
+		eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) ) return false;
+	if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	                           EGL_DEPTH_SIZE, 24, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs ) || numConfigs == 0 ) return false;
+
+	EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT, 0x0 );
+	if( context == EGL_NO_CONTEXT ) return false;
+
+	EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface( display, config, surfaceAttribs );
+	if( surface == EGL_NO_SURFACE ) return false;
+
+	return eglMakeCurrent( display, surface, surface, context ) == EGL_TRUE;
+}
+
+
+static void printMessages()
+{
+	int level;
+	float time;
+	const char *msg;
+	while( (msg = h3dGetMessage( &level, &time ))[0] != '\0' )
+	{
+		if( level <= 2 ) printf( "Engine: %s\n", msg );
+	}
+}
+
+
+static float randomFloat( float min, float max )
+{
+	static unsigned int state = 1234;
+	state = state * 1664525u + 1013904223u;
+	return min + (max - min) * (state >> 8) / 16777216.0f;
+}
+
+
+static H3DNode addBox( const char *name, H3DRes geoRes, H3DRes matRes )
+{
+	H3DNode model = h3dAddModelNode( H3DRootNode, name, geoRes );
+	h3dAddMeshNode( model, name, matRes, 0, 36, 0, 7 );
+	return model;
+}
+
+
+static void render( H3DNode cam, int swOccCulling, std::vector< float > &pixels )
+{
+	h3dSetNodeParamI( cam, H3DCamera::SWOccCullingI, swOccCulling );
+	h3dRender( cam );
+	h3dFinalizeFrame();
+	h3dGetRenderTargetData( 0, 0x0, 0, 0x0, 0x0, 0x0, &pixels[0], (int)(pixels.size() * sizeof( float )) );
+}
+
+
+int main( int argc, char** argv )
+{
+	if( !createContext() )
+	{
+		printf( "Failed to create an OpenGL context with EGL\n" );
+		return 1;
+	}
+	if( !h3dInit() )
+	{
+		printMessages();
+		printf( "Failed to initialize the engine\n" );
+		return 1;
+	}
+
+	H3DRes shaderRes = h3dAddResource( H3DResTypes::Shader, "OcclusionCheck.shader", 0 );
+	h3dLoadResource( shaderRes, shaderFX, (int)strlen( shaderFX ) );
+	H3DRes pipeRes = h3dAddResource( H3DResTypes::Pipeline, "OcclusionCheck.pipeline.xml", 0 );
+	h3dLoadResource( pipeRes, pipelineXML, (int)strlen( pipelineXML ) );
+	H3DRes wallMatRes = h3dAddResource( H3DResTypes::Material, "OcclusionCheckWall.material.xml", 0 );
+	h3dLoadResource( wallMatRes, wallMaterialXML, (int)strlen( wallMaterialXML ) );
+	H3DRes boxMatRes = h3dAddResource( H3DResTypes::Material, "OcclusionCheckBox.material.xml", 0 );
+	h3dLoadResource( boxMatRes, boxMaterialXML, (int)strlen( boxMaterialXML ) );
+
+	// Unit cube
+	float posData[8 * 3];
+	for( int i = 0; i < 8; ++i )
+	{
+		posData[i * 3 + 0] = (i & 1) ? 0.5f : -0.5f;
+		posData[i * 3 + 1] = (i & 2) ? 0.5f : -0.5f;
+		posData[i * 3 + 2] = (i & 4) ? 0.5f : -0.5f;
+	}
+	unsigned int indexData[36] = {
+		0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 1, 4,  1, 5, 4,
+		2, 6, 3,  3, 6, 7,  0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5 };
+	H3DRes geoRes = h3dutCreateGeometryRes( "OcclusionCheckCube", 8, 36, posData, indexData,
+	                                        0x0, 0x0, 0x0, 0x0, 0x0 );
+
+	H3DNode wall = addBox( "Wall", geoRes, wallMatRes );
+	h3dSetNodeFlags( h3dGetNodeChild( wall, 0 ), H3DNodeFlags::Occluder, false );
+
+	std::vector< H3DNode > boxes( numBoxes );
+	for( int i = 0; i < numBoxes; ++i ) boxes[i] = addBox( "Box", geoRes, boxMatRes );
+
+	H3DNode cam = h3dAddCameraNode( H3DRootNode, "Camera", pipeRes );
+	h3dSetNodeParamI( cam, H3DCamera::ViewportWidthI, width );
+	h3dSetNodeParamI( cam, H3DCamera::ViewportHeightI, height );
+	h3dSetupCameraView( cam, 60.0f, (float)width / height, 0.5f, 100.0f );
+	printMessages();
+
+	if( !h3dIsResLoaded( shaderRes ) || !h3dIsResLoaded( pipeRes ) || geoRes == 0 )
+	{
+		printf( "Failed to create the resources\n" );
+		return 1;
+	}
+
+	std::vector< float > pixels[2];
+	pixels[0].resize( width * height * 4 );
+	pixels[1].resize( width * height * 4 );
+	int failures = 0, culledTotal = 0;
+
+	for( int layout = 0; layout < numLayouts; ++layout )
+	{
+		// The wall is tilted so that its silhouette has edges at all angles
+		float angle = randomFloat( 0, 90 );
+		h3dSetNodeTransform( wall, 0, 0, -wallDist, 0, 0, angle, wallHalfWidth * 2, wallHalfHeight * 2, 0.2f );
+
+		float s = sinf( angle * 3.14159265f / 180 ), c = cosf( angle * 3.14159265f / 180 );
+		for( int i = 0; i < numBoxes; ++i )
+		{
+			// Pick a point on the border of the wall and move it outwards by up to one or inwards by up
+			// to six occlusion buffer pixels, then push it back so that it stays on the same view ray
+			float u, v, offset = randomFloat( -0.5f, 0.08f );
+			if( randomFloat( 0, 1 ) < 0.5f )
+			{
+				u = randomFloat( -wallHalfWidth, wallHalfWidth );
+				v = randomFloat( 0, 1 ) < 0.5f ? -wallHalfHeight - offset : wallHalfHeight + offset;
+			}
+			else
+			{
+				u = randomFloat( 0, 1 ) < 0.5f ? -wallHalfWidth - offset : wallHalfWidth + offset;
+				v = randomFloat( -wallHalfHeight, wallHalfHeight );
+			}
+
+			float dist = randomFloat( wallDist + 1, wallDist * 2 );
+			float scale = dist / wallDist;
+			float size = randomFloat( 0.01f, 0.08f ) * scale;
+			h3dSetNodeTransform( boxes[i], (u * c - v * s) * scale, (u * s + v * c) * scale, -dist,
+			                     0, 0, 0, size, size, size );
+		}
+
+		render( cam, 0, pixels[0] );
+		h3dGetStat( H3DStats::SWOccCulledCount, true );
+		render( cam, 1, pixels[1] );
+		int culled = (int)h3dGetStat( H3DStats::SWOccCulledCount, true );
+		culledTotal += culled;
+
+		int differences = 0;
+		for( size_t i = 0; i < pixels[0].size(); i += 4 )
+		{
+			if( memcmp( &pixels[0][i], &pixels[1][i], 4 * sizeof( float ) ) != 0 ) ++differences;
+		}
+		if( differences != 0 )
+		{
+			printf( "layout %2d: wall angle %5.1f, %3d boxes culled, %d pixels differ  FAILED\n",
+			        layout, angle, culled, differences );
+			++failures;
+		}
+	}
+
+	printMessages();
+	h3dRelease();
+
+	printf( "%d layouts, %d boxes culled on average\n", numLayouts, culledTotal / numLayouts );
+	if( culledTotal == 0 )
+	{
+		printf( "Software occlusion culling removed no boxes\n" );
+		return 1;
+	}
+	printf( failures == 0 ? "Software occlusion culling is conservative\n" :
+	                        "Software occlusion culling removed visible boxes\n" );
+	return failures == 0 ? 0 : 1;
+}
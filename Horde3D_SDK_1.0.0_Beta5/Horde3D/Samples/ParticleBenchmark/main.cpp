@@ -0,0 +1,296 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Measures the particle simulation kernels against the original per-slot update loop of the
+// emitter, for emitters that are completely filled and for emitters where only a tenth of the
+// slots is alive. The kernels are also measured with curves that are baked from the linear
+// changes, which differ from the original only by the sampling of the curves. No window or OpenGL
+// context is required.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "egParticleSim.h"
+#include "utTimer.h"
+
+using namespace Horde3D;
+
+// Configuration
+const uint32 particleCounts[] = { 10000, 100000, 1000000 };
+const uint32 liveDivisors[] = { 1, 10 };
+const uint32 stepsPerCount = 20000000;  // Number of simulated slots per measurement
+const float timeDelta = 1.0f / 60.0f;
+
+
+static float randf()
+{
+	return (float)rand() / (float)RAND_MAX;
+}
+
+
+// =================================================================================================
+// Original implementation
+// =================================================================================================
+
+struct OrigChannel
+{
+	float  startMin, startMax, endRate;
+};
+
+struct OrigEffect
+{
+	OrigChannel  moveVel, rotVel, drag, size, colR, colG, colB, colA;
+};
+
+struct OrigParticle
+{
+	float   life, maxLife;
+	Vec3f   dir, dragVec;
+	uint32  respawnCounter;
+	float   moveVel0, rotVel0, drag0;
+	float   size0;
+	float   r0, g0, b0, a0;
+};
+
+struct OrigEmitter
+{
+	uint32                      count;
+	std::vector< OrigParticle > particles;
+	std::vector< float >        positions, sizesAndRotations, colors;
+};
+
+
+// Update part of the former EmitterNode::update: all slots are visited and the resource is read
+// for every particle
+static void updateOriginal( OrigEmitter &e, const OrigEffect *effect, const Vec3f &force, Vec3f &bBMin, Vec3f &bBMax )
+{
+	bBMin = Vec3f( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
+	bBMax = Vec3f( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
+
+	for( uint32 i = 0; i < e.count; ++i )
+	{
+		OrigParticle &p = e.particles[i];
+
+		if( p.life > 0 )
+		{
+			float fac = 1.0f - (p.life / p.maxLife);
+
+			float moveVel = p.moveVel0 * (1.0f + (effect->moveVel.endRate - 1.0f) * fac);
+			float rotVel = p.rotVel0 * (1.0f + (effect->rotVel.endRate - 1.0f) * fac);
+			float drag = p.drag0 * (1.0f + (effect->drag.endRate - 1.0f) * fac);
+			e.sizesAndRotations[i * 2 + 0] = p.size0 * (1.0f + (effect->size.endRate - 1.0f) * fac);
+			e.sizesAndRotations[i * 2 + 0] *= 2;
+			e.colors[i * 4 + 0] = p.r0 * (1.0f + (effect->colR.endRate - 1.0f) * fac);
+			e.colors[i * 4 + 1] = p.g0 * (1.0f + (effect->colG.endRate - 1.0f) * fac);
+			e.colors[i * 4 + 2] = p.b0 * (1.0f + (effect->colB.endRate - 1.0f) * fac);
+			e.colors[i * 4 + 3] = p.a0 * (1.0f + (effect->colA.endRate - 1.0f) * fac);
+
+			e.positions[i * 3 + 0] += (p.dir.x * moveVel + p.dragVec.x * drag + force.x) * timeDelta;
+			e.positions[i * 3 + 1] += (p.dir.y * moveVel + p.dragVec.y * drag + force.y) * timeDelta;
+			e.positions[i * 3 + 2] += (p.dir.z * moveVel + p.dragVec.z * drag + force.z) * timeDelta;
+			e.sizesAndRotations[i * 2 + 1] += degToRad( rotVel ) * timeDelta;
+
+			p.life -= timeDelta;
+			if( p.life <= 0 ) e.sizesAndRotations[i * 2 + 0] = 0.0f;
+		}
+
+		Vec3f vertPos( e.positions[i*3+0], e.positions[i*3+1], e.positions[i*3+2] );
+		if( vertPos.x < bBMin.x ) bBMin.x = vertPos.x;
+		if( vertPos.y < bBMin.y ) bBMin.y = vertPos.y;
+		if( vertPos.z < bBMin.z ) bBMin.z = vertPos.z;
+		if( vertPos.x > bBMax.x ) bBMax.x = vertPos.x;
+		if( vertPos.y > bBMax.y ) bBMax.y = vertPos.y;
+		if( vertPos.z > bBMax.z ) bBMax.z = vertPos.z;
+	}
+}
+
+
+// =================================================================================================
+// Benchmark
+// =================================================================================================
+
+static void runBenchmark( uint32 capacity, uint32 liveCount, const OrigEffect &effect )
+{
+	uint32 iterations = std::max( stepsPerCount / capacity, 1u );
+	Vec3f force( 0, -0.5f, 0 );
+
+	// Live particles are spread over the slots of the original emitter
+	OrigEmitter orig;
+	orig.count = capacity;
+	orig.particles.resize( capacity );
+	orig.positions.assign( capacity * 3, 0.0f );
+	orig.sizesAndRotations.assign( capacity * 2, 0.0f );
+	orig.colors.assign( capacity * 4, 0.0f );
+	uint32 spacing = capacity / liveCount;
+
+	std::vector< float > state( capacity * ParticleStateChannels::Count );
+	std::vector< float > positions( capacity * 3 ), sizesAndRotations( capacity * 2 ), colors( capacity * 4 );
+	ParticleStreams streams;
+	streams.state = &state[0];
+	streams.stride = capacity;
+	streams.positions = &positions[0];
+	streams.sizesAndRotations = &sizesAndRotations[0];
+	streams.colors = &colors[0];
+
+	for( uint32 i = 0; i < capacity; ++i )
+	{
+		OrigParticle &p = orig.particles[i];
+		p.life = 0;
+		p.respawnCounter = 0;
+		if( i % spacing != 0 || i / spacing >= liveCount ) continue;
+
+		// Particles live long enough to survive all iterations
+		p.maxLife = 1000.0f + randf();
+		p.life = p.maxLife * (0.5f + 0.5f * randf());
+		p.dir = Vec3f( randf() - 0.5f, randf() - 0.5f, randf() - 0.5f ).normalized();
+		p.dragVec = Vec3f( randf(), randf(), randf() );
+		p.moveVel0 = randf(); p.rotVel0 = randf() * 90; p.drag0 = randf(); p.size0 = randf();
+		p.r0 = randf(); p.g0 = randf(); p.b0 = randf(); p.a0 = randf();
+		for( uint32 c = 0; c < 3; ++c ) orig.positions[i * 3 + c] = randf() * 10;
+		orig.sizesAndRotations[i * 2 + 1] = randf() * 360;
+
+		uint32 k = i / spacing;
+		streams.channel( ParticleStateChannels::Life )[k] = p.life;
+		streams.channel( ParticleStateChannels::InvMaxLife )[k] = 1.0f / p.maxLife;
+		for( uint32 c = 0; c < 3; ++c )
+		{
+			streams.channel( ParticleStateChannels::DirX + c )[k] = p.dir[c];
+			streams.channel( ParticleStateChannels::DragX + c )[k] = p.dragVec[c];
+			positions[k * 3 + c] = orig.positions[i * 3 + c];
+		}
+		streams.channel( ParticleStateChannels::MoveVel0 )[k] = p.moveVel0;
+		streams.channel( ParticleStateChannels::RotVel0 )[k] = p.rotVel0;
+		streams.channel( ParticleStateChannels::Drag0 )[k] = p.drag0;
+		streams.channel( ParticleStateChannels::Size0 )[k] = p.size0;
+		streams.channel( ParticleStateChannels::ColR0 )[k] = p.r0;
+		streams.channel( ParticleStateChannels::ColG0 )[k] = p.g0;
+		streams.channel( ParticleStateChannels::ColB0 )[k] = p.b0;
+		streams.channel( ParticleStateChannels::ColA0 )[k] = p.a0;
+		sizesAndRotations[k * 2 + 1] = orig.sizesAndRotations[i * 2 + 1];
+	}
+	std::vector< float > initState = state, initPositions = positions, initSizesAndRotations = sizesAndRotations;
+
+	printf( "%u particles, %u alive, %u steps\n", capacity, liveCount, iterations );
+
+	Timer timer;
+	Vec3f bBMin, bBMax;
+	timer.setEnabled( true );
+	for( uint32 it = 0; it < iterations; ++it )
+		updateOriginal( orig, &effect, force, bBMin, bBMax );
+	timer.setEnabled( false );
+	double refTime = timer.getElapsedTimeMS() * 1.0e6 / ((double)iterations * liveCount);
+	printf( "%-10s %-6s %8.2f ns/particle\n", "original", "", refTime );
+
+	ParticleSimParams params;
+	params.timeDelta = timeDelta;
+	params.force[0] = force.x; params.force[1] = force.y; params.force[2] = force.z;
+	params.moveVelRate = effect.moveVel.endRate - 1.0f;
+	params.rotVelRate = effect.rotVel.endRate - 1.0f;
+	params.dragRate = effect.drag.endRate - 1.0f;
+	params.sizeRate = effect.size.endRate - 1.0f;
+	params.colRate[0] = effect.colR.endRate - 1.0f;
+	params.colRate[1] = effect.colG.endRate - 1.0f;
+	params.colRate[2] = effect.colB.endRate - 1.0f;
+	params.colRate[3] = effect.colA.endRate - 1.0f;
+
+	const OrigChannel *channels[] = { &effect.moveVel, &effect.rotVel, &effect.drag, &effect.size,
+	                                  &effect.colR, &effect.colG, &effect.colB, &effect.colA };
+	std::vector< float > curveTable( ParticleCurveSamples * ParticleCurveChannels::Count );
+	for( uint32 k = 0; k < ParticleCurveSamples; ++k )
+	{
+		for( uint32 c = 0; c < ParticleCurveChannels::Count; ++c )
+		{
+			curveTable[k * ParticleCurveChannels::Count + c] =
+				1.0f + (channels[c]->endRate - 1.0f) * k / (ParticleCurveSamples - 1);
+		}
+	}
+
+	for( int run = 0; run < ParticleSimKernels::Count * 2; ++run )
+	{
+		int kernel = run / 2;
+		ParticleSimFunc func = getParticleSimFunc( kernel );
+		if( func == 0x0 ) continue;
+
+		params.curveMask = run % 2 != 0 ? (1 << ParticleCurveChannels::Count) - 1 : 0;
+		params.curveTable = params.curveMask != 0 ? &curveTable[0] : 0x0;
+
+		state = initState;
+		positions = initPositions;
+		sizesAndRotations = initSizesAndRotations;
+		uint32 count = liveCount;
+		float bounds[6];
+
+		timer.reset();
+		timer.setEnabled( true );
+		for( uint32 it = 0; it < iterations; ++it )
+		{
+			bounds[0] = bounds[1] = bounds[2] = Math::MaxFloat;
+			bounds[3] = bounds[4] = bounds[5] = -Math::MaxFloat;
+			func( streams, count, params, bounds );
+			count = removeDeadParticles( streams, count );
+		}
+		timer.setEnabled( false );
+		double time = timer.getElapsedTimeMS() * 1.0e6 / ((double)iterations * liveCount);
+
+		// Compare with the original; its box also contains the positions of empty slots
+		float error = 0;
+		for( uint32 k = 0; k < count; ++k )
+		{
+			for( uint32 c = 0; c < 3; ++c )
+				error = std::max( error, fabsf( positions[k * 3 + c] - orig.positions[k * spacing * 3 + c] ) );
+			error = std::max( error, fabsf( sizesAndRotations[k * 2] - orig.sizesAndRotations[k * spacing * 2] ) );
+		}
+		if( spacing == 1 )
+		{
+			for( uint32 c = 0; c < 3; ++c )
+			{
+				error = std::max( error, fabsf( bounds[c] - bBMin[c] ) );
+				error = std::max( error, fabsf( bounds[c + 3] - bBMax[c] ) );
+			}
+		}
+
+		printf( "%-10s %-6s %8.2f ns/particle  speedup %.2fx  max error %g%s\n", getParticleSimKernelName( kernel ),
+		        params.curveMask != 0 ? "curves" : "", time, refTime / time, error,
+		        kernel == getBestParticleSimKernel() ? "  (selected)" : "" );
+	}
+	printf( "\n" );
+}
+
+
+int main( int argc, char** argv )
+{
+	srand( 1 );
+
+	OrigEffect effect;
+	OrigChannel *channels[] = { &effect.moveVel, &effect.rotVel, &effect.drag, &effect.size,
+	                            &effect.colR, &effect.colG, &effect.colB, &effect.colA };
+	for( uint32 i = 0; i < sizeof( channels ) / sizeof( channels[0] ); ++i )
+	{
+		channels[i]->startMin = 0;
+		channels[i]->startMax = 1;
+		channels[i]->endRate = randf() * 2;
+	}
+
+	for( uint32 i = 0; i < sizeof( particleCounts ) / sizeof( particleCounts[0] ); ++i )
+	{
+		for( uint32 j = 0; j < sizeof( liveDivisors ) / sizeof( liveDivisors[0] ); ++j )
+			runBenchmark( particleCounts[i], particleCounts[i] / liveDivisors[j], effect );
+	}
+
+	return 0;
+}
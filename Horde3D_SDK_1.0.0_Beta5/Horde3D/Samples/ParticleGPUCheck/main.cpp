@@ -0,0 +1,267 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Checks the GPU particle simulation against the CPU simulation: two emitters with the same seed
+// are moved along the same path, one of them with H3DEmitter::GPUSimulationI enabled, and their
+// particles are compared after every few steps. Half way through, the drag channel gets a curve
+// to cover changing curves. The OpenGL context is created with EGL without a window, e.g. with
+// Mesa's llvmpipe renderer. Returns 0 if the results match.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "Horde3D.h"
+
+// Configuration
+const int maxCount = 20000;
+const float emissionRate = 2000;
+const int numSteps = 360;
+const int checkInterval = 40;
+const float tolerance = 1.0e-3f;
+const int seed = 1234;
+
+static const char *materialXML = "<Material class=\"Translucent.Particle\" />";
+
+static const char *effectXML =
+	"<ParticleEffect lifeMin=\"0.5\" lifeMax=\"3.0\">\n"
+	"	<ChannelOverLife channel=\"moveVel\" startMin=\"1.0\" startMax=\"3.0\" endRate=\"0.2\" />\n"
+	"	<ChannelOverLife channel=\"rotVel\" startMin=\"-90\" startMax=\"210\" endRate=\"0.5\" />\n"
+	"	<ChannelOverLife channel=\"drag\" startMin=\"0.1\" startMax=\"0.4\" endRate=\"2.0\" />\n"
+	"	<ChannelOverLife channel=\"size\" startMin=\"0.2\" startMax=\"0.4\">\n"
+	"		<Key time=\"0.0\" value=\"0.5\" />\n"
+	"		<Key time=\"0.3\" value=\"2.0\" />\n"
+	"		<Key time=\"1.0\" value=\"1.0\" />\n"
+	"	</ChannelOverLife>\n"
+	"	<ChannelOverLife channel=\"colR\" startMin=\"0.4\" startMax=\"0.6\" endRate=\"0.0\" />\n"
+	"	<ChannelOverLife channel=\"colG\" startMin=\"0.2\" startMax=\"0.3\" endRate=\"0.5\" />\n"
+	"	<ChannelOverLife channel=\"colB\" startMin=\"0.1\" startMax=\"0.2\" endRate=\"1.0\" />\n"
+	"	<ChannelOverLife channel=\"colA\" startMin=\"0.1\" startMax=\"0.2\">\n"
+	"		<Key time=\"0.1\" value=\"4.0\" />\n"
+	"		<Key time=\"0.8\" value=\"0.0\" />\n"
+	"	</ChannelOverLife>\n"
+	"</ParticleEffect>\n";
+
+
+struct Particle
+{
+	float  v[9];  // Position, size, rotation, color
+
+	bool operator<( const Particle &p ) const { return v[0] < p.v[0]; }
+};
+
+
+static bool createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	EGLDisplay display = getPlatformDisplay != 0x0 ?
+		getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0x0 ) :
+		eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) ) return false;
+	if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs ) || numConfigs == 0 ) return false;
+
+	EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT, 0x0 );
+	if( context == EGL_NO_CONTEXT ) return false;
+
+	// Draw calls fail without a complete framebuffer, even if nothing is rasterized
+	EGLint surfaceAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface( display, config, surfaceAttribs );
+	if( surface == EGL_NO_SURFACE ) return false;
+
+	return eglMakeCurrent( display, surface, surface, context ) == EGL_TRUE;
+}
+
+
+static void printMessages()
+{
+	int level;
+	float time;
+	const char *msg;
+	while( (msg = h3dGetMessage( &level, &time ))[0] != '\0' )
+	{
+		if( level <= 2 ) printf( "Engine: %s\n", msg );
+	}
+}
+
+
+static std::vector< Particle > getParticles( H3DNode emitter )
+{
+	std::vector< float > data( maxCount * 9 );
+	int count = h3dGetEmitterParticleData( emitter, maxCount, &data[0], &data[maxCount * 3], &data[maxCount * 5] );
+
+	std::vector< Particle > particles( std::min( count, maxCount ) );
+	for( size_t i = 0; i < particles.size(); ++i )
+	{
+		float *v = particles[i].v;
+		for( int c = 0; c < 3; ++c ) v[c] = data[i * 3 + c];
+		for( int c = 0; c < 2; ++c ) v[3 + c] = data[maxCount * 3 + i * 2 + c];
+		for( int c = 0; c < 4; ++c ) v[5 + c] = data[maxCount * 5 + i * 4 + c];
+	}
+
+	return particles;
+}
+
+
+// Every CPU particle is matched with the closest unused GPU particle that has a similar x coordinate;
+// returns the number of particles that could not be matched within the tolerance
+static int compareParticles( std::vector< Particle > &cpu, std::vector< Particle > &gpu, float &maxError )
+{
+	std::sort( gpu.begin(), gpu.end() );
+	std::vector< char > used( gpu.size(), 0 );
+	int unmatched = 0;
+
+	for( size_t i = 0; i < cpu.size(); ++i )
+	{
+		Particle key = cpu[i];
+		key.v[0] -= tolerance;
+		size_t j = std::lower_bound( gpu.begin(), gpu.end(), key ) - gpu.begin();
+
+		size_t best = gpu.size();
+		float bestError = tolerance;
+		for( ; j < gpu.size() && gpu[j].v[0] <= cpu[i].v[0] + tolerance; ++j )
+		{
+			if( used[j] ) continue;
+
+			// Rotations are compared in degrees per second of lifetime, they grow quickly
+			float error = 0;
+			for( int c = 0; c < 9; ++c )
+				error = std::max( error, fabsf( gpu[j].v[c] - cpu[i].v[c] ) / (c == 4 ? 100.0f : 1.0f) );
+			if( error <= bestError )
+			{
+				best = j;
+				bestError = error;
+			}
+		}
+
+		if( best == gpu.size() )
+		{
+			++unmatched;
+			continue;
+		}
+		used[best] = 1;
+		maxError = std::max( maxError, bestError );
+	}
+
+	return unmatched + (int)(gpu.size() > cpu.size() ? gpu.size() - cpu.size() : 0);
+}
+
+
+int main( int argc, char** argv )
+{
+	if( !createContext() )
+	{
+		printf( "Failed to create an OpenGL context with EGL\n" );
+		return 1;
+	}
+	if( !h3dInit() )
+	{
+		printMessages();
+		printf( "Failed to initialize the engine\n" );
+		return 1;
+	}
+
+	H3DRes matRes = h3dAddResource( H3DResTypes::Material, "ParticleGPUCheck.material.xml", 0 );
+	h3dLoadResource( matRes, materialXML, (int)strlen( materialXML ) );
+	H3DRes effectRes = h3dAddResource( H3DResTypes::ParticleEffect, "ParticleGPUCheck.particle.xml", 0 );
+	h3dLoadResource( effectRes, effectXML, (int)strlen( effectXML ) );
+
+	H3DNode emitters[2];
+	for( int i = 0; i < 2; ++i )
+	{
+		emitters[i] = h3dAddEmitterNode( H3DRootNode, i == 0 ? "CPU" : "GPU", matRes, effectRes, maxCount, -1 );
+		h3dSetNodeParamF( emitters[i], H3DEmitter::EmissionRateF, 0, emissionRate );
+		h3dSetNodeParamF( emitters[i], H3DEmitter::SpreadAngleF, 0, 45 );
+		h3dSetNodeParamF( emitters[i], H3DEmitter::ForceF3, 1, -1.5f );
+		h3dSetNodeParamI( emitters[i], H3DEmitter::SeedI, seed );
+	}
+	h3dSetNodeParamI( emitters[1], H3DEmitter::GPUSimulationI, 1 );
+	printMessages();
+	if( h3dGetNodeParamI( emitters[1], H3DEmitter::GPUSimulationI ) == 0 )
+	{
+		printf( "GPU particle simulation is not supported\n" );
+		return 1;
+	}
+
+	int failures = 0;
+	for( int step = 1; step <= numSteps; ++step )
+	{
+		// The emitters move on a circle with a varying frame time, so that drag and the distribution
+		// of particles along the motion vector are covered
+		float t = step / 60.0f;
+		float timeDelta = (1.0f + 0.5f * sinf( t * 7.0f )) / 60.0f;
+		for( int i = 0; i < 2; ++i )
+			h3dSetNodeTransform( emitters[i], 3 * cosf( t ), 0, 3 * sinf( t ), t * 30, 0, 0, 1, 1, 1 );
+
+		// Both update paths are used
+		if( step % 2 == 0 )
+			h3dUpdateEmitters( 2, emitters, timeDelta );
+		else
+		{
+			h3dUpdateEmitter( emitters[0], timeDelta );
+			h3dUpdateEmitter( emitters[1], timeDelta );
+		}
+
+		if( step % checkInterval != 0 ) continue;
+
+		std::vector< Particle > cpu = getParticles( emitters[0] );
+		std::vector< Particle > gpu = getParticles( emitters[1] );
+		float maxError = 0;
+		int mismatches = compareParticles( cpu, gpu, maxError );
+
+		// The box of the GPU emitter is an estimate that has to contain all particles
+		float cpuBox[6], gpuBox[6];
+		h3dGetNodeAABB( emitters[0], &cpuBox[0], &cpuBox[1], &cpuBox[2], &cpuBox[3], &cpuBox[4], &cpuBox[5] );
+		h3dGetNodeAABB( emitters[1], &gpuBox[0], &gpuBox[1], &gpuBox[2], &gpuBox[3], &gpuBox[4], &gpuBox[5] );
+		bool boxContained = true;
+		for( int c = 0; c < 3; ++c )
+		{
+			boxContained &= gpuBox[c] <= cpuBox[c] + tolerance;
+			boxContained &= gpuBox[c + 3] >= cpuBox[c + 3] - tolerance;
+		}
+
+		bool ok = mismatches == 0 && boxContained;
+		printf( "step %3d: %5d CPU particles, %5d GPU particles, %d mismatches, max error %g, box %s%s\n",
+		        step, (int)cpu.size(), (int)gpu.size(), mismatches, maxError,
+		        boxContained ? "contained" : "NOT CONTAINED", ok ? "" : "  FAILED" );
+		if( !ok ) ++failures;
+
+		// Recorded GPU steps have been run by the comparison, so the curve applies to both from here on
+		if( step == numSteps / 2 )
+		{
+			for( int k = 0; k < 256; ++k )
+				h3dSetResParamF( effectRes, H3DPartEffRes::ChanDragElem, 0, H3DPartEffRes::ChanCurveF, k,
+				                 1.0f + 2.0f * sinf( k / 255.0f * 3.14159f ) );
+		}
+	}
+
+	printMessages();
+	h3dRelease();
+
+	printf( failures == 0 ? "GPU simulation matches the CPU simulation\n" : "GPU simulation differs\n" );
+	return failures == 0 ? 0 : 1;
+}
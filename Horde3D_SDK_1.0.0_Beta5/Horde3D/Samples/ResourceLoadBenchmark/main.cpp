@@ -0,0 +1,353 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Loads the resources of the Knight and Chicago samples with a loader that reads and loads one file
+// after the other, as h3dutLoadResourcesFromDisk did before it used loader threads, with
+// h3dutLoadResourcesFromDisk and with h3dutStartLoadingResourcesFromDisk and polling between frames,
+// and compares the times. Every method has to load the same resources, and the pixels of all textures
+// and the vertex and index data of all geometries have to be the same. Decoded data also has to be
+// rejected when it is loaded a second time or into a resource of another type. The OpenGL context
+// required by the engine is created with EGL without a window. Returns 0 if all checks pass.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "Horde3D.h"
+#include "Horde3DUtils.h"
+#include "utTimer.h"
+
+using namespace Horde3D;
+
+// Configuration
+const int numRuns = 10;
+const float pollTimeMS = 2.0f;
+const int pollIntervalUS = 1000;  // Stands for the rendering of a frame between two polls
+
+struct Method
+{
+	enum List
+	{
+		Sequential = 0,
+		Blocking,
+		Polling,
+		Count
+	};
+};
+
+const char *methodNames[Method::Count] = { "sequential", "h3dutLoadResourcesFromDisk", "polling" };
+
+struct ResourceState
+{
+	bool          loaded;
+	unsigned int  checksum;  // Of the pixels for uncompressed textures and of the geometry streams
+
+	bool operator==( const ResourceState &state ) const
+		{ return loaded == state.loaded && checksum == state.checksum; }
+};
+
+typedef std::map< std::string, ResourceState > ResourceStates;
+
+
+static bool createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	EGLDisplay display = getPlatformDisplay != 0x0 ?
+		getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0x0 ) :
+		eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) ) return false;
+	if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs ) || numConfigs == 0 ) return false;
+
+	EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT, 0x0 );
+	if( context == EGL_NO_CONTEXT ) return false;
+
+	EGLint surfaceAttribs[] = { EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface( display, config, surfaceAttribs );
+	if( surface == EGL_NO_SURFACE ) return false;
+
+	return eglMakeCurrent( display, surface, surface, context ) == EGL_TRUE;
+}
+
+
+static void printMessages()
+{
+	int level;
+	float time;
+	const char *msg;
+	while( (msg = h3dGetMessage( &level, &time ))[0] != '\0' )
+	{
+		if( level <= 1 ) printf( "Engine: %s\n", msg );
+	}
+}
+
+
+static std::string extractAppPath( char *fullPath )
+{
+	std::string s( fullPath );
+	for( int i = (int)s.length() - 1; i >= 0; --i )
+	{
+		if( s[i] == '\\' || s[i] == '/' ) return s.substr( 0, i + 1 );
+	}
+	return "./";
+}
+
+
+static void addResources()
+{
+	// Knight sample
+	h3dAddResource( H3DResTypes::Pipeline, "pipelines/hdr.pipeline.xml", 0 );
+	h3dAddResource( H3DResTypes::Pipeline, "pipelines/forward.pipeline.xml", 0 );
+	h3dAddResource( H3DResTypes::Material, "overlays/font.material.xml", 0 );
+	h3dAddResource( H3DResTypes::Material, "overlays/panel.material.xml", 0 );
+	h3dAddResource( H3DResTypes::Material, "overlays/logo.material.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/sphere/sphere.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/knight/knight.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::Animation, "animations/knight_order.anim", 0 );
+	h3dAddResource( H3DResTypes::Animation, "animations/knight_attack.anim", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "particles/particleSys1/particleSys1.scene.xml", 0 );
+
+	// Chicago sample
+	h3dAddResource( H3DResTypes::Pipeline, "pipelines/deferred.pipeline.xml", 0 );
+	h3dAddResource( H3DResTypes::Material, "materials/light.material.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/platform/platform.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/skybox/skybox.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::SceneGraph, "models/man/man.scene.xml", 0 );
+	h3dAddResource( H3DResTypes::Animation, "animations/man.anim", 0 );
+}
+
+
+// Loads the resources one after the other like h3dutLoadResourcesFromDisk without loader threads
+static bool loadSequential( const std::string &contentDir )
+{
+	bool result = true;
+	std::vector< char > data;
+
+	H3DRes res;
+	while( (res = h3dQueryUnloadedResource( 0 )) != 0 )
+	{
+		std::ifstream inf( (contentDir + "/" + h3dGetResName( res )).c_str(), std::ios::binary );
+		if( !inf.good() )
+		{
+			h3dLoadResource( res, 0x0, 0 );
+			result = false;
+			continue;
+		}
+
+		inf.seekg( 0, std::ios::end );
+		int fileSize = (int)inf.tellg();
+		inf.seekg( 0 );
+		data.resize( fileSize + 1 );
+		inf.read( &data[0], fileSize );
+		result &= h3dLoadResource( res, &data[0], fileSize );
+	}
+
+	return result;
+}
+
+
+// Decoded data is taken over by the first resource it is loaded into
+static bool checkDecodedReload( const std::string &contentDir )
+{
+	std::ifstream inf( (contentDir + "/models/knight/knight.geo").c_str(), std::ios::binary );
+	std::vector< char > data( (std::istreambuf_iterator< char >( inf )), std::istreambuf_iterator< char >() );
+	H3DDecodedRes decoded = h3dDecodeResourceData( H3DResTypes::Geometry, &data[0], (int)data.size() );
+	if( decoded == 0x0 ) return false;
+
+	H3DRes geoRes[2], texRes;
+	geoRes[0] = h3dAddResource( H3DResTypes::Geometry, "ResourceLoadBenchmark0.geo", 0 );
+	geoRes[1] = h3dAddResource( H3DResTypes::Geometry, "ResourceLoadBenchmark1.geo", 0 );
+	texRes = h3dAddResource( H3DResTypes::Texture, "ResourceLoadBenchmark.tga", 0 );
+	bool wrongType = h3dLoadDecodedResource( texRes, decoded );
+	bool first = h3dLoadDecodedResource( geoRes[0], decoded );
+	bool second = h3dLoadDecodedResource( geoRes[1], decoded );
+	h3dFreeDecodedResourceData( decoded );
+
+	return !wrongType && first && !second && h3dGetResParamI( geoRes[0], H3DGeoRes::GeometryElem, 0,
+	                                                        H3DGeoRes::GeoVertexCountI ) > 0;
+}
+
+
+static unsigned int addChecksum( unsigned int checksum, const unsigned char *data, int size )
+{
+	for( int i = 0; i < size; ++i )
+		checksum = (checksum ^ data[i]) * 16777619u;
+	return checksum;
+}
+
+
+static unsigned int getGeometryChecksum( H3DRes res )
+{
+	int vertCount = h3dGetResParamI( res, H3DGeoRes::GeometryElem, 0, H3DGeoRes::GeoVertexCountI );
+	int indexCount = h3dGetResParamI( res, H3DGeoRes::GeometryElem, 0, H3DGeoRes::GeoIndexCountI );
+	int indexSize = h3dGetResParamI( res, H3DGeoRes::GeometryElem, 0, H3DGeoRes::GeoIndices16I ) ? 2 : 4;
+	
+	const int streams[4] = { H3DGeoRes::GeoIndexStream, H3DGeoRes::GeoVertPosStream,
+	                         H3DGeoRes::GeoVertTanStream, H3DGeoRes::GeoVertStaticStream };
+	const int sizes[4] = { indexCount * indexSize, vertCount * 3 * 4, vertCount * 7 * 4, vertCount * 12 * 4 };
+	
+	unsigned int checksum = 2166136261u;
+	for( int i = 0; i < 4; ++i )
+	{
+		const unsigned char *data = (const unsigned char *)h3dMapResStream(
+			res, H3DGeoRes::GeometryElem, 0, streams[i], true, false );
+		if( data == 0x0 ) continue;
+		checksum = addChecksum( checksum, data, sizes[i] );
+		h3dUnmapResStream( res );
+	}
+
+	return checksum;
+}
+
+
+static void getResourceStates( ResourceStates &states )
+{
+	states.clear();
+
+	H3DRes res = 0;
+	while( (res = h3dGetNextResource( H3DResTypes::Undefined, res )) != 0 )
+	{
+		ResourceState &state = states[h3dGetResName( res )];
+		state.loaded = h3dIsResLoaded( res );
+		state.checksum = 0;
+
+		if( !state.loaded ) continue;
+		if( h3dGetResType( res ) == H3DResTypes::Geometry )
+		{
+			state.checksum = getGeometryChecksum( res );
+			continue;
+		}
+		if( h3dGetResType( res ) != H3DResTypes::Texture ) continue;
+		int format = h3dGetResParamI( res, H3DTexRes::TextureElem, 0, H3DTexRes::TexFormatI );
+		if( format != H3DFormats::TEX_BGRA8 && format != H3DFormats::TEX_RGBA16F ) continue;
+		int width = h3dGetResParamI( res, H3DTexRes::ImageElem, 0, H3DTexRes::ImgWidthI );
+		int height = h3dGetResParamI( res, H3DTexRes::ImageElem, 0, H3DTexRes::ImgHeightI );
+		int bytesPerPixel = format == H3DFormats::TEX_BGRA8 ? 4 : 8;
+		const unsigned char *pixels = (const unsigned char *)h3dMapResStream(
+			res, H3DTexRes::ImageElem, 0, H3DTexRes::ImgPixelStream, true, false );
+		if( pixels == 0x0 ) continue;
+
+		state.checksum = addChecksum( 2166136261u, pixels, width * height * bytesPerPixel );
+		h3dUnmapResStream( res );
+	}
+}
+
+
+int main( int argc, char** argv )
+{
+	if( !createContext() )
+	{
+		printf( "Failed to create an OpenGL context with EGL\n" );
+		return 1;
+	}
+
+	std::string contentDir = extractAppPath( argv[0] ) + "../Content";
+	bool failed = false;
+	ResourceStates states[Method::Count];
+	Timer timer;
+
+	for( int method = 0; method < Method::Count; ++method )
+	{
+		double minTime = 1.0e30, sumTime = 0;
+		int polls = 0, resourceCount = 0;
+
+		for( int run = 0; run < numRuns; ++run )
+		{
+			if( !h3dInit() )
+			{
+				printMessages();
+				printf( "Failed to initialize the engine\n" );
+				return 1;
+			}
+			if( method == 0 && run == 0 )
+			{
+				printf( "%i runs, %i worker threads\n\n", numRuns, (int)h3dGetOption( H3DOptions::WorkerThreads ) );
+			}
+			h3dSetOption( H3DOptions::TexCompression, 0 );
+			addResources();
+
+			timer.reset();
+			timer.setEnabled( true );
+			bool result = true;
+			if( method == Method::Sequential )
+			{
+				result = loadSequential( contentDir );
+			}
+			else if( method == Method::Blocking )
+			{
+				result = h3dutLoadResourcesFromDisk( contentDir.c_str() );
+			}
+			else
+			{
+				h3dutStartLoadingResourcesFromDisk( contentDir.c_str() );
+				polls = 0;
+				while( h3dutPollResourceLoading( pollTimeMS, 0x0, &resourceCount ) < 1.0f )
+				{
+					usleep( pollIntervalUS );
+					++polls;
+				}
+				result = h3dutFinishLoadingResources();
+			}
+			timer.setEnabled( false );
+
+			double time = timer.getElapsedTimeMS();
+			minTime = std::min( minTime, time );
+			sumTime += time;
+			if( !result )
+			{
+				printf( "%s: at least one resource could not be loaded\n", methodNames[method] );
+				failed = true;
+			}
+
+			if( run + 1 == numRuns ) getResourceStates( states[method] );
+			printMessages();
+			h3dRelease();
+		}
+
+		printf( "%-28s %8.2f ms min  %8.2f ms mean", methodNames[method], minTime, sumTime / numRuns );
+		if( method == Method::Polling ) printf( "  %i polls for %i resources", polls + 1, resourceCount );
+		printf( "\n" );
+	}
+
+	bool same = true;
+	for( int method = 1; method < Method::Count; ++method )
+		same &= states[method] == states[0];
+	printf( "\n%i resources, %s\n", (int)states[0].size(), same ? "same resources, pixels and geometry" : "DIFFERENT" );
+	if( !same ) failed = true;
+
+	if( !h3dInit() ) return 1;
+	bool rejected = checkDecodedReload( contentDir );
+	h3dRelease();
+	printf( "Decoded data %s\n", rejected ? "is only loaded once" : "was loaded AGAIN" );
+	if( !rejected ) failed = true;
+
+	return failed ? 1 : 0;
+}
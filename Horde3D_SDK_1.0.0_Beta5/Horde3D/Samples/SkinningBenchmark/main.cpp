@@ -0,0 +1,145 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+// Measures the throughput of the software skinning kernels against the original loop that reads
+// float joint indices from the static vertex stream. No window or OpenGL context is required.
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include "egGeometry.h"
+#include "egSkinning.h"
+#include "utTimer.h"
+
+using namespace Horde3D;
+
+// Configuration
+const uint32 vertCount = 100000;
+const uint32 jointCount = 64;
+const int iterations = 50;
+
+
+static float randf()
+{
+	return (float)rand() / (float)RAND_MAX;
+}
+
+
+static float maxError( const Vec3f *a, const Vec3f *b, uint32 count, uint32 stride )
+{
+	float error = 0;
+	for( uint32 i = 0; i < count; ++i )
+	{
+		const Vec3f &va = *(const Vec3f *)((const char *)a + i * stride);
+		const Vec3f &vb = *(const Vec3f *)((const char *)b + i * stride);
+		error = std::max( error, (va - vb).length() );
+	}
+	return error;
+}
+
+
+int main( int argc, char** argv )
+{
+	srand( 1 );
+
+	// Random skeleton pose
+	Vec4f *jointRows = new Vec4f[jointCount * 3];
+	for( uint32 i = 0; i < jointCount; ++i )
+	{
+		Matrix4f mat = Matrix4f::TransMat( randf(), randf(), randf() ) *
+		               Matrix4f::RotMat( randf() * 6.28f, randf() * 6.28f, randf() * 6.28f );
+		for( uint32 j = 0; j < 3; ++j ) jointRows[i * 3 + j] = mat.getRow( j );
+	}
+
+	// Random mesh with four influences per vertex
+	Vec3f *basePos = new Vec3f[vertCount];
+	VertexDataTan *baseTan = new VertexDataTan[vertCount];
+	VertexDataStatic *staticData = new VertexDataStatic[vertCount];
+	VertexDataSkin *skinData = new VertexDataSkin[vertCount];
+	for( uint32 i = 0; i < vertCount; ++i )
+	{
+		basePos[i] = Vec3f( randf(), randf(), randf() );
+		baseTan[i].normal = Vec3f( randf(), randf(), randf() ).normalized();
+		baseTan[i].tangent = Vec3f( randf(), randf(), randf() ).normalized();
+		baseTan[i].handedness = 1;
+
+		float weightSum = 0;
+		for( uint32 j = 0; j < 4; ++j )
+		{
+			uint32 joint = rand() % jointCount;
+			float weight = randf();
+			staticData[i].jointVec[j] = (float)joint;
+			staticData[i].weightVec[j] = weight;
+			skinData[i].joints[j] = (uint16)joint;
+			weightSum += weight;
+		}
+		for( uint32 j = 0; j < 4; ++j )
+		{
+			staticData[i].weightVec[j] /= weightSum;
+			skinData[i].weights[j] = staticData[i].weightVec[j];
+		}
+	}
+
+	Vec3f *pos = new Vec3f[vertCount], *refPos = new Vec3f[vertCount];
+	VertexDataTan *tan = new VertexDataTan[vertCount], *refTan = new VertexDataTan[vertCount];
+
+	printf( "Skinning %u vertices with %u joints, %i iterations\n\n", vertCount, jointCount, iterations );
+
+	// Original loop
+	Timer timer;
+	for( int i = 0; i < iterations; ++i )
+	{
+		std::copy( basePos, basePos + vertCount, refPos );
+		std::copy( baseTan, baseTan + vertCount, refTan );
+		timer.setEnabled( true );
+		skinVerticesStatic( jointRows, staticData, refPos, refTan, vertCount );
+		timer.setEnabled( false );
+	}
+	double refVertsPerSec = (double)vertCount * iterations / (timer.getElapsedTimeMS() / 1000.0);
+	printf( "%-10s %8.2f MVerts/s\n", "original", refVertsPerSec / 1.0e6 );
+
+	for( int kernel = 0; kernel < SkinningKernels::Count; ++kernel )
+	{
+		SkinningFunc func = getSkinningFunc( kernel );
+		if( func == 0x0 ) continue;
+
+		timer.reset();
+		for( int i = 0; i < iterations; ++i )
+		{
+			std::copy( basePos, basePos + vertCount, pos );
+			std::copy( baseTan, baseTan + vertCount, tan );
+			timer.setEnabled( true );
+			func( jointRows, skinData, pos, tan, vertCount );
+			timer.setEnabled( false );
+		}
+		double vertsPerSec = (double)vertCount * iterations / (timer.getElapsedTimeMS() / 1000.0);
+
+		float error = std::max( maxError( pos, refPos, vertCount, sizeof( Vec3f ) ),
+		                        maxError( &tan[0].normal, &refTan[0].normal, vertCount, sizeof( VertexDataTan ) ) );
+		error = std::max( error, maxError( &tan[0].tangent, &refTan[0].tangent, vertCount, sizeof( VertexDataTan ) ) );
+
+		printf( "%-10s %8.2f MVerts/s  speedup %.2fx  max error %g%s\n", getSkinningKernelName( kernel ),
+		        vertsPerSec / 1.0e6, vertsPerSec / refVertsPerSec, error,
+		        kernel == getBestSkinningKernel() ? "  (selected)" : "" );
+	}
+
+	delete[] jointRows;
+	delete[] basePos; delete[] baseTan; delete[] staticData; delete[] skinData;
+	delete[] pos; delete[] refPos; delete[] tan; delete[] refTan;
+
+	return 0;
+}
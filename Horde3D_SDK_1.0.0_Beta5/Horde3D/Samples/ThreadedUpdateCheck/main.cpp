@@ -0,0 +1,248 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+//
+// Sample Application
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+//
+// This sample source file is not covered by the EPL as the rest of the SDK
+// and may be used without any restrictions. However, the EPL's disclaimer of
+// warranty and liability shall be in effect for this file.
+//
+// *************************************************************************************************
+
+
+// Checks that h3dRender draws from the snapshot that h3dEndFrame takes with the ThreadedUpdate option:
+// a scene with a hardware and a software skinned knight, a particle system in the hand of one of them
+// and a dot field is animated with the same seeds and steps once with immediate and once with
+// threaded updates. With threaded updates, a frame shows the scene as it was before the update of
+// the previous frame, so every threaded frame has to be identical to the previous immediate frame.
+// The immediate run first draws each animated frame with the knights in a different pose, so that
+// the skin palette has to be refreshed when they are animated again before the second h3dRender
+// call.
+// Both runs start in a new process, since the draw order of meshes with the same material depends
+// on the order in which nodes were added and removed before. The content directory can be passed
+// as argument (default: ../Content). The OpenGL context is created with EGL without a window like
+// in OcclusionCheck. Returns 0 if the check passes.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "Horde3D.h"
+#include "Horde3DUtils.h"
+
+// Configuration
+const int width = 320, height = 240;
+const int numFrames = 24;
+const float timeStep = 1.0f / 30.0f;
+const int imageSize = width * height * 4;
+
+static bool createContext()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+	EGLDisplay display = getPlatformDisplay != 0x0 ?
+		getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0x0 ) :
+		eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+	EGLint major, minor;
+	if( display == EGL_NO_DISPLAY || !eglInitialize( display, &major, &minor ) ) return false;
+	if( !eglBindAPI( EGL_OPENGL_API ) ) return false;
+
+	EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	                           EGL_DEPTH_SIZE, 24, EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if( !eglChooseConfig( display, configAttribs, &config, 1, &numConfigs ) || numConfigs == 0 ) return false;
+
+	EGLContext context = eglCreateContext( display, config, EGL_NO_CONTEXT, 0x0 );
+	if( context == EGL_NO_CONTEXT ) return false;
+
+	EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface( display, config, surfaceAttribs );
+	if( surface == EGL_NO_SURFACE ) return false;
+
+	return eglMakeCurrent( display, surface, surface, context ) == EGL_TRUE;
+}
+
+
+static void printMessages()
+{
+	int level;
+	float time;
+	const char *msg;
+	while( (msg = h3dGetMessage( &level, &time ))[0] != '\0' )
+	{
+		if( level <= 2 ) printf( "Engine: %s\n", msg );
+	}
+}
+
+
+
+static void animateKnights( H3DNode *knights, float time )
+{
+	for( int i = 0; i < 2; ++i )
+	{
+		h3dSetModelAnimParams( knights[i], 0, time * 24.0f, 1.0f );
+		h3dUpdateModel( knights[i], H3DModelUpdateFlags::Animation | H3DModelUpdateFlags::Geometry );
+	}
+}
+
+
+static bool runScene( const char *contentDir, bool threaded, float *images )
+{
+	if( !createContext() )
+	{
+		printf( "Failed to create an OpenGL context with EGL\n" );
+		return false;
+	}
+	if( !h3dInit() )
+	{
+		printMessages();
+		printf( "Failed to initialize the engine\n" );
+		return false;
+	}
+	h3dSetOption( H3DOptions::ThreadedUpdate, threaded ? 1.0f : 0.0f );
+
+	H3DRes pipeRes = h3dAddResource( H3DResTypes::Pipeline, "pipelines/forward.pipeline.xml", 0 );
+	H3DRes knightRes = h3dAddResource( H3DResTypes::SceneGraph, "models/knight/knight.scene.xml", 0 );
+	H3DRes animRes = h3dAddResource( H3DResTypes::Animation, "animations/knight_order.anim", 0 );
+	H3DRes particleSysRes = h3dAddResource( H3DResTypes::SceneGraph, "particles/particleSys1/particleSys1.scene.xml", 0 );
+	H3DRes dotMatRes = h3dAddResource( H3DResTypes::Material, "particles/particleSys1/particle1.material.xml", 0 );
+	if( !h3dutLoadResourcesFromDisk( contentDir ) )
+	{
+		printMessages();
+		printf( "Failed to load the content from %s\n", contentDir );
+		return false;
+	}
+
+	// The second knight is skinned on the CPU, so its vertex data is written by the background update
+	H3DNode knights[2];
+	for( int i = 0; i < 2; ++i )
+	{
+		knights[i] = h3dAddNodes( H3DRootNode, knightRes );
+		h3dSetNodeTransform( knights[i], i * 4.0f - 2.0f, 0, 0, 0, 180, 0, 0.1f, 0.1f, 0.1f );
+		h3dSetNodeParamI( knights[i], H3DModel::SWSkinningI, i );
+		h3dSetupModelAnimStage( knights[i], 0, animRes, 0, "", false );
+	}
+
+	h3dFindNodes( knights[0], "Bip01_R_Hand", H3DNodeTypes::Joint );
+	H3DNode particleSys = h3dAddNodes( h3dGetNodeFindResult( 0 ), particleSysRes );
+	h3dSetNodeTransform( particleSys, 0, 40, 0, 90, 0, 0, 1, 1, 1 );
+	std::vector< H3DNode > emitters( h3dFindNodes( particleSys, "", H3DNodeTypes::Emitter ) );
+	for( size_t i = 0; i < emitters.size(); ++i )
+	{
+		emitters[i] = h3dGetNodeFindResult( (int)i );
+		h3dSetNodeParamI( emitters[i], H3DEmitter::SeedI, (int)i + 1 );
+	}
+
+	H3DNode dotField = h3dAddDotFieldNode( H3DRootNode, "Dots", dotMatRes, 2000 );
+	h3dSetNodeTransform( dotField, 0, 3, -2, 0, 0, 0, 4, 2, 1 );
+	h3dSetNodeParamI( dotField, H3DDotField::SeedI, 7 );
+	h3dSetNodeParamI( dotField, H3DDotField::NoiseTypeI, 1 );
+	h3dSetNodeParamF( dotField, H3DDotField::CoherenceF, 0, 0.5f );
+	h3dSetNodeParamF( dotField, H3DDotField::DotSizeF, 0, 0.05f );
+
+	H3DNode light = h3dAddLightNode( H3DRootNode, "Light", 0, "LIGHTING", "SHADOWMAP" );
+	h3dSetNodeTransform( light, 0, 15, 10, -60, 0, 0, 1, 1, 1 );
+	h3dSetNodeParamF( light, H3DLight::RadiusF, 0, 30 );
+	h3dSetNodeParamF( light, H3DLight::FovF, 0, 90 );
+	h3dSetNodeParamI( light, H3DLight::ShadowMapCountI, 1 );
+
+	H3DNode cam = h3dAddCameraNode( H3DRootNode, "Camera", pipeRes );
+	h3dSetNodeTransform( cam, 0, 3, 9, -5, 0, 0, 1, 1, 1 );
+	h3dSetNodeParamI( cam, H3DCamera::ViewportWidthI, width );
+	h3dSetNodeParamI( cam, H3DCamera::ViewportHeightI, height );
+	h3dSetupCameraView( cam, 45.0f, (float)width / height, 0.1f, 1000.0f );
+
+	for( int frame = 0; frame < numFrames; ++frame )
+	{
+		h3dBeginFrame();
+		if( !threaded && frame > 0 )
+		{
+			animateKnights( knights, (frame + numFrames) * timeStep );
+			h3dRender( cam );
+			animateKnights( knights, frame * timeStep );
+		}
+		h3dRender( cam );
+		h3dFinalizeFrame();
+
+		// Waits for the background update, which has run while the frame was rendered
+		h3dGetRenderTargetData( 0, 0x0, 0, 0x0, 0x0, 0x0, images + frame * imageSize,
+		                        imageSize * (int)sizeof( float ) );
+
+		animateKnights( knights, (frame + 1) * timeStep );
+		for( size_t i = 0; i < emitters.size(); ++i ) h3dUpdateEmitter( emitters[i], timeStep );
+		h3dUpdateDotField( dotField, timeStep );
+		h3dEndFrame();
+	}
+
+	printMessages();
+	h3dRelease();
+	return true;
+}
+
+
+static bool equalImages( const float *a, const float *b )
+{
+	return memcmp( a, b, imageSize * sizeof( float ) ) == 0;
+}
+
+
+int main( int argc, char** argv )
+{
+	const char *contentDir = argc > 1 ? argv[1] : "../Content";
+
+	// The images of both runs are written to memory that is shared with the child process
+	size_t bufferSize = 2 * numFrames * imageSize * sizeof( float );
+	void *buffer = mmap( 0x0, bufferSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+	if( buffer == MAP_FAILED ) return 1;
+	float *immediate = (float *)buffer, *threaded = immediate + numFrames * imageSize;
+
+	for( int run = 0; run < 2; ++run )
+	{
+		pid_t pid = fork();
+		if( pid == 0 ) _exit( runScene( contentDir, run == 1, run == 1 ? threaded : immediate ) ? 0 : 1 );
+		
+		int status = 1;
+		if( pid < 0 || waitpid( pid, &status, 0 ) != pid || !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+		{
+			printf( "%s run failed\n", run == 1 ? "Threaded" : "Immediate" );
+			return 1;
+		}
+	}
+
+	// No update has been submitted before the first frame, so it is the same in both runs
+	int failures = 0, moving = 0;
+	for( int frame = 0; frame < numFrames; ++frame )
+	{
+		const float *expected = immediate + (frame > 0 ? frame - 1 : 0) * imageSize;
+		const float *image = immediate + frame * imageSize;
+		if( frame > 0 && !equalImages( image, image - imageSize ) ) ++moving;
+		if( !equalImages( threaded + frame * imageSize, expected ) )
+		{
+			printf( "frame %2d: threaded frame differs from immediate frame %d  FAILED\n",
+			        frame, frame > 0 ? frame - 1 : 0 );
+			++failures;
+		}
+	}
+
+	printf( "%d frames, the scene changed in %d of them\n", numFrames, moving );
+	if( moving < numFrames - 1 )
+	{
+		printf( "The scene did not change in every frame\n" );
+		return 1;
+	}
+	printf( failures == 0 ? "Threaded frames are rendered from the snapshot\n" :
+	                        "Threaded frames differ from the snapshot\n" );
+	return failures == 0 ? 0 : 1;
+}
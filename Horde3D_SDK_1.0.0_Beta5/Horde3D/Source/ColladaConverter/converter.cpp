@@ -19,6 +19,7 @@
 #include "converter.h"
 #include "optimizer.h"
 #include "utPlatform.h"
+#include "utAnimCompression.h"
 #include <fstream>
 #include <sstream>
 #include <iomanip>
@@ -890,8 +891,9 @@ bool Converter::writeGeometry( const string &assetPath, const string &assetName
 	fwrite( &count, sizeof( int ), 1, f );
 
 	// Write default identity matrix
+	Matrix4f identity;
 	for( unsigned int j = 0; j < 16; ++j )
-		fwrite( &Matrix4f().x[j], sizeof( float ), 1, f );
+		fwrite( &identity.x[j], sizeof( float ), 1, f );
 
 	for( unsigned int i = 0; i < _joints.size(); ++i )
 	{
@@ -1376,7 +1378,48 @@ void Converter::writeAnimFrames( SceneNode &node, FILE *f )
 }
 
 
-bool Converter::writeAnimation( const string &assetPath, const string &assetName )
+void Converter::writeAnimKeyTracks( SceneNode &node, FILE *f )
+{
+	fwrite( &node.name, 256, 1, f );
+
+	vector< Quaternion > rotQuats( node.frames.size() );
+	vector< Vec3f > transVecs( node.frames.size() ), scaleVecs( node.frames.size() );
+	for( size_t i = 0; i < node.frames.size(); ++i )
+	{
+		Vec3f rotVec;
+		node.frames[i].decompose( transVecs[i], rotVec, scaleVecs[i] );
+		rotQuats[i] = Quaternion( rotVec.x, rotVec.y, rotVec.z );
+	}
+
+	AnimKeyTrack< PackedQuaternion > rotTrack;
+	AnimKeyTrack< Vec3f > transTrack, scaleTrack;
+	compressKeyTrack( rotQuats, AnimCompression::DefaultRotTolerance, rotTrack );
+	compressKeyTrack( transVecs, AnimCompression::DefaultTransTolerance, transTrack );
+	compressKeyTrack( scaleVecs, AnimCompression::DefaultScaleTolerance, scaleTrack );
+
+	unsigned int numKeys = (unsigned int)rotTrack.keys.size();
+	fwrite( &numKeys, sizeof( int ), 1, f );
+	fwrite( &rotTrack.keyFrames[0], sizeof( int ), numKeys, f );
+	for( unsigned int i = 0; i < numKeys; ++i )
+		fwrite( rotTrack.keys[i].v, sizeof( short ), 3, f );
+
+	AnimKeyTrack< Vec3f > *vecTracks[2] = { &transTrack, &scaleTrack };
+	for( unsigned int i = 0; i < 2; ++i )
+	{
+		numKeys = (unsigned int)vecTracks[i]->keys.size();
+		fwrite( &numKeys, sizeof( int ), 1, f );
+		fwrite( &vecTracks[i]->keyFrames[0], sizeof( int ), numKeys, f );
+		for( unsigned int j = 0; j < numKeys; ++j )
+		{
+			fwrite( &vecTracks[i]->keys[j].x, sizeof( float ), 1, f );
+			fwrite( &vecTracks[i]->keys[j].y, sizeof( float ), 1, f );
+			fwrite( &vecTracks[i]->keys[j].z, sizeof( float ), 1, f );
+		}
+	}
+}
+
+
+bool Converter::writeAnimation( const string &assetPath, const string &assetName, bool compress )
 {
 	FILE *f = fopen( (_outPath + assetPath + assetName + ".anim").c_str(), "wb" );
 	if( f == 0x0 )
@@ -1386,7 +1429,7 @@ bool Converter::writeAnimation( const string &assetPath, const string &assetName
 	}
 
 	// Write header
-	unsigned int version = 3;
+	unsigned int version = compress ? 4 : 3;
 	fwrite( "H3DA", 4, 1, f );
 	fwrite( &version, sizeof( int ), 1, f );
 	
@@ -1403,14 +1446,16 @@ bool Converter::writeAnimation( const string &assetPath, const string &assetName
 	{
 		if( _joints[i]->frames.size() == 0 ) continue;
 		
-		writeAnimFrames( *_joints[i], f );
+		if( compress ) writeAnimKeyTracks( *_joints[i], f );
+		else writeAnimFrames( *_joints[i], f );
 	}
 
 	for( unsigned int i = 0; i < _meshes.size(); ++i )
 	{
 		if( _meshes[i]->frames.size() == 0 ) continue;
 		
-		writeAnimFrames( *_meshes[i], f );
+		if( compress ) writeAnimKeyTracks( *_meshes[i], f );
+		else writeAnimFrames( *_meshes[i], f );
 	}
 	
 	fclose( f );
@@ -150,7 +150,7 @@ public:
 	bool writeModel( const std::string &assetPath, const std::string &assetName, const std::string &modelName );
 	bool writeMaterials( const std::string &assetPath, const std::string &modelName, bool replace );
 	bool hasAnimation();
-	bool writeAnimation( const std::string &assetPath, const std::string &assetName );
+	bool writeAnimation( const std::string &assetPath, const std::string &assetName, bool compress );
 
 private:
 	Matrix4f getNodeTransform( DaeNode &node, unsigned int frame );
@@ -166,6 +166,7 @@ private:
 	void writeSGNode( const std::string &assetPath, const std::string &modelName, SceneNode *node, unsigned int depth, std::ofstream &outf );
 	bool writeSceneGraph( const std::string &assetPath, const std::string &assetName, const std::string &modelName );
 	void writeAnimFrames( SceneNode &node, FILE *f );
+	void writeAnimKeyTracks( SceneNode &node, FILE *f );
 
 private:
 	ColladaDocument              &_daeDoc;
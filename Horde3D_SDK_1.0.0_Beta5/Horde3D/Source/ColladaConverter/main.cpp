@@ -125,6 +125,7 @@ void printHelp()
 	log( "-noGeoOpt         disable geometry optimization" );
 	log( "-overwriteMats    force update of existing materials" );
 	log( "-addModelName     adds model name before material name" );
+	log( "-compressAnim     store animations as quantized and reduced key tracks" );
 	log( "-lodDist1 dist    distance for LOD1" );
 	log( "-lodDist2 dist    distance for LOD2" );
 	log( "-lodDist3 dist    distance for LOD3" );
@@ -150,7 +151,7 @@ int main( int argc, char **argv )
 	vector< string > assetList;
 	string input = argv[1], basePath = "./", outPath = "./";
 	AssetTypes::List assetType = AssetTypes::Model;
-	bool geoOpt = true, overwriteMats = false, addModelName = false;
+	bool geoOpt = true, overwriteMats = false, addModelName = false, compressAnim = false;
 	float lodDists[4] = { 10, 20, 40, 80 };
 	string modelName = "";	
 
@@ -204,6 +205,10 @@ int main( int argc, char **argv )
 		{
 			addModelName = true;
 		}
+		else if( _stricmp( arg.c_str(), "-compressAnim" ) == 0 )
+		{
+			compressAnim = true;
+		}
 		else
 		{
 			log( std::string( "Invalid arguments: '" ) + arg.c_str() + std::string( "'" ) );
@@ -290,7 +295,7 @@ int main( int argc, char **argv )
 				if( converter->hasAnimation() )
 				{
 					createDirectories( outPath, assetPath );
-					converter->writeAnimation( assetPath, assetName );
+					converter->writeAnimation( assetPath, assetName, compressAnim );
 				}
 				else
 				{
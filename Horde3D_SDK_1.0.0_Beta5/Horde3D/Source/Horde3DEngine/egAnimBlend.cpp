@@ -0,0 +1,394 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egAnimBlend.h"
+#include "utSIMD.h"
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+// Rotations are blended with normalized linear interpolation along the shortest path, like
+// Quaternion::nlerp; translation and scale are interpolated linearly
+
+// =================================================================================================
+// Scalar kernels
+// =================================================================================================
+
+static inline void blendNodeScalar( float *pose, const float *pose1, float t, uint32 stride, uint32 i )
+{
+	float *p = pose + i;
+	const float *p1 = pose1 + i;
+
+	float dot = 0;
+	for( uint32 c = 0; c < 4; ++c ) dot += p[c * stride] * p1[c * stride];
+	float sign = dot < 0 ? -1.0f : 1.0f;
+
+	float q[4], len2 = 0;
+	for( uint32 c = 0; c < 4; ++c )
+	{
+		q[c] = p[c * stride] + (p1[c * stride] * sign - p[c * stride]) * t;
+		len2 += q[c] * q[c];
+	}
+	float invLen = 1.0f / sqrtf( len2 );
+	for( uint32 c = 0; c < 4; ++c ) p[c * stride] = q[c] * invLen;
+
+	for( uint32 c = AnimPoseChannels::TransX; c < AnimPoseChannels::Count; ++c )
+		p[c * stride] += (p1[c * stride] - p[c * stride]) * t;
+}
+
+
+static void interpolatePosesScalar( float *pose, const float *pose1, float amount, uint32 stride )
+{
+	for( uint32 i = 0; i < stride; ++i )
+		blendNodeScalar( pose, pose1, amount, stride, i );
+}
+
+
+static void blendPosesScalar( float *destPose, const float *pose, const float *weights, uint32 stride )
+{
+	for( uint32 i = 0; i < stride; ++i )
+	{
+		if( weights[i] > 0 ) blendNodeScalar( destPose, pose, weights[i], stride, i );
+	}
+}
+
+
+static void composePosesScalar( const float *pose, uint32 stride, Matrix4f **dest )
+{
+	for( uint32 i = 0; i < stride; ++i )
+	{
+		if( dest[i] == 0x0 ) continue;
+
+		float x = pose[AnimPoseChannels::RotX * stride + i], y = pose[AnimPoseChannels::RotY * stride + i];
+		float z = pose[AnimPoseChannels::RotZ * stride + i], w = pose[AnimPoseChannels::RotW * stride + i];
+		float sx = pose[AnimPoseChannels::ScaleX * stride + i];
+		float sy = pose[AnimPoseChannels::ScaleY * stride + i];
+		float sz = pose[AnimPoseChannels::ScaleZ * stride + i];
+
+		float x2 = x + x, y2 = y + y, z2 = z + z;
+		float xx = x * x2,  xy = x * y2,  xz = x * z2;
+		float yy = y * y2,  yz = y * z2,  zz = z * z2;
+		float wx = w * x2,  wy = w * y2,  wz = w * z2;
+
+		Matrix4f &m = *dest[i];
+		m.c[0][0] = (1 - (yy + zz)) * sx;  m.c[0][1] = (xy + wz) * sx;  m.c[0][2] = (xz - wy) * sx;
+		m.c[1][0] = (xy - wz) * sy;  m.c[1][1] = (1 - (xx + zz)) * sy;  m.c[1][2] = (yz + wx) * sy;
+		m.c[2][0] = (xz + wy) * sz;  m.c[2][1] = (yz - wx) * sz;  m.c[2][2] = (1 - (xx + yy)) * sz;
+		m.c[3][0] = pose[AnimPoseChannels::TransX * stride + i];
+		m.c[3][1] = pose[AnimPoseChannels::TransY * stride + i];
+		m.c[3][2] = pose[AnimPoseChannels::TransZ * stride + i];
+		m.c[0][3] = 0; m.c[1][3] = 0; m.c[2][3] = 0; m.c[3][3] = 1;
+	}
+}
+
+
+static const AnimBlendFuncs animBlendFuncsScalar =
+	{ interpolatePosesScalar, blendPosesScalar, composePosesScalar };
+
+
+// =================================================================================================
+// SSE2 kernels
+// =================================================================================================
+
+#if defined( SIMD_SSE2 )
+
+SIMD_SSE2_FUNC static inline __m128 selectSSE2( __m128 mask, __m128 a, __m128 b )
+{
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+
+SIMD_SSE2_FUNC static inline void blendBatchSSE2( float *pose, const float *pose1, __m128 t, __m128 mask,
+                                                  uint32 stride, uint32 i )
+{
+	__m128 q[4], q1[4];
+	for( uint32 c = 0; c < 4; ++c )
+	{
+		q[c] = _mm_loadu_ps( pose + c * stride + i );
+		q1[c] = _mm_loadu_ps( pose1 + c * stride + i );
+	}
+
+	__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( q[0], q1[0] ), _mm_mul_ps( q[1], q1[1] ) ),
+	                         _mm_add_ps( _mm_mul_ps( q[2], q1[2] ), _mm_mul_ps( q[3], q1[3] ) ) );
+	__m128 sign = _mm_and_ps( _mm_cmplt_ps( dot, _mm_setzero_ps() ), _mm_set1_ps( -0.0f ) );
+
+	__m128 r[4], len2 = _mm_setzero_ps();
+	for( uint32 c = 0; c < 4; ++c )
+	{
+		r[c] = _mm_add_ps( q[c], _mm_mul_ps( _mm_sub_ps( _mm_xor_ps( q1[c], sign ), q[c] ), t ) );
+		len2 = _mm_add_ps( len2, _mm_mul_ps( r[c], r[c] ) );
+	}
+	__m128 invLen = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( len2 ) );
+	for( uint32 c = 0; c < 4; ++c )
+		_mm_storeu_ps( pose + c * stride + i, selectSSE2( mask, _mm_mul_ps( r[c], invLen ), q[c] ) );
+
+	for( uint32 c = AnimPoseChannels::TransX; c < AnimPoseChannels::Count; ++c )
+	{
+		__m128 v = _mm_loadu_ps( pose + c * stride + i );
+		__m128 v1 = _mm_loadu_ps( pose1 + c * stride + i );
+		_mm_storeu_ps( pose + c * stride + i, selectSSE2( mask, _mm_add_ps( v, _mm_mul_ps( _mm_sub_ps( v1, v ), t ) ), v ) );
+	}
+}
+
+
+SIMD_SSE2_FUNC static void interpolatePosesSSE2( float *pose, const float *pose1, float amount, uint32 stride )
+{
+	__m128 t = _mm_set1_ps( amount );
+	__m128 mask = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+	for( uint32 i = 0; i < stride; i += 4 )
+		blendBatchSSE2( pose, pose1, t, mask, stride, i );
+}
+
+
+SIMD_SSE2_FUNC static void blendPosesSSE2( float *destPose, const float *pose, const float *weights, uint32 stride )
+{
+	for( uint32 i = 0; i < stride; i += 4 )
+	{
+		__m128 t = _mm_loadu_ps( weights + i );
+		__m128 mask = _mm_cmpgt_ps( t, _mm_setzero_ps() );
+		if( _mm_movemask_ps( mask ) == 0 ) continue;
+		blendBatchSSE2( destPose, pose, t, mask, stride, i );
+	}
+}
+
+
+SIMD_SSE2_FUNC static void composePosesSSE2( const float *pose, uint32 stride, Matrix4f **dest )
+{
+	__m128 one = _mm_set1_ps( 1.0f );
+
+	for( uint32 i = 0; i < stride; i += 4 )
+	{
+		if( dest[i] == 0x0 && dest[i + 1] == 0x0 && dest[i + 2] == 0x0 && dest[i + 3] == 0x0 ) continue;
+
+		__m128 x = _mm_loadu_ps( pose + AnimPoseChannels::RotX * stride + i );
+		__m128 y = _mm_loadu_ps( pose + AnimPoseChannels::RotY * stride + i );
+		__m128 z = _mm_loadu_ps( pose + AnimPoseChannels::RotZ * stride + i );
+		__m128 w = _mm_loadu_ps( pose + AnimPoseChannels::RotW * stride + i );
+		__m128 sx = _mm_loadu_ps( pose + AnimPoseChannels::ScaleX * stride + i );
+		__m128 sy = _mm_loadu_ps( pose + AnimPoseChannels::ScaleY * stride + i );
+		__m128 sz = _mm_loadu_ps( pose + AnimPoseChannels::ScaleZ * stride + i );
+
+		__m128 x2 = _mm_add_ps( x, x ), y2 = _mm_add_ps( y, y ), z2 = _mm_add_ps( z, z );
+		__m128 xx = _mm_mul_ps( x, x2 ), xy = _mm_mul_ps( x, y2 ), xz = _mm_mul_ps( x, z2 );
+		__m128 yy = _mm_mul_ps( y, y2 ), yz = _mm_mul_ps( y, z2 ), zz = _mm_mul_ps( z, z2 );
+		__m128 wx = _mm_mul_ps( w, x2 ), wy = _mm_mul_ps( w, y2 ), wz = _mm_mul_ps( w, z2 );
+
+		// Columns of all four matrices, transposed so that each register holds one column of one node
+		__m128 c0[4] = { _mm_mul_ps( _mm_sub_ps( one, _mm_add_ps( yy, zz ) ), sx ),
+		                 _mm_mul_ps( _mm_add_ps( xy, wz ), sx ), _mm_mul_ps( _mm_sub_ps( xz, wy ), sx ),
+		                 _mm_setzero_ps() };
+		__m128 c1[4] = { _mm_mul_ps( _mm_sub_ps( xy, wz ), sy ),
+		                 _mm_mul_ps( _mm_sub_ps( one, _mm_add_ps( xx, zz ) ), sy ),
+		                 _mm_mul_ps( _mm_add_ps( yz, wx ), sy ), _mm_setzero_ps() };
+		__m128 c2[4] = { _mm_mul_ps( _mm_add_ps( xz, wy ), sz ), _mm_mul_ps( _mm_sub_ps( yz, wx ), sz ),
+		                 _mm_mul_ps( _mm_sub_ps( one, _mm_add_ps( xx, yy ) ), sz ), _mm_setzero_ps() };
+		__m128 c3[4] = { _mm_loadu_ps( pose + AnimPoseChannels::TransX * stride + i ),
+		                 _mm_loadu_ps( pose + AnimPoseChannels::TransY * stride + i ),
+		                 _mm_loadu_ps( pose + AnimPoseChannels::TransZ * stride + i ), one };
+		_MM_TRANSPOSE4_PS( c0[0], c0[1], c0[2], c0[3] );
+		_MM_TRANSPOSE4_PS( c1[0], c1[1], c1[2], c1[3] );
+		_MM_TRANSPOSE4_PS( c2[0], c2[1], c2[2], c2[3] );
+		_MM_TRANSPOSE4_PS( c3[0], c3[1], c3[2], c3[3] );
+
+		for( uint32 k = 0; k < 4; ++k )
+		{
+			if( dest[i + k] == 0x0 ) continue;
+			_mm_storeu_ps( dest[i + k]->c[0], c0[k] );
+			_mm_storeu_ps( dest[i + k]->c[1], c1[k] );
+			_mm_storeu_ps( dest[i + k]->c[2], c2[k] );
+			_mm_storeu_ps( dest[i + k]->c[3], c3[k] );
+		}
+	}
+}
+
+
+static const AnimBlendFuncs animBlendFuncsSSE2 =
+	{ interpolatePosesSSE2, blendPosesSSE2, composePosesSSE2 };
+
+#endif
+
+
+// =================================================================================================
+// NEON kernels
+// =================================================================================================
+
+#if defined( SIMD_NEON )
+
+static inline void blendBatchNEON( float *pose, const float *pose1, float32x4_t t, uint32x4_t mask,
+                                   uint32 stride, uint32 i )
+{
+	float32x4_t q[4], q1[4];
+	for( uint32 c = 0; c < 4; ++c )
+	{
+		q[c] = vld1q_f32( pose + c * stride + i );
+		q1[c] = vld1q_f32( pose1 + c * stride + i );
+	}
+
+	float32x4_t dot = vmulq_f32( q[0], q1[0] );
+	for( uint32 c = 1; c < 4; ++c ) dot = vmlaq_f32( dot, q[c], q1[c] );
+	uint32x4_t sign = vandq_u32( vcltq_f32( dot, vdupq_n_f32( 0 ) ), vdupq_n_u32( 0x80000000 ) );
+
+	float32x4_t r[4], len2 = vdupq_n_f32( 0 );
+	for( uint32 c = 0; c < 4; ++c )
+	{
+		float32x4_t flipped = vreinterpretq_f32_u32( veorq_u32( vreinterpretq_u32_f32( q1[c] ), sign ) );
+		r[c] = vmlaq_f32( q[c], vsubq_f32( flipped, q[c] ), t );
+		len2 = vmlaq_f32( len2, r[c], r[c] );
+	}
+
+	// Reciprocal square root estimate refined by two Newton-Raphson steps
+	float32x4_t invLen = vrsqrteq_f32( len2 );
+	invLen = vmulq_f32( invLen, vrsqrtsq_f32( vmulq_f32( len2, invLen ), invLen ) );
+	invLen = vmulq_f32( invLen, vrsqrtsq_f32( vmulq_f32( len2, invLen ), invLen ) );
+	for( uint32 c = 0; c < 4; ++c )
+		vst1q_f32( pose + c * stride + i, vbslq_f32( mask, vmulq_f32( r[c], invLen ), q[c] ) );
+
+	for( uint32 c = AnimPoseChannels::TransX; c < AnimPoseChannels::Count; ++c )
+	{
+		float32x4_t v = vld1q_f32( pose + c * stride + i );
+		float32x4_t v1 = vld1q_f32( pose1 + c * stride + i );
+		vst1q_f32( pose + c * stride + i, vbslq_f32( mask, vmlaq_f32( v, vsubq_f32( v1, v ), t ), v ) );
+	}
+}
+
+
+static void interpolatePosesNEON( float *pose, const float *pose1, float amount, uint32 stride )
+{
+	float32x4_t t = vdupq_n_f32( amount );
+	uint32x4_t mask = vdupq_n_u32( 0xFFFFFFFF );
+	for( uint32 i = 0; i < stride; i += 4 )
+		blendBatchNEON( pose, pose1, t, mask, stride, i );
+}
+
+
+static void blendPosesNEON( float *destPose, const float *pose, const float *weights, uint32 stride )
+{
+	for( uint32 i = 0; i < stride; i += 4 )
+	{
+		if( weights[i] <= 0 && weights[i + 1] <= 0 && weights[i + 2] <= 0 && weights[i + 3] <= 0 ) continue;
+		float32x4_t t = vld1q_f32( weights + i );
+		blendBatchNEON( destPose, pose, t, vcgtq_f32( t, vdupq_n_f32( 0 ) ), stride, i );
+	}
+}
+
+
+static void composePosesNEON( const float *pose, uint32 stride, Matrix4f **dest )
+{
+	float32x4_t one = vdupq_n_f32( 1.0f );
+	float cols[12][4];
+
+	for( uint32 i = 0; i < stride; i += 4 )
+	{
+		if( dest[i] == 0x0 && dest[i + 1] == 0x0 && dest[i + 2] == 0x0 && dest[i + 3] == 0x0 ) continue;
+
+		float32x4_t x = vld1q_f32( pose + AnimPoseChannels::RotX * stride + i );
+		float32x4_t y = vld1q_f32( pose + AnimPoseChannels::RotY * stride + i );
+		float32x4_t z = vld1q_f32( pose + AnimPoseChannels::RotZ * stride + i );
+		float32x4_t w = vld1q_f32( pose + AnimPoseChannels::RotW * stride + i );
+		float32x4_t sx = vld1q_f32( pose + AnimPoseChannels::ScaleX * stride + i );
+		float32x4_t sy = vld1q_f32( pose + AnimPoseChannels::ScaleY * stride + i );
+		float32x4_t sz = vld1q_f32( pose + AnimPoseChannels::ScaleZ * stride + i );
+
+		float32x4_t x2 = vaddq_f32( x, x ), y2 = vaddq_f32( y, y ), z2 = vaddq_f32( z, z );
+		float32x4_t xx = vmulq_f32( x, x2 ), xy = vmulq_f32( x, y2 ), xz = vmulq_f32( x, z2 );
+		float32x4_t yy = vmulq_f32( y, y2 ), yz = vmulq_f32( y, z2 ), zz = vmulq_f32( z, z2 );
+		float32x4_t wx = vmulq_f32( w, x2 ), wy = vmulq_f32( w, y2 ), wz = vmulq_f32( w, z2 );
+
+		vst1q_f32( cols[0], vmulq_f32( vsubq_f32( one, vaddq_f32( yy, zz ) ), sx ) );
+		vst1q_f32( cols[1], vmulq_f32( vaddq_f32( xy, wz ), sx ) );
+		vst1q_f32( cols[2], vmulq_f32( vsubq_f32( xz, wy ), sx ) );
+		vst1q_f32( cols[3], vmulq_f32( vsubq_f32( xy, wz ), sy ) );
+		vst1q_f32( cols[4], vmulq_f32( vsubq_f32( one, vaddq_f32( xx, zz ) ), sy ) );
+		vst1q_f32( cols[5], vmulq_f32( vaddq_f32( yz, wx ), sy ) );
+		vst1q_f32( cols[6], vmulq_f32( vaddq_f32( xz, wy ), sz ) );
+		vst1q_f32( cols[7], vmulq_f32( vsubq_f32( yz, wx ), sz ) );
+		vst1q_f32( cols[8], vmulq_f32( vsubq_f32( one, vaddq_f32( xx, yy ) ), sz ) );
+		vst1q_f32( cols[9], vld1q_f32( pose + AnimPoseChannels::TransX * stride + i ) );
+		vst1q_f32( cols[10], vld1q_f32( pose + AnimPoseChannels::TransY * stride + i ) );
+		vst1q_f32( cols[11], vld1q_f32( pose + AnimPoseChannels::TransZ * stride + i ) );
+
+		for( uint32 k = 0; k < 4; ++k )
+		{
+			if( dest[i + k] == 0x0 ) continue;
+
+			Matrix4f &m = *dest[i + k];
+			for( uint32 j = 0; j < 4; ++j )
+			{
+				m.c[j][0] = cols[j * 3][k];
+				m.c[j][1] = cols[j * 3 + 1][k];
+				m.c[j][2] = cols[j * 3 + 2][k];
+				m.c[j][3] = j < 3 ? 0.0f : 1.0f;
+			}
+		}
+	}
+}
+
+
+static const AnimBlendFuncs animBlendFuncsNEON =
+	{ interpolatePosesNEON, blendPosesNEON, composePosesNEON };
+
+#endif
+
+
+// =================================================================================================
+// Kernel selection
+// =================================================================================================
+
+const AnimBlendFuncs *getAnimBlendFuncs( int kernel )
+{
+	switch( kernel )
+	{
+	case AnimBlendKernels::Scalar:
+		return &animBlendFuncsScalar;
+#if defined( SIMD_SSE2 )
+	case AnimBlendKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? &animBlendFuncsSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case AnimBlendKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? &animBlendFuncsNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+int getBestAnimBlendKernel()
+{
+	for( int i = AnimBlendKernels::Count - 1; i > AnimBlendKernels::Scalar; --i )
+	{
+		if( getAnimBlendFuncs( i ) != 0x0 ) return i;
+	}
+
+	return AnimBlendKernels::Scalar;
+}
+
+
+const char *getAnimBlendKernelName( int kernel )
+{
+	switch( kernel )
+	{
+	case AnimBlendKernels::Scalar:
+		return "scalar";
+	case AnimBlendKernels::SSE2:
+		return "SSE2";
+	case AnimBlendKernels::NEON:
+		return "NEON";
+	default:
+		return "unknown";
+	}
+}
+
+}  // namespace
@@ -0,0 +1,77 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egAnimBlend_H_
+#define _egAnimBlend_H_
+
+#include "egPrerequisites.h"
+#include "utMath.h"
+
+
+namespace Horde3D {
+
+// =================================================================================================
+// Pose Blending
+// =================================================================================================
+
+// Poses of all nodes of an animation controller are stored as structure of arrays: each channel
+// is an array of stride floats, where stride is the node count rounded up to a multiple of
+// AnimPoseBatchSize so that the kernels can always process full batches
+struct AnimPoseChannels
+{
+	enum List
+	{
+		RotX = 0,
+		RotY,
+		RotZ,
+		RotW,
+		TransX,
+		TransY,
+		TransZ,
+		ScaleX,
+		ScaleY,
+		ScaleZ,
+		Count
+	};
+};
+
+const uint32 AnimPoseBatchSize = 4;
+
+struct AnimBlendKernels
+{
+	enum List
+	{
+		Scalar = 0,
+		SSE2,
+		NEON,
+		Count
+	};
+};
+
+struct AnimBlendFuncs
+{
+	// Interpolates pose towards pose1 by amount
+	void (*interpolate)( float *pose, const float *pose1, float amount, uint32 stride );
+	// Interpolates destPose towards pose by the per-node weights; nodes with a weight of 0 are
+	// left untouched, even if pose holds invalid data for them
+	void (*blend)( float *destPose, const float *pose, const float *weights, uint32 stride );
+	// Builds translation * rotation * scale matrices; nodes with a NULL destination are skipped
+	void (*compose)( const float *pose, uint32 stride, Matrix4f **dest );
+};
+
+// Returns 0x0 if the kernels were not compiled in or are not supported by the CPU
+const AnimBlendFuncs *getAnimBlendFuncs( int kernel );
+int getBestAnimBlendKernel();
+const char *getAnimBlendKernelName( int kernel );
+
+}
+#endif // _egAnimBlend_H_
@@ -195,17 +195,17 @@ bool MeshNode::checkIntersection( const Vec3f &rayOrig, const Vec3f &rayDir, Vec
 	{
 		Vec3f *vert0, *vert1, *vert2;
 		
-		if( geoRes->_16BitIndices )
+		if( geoRes->has16BitIndices() )
 		{
-			vert0 = &geoRes->getVertPosData()[((uint16 *)geoRes->_indexData)[i + 0]];
-			vert1 = &geoRes->getVertPosData()[((uint16 *)geoRes->_indexData)[i + 1]];
-			vert2 = &geoRes->getVertPosData()[((uint16 *)geoRes->_indexData)[i + 2]];
+			vert0 = &geoRes->getVertPosData()[((uint16 *)geoRes->getIndexData())[i + 0]];
+			vert1 = &geoRes->getVertPosData()[((uint16 *)geoRes->getIndexData())[i + 1]];
+			vert2 = &geoRes->getVertPosData()[((uint16 *)geoRes->getIndexData())[i + 2]];
 		}
 		else
 		{
-			vert0 = &geoRes->getVertPosData()[((uint32 *)geoRes->_indexData)[i + 0]];
-			vert1 = &geoRes->getVertPosData()[((uint32 *)geoRes->_indexData)[i + 1]];
-			vert2 = &geoRes->getVertPosData()[((uint32 *)geoRes->_indexData)[i + 2]];
+			vert0 = &geoRes->getVertPosData()[((uint32 *)geoRes->getIndexData())[i + 0]];
+			vert1 = &geoRes->getVertPosData()[((uint32 *)geoRes->getIndexData())[i + 1]];
+			vert2 = &geoRes->getVertPosData()[((uint32 *)geoRes->getIndexData())[i + 2]];
 		}
 		
 		if( rayTriangleIntersection( orig, dir, *vert0, *vert1, *vert2, intsPos ) )
@@ -319,7 +319,7 @@ int JointNode::getParamI( int param )
 
 void JointNode::onPostUpdate()
 {
-	if( _parentModel->getGeometryResource() == 0x0 ) return;
+	if( _parentModel->getGeometryResource() == 0x0 || _parentModel->hasCachedJointMats() ) return;
 	
 	if( _parent->getType() != SceneNodeTypes::Joint )
 		_relModelMat = _relTrans;
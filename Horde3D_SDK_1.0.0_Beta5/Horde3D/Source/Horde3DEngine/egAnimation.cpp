@@ -11,8 +11,10 @@
 // *************************************************************************************************
 
 #include "egAnimation.h"
+#include "egAnimBlend.h"
 #include "egModules.h"
 #include "egCom.h"
+#include "utThreading.h"
 #include <cstring>
 #include <algorithm>
 
@@ -28,8 +30,12 @@ using namespace std;
 // Animation Resource
 // =================================================================================================
 
+// Guards the retargeting caches of all animations since models can be updated on worker threads
+static Mutex entityMapMutex;
+
+
 AnimationResource::AnimationResource( const string &name, int flags ) :
-	Resource( ResourceTypes::Animation, name, flags )
+	Resource( ResourceTypes::Animation, name, flags ), _entityMapStamp( 0 )
 {
 	initDefault();	
 }
@@ -46,6 +52,7 @@ Resource *AnimationResource::clone()
 	AnimationResource *res = new AnimationResource( "", _flags );
 
 	*res = *this;
+	res->_entityMaps.clear();  // Maps point to the entities of the original
 	
 	return res;
 }
@@ -59,6 +66,10 @@ void AnimationResource::initDefault()
 
 void AnimationResource::release()
 {
+	ScopedLock lock( entityMapMutex );
+	_entityMaps.clear();
+	++_entityMapStamp;
+	
 	_entities.clear();
 }
 
@@ -75,6 +86,101 @@ bool AnimationResource::raiseError( const string &msg )
 }
 
 
+static void bakeFrame( Frame &frame )
+{
+	frame.bakedTransMat = Matrix4f::ScaleMat( frame.scaleVec.x, frame.scaleVec.y, frame.scaleVec.z );
+	frame.bakedTransMat = Matrix4f( frame.rotQuat ) * frame.bakedTransMat;
+	frame.bakedTransMat.translate( frame.transVec.x, frame.transVec.y, frame.transVec.z );
+}
+
+
+void AnimationResource::compressEntity( AnimResEntity &entity )
+{
+	if( entity.frames.size() < 2 ) return;
+	
+	vector< Quaternion > rotQuats( entity.frames.size() );
+	vector< Vec3f > transVecs( entity.frames.size() ), scaleVecs( entity.frames.size() );
+	for( size_t i = 0; i < entity.frames.size(); ++i )
+	{
+		rotQuats[i] = entity.frames[i].rotQuat;
+		transVecs[i] = entity.frames[i].transVec;
+		scaleVecs[i] = entity.frames[i].scaleVec;
+	}
+
+	compressKeyTrack( rotQuats, AnimCompression::DefaultRotTolerance, entity.rotTrack );
+	compressKeyTrack( transVecs, AnimCompression::DefaultTransTolerance, entity.transTrack );
+	compressKeyTrack( scaleVecs, AnimCompression::DefaultScaleTolerance, entity.scaleTrack );
+
+	// Free frame memory
+	vector< Frame >().swap( entity.frames );
+}
+
+
+static void calcEntityBounds( AnimResEntity &entity )
+{
+	// Interpolated values lie between two frames or keys, so the bounds of these are sufficient
+	entity.maxTransLen = 0;
+	entity.maxScale = 0;
+	for( size_t i = 0, s = entity.frames.size(); i < s; ++i )
+	{
+		const Frame &frame = entity.frames[i];
+		entity.maxTransLen = maxf( entity.maxTransLen, frame.transVec.length() );
+		entity.maxScale = maxf( entity.maxScale, maxf( fabsf( frame.scaleVec.x ),
+			maxf( fabsf( frame.scaleVec.y ), fabsf( frame.scaleVec.z ) ) ) );
+	}
+	for( size_t i = 0, s = entity.transTrack.keys.size(); i < s; ++i )
+		entity.maxTransLen = maxf( entity.maxTransLen, entity.transTrack.keys[i].length() );
+	for( size_t i = 0, s = entity.scaleTrack.keys.size(); i < s; ++i )
+	{
+		const Vec3f &scaleVec = entity.scaleTrack.keys[i];
+		entity.maxScale = maxf( entity.maxScale, maxf( fabsf( scaleVec.x ),
+			maxf( fabsf( scaleVec.y ), fabsf( scaleVec.z ) ) ) );
+	}
+}
+
+
+static void readKeyValue( const char *pData, PackedQuaternion &value )
+{
+	memcpy( &value, pData, sizeof( PackedQuaternion ) );
+}
+
+
+static void readKeyValue( const char *pData, Vec3f &value )
+{
+	float v[3];
+	memcpy( v, pData, 3 * sizeof( float ) );
+	value = Vec3f( v[0], v[1], v[2] );
+}
+
+
+template< class T > static bool readKeyTrack( char *&pData, const char *dataEnd, uint32 numFrames,
+                                              uint32 valueSize, AnimKeyTrack< T > &track )
+{
+	uint32 numKeys;
+	if( pData + sizeof( uint32 ) > dataEnd ) return false;
+	memcpy( &numKeys, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+	if( numKeys == 0 || numKeys > numFrames ) return false;
+	if( pData + numKeys * (sizeof( uint32 ) + valueSize) > dataEnd ) return false;
+	
+	track.keyFrames.resize( numKeys );
+	track.keys.resize( numKeys );
+	memcpy( &track.keyFrames[0], pData, numKeys * sizeof( uint32 ) ); pData += numKeys * sizeof( uint32 );
+	for( uint32 i = 0; i < numKeys; ++i )
+	{
+		readKeyValue( pData, track.keys[i] ); pData += valueSize;
+	}
+
+	// Sampling relies on ascending key frames starting at the first frame
+	if( track.keyFrames[0] != 0 || track.keyFrames[numKeys - 1] >= numFrames ) return false;
+	for( uint32 i = 1; i < numKeys; ++i )
+	{
+		if( track.keyFrames[i] <= track.keyFrames[i - 1] ) return false;
+	}
+
+	return true;
+}
+
+
 struct AnimEntCompFunc  // Functor for std::sort (can't be nested directly in function)
 {
 	bool operator()( const AnimResEntity &a, const AnimResEntity &b ) const
@@ -99,7 +205,7 @@ bool AnimationResource::load( const char *data, int size )
 	
 	uint32 version;
 	memcpy( &version, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-	if( version != 2 && version != 3 )
+	if( version != 2 && version != 3 && version != 4 )
 		return raiseError( "Unsupported version of animation resource" );
 	
 	// Load animation data
@@ -117,6 +223,26 @@ bool AnimationResource::load( const char *data, int size )
 		memcpy( name, pData, 256 ); pData += 256;
 		entity.nameId = AnimationController::hashName( name );
 		
+		// Quantized key tracks
+		if( version == 4 )
+		{
+			const char *dataEnd = data + size;
+			if( !readKeyTrack( pData, dataEnd, _numFrames, sizeof( PackedQuaternion ), entity.rotTrack ) ||
+			    !readKeyTrack( pData, dataEnd, _numFrames, 3 * sizeof( float ), entity.transTrack ) ||
+			    !readKeyTrack( pData, dataEnd, _numFrames, 3 * sizeof( float ), entity.scaleTrack ) )
+			{
+				return raiseError( "Invalid key track in animation resource" );
+			}
+			
+			entity.frameCount = _numFrames;
+			Frame &frame = entity.firstFrame;
+			entity.sampleKeyTracks( 0, frame.rotQuat, frame.transVec, frame.scaleVec );
+			bakeFrame( frame );
+			entity.firstFrameInvTrans = frame.bakedTransMat.inverted();
+			calcEntityBounds( entity );
+			continue;
+		}
+		
 		// Animation compression
 		if( version == 3 )
 		{
@@ -142,13 +268,18 @@ bool AnimationResource::load( const char *data, int size )
 			memcpy( &frame.scaleVec.z, pData, sizeof( float ) ); pData += sizeof( float );
 
 			// Prebake transformation matrix for fast animation path
-			frame.bakedTransMat.scale( frame.scaleVec.x, frame.scaleVec.y, frame.scaleVec.z );
-			frame.bakedTransMat = Matrix4f( frame.rotQuat ) * frame.bakedTransMat;
-			frame.bakedTransMat.translate( frame.transVec.x, frame.transVec.y, frame.transVec.z );
+			bakeFrame( frame );
 		}
 
+		entity.frameCount = (uint32)entity.frames.size();
 		if( !entity.frames.empty() )
+		{
+			entity.firstFrame = entity.frames[0];
 			entity.firstFrameInvTrans = entity.frames[0].bakedTransMat.inverted();
+		}
+		calcEntityBounds( entity );
+
+		if( Modules::config().animCompression ) compressEntity( entity );
 	}
 
 	// Sort entities by name id
@@ -203,10 +334,132 @@ AnimResEntity *AnimationResource::findEntity( uint32 nameId )
 }
 
 
+const AnimEntityMap *AnimationResource::getEntityMap( uint32 hierarchyHash, const vector< uint32 > &nameIds,
+                                                      const vector< int > &parents, uint32 startNodeNameId )
+{
+	ScopedLock lock( entityMapMutex );
+	
+	for( list< AnimEntityMap >::iterator itr = _entityMaps.begin(); itr != _entityMaps.end(); ++itr )
+	{
+		if( itr->hierarchyHash == hierarchyHash && itr->startNodeNameId == startNodeNameId &&
+		    itr->nameIds == nameIds && itr->parents == parents )
+		{
+			return &(*itr);
+		}
+	}
+
+	_entityMaps.push_back( AnimEntityMap() );
+	AnimEntityMap &entityMap = _entityMaps.back();
+	entityMap.hierarchyHash = hierarchyHash;
+	entityMap.nameIds = nameIds;
+	entityMap.parents = parents;
+	entityMap.startNodeNameId = startNodeNameId;
+	entityMap.entities.resize( nameIds.size(), 0x0 );
+
+	// Animation mask: only the start node and its descendants are animated; parents are always
+	// stored before their children, so the flag of the parent is already known
+	vector< char > included( nameIds.size(), 0 );
+	for( size_t i = 0, s = nameIds.size(); i < s; ++i )
+	{
+		included[i] = startNodeNameId == 0 || nameIds[i] == startNodeNameId ||
+		              (parents[i] >= 0 && included[parents[i]] != 0);
+		if( included[i] ) entityMap.entities[i] = findEntity( nameIds[i] );
+	}
+
+	return &entityMap;
+}
+
+
+// =================================================================================================
+// Pose Cache
+// =================================================================================================
+
+AnimPoseCache::AnimPoseCache() :
+	_hitCount( 0 ), _missCount( 0 )
+{
+}
+
+
+uint32 AnimPoseCache::hashKey( const vector< uint32 > &key )
+{
+	// FNV-1a over the key words
+	uint32 hash = 2166136261u;
+	for( size_t i = 0, s = key.size(); i < s; ++i )
+	{
+		hash ^= key[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+const AnimPoseCacheEntry *AnimPoseCache::find( const vector< uint32 > &key )
+{
+	uint32 hash = hashKey( key );
+	ScopedLock lock( _mutex );
+
+	pair< multimap< uint32, AnimPoseCacheEntry >::iterator, multimap< uint32, AnimPoseCacheEntry >::iterator >
+		range = _entries.equal_range( hash );
+	for( multimap< uint32, AnimPoseCacheEntry >::iterator itr = range.first; itr != range.second; ++itr )
+	{
+		if( itr->second.key == key )
+		{
+			++_hitCount;
+			return &itr->second;
+		}
+	}
+
+	++_missCount;
+	return 0x0;
+}
+
+
+void AnimPoseCache::insert( AnimPoseCacheEntry &entry )
+{
+	uint32 hash = hashKey( entry.key );
+	ScopedLock lock( _mutex );
+
+	// Another model may have evaluated the same pose in the meantime
+	pair< multimap< uint32, AnimPoseCacheEntry >::iterator, multimap< uint32, AnimPoseCacheEntry >::iterator >
+		range = _entries.equal_range( hash );
+	for( multimap< uint32, AnimPoseCacheEntry >::iterator itr = range.first; itr != range.second; ++itr )
+	{
+		if( itr->second.key == entry.key ) return;
+	}
+
+	// Swap the data in to avoid copying the matrices
+	multimap< uint32, AnimPoseCacheEntry >::iterator itr =
+		_entries.insert( make_pair( hash, AnimPoseCacheEntry() ) );
+	itr->second.key.swap( entry.key );
+	itr->second.animatedNodes.swap( entry.animatedNodes );
+	itr->second.relTrans.swap( entry.relTrans );
+	itr->second.jointMats.swap( entry.jointMats );
+	itr->second.skinMatRows.swap( entry.skinMatRows );
+}
+
+
+void AnimPoseCache::clear()
+{
+	ScopedLock lock( _mutex );
+
+	_entries.clear();
+	
+	Modules::stats().incStat( EngineStats::PoseCacheHitCount, (float)_hitCount );
+	Modules::stats().incStat( EngineStats::PoseCacheMissCount, (float)_missCount );
+	_hitCount = 0;
+	_missCount = 0;
+}
+
+
 // =================================================================================================
 // Animation Controller
 // =================================================================================================
 
+const AnimBlendFuncs *AnimationController::blendFuncs = getAnimBlendFuncs( AnimBlendKernels::Scalar );
+AnimPoseCache AnimationController::poseCache;
+
+
 // TODO: Verify that name collisions are very unlikely
 uint32 AnimationController::hashName( const char *name )
 {
@@ -221,7 +474,7 @@ uint32 AnimationController::hashName( const char *name )
 
 
 AnimationController::AnimationController() :
-	_dirty( false )
+	_hierarchyHash( 0 ), _dirty( false ), _mapDirty( false )
 {
 	_animStages.resize( MaxNumAnimStages );
 	_activeStages.reserve( MaxNumAnimStages );
@@ -236,65 +489,67 @@ AnimationController::~AnimationController()
 void AnimationController::clearNodeList()
 {
 	_nodeList.clear();
+	_nodeNameIds.clear();
+	_nodeParents.clear();
+	_hierarchyHash = 0;
+	_mapDirty = true;
 }
 
 
 void AnimationController::registerNode( IAnimatableNode *node )
 {
-	AnimCtrlNode ctrlNode;
-	ctrlNode.node = node;
-
-	_nodeList.push_back( ctrlNode );
-
-	for( uint32 i = 0; i < _animStages.size(); ++i )
+	// Nodes are registered in depth-first order, so the parent is found among the previous nodes
+	int parent = -1;
+	IAnimatableNode *parentNode = node->getANParent();
+	for( int i = (int)_nodeList.size() - 1; i >= 0 && parentNode != 0x0; --i )
 	{
-		mapAnimRes( (uint32)_nodeList.size() - 1, i );
+		if( _nodeList[i] == parentNode )
+		{
+			parent = i;
+			break;
+		}
 	}
+	
+	uint32 nameId = hashName( node->getANName().c_str() );
+	_nodeList.push_back( node );
+	_nodeNameIds.push_back( nameId );
+	_nodeParents.push_back( parent );
+	_hierarchyHash = (_hierarchyHash * 31 + nameId) * 31 + (uint32)(parent + 1);
+
+	// Stages are mapped again once the complete list is known
+	_mapDirty = true;
+	_dirty = true;
 }
 
 
-void AnimationController::mapAnimRes( uint32 node, uint32 stage )
+void AnimationController::mapAnimRes( uint32 stage )
 {
-	static std::string maskStart, maskEnd;
+	AnimStage &curStage = _animStages[stage];
 	
 	_dirty = true;
 	
-	AnimationResource *animRes = _animStages[stage].anim;
-	if( animRes == 0x0 )
-	{	
-		_nodeList[node].animEntities[stage] = 0x0;
+	if( curStage.anim == 0x0 )
+	{
+		curStage.entityMap = 0x0;
 		return;
 	}
 
-	// Animation mask
-	bool includeNode = true;
+	curStage.entityMap = curStage.anim->getEntityMap( _hierarchyHash, _nodeNameIds, _nodeParents,
+	                                                  curStage.startNodeNameId );
+	curStage.entityMapStamp = curStage.anim->getEntityMapStamp();
+}
 
-	if( _animStages[stage].startNodeNameId != 0 )
-	{
-		includeNode = false;
-		
-		IAnimatableNode *animNode = _nodeList[node].node;
-		while( animNode != 0x0 )
-		{
-			if( hashName( animNode->getANName().c_str() ) == _animStages[stage].startNodeNameId )
-			{
-				includeNode = true;
-				break;
-			}
-			animNode = animNode->getANParent();
-		}
-	}
-	
-	// Find node in animation resource if not masked out
-	if( includeNode )
-	{
-		uint32 nameId = hashName( _nodeList[node].node->getANName().c_str() );
-		_nodeList[node].animEntities[stage] = animRes->findEntity( nameId );
-	}
-	else
+
+void AnimationController::updateStageMaps()
+{
+	// Remap stages if nodes were registered or an animation was reloaded
+	for( size_t i = 0, s = _activeStages.size(); i < s; ++i )
 	{
-		_nodeList[node].animEntities[stage] = 0x0;
+		const AnimStage &curStage = _animStages[_activeStages[i]];
+		if( _mapDirty || curStage.entityMapStamp != curStage.anim->getEntityMapStamp() )
+			mapAnimRes( _activeStages[i] );
 	}
+	_mapDirty = false;
 }
 
 
@@ -348,8 +603,7 @@ bool AnimationController::setupAnimStage( int stage, AnimationResource *anim, in
 	curStage.startNodeNameId = hashName( startNode.c_str() );
 	curStage.additive = additive;
 
-	for( size_t i = 0, s = _nodeList.size(); i < s; ++i )
-		mapAnimRes( (uint32)i, stage );
+	mapAnimRes( stage );
 
 	updateActiveList();
 	return setAnimParams( stage, 0.0f, 1.0f );
@@ -376,150 +630,351 @@ bool AnimationController::setAnimParams( int stage, float time, float weight )
 }
 
 
+static inline void storePose( float *pose, uint32 stride, uint32 i, const Quaternion &rotQuat,
+                              const Vec3f &transVec, const Vec3f &scaleVec )
+{
+	pose[AnimPoseChannels::RotX * stride + i] = rotQuat.x;
+	pose[AnimPoseChannels::RotY * stride + i] = rotQuat.y;
+	pose[AnimPoseChannels::RotZ * stride + i] = rotQuat.z;
+	pose[AnimPoseChannels::RotW * stride + i] = rotQuat.w;
+	pose[AnimPoseChannels::TransX * stride + i] = transVec.x;
+	pose[AnimPoseChannels::TransY * stride + i] = transVec.y;
+	pose[AnimPoseChannels::TransZ * stride + i] = transVec.z;
+	pose[AnimPoseChannels::ScaleX * stride + i] = scaleVec.x;
+	pose[AnimPoseChannels::ScaleY * stride + i] = scaleVec.y;
+	pose[AnimPoseChannels::ScaleZ * stride + i] = scaleVec.z;
+}
+
+
+static inline void loadPose( const float *pose, uint32 stride, uint32 i, Quaternion &rotQuat,
+                             Vec3f &transVec, Vec3f &scaleVec )
+{
+	rotQuat = Quaternion( pose[AnimPoseChannels::RotX * stride + i], pose[AnimPoseChannels::RotY * stride + i],
+	                      pose[AnimPoseChannels::RotZ * stride + i], pose[AnimPoseChannels::RotW * stride + i] );
+	transVec = Vec3f( pose[AnimPoseChannels::TransX * stride + i], pose[AnimPoseChannels::TransY * stride + i],
+	                  pose[AnimPoseChannels::TransZ * stride + i] );
+	scaleVec = Vec3f( pose[AnimPoseChannels::ScaleX * stride + i], pose[AnimPoseChannels::ScaleY * stride + i],
+	                  pose[AnimPoseChannels::ScaleZ * stride + i] );
+}
+
+
 bool AnimationController::animate()
 {
 	if( !_dirty || _activeStages.empty() ) return false;
 
-	Quaternion nodeRotQuat;
-	Vec3f nodeTransVec, nodeScaleVec;
-	
-	Timer *timer = Modules::stats().getTimer( EngineStats::AnimationTime );
-	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
-	
-	// Animate
-	for( size_t i = 0, si = _nodeList.size(); i < si; ++i )
+	updateStageMaps();
+
+	// Note: Time stats are gathered by the caller since this may run on a worker thread
+
+	uint32 numNodes = (uint32)_nodeList.size();
+	uint32 stride = (numNodes + AnimPoseBatchSize - 1) / AnimPoseBatchSize * AnimPoseBatchSize;
+	_animatedNodes.assign( numNodes, 0 );
+	if( stride == 0 )
 	{
-		// Fast path
-		if( Modules::config().fastAnimation && _activeStages.size() == 1 )
+		_dirty = false;
+		return true;
+	}
+
+	// Scratch layout: blended node poses, stage samples, samples of next frames, per-node blend
+	// weights and flags of nodes that received animation data
+	_poseData.resize( stride * (AnimPoseChannels::Count * 3 + 2) );
+	_transRefs.resize( stride );
+	float *nodePose = &_poseData[0];
+	float *samplePose = nodePose + AnimPoseChannels::Count * stride;
+	float *nextPose = samplePose + AnimPoseChannels::Count * stride;
+	float *weights = nextPose + AnimPoseChannels::Count * stride;
+	float *nodeUpdated = weights + stride;
+	bool interpolate = !Modules::config().fastAnimation;
+
+	// Fast path
+	if( Modules::config().fastAnimation && _activeStages.size() == 1 )
+	{
+		uint32 firstStage = _activeStages[0];
+		uint32 frame = (uint32)ftoi_t( _animStages[firstStage].animTime );
+		bool composeNeeded = false;
+
+		for( uint32 i = 0; i < stride; ++i )
 		{
-			uint32 firstStage = _activeStages[0];
-			AnimResEntity *animEnt = _nodeList[i].animEntities[firstStage];
-			if( animEnt != 0x0 && !animEnt->frames.empty() )
+			_transRefs[i] = 0x0;
+			AnimResEntity *animEnt = i < numNodes ? _animStages[firstStage].entityMap->entities[i] : 0x0;
+			if( animEnt == 0x0 || animEnt->frameCount == 0 ) continue;
+
+			_animatedNodes[i] = 1;
+			uint32 f = animEnt->frameCount > 1 ? frame % animEnt->frameCount : 0;  // Animation compression
+			if( !animEnt->isCompressed() )
 			{
-				uint32 frame = (uint32)ftoi_t( _animStages[firstStage].animTime ) % animEnt->frames.size();
-				if( animEnt->frames.size() == 1 ) frame = 0;  // Animation compression
-				_nodeList[i].node->getANRelTransRef() = animEnt->frames[frame].bakedTransMat;
+				_nodeList[i]->getANRelTransRef() = animEnt->frames[f].bakedTransMat;
+			}
+			else
+			{
+				Quaternion rotQuat;
+				Vec3f transVec, scaleVec;
+				animEnt->sampleKeyTracks( (float)f, rotQuat, transVec, scaleVec );
+				storePose( samplePose, stride, i, rotQuat, transVec, scaleVec );
+				_transRefs[i] = &_nodeList[i]->getANRelTransRef();
+				composeNeeded = true;
 			}
-			continue;
 		}
 
-		// Standard path
-		bool nodeUpdated = false;
-		float layerWeightSum = 0.0f, remainingWeight = 1.0f;
-		int prevLayer = 0;
+		if( composeNeeded ) blendFuncs->compose( samplePose, stride, &_transRefs[0] );
 
-		for( size_t j = 0, sj = _activeStages.size(); j < sj; ++j )
-		{
-			uint32 stageIdx = _activeStages[j];
-			const AnimStage &curStage = _animStages[stageIdx];
+		_dirty = false;
+		return true;
+	}
+
+	// Standard path: reset all nodes to the identity pose
+	for( uint32 c = 0; c < AnimPoseChannels::Count; ++c )
+	{
+		float value = (c == AnimPoseChannels::RotW || c >= AnimPoseChannels::ScaleX) ? 1.0f : 0.0f;
+		std::fill( nodePose + c * stride, nodePose + (c + 1) * stride, value );
+	}
+	std::fill( nodeUpdated, nodeUpdated + stride, 0.0f );
 
-			// Check if layer has changed
-			if( j == 0 || curStage.layer != prevLayer )
+	float layerWeightSum = 0.0f, remainingWeight = 1.0f;
+	int prevLayer = 0;
+
+	for( size_t j = 0, sj = _activeStages.size(); j < sj; ++j )
+	{
+		uint32 stageIdx = _activeStages[j];
+		const AnimStage &curStage = _animStages[stageIdx];
+
+		// Check if layer has changed
+		if( j == 0 || curStage.layer != prevLayer )
+		{
+			remainingWeight *= 1.0f - minf( layerWeightSum, 1.0f );
+			
+			// Find layer weight sum
+			layerWeightSum = curStage.weight;
+			for( size_t k = j + 1, sk = _activeStages.size(); k < sk; ++k )
 			{
-				remainingWeight *= 1.0f - minf( layerWeightSum, 1.0f );
-				
-				// Find layer weight sum
-				layerWeightSum = curStage.weight;
-				for( size_t k = j + 1, sk = _activeStages.size(); k < sk; ++k )
-				{
-					if( _animStages[_activeStages[k]].layer == curStage.layer )
-						layerWeightSum += _animStages[_activeStages[k]].weight;
-					else
-						break;
-				}
-				
-				prevLayer = curStage.layer;
+				if( _animStages[_activeStages[k]].layer == curStage.layer )
+					layerWeightSum += _animStages[_activeStages[k]].weight;
+				else
+					break;
 			}
 			
-			AnimResEntity *animEnt = _nodeList[i].animEntities[stageIdx];
-			if( animEnt == 0x0 || layerWeightSum < Math::Epsilon ) continue;
-			
-			uint32 numFrames = (uint32)animEnt->frames.size();
-			if( numFrames > 0 )
+			prevLayer = curStage.layer;
+		}
+
+		if( layerWeightSum < Math::Epsilon ) continue;
+
+		// Normalize weight and apply to remaining weight
+		float weight = (curStage.weight / layerWeightSum) * remainingWeight;
+		uint32 frame = ftoi_t( curStage.animTime );
+		float amount = curStage.animTime - frame;
+
+		// Sample all entities of the stage into the SoA arrays
+		bool stageUsed = false;
+		for( uint32 i = 0; i < stride; ++i )
+		{
+			weights[i] = 0;
+			AnimResEntity *animEnt = i < numNodes ? curStage.entityMap->entities[i] : 0x0;
+			if( animEnt == 0x0 || animEnt->frameCount == 0 ) continue;
+
+			// Find frames
+			uint32 numFrames = animEnt->frameCount;
+			uint32 f0 = frame % numFrames;
+			uint32 f1 = f0 + 1;
+			if( f1 > numFrames - 1 ) f1 = numFrames - 1;
+			if( numFrames == 1 ) f0 = f1 = 0;	// Animation compression
+
+			if( !animEnt->isCompressed() )
 			{
-				// Normalize weight and apply to remaining weight
-				float weight = (curStage.weight / layerWeightSum) * remainingWeight;
-
-				// Find frames
-				uint32 f0 = ftoi_t( curStage.animTime );
-				float amount = curStage.animTime - f0;
-				f0 = f0 % numFrames;
-				uint32 f1 = f0 + 1;
-				if( f1 > numFrames - 1 ) f1 = numFrames - 1;
-				if( numFrames == 1 ) f0 = f1 = 0;	// Animation compression
-
-				// Assign data of first frame
-				Frame &frame0 = animEnt->frames[f0];
-				Vec3f transVec( frame0.transVec );
-				Vec3f scaleVec( frame0.scaleVec );
-				Quaternion rotQuat( frame0.rotQuat );
-
-				// Inter-frame interpolation
-				if( !Modules::config().fastAnimation )
+				const Frame &frame0 = animEnt->frames[f0];
+				storePose( samplePose, stride, i, frame0.rotQuat, frame0.transVec, frame0.scaleVec );
+				if( interpolate )
 				{
-					Frame &frame1 = animEnt->frames[f1];
-					transVec = transVec.lerp( frame1.transVec, amount );
-					scaleVec = scaleVec.lerp( frame1.scaleVec, amount );
-					rotQuat = rotQuat.nlerp( frame1.rotQuat, amount );
+					const Frame &frame1 = animEnt->frames[f1];
+					storePose( nextPose, stride, i, frame1.rotQuat, frame1.transVec, frame1.scaleVec );
 				}
+			}
+			else
+			{
+				// Key tracks are piecewise linear, so they can be sampled between frames directly
+				Quaternion rotQuat;
+				Vec3f transVec, scaleVec;
+				animEnt->sampleKeyTracks( interpolate && f1 != f0 ? f0 + amount : (float)f0,
+				                          rotQuat, transVec, scaleVec );
+				storePose( samplePose, stride, i, rotQuat, transVec, scaleVec );
+				if( interpolate ) storePose( nextPose, stride, i, rotQuat, transVec, scaleVec );
+			}
 
-				if( curStage.additive )
-				{
-					// Additive animations are only applied if there is some other animation before
-					if( nodeUpdated )
-					{
-						// Add the difference to the first frame of the animation
-						Frame &firstFrame = animEnt->frames[0];
-						float w = curStage.weight;
-
-						Quaternion fullRotQuat = nodeRotQuat * (firstFrame.rotQuat.inverted() * rotQuat);
-						nodeRotQuat = nodeRotQuat.nlerp( fullRotQuat, w );
-						nodeTransVec += (transVec - firstFrame.transVec) * w;
-						Vec3f fullScaleVec( nodeScaleVec.x * (scaleVec.x / firstFrame.scaleVec.x),
-						                    nodeScaleVec.y * (scaleVec.y / firstFrame.scaleVec.y),
-						                    nodeScaleVec.z * (scaleVec.z / firstFrame.scaleVec.z) );
-						nodeScaleVec = nodeScaleVec.lerp( fullScaleVec, w );
-					}
-				}
-				else
-				{
-					if( !nodeUpdated )
-					{
-						nodeRotQuat = rotQuat;
-						nodeTransVec = transVec;
-						nodeScaleVec = scaleVec;
-					}
-					else
-					{
-						// Interpolate between current state and animation
-						nodeRotQuat = nodeRotQuat.nlerp( rotQuat, weight );
-						nodeTransVec = nodeTransVec.lerp( transVec, weight );
-						nodeScaleVec = nodeScaleVec.lerp( scaleVec, weight );
-					}
-				}
+			// The first animation of a node is taken over completely
+			weights[i] = nodeUpdated[i] != 0 ? weight : 1.0f;
+			stageUsed = true;
+		}
+		if( !stageUsed ) continue;
 
-				nodeUpdated = true;
+		// Inter-frame interpolation
+		if( interpolate ) blendFuncs->interpolate( samplePose, nextPose, amount, stride );
+
+		if( !curStage.additive )
+		{
+			// Interpolate between current state and animation
+			blendFuncs->blend( nodePose, samplePose, weights, stride );
+			for( uint32 i = 0; i < numNodes; ++i )
+			{
+				if( weights[i] > 0 ) nodeUpdated[i] = 1.0f;
 			}
 		}
-
-		// Build matrix from animation data
-		if( nodeUpdated )
+		else
 		{
-			Matrix4f mat( Math::NO_INIT );
-			Matrix4f::fastMult43( mat, Matrix4f( nodeRotQuat ),
-				Matrix4f::ScaleMat( nodeScaleVec.x, nodeScaleVec.y, nodeScaleVec.z ) );
-			Matrix4f::fastMult43( _nodeList[i].node->getANRelTransRef(),
-				Matrix4f::TransMat( nodeTransVec.x, nodeTransVec.y, nodeTransVec.z ), mat );
+			// Additive animations are only applied if there is some other animation before
+			float w = curStage.weight;
+			for( uint32 i = 0; i < numNodes; ++i )
+			{
+				if( weights[i] <= 0 || nodeUpdated[i] == 0 ) continue;
+
+				Quaternion rotQuat, nodeRotQuat;
+				Vec3f transVec, scaleVec, nodeTransVec, nodeScaleVec;
+				loadPose( samplePose, stride, i, rotQuat, transVec, scaleVec );
+				loadPose( nodePose, stride, i, nodeRotQuat, nodeTransVec, nodeScaleVec );
+				
+				// Add the difference to the first frame of the animation
+				const Frame &firstFrame = curStage.entityMap->entities[i]->firstFrame;
+				Quaternion fullRotQuat = nodeRotQuat * (firstFrame.rotQuat.inverted() * rotQuat);
+				nodeRotQuat = nodeRotQuat.nlerp( fullRotQuat, w );
+				nodeTransVec += (transVec - firstFrame.transVec) * w;
+				Vec3f fullScaleVec( nodeScaleVec.x * (scaleVec.x / firstFrame.scaleVec.x),
+				                    nodeScaleVec.y * (scaleVec.y / firstFrame.scaleVec.y),
+				                    nodeScaleVec.z * (scaleVec.z / firstFrame.scaleVec.z) );
+				nodeScaleVec = nodeScaleVec.lerp( fullScaleVec, w );
+
+				storePose( nodePose, stride, i, nodeRotQuat, nodeTransVec, nodeScaleVec );
+			}
 		}
 	}
 
-	timer->setEnabled( false );
+	// Build matrices from animation data
+	for( uint32 i = 0; i < stride; ++i )
+		_transRefs[i] = i < numNodes && nodeUpdated[i] != 0 ? &_nodeList[i]->getANRelTransRef() : 0x0;
+	for( uint32 i = 0; i < numNodes; ++i )
+		_animatedNodes[i] = nodeUpdated[i] != 0 ? 1 : 0;
+	blendFuncs->compose( nodePose, stride, &_transRefs[0] );
 
 	_dirty = false;
 	return true;
 }
 
 
+bool AnimationController::predictNodeBounds( vector< float > &reach, vector< float > &scale )
+{
+	// Computes for each node an upper bound of the distance to the model origin and of the accumulated
+	// scale that holds for any time and weight of the current stages. Blended translations and scales
+	// are convex combinations of the sampled ones, so the per-entity bounds of the clips apply.
+	// Additive stages can push nodes beyond these bounds, so no prediction is made for them.
+	for( size_t i = 0, s = _activeStages.size(); i < s; ++i )
+	{
+		if( _animStages[_activeStages[i]].additive ) return false;
+	}
+	updateStageMaps();
+	
+	uint32 numNodes = (uint32)_nodeList.size();
+	reach.resize( numNodes );
+	scale.resize( numNodes );
+
+	for( uint32 i = 0; i < numNodes; ++i )
+	{
+		// The current transformation remains if the stages do not animate the node
+		const Matrix4f &relTrans = _nodeList[i]->getANRelTransRef();
+		float transLen = Vec3f( relTrans.c[3][0], relTrans.c[3][1], relTrans.c[3][2] ).length();
+		float nodeScale = maxf( Vec3f( relTrans.c[0][0], relTrans.c[0][1], relTrans.c[0][2] ).length(),
+			maxf( Vec3f( relTrans.c[1][0], relTrans.c[1][1], relTrans.c[1][2] ).length(),
+			      Vec3f( relTrans.c[2][0], relTrans.c[2][1], relTrans.c[2][2] ).length() ) );
+
+		for( size_t j = 0, s = _activeStages.size(); j < s; ++j )
+		{
+			AnimResEntity *animEnt = _animStages[_activeStages[j]].entityMap->entities[i];
+			if( animEnt == 0x0 || animEnt->frameCount == 0 ) continue;
+
+			transLen = maxf( transLen, animEnt->maxTransLen );
+			nodeScale = maxf( nodeScale, animEnt->maxScale );
+		}
+
+		int parent = _nodeParents[i];
+		float parentReach = parent >= 0 ? reach[parent] : 0.0f;
+		float parentScale = parent >= 0 ? scale[parent] : 1.0f;
+		reach[i] = parentReach + parentScale * transLen;
+		scale[i] = parentScale * nodeScale;
+	}
+
+	return true;
+}
+
+
+void AnimationController::prewarm( AnimationResource *anim, const string &startNode )
+{
+	anim->getEntityMap( _hierarchyHash, _nodeNameIds, _nodeParents, hashName( startNode.c_str() ) );
+}
+
+
+static inline void appendKeyFloat( vector< uint32 > &key, float f )
+{
+	uint32 bits;
+	memcpy( &bits, &f, sizeof( uint32 ) );
+	key.push_back( bits );
+}
+
+
+bool AnimationController::getPoseKey( vector< uint32 > &key )
+{
+	// Builds a key from everything the result of animate depends on; returns false if there is
+	// nothing to evaluate
+	key.resize( 0 );
+	if( !_dirty || _activeStages.empty() ) return false;
+
+	updateStageMaps();
+
+	// An entity map stands for an animation applied to a specific hierarchy; the stamp of the
+	// animation is added since a map released on reload can be replaced at the same address
+	bool fastAnimation = Modules::config().fastAnimation;
+	key.push_back( _hierarchyHash );
+	key.push_back( (uint32)_nodeList.size() );
+	key.push_back( fastAnimation ? 1 : 0 );
+	for( size_t i = 0, s = _activeStages.size(); i < s; ++i )
+	{
+		const AnimStage &curStage = _animStages[_activeStages[i]];
+		uint64 mapAddr = (uint64)(size_t)curStage.entityMap;
+		key.push_back( (uint32)mapAddr );
+		key.push_back( (uint32)(mapAddr >> 32) );
+		key.push_back( curStage.entityMapStamp );
+		// Without inter-frame interpolation, only the frame index is relevant
+		if( fastAnimation ) key.push_back( (uint32)ftoi_t( curStage.animTime ) );
+		else appendKeyFloat( key, curStage.animTime );
+		appendKeyFloat( key, curStage.weight );
+		key.push_back( (uint32)curStage.layer );
+		key.push_back( curStage.additive ? 1 : 0 );
+	}
+
+	return true;
+}
+
+
+void AnimationController::capturePose( AnimPoseCacheEntry &pose )
+{
+	uint32 numNodes = (uint32)_nodeList.size();
+	pose.animatedNodes = _animatedNodes;
+	pose.relTrans.resize( numNodes );
+	for( uint32 i = 0; i < numNodes; ++i )
+	{
+		if( _animatedNodes[i] ) pose.relTrans[i] = _nodeList[i]->getANRelTransRef();
+	}
+}
+
+
+void AnimationController::applyCachedPose( const AnimPoseCacheEntry &pose )
+{
+	// Nodes that are not animated keep their own transformation, just like in animate
+	for( uint32 i = 0, s = (uint32)_nodeList.size(); i < s; ++i )
+	{
+		if( pose.animatedNodes[i] ) _nodeList[i]->getANRelTransRef() = pose.relTrans[i];
+	}
+	_animatedNodes = pose.animatedNodes;
+
+	_dirty = false;
+}
+
+
 int AnimationController::getAnimCount()
 {
     return _activeStages.size();
@@ -16,6 +16,10 @@
 #include "egPrerequisites.h"
 #include "egResource.h"
 #include "utMath.h"
+#include "utAnimCompression.h"
+#include "utThreading.h"
+#include <list>
+#include <map>
 
 
 namespace Horde3D {
@@ -45,9 +49,33 @@ struct Frame
 
 struct AnimResEntity
 {
-	uint32                nameId;
-	Matrix4f              firstFrameInvTrans;
-	std::vector< Frame >  frames;
+	uint32                             nameId;
+	uint32                             frameCount;  // 1 for entities that have a single static frame
+	Matrix4f                           firstFrameInvTrans;
+	Frame                              firstFrame;
+	std::vector< Frame >               frames;      // Empty if the entity is stored as key tracks
+	AnimKeyTrack< PackedQuaternion >   rotTrack;
+	AnimKeyTrack< Vec3f >              transTrack, scaleTrack;
+	float                              maxTransLen, maxScale;  // Bounds over all frames
+
+	bool isCompressed() const { return frames.empty(); }
+	void sampleKeyTracks( float frame, Quaternion &rotQuat, Vec3f &transVec, Vec3f &scaleVec ) const
+	{
+		rotQuat = sampleKeyTrack( rotTrack, frame );
+		transVec = sampleKeyTrack( transTrack, frame );
+		scaleVec = sampleKeyTrack( scaleTrack, frame );
+	}
+};
+
+// Node-to-entity mapping of an animation for a specific node hierarchy; it is shared by all
+// controllers with an identical hierarchy, so it is only resolved once for many equal characters
+struct AnimEntityMap
+{
+	uint32                          hierarchyHash;
+	std::vector< uint32 >           nameIds;     // Node name hashes, parents before children
+	std::vector< int >              parents;     // Index of parent node or -1
+	uint32                          startNodeNameId;
+	std::vector< AnimResEntity * >  entities;    // Entity of each node, NULL if missing or masked out
 };
 
 // =================================================================================================
@@ -70,13 +98,19 @@ public:
 	int getElemParamI( int elem, int elemIdx, int param );
 
 	AnimResEntity *findEntity( uint32 nameId );
+	const AnimEntityMap *getEntityMap( uint32 hierarchyHash, const std::vector< uint32 > &nameIds,
+	                                   const std::vector< int > &parents, uint32 startNodeNameId );
+	uint32 getEntityMapStamp() { return _entityMapStamp; }
 
 private:
 	bool raiseError( const std::string &msg );
+	void compressEntity( AnimResEntity &entity );
 
 private:
 	uint32                        _numFrames;
 	std::vector< AnimResEntity >  _entities;
+	std::list< AnimEntityMap >    _entityMaps;  // Retargeting cache
+	uint32                        _entityMapStamp;  // Changed when the cached maps become invalid
 
 	friend class Renderer;
 	friend class ModelNode;
@@ -102,23 +136,60 @@ public:
 
 struct AnimStage
 {
-	PAnimationResource  anim;  // If NULL, stage is inactive
-	int                 layer;
-	uint32              startNodeNameId;
-	float               animTime;
-	float               weight;
-	bool                additive;
+	PAnimationResource   anim;  // If NULL, stage is inactive
+	int                  layer;
+	uint32               startNodeNameId;
+	const AnimEntityMap  *entityMap;
+	uint32               entityMapStamp;
+	float                animTime;
+	float                weight;
+	bool                 additive;
+};
+
+struct AnimBlendFuncs;
+
+// =================================================================================================
+
+// Result of evaluating the stages of a controller; the key describes all inputs that the pose
+// depends on, so controllers with equal keys can take over the pose without sampling the clips
+struct AnimPoseCacheEntry
+{
+	std::vector< uint32 >         key;
+	std::vector< unsigned char >  animatedNodes;  // Nodes whose transformation is defined by the pose
+	std::vector< Matrix4f >       relTrans;
+	std::vector< Matrix4f >       jointMats;      // Joint matrices relative to the model and skinning
+	std::vector< Vec4f >          skinMatRows;    // matrices; empty if not all joints are animated
 };
 
-struct AnimCtrlNode
+class AnimPoseCache
 {
-	IAnimatableNode  *node;
-	AnimResEntity    *animEntities[MaxNumAnimStages];
+public:
+	AnimPoseCache();
+
+	// Returned entries are not changed anymore and remain valid until the cache is cleared
+	const AnimPoseCacheEntry *find( const std::vector< uint32 > &key );
+	void insert( AnimPoseCacheEntry &entry );  // Takes over the data of entry
+	// Must not be called while models are updated; reports the hit counts to the stat manager
+	void clear();
+
+private:
+	static uint32 hashKey( const std::vector< uint32 > &key );
+
+private:
+	Mutex                                        _mutex;
+	std::multimap< uint32, AnimPoseCacheEntry >  _entries;  // Indexed by key hash
+	uint32                                       _hitCount, _missCount;
 };
 
+// =================================================================================================
+
 class AnimationController
 {
 public:
+	static const AnimBlendFuncs  *blendFuncs;  // Pose blending kernels selected at init
+	static AnimPoseCache         poseCache;   // Poses evaluated in the current frame
+	
+
 	static uint32 hashName( const char *name );
 	
 	AnimationController();
@@ -131,19 +202,34 @@ public:
 	                     const std::string &startNode, bool additive );
 	bool setAnimParams( int stage, float time, float weight );
 	bool animate();
+	bool predictNodeBounds( std::vector< float > &reach, std::vector< float > &scale );
+	void prewarm( AnimationResource *anim, const std::string &startNode );
+	bool getPoseKey( std::vector< uint32 > &key );
+	void capturePose( AnimPoseCacheEntry &pose );
+	void applyCachedPose( const AnimPoseCacheEntry &pose );
 
     int  getAnimCount();
+	bool isDirty() { return _dirty && !_activeStages.empty(); }
+	const std::vector< IAnimatableNode * > &getNodeList() { return _nodeList; }
     void getAnimParams( int stage, float *time, float *weight );
 
 protected:
-	void mapAnimRes( uint32 node, uint32 stage );
+	void mapAnimRes( uint32 stage );
+	void updateStageMaps();
 	void updateActiveList();
 
 protected:
-	std::vector< AnimStage >     _animStages;
-	std::vector< uint32 >        _activeStages;
-	std::vector< AnimCtrlNode >  _nodeList;
-	bool                         _dirty;
+	std::vector< AnimStage >          _animStages;
+	std::vector< uint32 >             _activeStages;
+	std::vector< IAnimatableNode * >  _nodeList;
+	std::vector< uint32 >             _nodeNameIds;  // Hierarchy description used as retargeting key
+	std::vector< int >                _nodeParents;
+	uint32                            _hierarchyHash;
+	std::vector< float >              _poseData;   // SoA scratch arrays for sampling and blending
+	std::vector< Matrix4f * >         _transRefs;
+	std::vector< unsigned char >      _animatedNodes;  // Nodes that received data in the last animate
+	bool                              _dirty;
+	bool                              _mapDirty;  // Node list changed since stages were mapped
 };
 
 }
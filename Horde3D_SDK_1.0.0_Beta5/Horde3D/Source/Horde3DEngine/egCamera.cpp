@@ -37,6 +37,7 @@ CameraNode::CameraNode( const CameraNodeTpl &cameraTpl ) :
 	_frustFar = cameraTpl.farPlane;
 	_orthographic = cameraTpl.orthographic;
 	_occSet = cameraTpl.occlusionCulling ? Modules::renderer().registerOccSet() : -1;
+	_swOccCulling = cameraTpl.swOcclusionCulling;
 	_manualProjMat = false;
 }
 
@@ -99,6 +100,14 @@ SceneNodeTpl *CameraNode::parsingFunc( map< string, string > &attribs )
 		else
 			cameraTpl->occlusionCulling = false;
 	}
+	itr = attribs.find( "swOcclusionCulling" );
+	if( itr != attribs.end() ) 
+	{
+		if ( _stricmp( itr->second.c_str(), "true" ) == 0 || _stricmp( itr->second.c_str(), "1" ) == 0 )
+			cameraTpl->swOcclusionCulling = true;
+		else
+			cameraTpl->swOcclusionCulling = false;
+	}
 
 	if( !result )
 	{
@@ -139,6 +148,8 @@ int CameraNode::getParamI( int param )
 		return _orthographic ? 1 : 0;
 	case CameraNodeParams::OccCullingI:
 		return _occSet >= 0 ? 1 : 0;
+	case CameraNodeParams::SWOccCullingI:
+		return _swOccCulling ? 1 : 0;
 	}
 
 	return SceneNode::getParamI( param );
@@ -196,6 +207,9 @@ void CameraNode::setParamI( int param, int value )
 			_occSet = -1;
 		}
 		return;
+	case CameraNodeParams::SWOccCullingI:
+		_swOccCulling = (value != 0);
+		return;
 	}
 
 	SceneNode::setParamI( param, value );
@@ -44,7 +44,8 @@ struct CameraNodeParams
 		ViewportWidthI,
 		ViewportHeightI,
 		OrthoI,
-		OccCullingI
+		OccCullingI,
+		SWOccCullingI
 	};
 };
 
@@ -60,6 +61,7 @@ struct CameraNodeTpl : public SceneNodeTpl
 	int                 outputBufferIndex;
 	bool                orthographic;
 	bool                occlusionCulling;
+	bool                swOcclusionCulling;
 
 	CameraNodeTpl( const std::string &name, PipelineResource *pipelineRes ) :
 		SceneNodeTpl( SceneNodeTypes::Camera, name ), pipeRes( pipelineRes ),
@@ -67,7 +69,7 @@ struct CameraNodeTpl : public SceneNodeTpl
 		// Default params: fov=45, aspect=4/3
 		leftPlane( -0.055228457f ), rightPlane( 0.055228457f ), bottomPlane( -0.041421354f ),
 		topPlane( 0.041421354f ), nearPlane( 0.1f ), farPlane( 1000.0f ), outputBufferIndex( 0 ),
-		orthographic( false ), occlusionCulling( false )
+		orthographic( false ), occlusionCulling( false ), swOcclusionCulling( false )
 	{
 	}
 };
@@ -111,6 +113,7 @@ private:
 	int                 _outputBufferIndex;
 	int                 _occSet;
 	bool                _orthographic;  // Perspective or orthographic frustum?
+	bool                _swOccCulling;  // Software occlusion culling against occluder meshes?
 	bool                _manualProjMat; // Projection matrix manually set?
 
 	friend class SceneManager;
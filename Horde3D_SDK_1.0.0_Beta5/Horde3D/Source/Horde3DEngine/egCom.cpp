@@ -14,6 +14,8 @@
 #include "utMath.h"
 #include "egModules.h"
 #include "egRenderer.h"
+#include "egFrame.h"
+#include "utThreadPool.h"
 #include <stdarg.h>
 #include <stdio.h>
 
@@ -41,6 +43,10 @@ EngineConfig::EngineConfig()
 	debugViewMode = false;
 	dumpFailedShaders = false;
 	gatherTimeStats = true;
+	threadedUpdate = false;
+	workerThreads = (int)getProcessorCount() - 1;
+	animCompression = false;
+	animPoseCache = false;
 }
 
 
@@ -76,6 +82,14 @@ float EngineConfig::getOption( EngineOptions::List param )
 		return dumpFailedShaders ? 1.0f : 0.0f;
 	case EngineOptions::GatherTimeStats:
 		return gatherTimeStats ? 1.0f : 0.0f;
+	case EngineOptions::ThreadedUpdate:
+		return threadedUpdate ? 1.0f : 0.0f;
+	case EngineOptions::WorkerThreads:
+		return (float)workerThreads;
+	case EngineOptions::AnimCompression:
+		return animCompression ? 1.0f : 0.0f;
+	case EngineOptions::AnimPoseCache:
+		return animPoseCache ? 1.0f : 0.0f;
 	default:
 		Modules::setError( "Invalid param for h3dGetOption" );
 		return Math::NaN;
@@ -149,6 +163,23 @@ bool EngineConfig::setOption( EngineOptions::List param, float value )
 	case EngineOptions::GatherTimeStats:
 		gatherTimeStats = (value != 0);
 		return true;
+	case EngineOptions::ThreadedUpdate:
+		threadedUpdate = (value != 0);
+		return true;
+	case EngineOptions::WorkerThreads:
+		if( value < 0 ) return false;
+		workerThreads = ftoi_r( value );
+
+		// Pool must be idle when its threads are replaced
+		Modules::frameMan().sync();
+		Modules::threadPool().setWorkerCount( (unsigned int)workerThreads );
+		return true;
+	case EngineOptions::AnimCompression:
+		animCompression = (value != 0);
+		return true;
+	case EngineOptions::AnimPoseCache:
+		animPoseCache = (value != 0);
+		return true;
 	default:
 		Modules::setError( "Invalid param for h3dSetOption" );
 		return false;
@@ -169,6 +200,7 @@ EngineLog::EngineLog()
 
 void EngineLog::pushMessage( int level, const char *msg, va_list args )
 {
+	_mutex.lock();
 	float time = _timer.getElapsedTimeMS() / 1000.0f;
 
 #if defined( PLATFORM_WIN )
@@ -196,6 +228,7 @@ void EngineLog::pushMessage( int level, const char *msg, va_list args )
 	OutputDebugStringA( _textBuf );
 	OutputDebugString( TEXT("\r\n") );
 #endif
+	_mutex.unlock();
 }
 
 
@@ -245,14 +278,18 @@ void EngineLog::writeDebugInfo( const char *msg, ... )
 
 bool EngineLog::getMessage( LogMessage &msg )
 {
+	bool result = false;
+
+	_mutex.lock();
 	if( !_messages.empty() )
 	{
 		msg = _messages.front();
 		_messages.pop();
-		return true;
+		result = true;
 	}
-	else
-		return false;
+	_mutex.unlock();
+
+	return result;
 }
 
 
@@ -265,6 +302,11 @@ StatManager::StatManager()
 	_statTriCount = 0;
 	_statBatchCount = 0;
 	_statLightPassCount = 0;
+	_statSWOccCulledCount = 0;
+	_statPoseCacheHitCount = 0;
+	_statPoseCacheMissCount = 0;
+	_statEmitterLodSkipCount = 0;
+	_statEmitterCullSkipCount = 0;
 
 	_frameTime = 0;
 
@@ -338,6 +380,45 @@ float StatManager::getStat( int param, bool reset )
 		return (gRDI->getTextureMem() / 1024) / 1024.0f;
 	case EngineStats::GeometryVMem:
 		return (gRDI->getBufferMem() / 1024) / 1024.0f;
+	case EngineStats::SWOccCulledCount:
+		value = (float)_statSWOccCulledCount;
+		if( reset ) _statSWOccCulledCount = 0;
+		return value;
+	case EngineStats::PoseCacheHitCount:
+		value = (float)_statPoseCacheHitCount;
+		if( reset ) _statPoseCacheHitCount = 0;
+		return value;
+	case EngineStats::PoseCacheMissCount:
+		value = (float)_statPoseCacheMissCount;
+		if( reset ) _statPoseCacheMissCount = 0;
+		return value;
+	case EngineStats::EmitterLodSkipCount:
+		value = (float)_statEmitterLodSkipCount;
+		if( reset ) _statEmitterLodSkipCount = 0;
+		return value;
+	case EngineStats::EmitterCullSkipCount:
+		value = (float)_statEmitterCullSkipCount;
+		if( reset ) _statEmitterCullSkipCount = 0;
+		return value;
+	case EngineStats::ShaderChangesSubmitted:
+	case EngineStats::ShaderChangesApplied:
+	case EngineStats::RenderStateChangesSubmitted:
+	case EngineStats::RenderStateChangesApplied:
+	case EngineStats::TextureChangesSubmitted:
+	case EngineStats::TextureChangesApplied:
+	case EngineStats::SamplerChangesSubmitted:
+	case EngineStats::SamplerChangesApplied:
+	case EngineStats::VertLayoutChangesSubmitted:
+	case EngineStats::VertLayoutChangesApplied:
+	case EngineStats::IndexBufChangesSubmitted:
+	case EngineStats::IndexBufChangesApplied:
+	case EngineStats::ViewportChangesSubmitted:
+	case EngineStats::ViewportChangesApplied:
+		{
+			// Stats come in submitted/applied pairs ordered like the RDI state categories
+			int index = param - EngineStats::ShaderChangesSubmitted;
+			return (float)gRDI->getStateChangeCount( (RDIStateCategory)(index / 2), (index & 1) != 0, reset );
+		}
 	default:
 		Modules::setError( "Invalid param for h3dGetStat" );
 		return Math::NaN;
@@ -358,6 +439,21 @@ void StatManager::incStat( int param, float value )
 	case EngineStats::LightPassCount:
 		_statLightPassCount += ftoi_r( value );
 		break;
+	case EngineStats::SWOccCulledCount:
+		_statSWOccCulledCount += ftoi_r( value );
+		break;
+	case EngineStats::PoseCacheHitCount:
+		_statPoseCacheHitCount += ftoi_r( value );
+		break;
+	case EngineStats::PoseCacheMissCount:
+		_statPoseCacheMissCount += ftoi_r( value );
+		break;
+	case EngineStats::EmitterLodSkipCount:
+		_statEmitterLodSkipCount += ftoi_r( value );
+		break;
+	case EngineStats::EmitterCullSkipCount:
+		_statEmitterCullSkipCount += ftoi_r( value );
+		break;
 	case EngineStats::FrameTime:
 		_frameTime += value;
 		break;
@@ -18,6 +18,7 @@
 #include <queue>
 #include <cstdarg>
 #include "utTimer.h"
+#include "utThreading.h"
 
 
 namespace Horde3D {
@@ -45,7 +46,11 @@ struct EngineOptions
 		WireframeMode,
 		DebugViewMode,
 		DumpFailedShaders,
-		GatherTimeStats
+		GatherTimeStats,
+		ThreadedUpdate,
+		WorkerThreads,
+		AnimCompression,
+		AnimPoseCache
 	};
 };
 
@@ -73,6 +78,10 @@ public:
 	bool  debugViewMode;
 	bool  dumpFailedShaders;
 	bool  gatherTimeStats;
+	bool  threadedUpdate;
+	int   workerThreads;
+	bool  animCompression;
+	bool  animPoseCache;
 };
 
 
@@ -122,6 +131,7 @@ protected:
 	char                      _textBuf[2048];
 	uint32                    _maxNumMessages;
 	std::queue< LogMessage >  _messages;
+	Mutex                     _mutex;  // Messages can also come from the background update
 };
 
 
@@ -145,7 +155,26 @@ struct EngineStats
 		ShadowsGPUTime,
 		ParticleGPUTime,
 		TextureVMem,
-		GeometryVMem
+		GeometryVMem,
+		SWOccCulledCount,
+		ShaderChangesSubmitted,
+		ShaderChangesApplied,
+		RenderStateChangesSubmitted,
+		RenderStateChangesApplied,
+		TextureChangesSubmitted,
+		TextureChangesApplied,
+		SamplerChangesSubmitted,
+		SamplerChangesApplied,
+		VertLayoutChangesSubmitted,
+		VertLayoutChangesApplied,
+		IndexBufChangesSubmitted,
+		IndexBufChangesApplied,
+		ViewportChangesSubmitted,
+		ViewportChangesApplied,
+		PoseCacheHitCount,
+		PoseCacheMissCount,
+		EmitterLodSkipCount,
+		EmitterCullSkipCount
 	};
 };
 
@@ -166,6 +195,9 @@ protected:
 	uint32    _statTriCount;
 	uint32    _statBatchCount;
 	uint32    _statLightPassCount;
+	uint32    _statSWOccCulledCount;
+	uint32    _statPoseCacheHitCount, _statPoseCacheMissCount;
+	uint32    _statEmitterLodSkipCount, _statEmitterCullSkipCount;
 
 	Timer     _frameTimer;
 	Timer     _animTimer;
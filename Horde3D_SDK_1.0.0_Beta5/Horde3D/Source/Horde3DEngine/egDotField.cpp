@@ -0,0 +1,1682 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egDotField.h"
+#include "egModules.h"
+#include "egCom.h"
+#include "utThreadPool.h"
+#include "utSIMD.h"
+#include <algorithm>
+#include <cstring>
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+using namespace std;
+
+// Dots are updated in chunks on the thread pool; within a chunk, random values and the dots to
+// place again are produced for blocks that stay in the cache. Each chunk has its own random stream.
+static const uint32 DotChunkSize = 16384;
+static const uint32 DotBlockSize = 256;
+
+// 24 random bits are converted exactly like the Philox values of the particles
+static const float DotRandomScale = 1.0f / 16777216.0f;
+
+// Taylor polynomials of sine and cosine on [-pi/4, pi/4], accurate to about 3e-7
+static const float HalfPi = 1.57079633f;
+static const float SqrtHalf = 0.707106781f;
+static const float SinC3 = -1.0f / 6.0f, SinC5 = 1.0f / 120.0f, SinC7 = -1.0f / 5040.0f;
+static const float CosC2 = -1.0f / 2.0f, CosC4 = 1.0f / 24.0f, CosC6 = -1.0f / 720.0f, CosC8 = 1.0f / 40320.0f;
+
+
+static void seedRandomStream( DotRandomStream &stream, uint32 seed, uint32 step, uint32 chunk )
+{
+	// Each Philox block yields two state words
+	for( uint32 k = 0; k < 8; ++k )
+	{
+		uint32 ctr0 = step, ctr1 = chunk * 8 + k;
+		philox2x32( seed, ctr0, ctr1 );
+		stream.words[k / 2][(k % 2) * 2 + 0] = ctr0;
+		stream.words[k / 2][(k % 2) * 2 + 1] = ctr1;
+	}
+}
+
+
+// One xoshiro128+ step on each lane; the upper bits of the sums are the random bits
+static inline void nextRandomValues( DotRandomStream &stream, float *values )
+{
+	uint32 (&w)[4][4] = stream.words;
+	for( uint32 k = 0; k < 4; ++k )
+	{
+		uint32 result = w[0][k] + w[3][k];
+		uint32 t = w[1][k] << 9;
+		w[2][k] ^= w[0][k];
+		w[3][k] ^= w[1][k];
+		w[1][k] ^= w[2][k];
+		w[0][k] ^= w[3][k];
+		w[2][k] ^= t;
+		w[3][k] = (w[3][k] << 11) | (w[3][k] >> 21);
+		values[k] = (float)(result >> 8) * DotRandomScale;
+	}
+}
+
+
+// Unit vector in the plane for an angle of u full turns. The angle is split into its quadrant and
+// the offset from the middle of the quadrant, where the polynomials are evaluated; the SIMD
+// kernels perform the same operations, so they yield identical vectors.
+static inline void randomCirclePoint( float u, float &x, float &y )
+{
+	float t = u * 4;
+	int quadrant = (int)t;
+	float a = (t - (float)quadrant - 0.5f) * HalfPi;
+	float a2 = a * a;
+	float s = a + a * a2 * (SinC3 + a2 * (SinC5 + a2 * SinC7));
+	float c = 1 + a2 * (CosC2 + a2 * (CosC4 + a2 * (CosC6 + a2 * CosC8)));
+	
+	// Rotate by the angle of the middle of the quadrant
+	float qx = (c - s) * SqrtHalf, qy = (c + s) * SqrtHalf;
+	float rx = (quadrant & 1) ? qy : qx, ry = (quadrant & 1) ? qx : qy;
+	x = ((quadrant + 1) & 2) ? -rx : rx;
+	y = (quadrant & 2) ? -ry : ry;
+}
+
+
+// Uniform on the unit circle in the xy plane or on the unit sphere
+static inline void randomDirection( float a, float b, bool planar, float *dir )
+{
+	float x, y;
+	randomCirclePoint( a, x, y );
+	if( planar )
+	{
+		dir[0] = x; dir[1] = y; dir[2] = 0;
+	}
+	else
+	{
+		float z = 2 * b - 1;
+		float r = sqrtf( maxf( 1 - z * z, 0 ) );
+		dir[0] = x * r; dir[1] = y * r; dir[2] = z;
+	}
+}
+
+
+// Uniform in the aperture for the getNumPositionValues values rnd[k * stride]
+static inline void randomPosition( const float *rnd, uint32 stride, int shape, const float *aperture, float *pos )
+{
+	bool planar = aperture[2] == 0;
+	if( shape == DotApertureShapes::Box )
+	{
+		pos[0] = (2 * rnd[0] - 1) * aperture[0];
+		pos[1] = (2 * rnd[stride] - 1) * aperture[1];
+		pos[2] = planar ? 0 : (2 * rnd[2 * stride] - 1) * aperture[2];
+	}
+	else if( planar )
+	{
+		// The distance from the center has the density 2r in the unit disc
+		float r = sqrtf( rnd[stride] );
+		randomCirclePoint( rnd[0], pos[0], pos[1] );
+		pos[0] *= r * aperture[0];
+		pos[1] *= r * aperture[1];
+		pos[2] = 0;
+	}
+	else
+	{
+		// The distance has the density 3r^2 in the unit ball, like the maximum of three values
+		float r = std::max( rnd[2 * stride], std::max( rnd[3 * stride], rnd[4 * stride] ) );
+		randomDirection( rnd[0], rnd[stride], false, pos );
+		for( uint32 c = 0; c < 3; ++c ) pos[c] *= r * aperture[c];
+	}
+}
+
+
+// Values that a group of four dots draws for a random direction and a random position
+static uint32 getNumDirectionValues( const DotFieldStepParams &params )
+{
+	return params.aperture[2] > 0 ? 2 : 1;
+}
+
+static uint32 getNumPositionValues( const DotFieldStepParams &params )
+{
+	bool planar = params.aperture[2] == 0;
+	if( params.shape == DotApertureShapes::Box || planar ) return planar ? 2 : 3;
+	return 5;
+}
+
+// Values that a group of four dots draws for the noise of a step
+static uint32 getNumNoiseValues( const DotFieldStepParams &params )
+{
+	if( params.noiseType == DotNoiseTypes::Walk ) return getNumDirectionValues( params );
+	return getNumPositionValues( params );
+}
+
+// A placed dot gets the values for its direction, then those for its position and the signal value
+static uint32 getNumPlacementValues( const DotFieldStepParams &params )
+{
+	return getNumDirectionValues( params ) + getNumPositionValues( params ) + 1;
+}
+
+static const uint32 MaxNoiseValues = 5;
+static const uint32 MaxPlacementValues = 8;
+
+
+// =================================================================================================
+// Scalar kernels
+// =================================================================================================
+
+// Wraps a dot that left the aperture at x with the velocity v to the opposite side; returns false
+// if that is not possible. The SIMD kernels perform the same operations.
+static inline bool wrapDot( float *x, const float *v, uint32 numAxes, const DotFieldStepParams &params )
+{
+	if( params.shape == DotApertureShapes::Box )
+	{
+		// Each coordinate is wrapped separately, keeping the distance the dot moved beyond the edge
+		for( uint32 c = 0; c < numAxes; ++c )
+		{
+			float size = 2 * params.aperture[c];
+			x[c] = size > 0 ? x[c] - size * floorf( (x[c] + params.aperture[c]) / size ) : 0;
+		}
+		return true;
+	}
+	
+	// The dot enters again where the line of its motion enters the ellipsoid, which is the far
+	// intersection when going backwards; in the space where the ellipsoid is the unit sphere,
+	// the intersections solve |q - t * d|^2 = 1
+	float qa = 0, qb = 0, qc = -1;
+	for( uint32 c = 0; c < numAxes; ++c )
+	{
+		float q = x[c] * params.invAperture[c], d = v[c] * params.invAperture[c];
+		qa += d * d;
+		qb += q * d;
+		qc += q * q;
+	}
+	float disc = qb * qb - qa * qc;
+	if( !(qa > 0 && disc >= 0) ) return false;
+
+	// The part of the step beyond the exit point is kept if it fits into the chord
+	float root = sqrtf( disc );
+	float tExit = (qb - root) / qa, tEntry = (qb + root) / qa;
+	float t = tExit >= 0 && tExit <= tEntry - tExit ? tEntry - tExit : tEntry;
+	for( uint32 c = 0; c < numAxes; ++c ) x[c] -= t * v[c];
+	return true;
+}
+
+
+static uint32 moveDotsScalar( const DotStreams &s, uint32 count, const DotFieldStepParams &params,
+                              uint32 *indices )
+{
+	float *pos[3];
+	const float *dir[3];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		pos[c] = s.channel( DotStateChannels::PosX + c );
+		dir[c] = s.direction( c );
+	}
+	const float *signal = s.channel( DotStateChannels::Signal );
+	float *life = s.channel( DotStateChannels::Life );
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numAxes = params.aperture[2] > 0 ? 3 : 2;  // Z stays 0 in planar fields
+	bool mortal = params.lifeStep != 0;
+	uint32 numPlaced = 0;
+
+	for( uint32 i = 0; i < count; ++i )
+	{
+		bool isSignal = signal[i] < params.coherence;
+		bool outside = false;
+		float x[3], v[3], r2 = 0;
+
+		for( uint32 c = 0; c < numAxes; ++c )
+		{
+			v[c] = isSignal ? params.signalVel[c] : dir[c][i] * params.noiseSpeed;
+			x[c] = pos[c][i] + v[c] * params.timeDelta;
+			outside |= fabsf( x[c] ) > params.aperture[c];
+			float q = x[c] * params.invAperture[c];
+			r2 += q * q;
+		}
+		if( !box ) outside = r2 > 1.0f;
+		
+		bool lost = outside && !wrapDot( x, v, numAxes, params );
+		for( uint32 c = 0; c < numAxes; ++c ) pos[c][i] = x[c];
+
+		bool dead = false;
+		if( mortal )
+		{
+			// A dead dot gets a new lifetime, keeping the time it was dead already
+			float l = life[i] - params.lifeStep;
+			dead = l <= params.deathLevel;
+			if( dead )
+			{
+				l += params.lifetime;
+				if( l <= 0 ) l = params.lifetime;
+			}
+			life[i] = l;
+		}
+		indices[numPlaced] = i;
+		numPlaced += lost || dead ? 1 : 0;
+	}
+
+	return numPlaced;
+}
+
+
+static void transformDotsScalar( const DotStreams &s, uint32 count, const DotFieldStepParams &params )
+{
+	const float *pos[3];
+	for( uint32 c = 0; c < 3; ++c ) pos[c] = s.channel( DotStateChannels::PosX + c );
+	const float *m = params.transform;
+	bool planar = params.aperture[2] == 0;
+
+	for( uint32 i = 0; i < count; ++i )
+	{
+		float x = pos[0][i], y = pos[1][i], z = planar ? 0 : pos[2][i];
+		for( uint32 r = 0; r < 3; ++r )
+			s.positions[i * 3 + r] = m[r * 4 + 0] * x + m[r * 4 + 1] * y + m[r * 4 + 2] * z + m[r * 4 + 3];
+	}
+}
+
+
+static void applyNoiseScalar( const DotStreams &s, uint32 count, const DotFieldStepParams &params,
+                              DotRandomStream &stream )
+{
+	bool planar = params.aperture[2] == 0;
+	uint32 numAxes = planar ? 2 : 3;
+	bool walk = params.noiseType == DotNoiseTypes::Walk;
+	uint32 numValues = getNumNoiseValues( params );
+	const float *signal = s.channel( DotStateChannels::Signal );
+	float values[MaxNoiseValues][4];
+
+	for( uint32 group = 0; group < count; group += 4 )
+	{
+		for( uint32 k = 0; k < numValues; ++k ) nextRandomValues( stream, values[k] );
+		
+		for( uint32 i = group, last = std::min( group + 4, count ); i < last; ++i )
+		{
+			const float *rnd = &values[0][i - group];
+			float v[3];
+			if( walk )
+			{
+				// Signal dots ignore their direction, so it is replaced for all dots
+				randomDirection( rnd[0], planar ? 0 : rnd[4], planar, v );
+				for( uint32 c = 0; c < numAxes; ++c ) s.direction( c )[i] = v[c];
+			}
+			else if( !(signal[i] < params.coherence) )
+			{
+				randomPosition( rnd, 4, params.shape, params.aperture, v );
+				for( uint32 c = 0; c < numAxes; ++c ) s.channel( DotStateChannels::PosX + c )[i] = v[c];
+			}
+		}
+	}
+}
+
+
+static void placeDotsScalar( const DotStreams &s, const uint32 *indices, uint32 count,
+                             const DotFieldStepParams &params, DotRandomStream &stream )
+{
+	bool planar = params.aperture[2] == 0;
+	uint32 numDirValues = getNumDirectionValues( params );
+	uint32 numValues = getNumPlacementValues( params );
+	float values[MaxPlacementValues][4];
+
+	for( uint32 group = 0; group < count; group += 4 )
+	{
+		for( uint32 k = 0; k < numValues; ++k ) nextRandomValues( stream, values[k] );
+
+		for( uint32 j = group, last = std::min( group + 4, count ); j < last; ++j )
+		{
+			const float *rnd = &values[0][j - group];
+			uint32 i = indices[j];
+			float dir[3], pos[3];
+			randomDirection( rnd[0], planar ? 0 : rnd[4], planar, dir );
+			randomPosition( rnd + numDirValues * 4, 4, params.shape, params.aperture, pos );
+			for( uint32 c = 0; c < 3; ++c )
+			{
+				s.channel( DotStateChannels::PosX + c )[i] = pos[c];
+				s.channel( DotStateChannels::DirX + c )[i] = dir[c];
+			}
+			s.channel( DotStateChannels::Signal )[i] = rnd[(numValues - 1) * 4];
+		}
+	}
+}
+
+
+// =================================================================================================
+// SSE2 kernels
+// =================================================================================================
+
+#if defined( SIMD_SSE2 )
+
+// Wraps the lanes of x that are outside like wrapDot; returns the movemask of the lanes that
+// could not be wrapped
+SIMD_SSE2_FUNC static inline int wrapDotsSSE2( __m128 *x, const __m128 *v, __m128 outside, uint32 numAxes,
+                                               const DotFieldStepParams &params )
+{
+	const __m128 one = _mm_set1_ps( 1.0f );
+	if( params.shape == DotApertureShapes::Box )
+	{
+		for( uint32 c = 0; c < numAxes; ++c )
+		{
+			__m128 w = _mm_setzero_ps();
+			if( params.aperture[c] > 0 )
+			{
+				// Floor of the quotient, which is small enough for a conversion to int
+				__m128 size = _mm_set1_ps( 2 * params.aperture[c] );
+				__m128 n = _mm_div_ps( _mm_add_ps( x[c], _mm_set1_ps( params.aperture[c] ) ), size );
+				__m128 f = _mm_cvtepi32_ps( _mm_cvttps_epi32( n ) );
+				f = _mm_sub_ps( f, _mm_and_ps( _mm_cmpgt_ps( f, n ), one ) );
+				w = _mm_sub_ps( x[c], _mm_mul_ps( size, f ) );
+			}
+			x[c] = _mm_or_ps( _mm_and_ps( outside, w ), _mm_andnot_ps( outside, x[c] ) );
+		}
+		return 0;
+	}
+
+	__m128 qa = _mm_setzero_ps(), qb = _mm_setzero_ps(), qc = _mm_set1_ps( -1.0f );
+	for( uint32 c = 0; c < numAxes; ++c )
+	{
+		__m128 invAperture = _mm_set1_ps( params.invAperture[c] );
+		__m128 q = _mm_mul_ps( x[c], invAperture ), d = _mm_mul_ps( v[c], invAperture );
+		qa = _mm_add_ps( qa, _mm_mul_ps( d, d ) );
+		qb = _mm_add_ps( qb, _mm_mul_ps( q, d ) );
+		qc = _mm_add_ps( qc, _mm_mul_ps( q, q ) );
+	}
+	__m128 disc = _mm_sub_ps( _mm_mul_ps( qb, qb ), _mm_mul_ps( qa, qc ) );
+	__m128 wrap = _mm_and_ps( outside, _mm_and_ps( _mm_cmpgt_ps( qa, _mm_setzero_ps() ),
+	                                               _mm_cmpge_ps( disc, _mm_setzero_ps() ) ) );
+
+	__m128 root = _mm_sqrt_ps( disc );
+	__m128 tExit = _mm_div_ps( _mm_sub_ps( qb, root ), qa ), tEntry = _mm_div_ps( _mm_add_ps( qb, root ), qa );
+	__m128 chord = _mm_sub_ps( tEntry, tExit );
+	__m128 keep = _mm_and_ps( _mm_cmpge_ps( tExit, _mm_setzero_ps() ), _mm_cmple_ps( tExit, chord ) );
+	__m128 t = _mm_or_ps( _mm_and_ps( keep, chord ), _mm_andnot_ps( keep, tEntry ) );
+	for( uint32 c = 0; c < numAxes; ++c )
+	{
+		__m128 w = _mm_sub_ps( x[c], _mm_mul_ps( t, v[c] ) );
+		x[c] = _mm_or_ps( _mm_and_ps( wrap, w ), _mm_andnot_ps( wrap, x[c] ) );
+	}
+
+	return _mm_movemask_ps( _mm_andnot_ps( wrap, outside ) );
+}
+
+
+SIMD_SSE2_FUNC static uint32 moveDotsSSE2( const DotStreams &s, uint32 count, const DotFieldStepParams &params,
+                                           uint32 *indices )
+{
+	float *pos[3];
+	const float *dir[3];
+	__m128 signalVel[3], aperture[3], invAperture[3];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		pos[c] = s.channel( DotStateChannels::PosX + c );
+		dir[c] = s.direction( c );
+		signalVel[c] = _mm_set1_ps( params.signalVel[c] );
+		aperture[c] = _mm_set1_ps( params.aperture[c] );
+		invAperture[c] = _mm_set1_ps( params.invAperture[c] );
+	}
+	const float *signal = s.channel( DotStateChannels::Signal );
+	float *life = s.channel( DotStateChannels::Life );
+	const __m128 absMask = _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) );
+	const __m128 one = _mm_set1_ps( 1.0f );
+	__m128 dt = _mm_set1_ps( params.timeDelta );
+	__m128 noiseSpeed = _mm_set1_ps( params.noiseSpeed );
+	__m128 coherence = _mm_set1_ps( params.coherence );
+	__m128 lifeStep = _mm_set1_ps( params.lifeStep );
+	__m128 deathLevel = _mm_set1_ps( params.deathLevel );
+	__m128 lifetime = _mm_set1_ps( params.lifetime );
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numAxes = params.aperture[2] > 0 ? 3 : 2;
+	bool mortal = params.lifeStep != 0;
+	uint32 numPlaced = 0;
+
+	uint32 i = 0;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 isSignal = _mm_cmplt_ps( _mm_loadu_ps( signal + i ), coherence );
+		__m128 outside = _mm_setzero_ps();
+		__m128 x[3], v[3], r2 = _mm_setzero_ps();
+
+		for( uint32 c = 0; c < numAxes; ++c )
+		{
+			v[c] = _mm_mul_ps( _mm_loadu_ps( dir[c] + i ), noiseSpeed );
+			v[c] = _mm_or_ps( _mm_and_ps( isSignal, signalVel[c] ), _mm_andnot_ps( isSignal, v[c] ) );
+			x[c] = _mm_add_ps( _mm_loadu_ps( pos[c] + i ), _mm_mul_ps( v[c], dt ) );
+			outside = _mm_or_ps( outside, _mm_cmpgt_ps( _mm_and_ps( x[c], absMask ), aperture[c] ) );
+			__m128 q = _mm_mul_ps( x[c], invAperture[c] );
+			r2 = _mm_add_ps( r2, _mm_mul_ps( q, q ) );
+		}
+		if( !box ) outside = _mm_cmpgt_ps( r2, one );
+
+		// Most groups stay inside, they skip the wrapping
+		int lostBits = 0;
+		if( _mm_movemask_ps( outside ) != 0 ) lostBits = wrapDotsSSE2( x, v, outside, numAxes, params );
+		for( uint32 c = 0; c < numAxes; ++c ) _mm_storeu_ps( pos[c] + i, x[c] );
+
+		int deadBits = 0;
+		if( mortal )
+		{
+			__m128 l = _mm_sub_ps( _mm_loadu_ps( life + i ), lifeStep );
+			__m128 dead = _mm_cmple_ps( l, deathLevel );
+			__m128 renewed = _mm_add_ps( l, lifetime );
+			__m128 over = _mm_cmple_ps( renewed, _mm_setzero_ps() );
+			renewed = _mm_or_ps( _mm_and_ps( over, lifetime ), _mm_andnot_ps( over, renewed ) );
+			_mm_storeu_ps( life + i, _mm_or_ps( _mm_and_ps( dead, renewed ), _mm_andnot_ps( dead, l ) ) );
+			deadBits = _mm_movemask_ps( dead );
+		}
+
+		int placedBits = lostBits | deadBits;
+		if( placedBits == 0 ) continue;
+		for( uint32 k = 0; k < 4; ++k )
+		{
+			indices[numPlaced] = i + k;
+			numPlaced += (placedBits >> k) & 1;
+		}
+	}
+
+	if( i < count )
+	{
+		uint32 numTail = moveDotsScalar( s.offset( i ), count - i, params, indices + numPlaced );
+		for( uint32 k = 0; k < numTail; ++k ) indices[numPlaced++] += i;
+	}
+	return numPlaced;
+}
+
+
+SIMD_SSE2_FUNC static void transformDotsSSE2( const DotStreams &s, uint32 count, const DotFieldStepParams &params )
+{
+	const float *pos[3];
+	for( uint32 c = 0; c < 3; ++c ) pos[c] = s.channel( DotStateChannels::PosX + c );
+	__m128 m[12];
+	for( uint32 j = 0; j < 12; ++j ) m[j] = _mm_set1_ps( params.transform[j] );
+	bool planar = params.aperture[2] == 0;
+	
+	// The positions are only read again for the upload to the GPU, so they bypass the cache
+	bool aligned = ((size_t)s.positions & 15) == 0;
+
+	uint32 i = 0;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 x = _mm_loadu_ps( pos[0] + i ), y = _mm_loadu_ps( pos[1] + i );
+		__m128 z = planar ? _mm_setzero_ps() : _mm_loadu_ps( pos[2] + i );
+		__m128 w[3];
+		for( uint32 r = 0; r < 3; ++r )
+		{
+			w[r] = _mm_add_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( m[r * 4 + 0], x ), _mm_mul_ps( m[r * 4 + 1], y ) ),
+			                               _mm_mul_ps( m[r * 4 + 2], z ) ), m[r * 4 + 3] );
+		}
+
+		// Interleave to x0 y0 z0 x1, y1 z1 x2 y2, z2 x3 y3 z3
+		__m128 xyLow = _mm_unpacklo_ps( w[0], w[1] );   // x0 y0 x1 y1
+		__m128 xyHigh = _mm_unpackhi_ps( w[0], w[1] );  // x2 y2 x3 y3
+		__m128 zx = _mm_shuffle_ps( w[2], xyLow, _MM_SHUFFLE( 2, 2, 0, 0 ) );      // z0 z0 x1 x1
+		__m128 yz = _mm_shuffle_ps( xyLow, w[2], _MM_SHUFFLE( 1, 1, 3, 3 ) );      // y1 y1 z1 z1
+		__m128 zx2 = _mm_shuffle_ps( w[2], xyHigh, _MM_SHUFFLE( 2, 2, 2, 2 ) );    // z2 z2 x3 x3
+		__m128 yz3 = _mm_shuffle_ps( xyHigh, w[2], _MM_SHUFFLE( 3, 3, 3, 3 ) );    // y3 y3 z3 z3
+		__m128 out[3] = { _mm_shuffle_ps( xyLow, zx, _MM_SHUFFLE( 2, 0, 1, 0 ) ),
+		                  _mm_shuffle_ps( yz, xyHigh, _MM_SHUFFLE( 1, 0, 2, 0 ) ),
+		                  _mm_shuffle_ps( zx2, yz3, _MM_SHUFFLE( 2, 0, 2, 0 ) ) };
+		float *dst = s.positions + i * 3;
+		for( uint32 k = 0; k < 3; ++k )
+		{
+			if( aligned ) _mm_stream_ps( dst + k * 4, out[k] );
+			else _mm_storeu_ps( dst + k * 4, out[k] );
+		}
+	}
+	if( aligned ) _mm_sfence();
+
+	if( i < count ) transformDotsScalar( s.offset( i ), count - i, params );
+}
+
+
+SIMD_SSE2_FUNC static inline __m128 nextRandomSSE2( __m128i *w )
+{
+	__m128i result = _mm_add_epi32( w[0], w[3] );
+	__m128i t = _mm_slli_epi32( w[1], 9 );
+	w[2] = _mm_xor_si128( w[2], w[0] );
+	w[3] = _mm_xor_si128( w[3], w[1] );
+	w[1] = _mm_xor_si128( w[1], w[2] );
+	w[0] = _mm_xor_si128( w[0], w[3] );
+	w[2] = _mm_xor_si128( w[2], t );
+	w[3] = _mm_or_si128( _mm_slli_epi32( w[3], 11 ), _mm_srli_epi32( w[3], 21 ) );
+	return _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( result, 8 ) ), _mm_set1_ps( DotRandomScale ) );
+}
+
+
+SIMD_SSE2_FUNC static inline void randomCirclePointSSE2( __m128 u, __m128 &x, __m128 &y )
+{
+	__m128 t = _mm_mul_ps( u, _mm_set1_ps( 4.0f ) );
+	__m128i quadrant = _mm_cvttps_epi32( t );
+	__m128 a = _mm_mul_ps( _mm_sub_ps( _mm_sub_ps( t, _mm_cvtepi32_ps( quadrant ) ), _mm_set1_ps( 0.5f ) ),
+	                       _mm_set1_ps( HalfPi ) );
+	__m128 a2 = _mm_mul_ps( a, a );
+	__m128 s = _mm_add_ps( _mm_set1_ps( SinC5 ), _mm_mul_ps( a2, _mm_set1_ps( SinC7 ) ) );
+	s = _mm_add_ps( _mm_set1_ps( SinC3 ), _mm_mul_ps( a2, s ) );
+	s = _mm_add_ps( a, _mm_mul_ps( _mm_mul_ps( a, a2 ), s ) );
+	__m128 c = _mm_add_ps( _mm_set1_ps( CosC6 ), _mm_mul_ps( a2, _mm_set1_ps( CosC8 ) ) );
+	c = _mm_add_ps( _mm_set1_ps( CosC4 ), _mm_mul_ps( a2, c ) );
+	c = _mm_add_ps( _mm_set1_ps( CosC2 ), _mm_mul_ps( a2, c ) );
+	c = _mm_add_ps( _mm_set1_ps( 1.0f ), _mm_mul_ps( a2, c ) );
+
+	__m128 qx = _mm_mul_ps( _mm_sub_ps( c, s ), _mm_set1_ps( SqrtHalf ) );
+	__m128 qy = _mm_mul_ps( _mm_add_ps( c, s ), _mm_set1_ps( SqrtHalf ) );
+	const __m128i one = _mm_set1_epi32( 1 ), two = _mm_set1_epi32( 2 );
+	__m128 swap = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( quadrant, one ), one ) );
+	__m128 rx = _mm_or_ps( _mm_and_ps( swap, qy ), _mm_andnot_ps( swap, qx ) );
+	__m128 ry = _mm_or_ps( _mm_and_ps( swap, qx ), _mm_andnot_ps( swap, qy ) );
+	x = _mm_xor_ps( rx, _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( _mm_add_epi32( quadrant, one ), two ), 30 ) ) );
+	y = _mm_xor_ps( ry, _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( quadrant, two ), 30 ) ) );
+}
+
+
+SIMD_SSE2_FUNC static inline void randomDirectionSSE2( __m128 a, __m128 b, bool planar, __m128 *dir )
+{
+	randomCirclePointSSE2( a, dir[0], dir[1] );
+	if( planar ) return;
+	
+	__m128 z = _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( 2.0f ), b ), _mm_set1_ps( 1.0f ) );
+	__m128 r = _mm_sqrt_ps( _mm_max_ps( _mm_sub_ps( _mm_set1_ps( 1.0f ), _mm_mul_ps( z, z ) ), _mm_setzero_ps() ) );
+	dir[0] = _mm_mul_ps( dir[0], r );
+	dir[1] = _mm_mul_ps( dir[1], r );
+	dir[2] = z;
+}
+
+
+// Like randomPosition, for the getNumPositionValues values in rnd; the parameters are passed
+// separately, so that the callers keep them in registers
+SIMD_SSE2_FUNC static inline void randomPositionSSE2( const __m128 *rnd, bool box, bool planar, const __m128 *aperture,
+                                                      __m128 *pos )
+{
+	if( box )
+	{
+		const __m128 one = _mm_set1_ps( 1.0f ), two = _mm_set1_ps( 2.0f );
+		for( uint32 c = 0; c < (planar ? 2u : 3u); ++c )
+			pos[c] = _mm_mul_ps( _mm_sub_ps( _mm_mul_ps( two, rnd[c] ), one ), aperture[c] );
+		if( planar ) pos[2] = _mm_setzero_ps();
+	}
+	else if( planar )
+	{
+		__m128 r = _mm_sqrt_ps( rnd[1] );
+		randomCirclePointSSE2( rnd[0], pos[0], pos[1] );
+		for( uint32 c = 0; c < 2; ++c ) pos[c] = _mm_mul_ps( pos[c], _mm_mul_ps( r, aperture[c] ) );
+		pos[2] = _mm_setzero_ps();
+	}
+	else
+	{
+		__m128 r = _mm_max_ps( rnd[2], _mm_max_ps( rnd[3], rnd[4] ) );
+		randomDirectionSSE2( rnd[0], rnd[1], false, pos );
+		for( uint32 c = 0; c < 3; ++c ) pos[c] = _mm_mul_ps( pos[c], _mm_mul_ps( r, aperture[c] ) );
+	}
+}
+
+
+SIMD_SSE2_FUNC static void applyNoiseSSE2( const DotStreams &s, uint32 count, const DotFieldStepParams &params,
+                                           DotRandomStream &stream )
+{
+	bool planar = params.aperture[2] == 0;
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numAxes = planar ? 2 : 3;
+	bool walk = params.noiseType == DotNoiseTypes::Walk;
+	uint32 numValues = getNumNoiseValues( params );
+	float *channels[3];
+	__m128 aperture[3];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		channels[c] = walk ? s.direction( c ) : s.channel( DotStateChannels::PosX + c );
+		aperture[c] = _mm_set1_ps( params.aperture[c] );
+	}
+	const float *signal = s.channel( DotStateChannels::Signal );
+	__m128 coherence = _mm_set1_ps( params.coherence );
+	__m128i w[4];
+	for( uint32 k = 0; k < 4; ++k ) w[k] = _mm_loadu_si128( (const __m128i *)stream.words[k] );
+
+	// The directions of a random walk take one or two values, so the loops are separate to keep
+	// them in registers
+	uint32 i = 0;
+	if( walk && planar )
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			__m128 x, y;
+			randomCirclePointSSE2( nextRandomSSE2( w ), x, y );
+			_mm_storeu_ps( channels[0] + i, x );
+			_mm_storeu_ps( channels[1] + i, y );
+		}
+	}
+	else if( walk )
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			__m128 a = nextRandomSSE2( w ), b = nextRandomSSE2( w );
+			__m128 v[3];
+			randomDirectionSSE2( a, b, false, v );
+			for( uint32 c = 0; c < 3; ++c ) _mm_storeu_ps( channels[c] + i, v[c] );
+		}
+	}
+	else
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			__m128 rnd[MaxNoiseValues];
+			for( uint32 k = 0; k < numValues; ++k ) rnd[k] = nextRandomSSE2( w );
+		
+			__m128 v[3];
+			randomPositionSSE2( rnd, box, planar, aperture, v );
+		
+			// Signal dots keep their position
+			__m128 isSignal = _mm_cmplt_ps( _mm_loadu_ps( signal + i ), coherence );
+			for( uint32 c = 0; c < numAxes; ++c )
+			{
+				__m128 x = _mm_or_ps( _mm_and_ps( isSignal, _mm_loadu_ps( channels[c] + i ) ),
+				                      _mm_andnot_ps( isSignal, v[c] ) );
+				_mm_storeu_ps( channels[c] + i, x );
+			}
+		}
+	}
+
+	for( uint32 k = 0; k < 4; ++k ) _mm_storeu_si128( (__m128i *)stream.words[k], w[k] );
+	if( i < count ) applyNoiseScalar( s.offset( i ), count - i, params, stream );
+}
+
+
+SIMD_SSE2_FUNC static void placeDotsSSE2( const DotStreams &s, const uint32 *indices, uint32 count,
+                                          const DotFieldStepParams &params, DotRandomStream &stream )
+{
+	bool planar = params.aperture[2] == 0;
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numDirValues = getNumDirectionValues( params );
+	uint32 numValues = getNumPlacementValues( params );
+	__m128 aperture[3];
+	for( uint32 c = 0; c < 3; ++c ) aperture[c] = _mm_set1_ps( params.aperture[c] );
+	__m128i w[4];
+	for( uint32 k = 0; k < 4; ++k ) w[k] = _mm_loadu_si128( (const __m128i *)stream.words[k] );
+
+	for( uint32 j = 0; j < count; j += 4 )
+	{
+		__m128 rnd[MaxPlacementValues];
+		for( uint32 k = 0; k < numValues; ++k ) rnd[k] = nextRandomSSE2( w );
+
+		// The dots are scattered, so the lanes are written separately; the last group may be incomplete
+		float values[DotStateChannels::Life][4];
+		__m128 v[3];
+		randomPositionSSE2( rnd + numDirValues, box, planar, aperture, v );
+		for( uint32 c = 0; c < 3; ++c ) _mm_storeu_ps( values[DotStateChannels::PosX + c], v[c] );
+		randomDirectionSSE2( rnd[0], rnd[1], planar, v );
+		if( planar ) v[2] = _mm_setzero_ps();
+		for( uint32 c = 0; c < 3; ++c ) _mm_storeu_ps( values[DotStateChannels::DirX + c], v[c] );
+		_mm_storeu_ps( values[DotStateChannels::Signal], rnd[numValues - 1] );
+
+		for( uint32 k = 0, last = std::min( 4u, count - j ); k < last; ++k )
+		{
+			for( uint32 c = 0; c < DotStateChannels::Life; ++c ) s.channel( c )[indices[j + k]] = values[c][k];
+		}
+	}
+
+	for( uint32 k = 0; k < 4; ++k ) _mm_storeu_si128( (__m128i *)stream.words[k], w[k] );
+}
+
+#endif
+
+
+// =================================================================================================
+// NEON kernels
+// =================================================================================================
+
+#if defined( SIMD_NEON )
+
+// ARMv7 has no exact square root and division for vectors
+static inline float32x4_t sqrtNEON( float32x4_t x )
+{
+#if defined( __aarch64__ )
+	return vsqrtq_f32( x );
+#else
+	float v[4];
+	vst1q_f32( v, x );
+	for( uint32 k = 0; k < 4; ++k ) v[k] = sqrtf( v[k] );
+	return vld1q_f32( v );
+#endif
+}
+
+
+static inline float32x4_t divNEON( float32x4_t a, float32x4_t b )
+{
+#if defined( __aarch64__ )
+	return vdivq_f32( a, b );
+#else
+	float u[4], v[4];
+	vst1q_f32( u, a );
+	vst1q_f32( v, b );
+	for( uint32 k = 0; k < 4; ++k ) u[k] /= v[k];
+	return vld1q_f32( u );
+#endif
+}
+
+
+// Wraps the lanes of x that are outside like wrapDot; returns the mask of the lanes that could not
+// be wrapped
+static inline uint32x4_t wrapDotsNEON( float32x4_t *x, const float32x4_t *v, uint32x4_t outside, uint32 numAxes,
+                                       const DotFieldStepParams &params )
+{
+	const float32x4_t zero = vdupq_n_f32( 0.0f );
+	if( params.shape == DotApertureShapes::Box )
+	{
+		for( uint32 c = 0; c < numAxes; ++c )
+		{
+			float32x4_t w = zero;
+			if( params.aperture[c] > 0 )
+			{
+				// Floor of the quotient, which is small enough for a conversion to int
+				float32x4_t size = vdupq_n_f32( 2 * params.aperture[c] );
+				float32x4_t n = divNEON( vaddq_f32( x[c], vdupq_n_f32( params.aperture[c] ) ), size );
+				float32x4_t f = vcvtq_f32_s32( vcvtq_s32_f32( n ) );
+				f = vsubq_f32( f, vreinterpretq_f32_u32( vandq_u32( vcgtq_f32( f, n ),
+				                                                    vreinterpretq_u32_f32( vdupq_n_f32( 1.0f ) ) ) ) );
+				w = vsubq_f32( x[c], vmulq_f32( size, f ) );
+			}
+			x[c] = vbslq_f32( outside, w, x[c] );
+		}
+		return vdupq_n_u32( 0 );
+	}
+
+	float32x4_t qa = zero, qb = zero, qc = vdupq_n_f32( -1.0f );
+	for( uint32 c = 0; c < numAxes; ++c )
+	{
+		float32x4_t q = vmulq_n_f32( x[c], params.invAperture[c] ), d = vmulq_n_f32( v[c], params.invAperture[c] );
+		qa = vaddq_f32( qa, vmulq_f32( d, d ) );
+		qb = vaddq_f32( qb, vmulq_f32( q, d ) );
+		qc = vaddq_f32( qc, vmulq_f32( q, q ) );
+	}
+	float32x4_t disc = vsubq_f32( vmulq_f32( qb, qb ), vmulq_f32( qa, qc ) );
+	uint32x4_t wrap = vandq_u32( outside, vandq_u32( vcgtq_f32( qa, zero ), vcgeq_f32( disc, zero ) ) );
+
+	float32x4_t root = sqrtNEON( disc );
+	float32x4_t tExit = divNEON( vsubq_f32( qb, root ), qa ), tEntry = divNEON( vaddq_f32( qb, root ), qa );
+	float32x4_t chord = vsubq_f32( tEntry, tExit );
+	float32x4_t t = vbslq_f32( vandq_u32( vcgeq_f32( tExit, zero ), vcleq_f32( tExit, chord ) ), chord, tEntry );
+	for( uint32 c = 0; c < numAxes; ++c ) x[c] = vbslq_f32( wrap, vsubq_f32( x[c], vmulq_f32( t, v[c] ) ), x[c] );
+
+	return vbicq_u32( outside, wrap );
+}
+
+
+static uint32 moveDotsNEON( const DotStreams &s, uint32 count, const DotFieldStepParams &params,
+                            uint32 *indices )
+{
+	float *pos[3];
+	const float *dir[3];
+	float32x4_t signalVel[3], aperture[3], invAperture[3];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		pos[c] = s.channel( DotStateChannels::PosX + c );
+		dir[c] = s.direction( c );
+		signalVel[c] = vdupq_n_f32( params.signalVel[c] );
+		aperture[c] = vdupq_n_f32( params.aperture[c] );
+		invAperture[c] = vdupq_n_f32( params.invAperture[c] );
+	}
+	const float *signal = s.channel( DotStateChannels::Signal );
+	float *life = s.channel( DotStateChannels::Life );
+	float32x4_t dt = vdupq_n_f32( params.timeDelta );
+	float32x4_t noiseSpeed = vdupq_n_f32( params.noiseSpeed );
+	float32x4_t coherence = vdupq_n_f32( params.coherence );
+	float32x4_t lifeStep = vdupq_n_f32( params.lifeStep );
+	float32x4_t deathLevel = vdupq_n_f32( params.deathLevel );
+	float32x4_t lifetime = vdupq_n_f32( params.lifetime );
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numAxes = params.aperture[2] > 0 ? 3 : 2;
+	bool mortal = params.lifeStep != 0;
+	uint32 numPlaced = 0;
+
+	uint32 i = 0;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		uint32x4_t isSignal = vcltq_f32( vld1q_f32( signal + i ), coherence );
+		uint32x4_t outside = vdupq_n_u32( 0 );
+		float32x4_t x[3], v[3], r2 = vdupq_n_f32( 0.0f );
+
+		for( uint32 c = 0; c < numAxes; ++c )
+		{
+			v[c] = vbslq_f32( isSignal, signalVel[c], vmulq_f32( vld1q_f32( dir[c] + i ), noiseSpeed ) );
+			x[c] = vaddq_f32( vld1q_f32( pos[c] + i ), vmulq_f32( v[c], dt ) );
+			outside = vorrq_u32( outside, vcgtq_f32( vabsq_f32( x[c] ), aperture[c] ) );
+			float32x4_t q = vmulq_f32( x[c], invAperture[c] );
+			r2 = vaddq_f32( r2, vmulq_f32( q, q ) );
+		}
+		if( !box ) outside = vcgtq_f32( r2, vdupq_n_f32( 1.0f ) );
+
+		// Most groups stay inside, they skip the wrapping
+		uint32x4_t lost = vdupq_n_u32( 0 );
+		uint32x2_t any = vorr_u32( vget_low_u32( outside ), vget_high_u32( outside ) );
+		if( (vget_lane_u32( any, 0 ) | vget_lane_u32( any, 1 )) != 0 )
+			lost = wrapDotsNEON( x, v, outside, numAxes, params );
+		for( uint32 c = 0; c < numAxes; ++c ) vst1q_f32( pos[c] + i, x[c] );
+
+		uint32x4_t dead = vdupq_n_u32( 0 );
+		if( mortal )
+		{
+			float32x4_t l = vsubq_f32( vld1q_f32( life + i ), lifeStep );
+			dead = vcleq_f32( l, deathLevel );
+			float32x4_t renewed = vaddq_f32( l, lifetime );
+			renewed = vbslq_f32( vcleq_f32( renewed, vdupq_n_f32( 0.0f ) ), lifetime, renewed );
+			vst1q_f32( life + i, vbslq_f32( dead, renewed, l ) );
+		}
+
+		uint32x4_t placed = vorrq_u32( lost, dead );
+		uint32x2_t anyPlaced = vorr_u32( vget_low_u32( placed ), vget_high_u32( placed ) );
+		if( (vget_lane_u32( anyPlaced, 0 ) | vget_lane_u32( anyPlaced, 1 )) == 0 ) continue;
+		uint32 placedMask[4];
+		vst1q_u32( placedMask, placed );
+		for( uint32 k = 0; k < 4; ++k )
+		{
+			indices[numPlaced] = i + k;
+			numPlaced += placedMask[k] & 1;
+		}
+	}
+
+	if( i < count )
+	{
+		uint32 numTail = moveDotsScalar( s.offset( i ), count - i, params, indices + numPlaced );
+		for( uint32 k = 0; k < numTail; ++k ) indices[numPlaced++] += i;
+	}
+	return numPlaced;
+}
+
+
+static void transformDotsNEON( const DotStreams &s, uint32 count, const DotFieldStepParams &params )
+{
+	const float *pos[3];
+	for( uint32 c = 0; c < 3; ++c ) pos[c] = s.channel( DotStateChannels::PosX + c );
+	const float *m = params.transform;
+	bool planar = params.aperture[2] == 0;
+
+	uint32 i = 0;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		float32x4_t x = vld1q_f32( pos[0] + i ), y = vld1q_f32( pos[1] + i );
+		float32x4_t z = planar ? vdupq_n_f32( 0.0f ) : vld1q_f32( pos[2] + i );
+		float32x4x3_t w;
+		for( uint32 r = 0; r < 3; ++r )
+		{
+			w.val[r] = vaddq_f32( vaddq_f32( vaddq_f32( vmulq_n_f32( x, m[r * 4 + 0] ), vmulq_n_f32( y, m[r * 4 + 1] ) ),
+			                                 vmulq_n_f32( z, m[r * 4 + 2] ) ), vdupq_n_f32( m[r * 4 + 3] ) );
+		}
+		vst3q_f32( s.positions + i * 3, w );
+	}
+
+	if( i < count ) transformDotsScalar( s.offset( i ), count - i, params );
+}
+
+
+static inline float32x4_t nextRandomNEON( uint32x4_t *w )
+{
+	uint32x4_t result = vaddq_u32( w[0], w[3] );
+	uint32x4_t t = vshlq_n_u32( w[1], 9 );
+	w[2] = veorq_u32( w[2], w[0] );
+	w[3] = veorq_u32( w[3], w[1] );
+	w[1] = veorq_u32( w[1], w[2] );
+	w[0] = veorq_u32( w[0], w[3] );
+	w[2] = veorq_u32( w[2], t );
+	w[3] = vorrq_u32( vshlq_n_u32( w[3], 11 ), vshrq_n_u32( w[3], 21 ) );
+	return vmulq_n_f32( vcvtq_f32_u32( vshrq_n_u32( result, 8 ) ), DotRandomScale );
+}
+
+
+static inline void randomCirclePointNEON( float32x4_t u, float32x4_t &x, float32x4_t &y )
+{
+	float32x4_t t = vmulq_n_f32( u, 4.0f );
+	uint32x4_t quadrant = vcvtq_u32_f32( t );
+	float32x4_t a = vmulq_n_f32( vsubq_f32( vsubq_f32( t, vcvtq_f32_u32( quadrant ) ), vdupq_n_f32( 0.5f ) ), HalfPi );
+	float32x4_t a2 = vmulq_f32( a, a );
+	float32x4_t s = vaddq_f32( vdupq_n_f32( SinC5 ), vmulq_n_f32( a2, SinC7 ) );
+	s = vaddq_f32( vdupq_n_f32( SinC3 ), vmulq_f32( a2, s ) );
+	s = vaddq_f32( a, vmulq_f32( vmulq_f32( a, a2 ), s ) );
+	float32x4_t c = vaddq_f32( vdupq_n_f32( CosC6 ), vmulq_n_f32( a2, CosC8 ) );
+	c = vaddq_f32( vdupq_n_f32( CosC4 ), vmulq_f32( a2, c ) );
+	c = vaddq_f32( vdupq_n_f32( CosC2 ), vmulq_f32( a2, c ) );
+	c = vaddq_f32( vdupq_n_f32( 1.0f ), vmulq_f32( a2, c ) );
+
+	float32x4_t qx = vmulq_n_f32( vsubq_f32( c, s ), SqrtHalf );
+	float32x4_t qy = vmulq_n_f32( vaddq_f32( c, s ), SqrtHalf );
+	const uint32x4_t one = vdupq_n_u32( 1 ), two = vdupq_n_u32( 2 );
+	uint32x4_t swap = vceqq_u32( vandq_u32( quadrant, one ), one );
+	float32x4_t rx = vbslq_f32( swap, qy, qx ), ry = vbslq_f32( swap, qx, qy );
+	x = vreinterpretq_f32_u32( veorq_u32( vreinterpretq_u32_f32( rx ),
+	                                      vshlq_n_u32( vandq_u32( vaddq_u32( quadrant, one ), two ), 30 ) ) );
+	y = vreinterpretq_f32_u32( veorq_u32( vreinterpretq_u32_f32( ry ), vshlq_n_u32( vandq_u32( quadrant, two ), 30 ) ) );
+}
+
+
+static inline void randomDirectionNEON( float32x4_t a, float32x4_t b, bool planar, float32x4_t *dir )
+{
+	randomCirclePointNEON( a, dir[0], dir[1] );
+	if( planar ) return;
+	
+	float32x4_t z = vsubq_f32( vmulq_n_f32( b, 2.0f ), vdupq_n_f32( 1.0f ) );
+	float32x4_t r = sqrtNEON( vmaxq_f32( vsubq_f32( vdupq_n_f32( 1.0f ), vmulq_f32( z, z ) ), vdupq_n_f32( 0.0f ) ) );
+	dir[0] = vmulq_f32( dir[0], r );
+	dir[1] = vmulq_f32( dir[1], r );
+	dir[2] = z;
+}
+
+
+// Like randomPosition, for the getNumPositionValues values in rnd; the parameters are passed
+// separately, so that the callers keep them in registers
+static inline void randomPositionNEON( const float32x4_t *rnd, bool box, bool planar, const float32x4_t *aperture,
+                                       float32x4_t *pos )
+{
+	if( box )
+	{
+		for( uint32 c = 0; c < (planar ? 2u : 3u); ++c )
+			pos[c] = vmulq_f32( vsubq_f32( vmulq_n_f32( rnd[c], 2.0f ), vdupq_n_f32( 1.0f ) ), aperture[c] );
+		if( planar ) pos[2] = vdupq_n_f32( 0.0f );
+	}
+	else if( planar )
+	{
+		float32x4_t r = sqrtNEON( rnd[1] );
+		randomCirclePointNEON( rnd[0], pos[0], pos[1] );
+		for( uint32 c = 0; c < 2; ++c ) pos[c] = vmulq_f32( pos[c], vmulq_f32( r, aperture[c] ) );
+		pos[2] = vdupq_n_f32( 0.0f );
+	}
+	else
+	{
+		float32x4_t r = vmaxq_f32( rnd[2], vmaxq_f32( rnd[3], rnd[4] ) );
+		randomDirectionNEON( rnd[0], rnd[1], false, pos );
+		for( uint32 c = 0; c < 3; ++c ) pos[c] = vmulq_f32( pos[c], vmulq_f32( r, aperture[c] ) );
+	}
+}
+
+
+static void applyNoiseNEON( const DotStreams &s, uint32 count, const DotFieldStepParams &params,
+                            DotRandomStream &stream )
+{
+	bool planar = params.aperture[2] == 0;
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numAxes = planar ? 2 : 3;
+	bool walk = params.noiseType == DotNoiseTypes::Walk;
+	uint32 numValues = getNumNoiseValues( params );
+	float *channels[3];
+	float32x4_t aperture[3];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		channels[c] = walk ? s.direction( c ) : s.channel( DotStateChannels::PosX + c );
+		aperture[c] = vdupq_n_f32( params.aperture[c] );
+	}
+	const float *signal = s.channel( DotStateChannels::Signal );
+	float32x4_t coherence = vdupq_n_f32( params.coherence );
+	uint32x4_t w[4];
+	for( uint32 k = 0; k < 4; ++k ) w[k] = vld1q_u32( stream.words[k] );
+
+	// Like in applyNoiseSSE2, the loops of a random walk are separate
+	uint32 i = 0;
+	if( walk && planar )
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			float32x4_t x, y;
+			randomCirclePointNEON( nextRandomNEON( w ), x, y );
+			vst1q_f32( channels[0] + i, x );
+			vst1q_f32( channels[1] + i, y );
+		}
+	}
+	else if( walk )
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			float32x4_t a = nextRandomNEON( w ), b = nextRandomNEON( w );
+			float32x4_t v[3];
+			randomDirectionNEON( a, b, false, v );
+			for( uint32 c = 0; c < 3; ++c ) vst1q_f32( channels[c] + i, v[c] );
+		}
+	}
+	else
+	{
+		for( ; i + 4 <= count; i += 4 )
+		{
+			float32x4_t rnd[MaxNoiseValues];
+			for( uint32 k = 0; k < numValues; ++k ) rnd[k] = nextRandomNEON( w );
+			
+			float32x4_t v[3];
+			randomPositionNEON( rnd, box, planar, aperture, v );
+			
+			// Signal dots keep their position
+			uint32x4_t isSignal = vcltq_f32( vld1q_f32( signal + i ), coherence );
+			for( uint32 c = 0; c < numAxes; ++c )
+				vst1q_f32( channels[c] + i, vbslq_f32( isSignal, vld1q_f32( channels[c] + i ), v[c] ) );
+		}
+	}
+
+	for( uint32 k = 0; k < 4; ++k ) vst1q_u32( stream.words[k], w[k] );
+	if( i < count ) applyNoiseScalar( s.offset( i ), count - i, params, stream );
+}
+
+
+static void placeDotsNEON( const DotStreams &s, const uint32 *indices, uint32 count,
+                           const DotFieldStepParams &params, DotRandomStream &stream )
+{
+	bool planar = params.aperture[2] == 0;
+	bool box = params.shape == DotApertureShapes::Box;
+	uint32 numDirValues = getNumDirectionValues( params );
+	uint32 numValues = getNumPlacementValues( params );
+	float32x4_t aperture[3];
+	for( uint32 c = 0; c < 3; ++c ) aperture[c] = vdupq_n_f32( params.aperture[c] );
+	uint32x4_t w[4];
+	for( uint32 k = 0; k < 4; ++k ) w[k] = vld1q_u32( stream.words[k] );
+
+	for( uint32 j = 0; j < count; j += 4 )
+	{
+		float32x4_t rnd[MaxPlacementValues];
+		for( uint32 k = 0; k < numValues; ++k ) rnd[k] = nextRandomNEON( w );
+
+		// The dots are scattered, so the lanes are written separately; the last group may be incomplete
+		float values[DotStateChannels::Life][4];
+		float32x4_t v[3];
+		randomPositionNEON( rnd + numDirValues, box, planar, aperture, v );
+		for( uint32 c = 0; c < 3; ++c ) vst1q_f32( values[DotStateChannels::PosX + c], v[c] );
+		randomDirectionNEON( rnd[0], rnd[1], planar, v );
+		if( planar ) v[2] = vdupq_n_f32( 0.0f );
+		for( uint32 c = 0; c < 3; ++c ) vst1q_f32( values[DotStateChannels::DirX + c], v[c] );
+		vst1q_f32( values[DotStateChannels::Signal], rnd[numValues - 1] );
+
+		for( uint32 k = 0, last = std::min( 4u, count - j ); k < last; ++k )
+		{
+			for( uint32 c = 0; c < DotStateChannels::Life; ++c ) s.channel( c )[indices[j + k]] = values[c][k];
+		}
+	}
+
+	for( uint32 k = 0; k < 4; ++k ) vst1q_u32( stream.words[k], w[k] );
+}
+
+#endif
+
+
+// =================================================================================================
+// Kernel selection
+// =================================================================================================
+
+DotMoveFunc getDotMoveFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return moveDotsScalar;
+#if defined( SIMD_SSE2 )
+	case ParticleSimKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? moveDotsSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case ParticleSimKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? moveDotsNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+DotTransformFunc getDotTransformFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return transformDotsScalar;
+#if defined( SIMD_SSE2 )
+	case ParticleSimKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? transformDotsSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case ParticleSimKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? transformDotsNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+DotNoiseFunc getDotNoiseFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return applyNoiseScalar;
+#if defined( SIMD_SSE2 )
+	case ParticleSimKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? applyNoiseSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case ParticleSimKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? applyNoiseNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+DotPlaceFunc getDotPlaceFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return placeDotsScalar;
+#if defined( SIMD_SSE2 )
+	case ParticleSimKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? placeDotsSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case ParticleSimKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? placeDotsNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+// *************************************************************************************************
+// DotFieldNode
+// *************************************************************************************************
+
+DotMoveFunc DotFieldNode::moveFunc = getDotMoveFunc( ParticleSimKernels::Scalar );
+DotTransformFunc DotFieldNode::transformFunc = getDotTransformFunc( ParticleSimKernels::Scalar );
+DotNoiseFunc DotFieldNode::noiseFunc = getDotNoiseFunc( ParticleSimKernels::Scalar );
+DotPlaceFunc DotFieldNode::placeFunc = getDotPlaceFunc( ParticleSimKernels::Scalar );
+
+
+DotFieldNode::DotFieldNode( const DotFieldNodeTpl &dotFieldTpl ) :
+	ParticleNode( dotFieldTpl )
+{
+	_materialRes = dotFieldTpl.matRes;
+	_seed = dotFieldTpl.hasSeed ? dotFieldTpl.seed : newRandomSeed();
+	_step = 0;
+	_apertureShape = dotFieldTpl.apertureShape;
+	_noiseType = dotFieldTpl.noiseType;
+	_depthSort = dotFieldTpl.depthSort;
+	_aperture = Vec3f( maxf( dotFieldTpl.aperture[0], 0 ), maxf( dotFieldTpl.aperture[1], 0 ),
+	                   maxf( dotFieldTpl.aperture[2], 0 ) );
+	_direction = Vec3f( dotFieldTpl.direction[0], dotFieldTpl.direction[1], dotFieldTpl.direction[2] );
+	_speed = dotFieldTpl.speed;
+	_coherence = dotFieldTpl.coherence;
+	_lifetime = maxf( dotFieldTpl.lifetime, 0 );
+	_dotSize = dotFieldTpl.dotSize;
+	for( uint32 c = 0; c < 4; ++c ) _color[c] = dotFieldTpl.color[c];
+
+	_dotCount = 0;
+	_dotState = 0x0;
+	_renderDataDirty[0] = _renderDataDirty[1] = true;
+
+	setupStep( 0 );
+	setDotCount( dotFieldTpl.dotCount );
+}
+
+
+DotFieldNode::~DotFieldNode()
+{
+	delete[] _dotState;
+}
+
+
+SceneNodeTpl *DotFieldNode::parsingFunc( map< string, string > &attribs )
+{
+	bool result = true;
+
+	map< string, string >::iterator itr;
+	DotFieldNodeTpl *dotFieldTpl = new DotFieldNodeTpl( "", 0x0, 0 );
+
+	itr = attribs.find( "material" );
+	if( itr != attribs.end() )
+	{
+		uint32 res = Modules::resMan().addResource( ResourceTypes::Material, itr->second, 0, false );
+		if( res != 0 )
+			dotFieldTpl->matRes = (MaterialResource *)Modules::resMan().resolveResHandle( res );
+	}
+	else result = false;
+	itr = attribs.find( "dotCount" );
+	if( itr != attribs.end() ) dotFieldTpl->dotCount = atoi( itr->second.c_str() );
+	else result = false;
+	itr = attribs.find( "seed" );
+	if( itr != attribs.end() )
+	{
+		dotFieldTpl->seed = (uint32)atoi( itr->second.c_str() );
+		dotFieldTpl->hasSeed = true;
+	}
+	itr = attribs.find( "apertureShape" );
+	if( itr != attribs.end() )
+	{
+		if( _stricmp( itr->second.c_str(), "BOX" ) == 0 )
+			dotFieldTpl->apertureShape = DotApertureShapes::Box;
+		else if( _stricmp( itr->second.c_str(), "ELLIPSOID" ) == 0 )
+			dotFieldTpl->apertureShape = DotApertureShapes::Ellipsoid;
+		else result = false;
+	}
+	itr = attribs.find( "noiseType" );
+	if( itr != attribs.end() )
+	{
+		if( _stricmp( itr->second.c_str(), "DIRECTION" ) == 0 )
+			dotFieldTpl->noiseType = DotNoiseTypes::Direction;
+		else if( _stricmp( itr->second.c_str(), "WALK" ) == 0 )
+			dotFieldTpl->noiseType = DotNoiseTypes::Walk;
+		else if( _stricmp( itr->second.c_str(), "POSITION" ) == 0 )
+			dotFieldTpl->noiseType = DotNoiseTypes::Position;
+		else result = false;
+	}
+	itr = attribs.find( "depthSort" );
+	if( itr != attribs.end() )
+	{
+		if ( _stricmp( itr->second.c_str(), "true" ) == 0 || _stricmp( itr->second.c_str(), "1" ) == 0 )
+			dotFieldTpl->depthSort = true;
+	}
+	itr = attribs.find( "apertureX" );
+	if( itr != attribs.end() ) dotFieldTpl->aperture[0] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "apertureY" );
+	if( itr != attribs.end() ) dotFieldTpl->aperture[1] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "apertureZ" );
+	if( itr != attribs.end() ) dotFieldTpl->aperture[2] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "dirX" );
+	if( itr != attribs.end() ) dotFieldTpl->direction[0] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "dirY" );
+	if( itr != attribs.end() ) dotFieldTpl->direction[1] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "dirZ" );
+	if( itr != attribs.end() ) dotFieldTpl->direction[2] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "speed" );
+	if( itr != attribs.end() ) dotFieldTpl->speed = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "coherence" );
+	if( itr != attribs.end() ) dotFieldTpl->coherence = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "lifetime" );
+	if( itr != attribs.end() ) dotFieldTpl->lifetime = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "dotSize" );
+	if( itr != attribs.end() ) dotFieldTpl->dotSize = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "colR" );
+	if( itr != attribs.end() ) dotFieldTpl->color[0] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "colG" );
+	if( itr != attribs.end() ) dotFieldTpl->color[1] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "colB" );
+	if( itr != attribs.end() ) dotFieldTpl->color[2] = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "colA" );
+	if( itr != attribs.end() ) dotFieldTpl->color[3] = (float)atof( itr->second.c_str() );
+
+	if( !result )
+	{
+		delete dotFieldTpl; dotFieldTpl = 0x0;
+	}
+
+	return dotFieldTpl;
+}
+
+
+SceneNode *DotFieldNode::factoryFunc( const SceneNodeTpl &nodeTpl )
+{
+	if( nodeTpl.type != SceneNodeTypes::DotField ) return 0x0;
+
+	return new DotFieldNode( *(DotFieldNodeTpl *)&nodeTpl );
+}
+
+
+void DotFieldNode::setDotCount( uint32 dotCount )
+{
+	delete[] _dotState; _dotState = 0x0;
+
+	// The render data is only valid after the first update
+	_dotCount = dotCount;
+	_aliveCount = 0;
+	_dotState = new float[_dotCount * DotStateChannels::Count];
+	allocRenderData( _dotCount );
+	_renderDataDirty[0] = _renderDataDirty[1] = true;
+	++_parDataVersion;
+
+	placeDots( false );
+}
+
+
+DotStreams DotFieldNode::getStreams()
+{
+	DotStreams streams;
+	streams.state = _dotState;
+	streams.stride = _dotCount;
+	streams.positions = _parPositions;
+	streams.dirs = streams.channel( DotStateChannels::DirX );
+	streams.dirStride = _dotCount;
+
+	return streams;
+}
+
+
+void DotFieldNode::placeDots( bool livesOnly )
+{
+	// All dots are placed with the random values of step 0; the lives are drawn first, so they are
+	// the same if only the lifetime changes
+	uint32 indices[DotBlockSize];
+	for( uint32 k = 0; k < DotBlockSize; ++k ) indices[k] = k;
+	float lives[4];
+	DotRandomStream stream;
+	DotStreams streams = getStreams();
+	float *life = streams.channel( DotStateChannels::Life );
+	setupStep( 0 );
+
+	for( uint32 chunk = 0; chunk < _dotCount; chunk += DotChunkSize )
+	{
+		uint32 count = std::min( DotChunkSize, _dotCount - chunk );
+		seedRandomStream( stream, _seed, 0, chunk / DotChunkSize );
+		
+		// Deaths are spread evenly over the lifetime
+		for( uint32 i = chunk; i < chunk + count; i += 4 )
+		{
+			nextRandomValues( stream, lives );
+			for( uint32 k = 0; k < 4 && i + k < chunk + count; ++k ) life[i + k] = _lifetime * lives[k];
+		}
+		
+		if( livesOnly ) continue;
+		for( uint32 block = chunk; block < chunk + count; block += DotBlockSize )
+		{
+			placeFunc( streams.offset( block ), indices, std::min( DotBlockSize, chunk + count - block ),
+			           _stepParams, stream );
+		}
+	}
+
+	if( !livesOnly ) _step = 0;
+}
+
+
+void DotFieldNode::setupStep( float timeDelta )
+{
+	DotFieldStepParams &p = _stepParams;
+	bool planar = _aperture.z == 0;
+
+	p.timeDelta = timeDelta;
+	p.noiseType = _noiseType;
+	Vec3f dir = _direction;
+	if( planar ) dir.z = 0;
+	float len = dir.length();
+	for( uint32 c = 0; c < 3; ++c ) p.signalVel[c] = len > 0 ? dir[c] / len * _speed : 0;
+	p.noiseSpeed = _noiseType == DotNoiseTypes::Position ? 0 : _speed;
+	p.coherence = _coherence;
+	p.lifeStep = _lifetime > 0 ? timeDelta : 0;
+	p.deathLevel = _lifetime > 0 ? 0 : -Math::MaxFloat;
+	p.lifetime = _lifetime;
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		p.aperture[c] = _aperture[c];
+		p.invAperture[c] = _aperture[c] > 0 ? 1.0f / _aperture[c] : 0;
+	}
+	p.shape = _apertureShape;
+
+	for( uint32 r = 0; r < 3; ++r )
+	{
+		for( uint32 c = 0; c < 4; ++c ) p.transform[r * 4 + c] = _absTrans.c[c][r];
+	}
+}
+
+
+void DotFieldNode::updateChunkFunc( void *userData, unsigned int index )
+{
+	DotFieldNode *node = (DotFieldNode *)userData;
+	uint32 first = index * DotChunkSize;
+	node->updateChunk( first, std::min( DotChunkSize, node->_dotCount - first ) );
+}
+
+
+void DotFieldNode::updateChunk( uint32 first, uint32 count )
+{
+	uint32 indices[DotBlockSize];
+	const DotFieldStepParams &p = _stepParams;
+
+	// Noise dots of the walk and position types need values in every step; the directions of a
+	// random walk only last for the step, so they stay in the cache instead of the Dir channels.
+	// If no noise dot moves, the kernels read zero directions from the cache as well.
+	bool noise = _noiseType != DotNoiseTypes::Direction && p.coherence < 1;
+	bool walk = noise && _noiseType == DotNoiseTypes::Walk;
+	bool still = !walk && (_noiseType == DotNoiseTypes::Position || p.coherence >= 1);
+	float blockDirs[3 * DotBlockSize];
+	if( still ) memset( blockDirs, 0, DotBlockSize * sizeof( float ) );
+	DotRandomStream stream;
+	if( p.timeDelta != 0 ) seedRandomStream( stream, _seed, _step, first / DotChunkSize );
+
+	for( uint32 block = first; block < first + count; block += DotBlockSize )
+	{
+		uint32 n = std::min( DotBlockSize, first + count - block );
+		DotStreams s = getStreams().offset( block );
+		if( walk || still )
+		{
+			s.dirs = blockDirs;
+			s.dirStride = walk ? DotBlockSize : 0;
+		}
+
+		if( p.timeDelta != 0 )
+		{
+			if( noise ) noiseFunc( s, n, p, stream );
+
+			// Dots that die or can't be wrapped are placed again
+			uint32 numPlaced = moveFunc( s, n, p, indices );
+			if( numPlaced > 0 ) placeFunc( s, indices, numPlaced, p, stream );
+		}
+
+		transformFunc( s, n, p );
+	}
+}
+
+
+void DotFieldNode::updateRenderData()
+{
+	// Sizes and colors are equal for all dots
+	for( uint32 i = 0; i < _dotCount; ++i )
+	{
+		_parSizesANDRotations[i * 2 + 0] = _dotSize;
+		_parSizesANDRotations[i * 2 + 1] = 0;
+		for( uint32 c = 0; c < 4; ++c ) _parColors[i * 4 + c] = _color[c];
+	}
+	_renderDataDirty[_parBuffer] = false;
+}
+
+
+void DotFieldNode::updateBounds()
+{
+	// Dots never leave the aperture, so the box does not depend on them
+	float margin = _dotSize * 0.5f;
+	BoundingBox box;
+	box.min = Vec3f( -_aperture.x, -_aperture.y, -_aperture.z );
+	box.max = _aperture;
+	box.transform( _absTrans );
+	_bBox.min = box.min - Vec3f( margin, margin, margin );
+	_bBox.max = box.max + Vec3f( margin, margin, margin );
+
+	// Avoid zero box dimensions for planes
+	if( _bBox.max.x - _bBox.min.x == 0 ) _bBox.max.x += Math::Epsilon;
+	if( _bBox.max.y - _bBox.min.y == 0 ) _bBox.max.y += Math::Epsilon;
+	if( _bBox.max.z - _bBox.min.z == 0 ) _bBox.max.z += Math::Epsilon;
+}
+
+
+void DotFieldNode::update( float timeDelta )
+{
+	Timer *timer = Modules::stats().getTimer( EngineStats::ParticleSimTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+
+	// Update absolute transformation
+	updateTree();
+
+	// In the snapshot, the positions are written to the second set of arrays; they do not depend on
+	// the previous ones
+	detachSnapshotData();
+
+	// A zero time delta only moves the dots with the node
+	if( timeDelta != 0 ) ++_step;
+	setupStep( timeDelta );
+
+	uint32 numChunks = (_dotCount + DotChunkSize - 1) / DotChunkSize;
+	Modules::threadPool().parallelFor( numChunks, updateChunkFunc, this );
+
+	if( _renderDataDirty[_parBuffer] ) updateRenderData();
+	updateBounds();
+	_aliveCount = _dotCount;
+	++_parDataVersion;
+
+	timer->setEnabled( false );
+}
+
+
+int DotFieldNode::getDotData( int maxCount, float *positions, float *signal )
+{
+	uint32 count = std::min( (uint32)std::max( maxCount, 0 ), _aliveCount );
+	if( positions != 0x0 ) memcpy( positions, _parPositions, count * 3 * sizeof( float ) );
+	if( signal != 0x0 )
+	{
+		const float *values = _dotState + DotStateChannels::Signal * _dotCount;
+		for( uint32 i = 0; i < count; ++i )
+			signal[i] = values[i] < _stepParams.coherence ? 1.0f : 0.0f;
+	}
+
+	return (int)_aliveCount;
+}
+
+
+int DotFieldNode::getParamI( int param )
+{
+	switch( param )
+	{
+	case DotFieldNodeParams::MatResI:
+		if( _materialRes != 0x0 ) return _materialRes->getHandle();
+		else return 0;
+	case DotFieldNodeParams::DotCountI:
+		return (int)_dotCount;
+	case DotFieldNodeParams::SeedI:
+		return (int)_seed;
+	case DotFieldNodeParams::ApertureShapeI:
+		return _apertureShape;
+	case DotFieldNodeParams::NoiseTypeI:
+		return _noiseType;
+	case DotFieldNodeParams::DepthSortI:
+		return _depthSort ? 1 : 0;
+	}
+
+	return SceneNode::getParamI( param );
+}
+
+
+void DotFieldNode::setParamI( int param, int value )
+{
+	Resource *res;
+
+	switch( param )
+	{
+	case DotFieldNodeParams::MatResI:
+		res = Modules::resMan().resolveResHandle( value );
+		if( res != 0x0 && res->getType() == ResourceTypes::Material )
+			_materialRes = (MaterialResource *)res;
+		else
+			Modules::setError( "Invalid handle in h3dSetNodeParamI for H3DDotField::MatResI" );
+		return;
+	case DotFieldNodeParams::DotCountI:
+		if( value >= 0 )
+			setDotCount( (uint32)value );
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DDotField::DotCountI" );
+		return;
+	case DotFieldNodeParams::SeedI:
+		// The dots are placed again so that the same seed yields the same stimulus again
+		_seed = (uint32)value;
+		placeDots( false );
+		return;
+	case DotFieldNodeParams::ApertureShapeI:
+		if( value == DotApertureShapes::Box || value == DotApertureShapes::Ellipsoid )
+		{
+			_apertureShape = value;
+			placeDots( false );
+		}
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DDotField::ApertureShapeI" );
+		return;
+	case DotFieldNodeParams::NoiseTypeI:
+		if( value >= DotNoiseTypes::Direction && value <= DotNoiseTypes::Position )
+			_noiseType = value;
+		else
+			Modules::setError( "Invalid value in h3dSetNodeParamI for H3DDotField::NoiseTypeI" );
+		return;
+	case DotFieldNodeParams::DepthSortI:
+		_depthSort = value != 0;
+		return;
+	}
+
+	SceneNode::setParamI( param, value );
+}
+
+
+float DotFieldNode::getParamF( int param, int compIdx )
+{
+	switch( param )
+	{
+	case DotFieldNodeParams::ApertureF3:
+		if( (unsigned)compIdx < 3 ) return _aperture[compIdx];
+		break;
+	case DotFieldNodeParams::DirectionF3:
+		if( (unsigned)compIdx < 3 ) return _direction[compIdx];
+		break;
+	case DotFieldNodeParams::SpeedF:
+		return _speed;
+	case DotFieldNodeParams::CoherenceF:
+		return _coherence;
+	case DotFieldNodeParams::LifetimeF:
+		return _lifetime;
+	case DotFieldNodeParams::DotSizeF:
+		return _dotSize;
+	case DotFieldNodeParams::ColorF4:
+		if( (unsigned)compIdx < 4 ) return _color[compIdx];
+		break;
+	}
+
+	return SceneNode::getParamF( param, compIdx );
+}
+
+
+void DotFieldNode::setParamF( int param, int compIdx, float value )
+{
+	switch( param )
+	{
+	case DotFieldNodeParams::ApertureF3:
+		if( (unsigned)compIdx < 3 )
+		{
+			// The dots are spread over the new aperture
+			_aperture[compIdx] = maxf( value, 0 );
+			placeDots( false );
+			return;
+		}
+		break;
+	case DotFieldNodeParams::DirectionF3:
+		if( (unsigned)compIdx < 3 )
+		{
+			_direction[compIdx] = value;
+			return;
+		}
+		break;
+	case DotFieldNodeParams::SpeedF:
+		_speed = value;
+		return;
+	case DotFieldNodeParams::CoherenceF:
+		_coherence = value;
+		return;
+	case DotFieldNodeParams::LifetimeF:
+		_lifetime = maxf( value, 0 );
+		placeDots( true );
+		return;
+	case DotFieldNodeParams::DotSizeF:
+		_dotSize = value;
+		_renderDataDirty[0] = _renderDataDirty[1] = true;
+		return;
+	case DotFieldNodeParams::ColorF4:
+		if( (unsigned)compIdx < 4 )
+		{
+			_color[compIdx] = value;
+			_renderDataDirty[0] = _renderDataDirty[1] = true;
+			return;
+		}
+		break;
+	}
+
+	SceneNode::setParamF( param, compIdx, value );
+}
+
+}  // namespace
@@ -0,0 +1,249 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egDotField_H_
+#define _egDotField_H_
+
+#include "egPrerequisites.h"
+#include "utMath.h"
+#include "egParticle.h"
+
+
+namespace Horde3D {
+
+// =================================================================================================
+// Dot Field Simulation
+// =================================================================================================
+
+// Dots are stored as structure of arrays in the local space of the node, which is the space of the
+// aperture. A dot is a signal dot while its signal value is below the coherence, so changing the
+// coherence changes the fraction of signal dots immediately.
+struct DotStateChannels
+{
+	enum List
+	{
+		PosX = 0,
+		PosY,
+		PosZ,
+		DirX,    // Direction of a noise dot
+		DirY,
+		DirZ,
+		Signal,  // Uniform in [0, 1), drawn when the dot is placed
+		Life,    // Remaining lifetime, unused for an infinite lifetime
+		Count
+	};
+};
+
+struct DotApertureShapes
+{
+	enum List
+	{
+		Box = 0,
+		Ellipsoid
+	};
+};
+
+struct DotNoiseTypes
+{
+	enum List
+	{
+		Direction = 0,  // Each noise dot keeps the random direction it got when it was placed
+		Walk,           // Noise dots get a new random direction every step
+		Position        // Noise dots are placed at a new random position every step
+	};
+};
+
+// Values that are equal for all dots of a field during a step
+struct DotFieldStepParams
+{
+	float  timeDelta;
+	int    noiseType;
+	float  signalVel[3];      // Velocity of signal dots
+	float  noiseSpeed;        // 0 for DotNoiseTypes::Position
+	float  coherence;
+	float  lifeStep, deathLevel;  // A dot dies when its life minus lifeStep drops to deathLevel; 0 for immortal dots
+	float  lifetime;          // Added to the life of a dead dot
+	float  aperture[3];       // Half extents; a zero z extent makes the field planar and z is skipped
+	float  invAperture[3];    // Reciprocal half extents, 0 for zero extents
+	int    shape;
+	float  transform[12];     // Local to world space, rows of a 3x4 matrix
+};
+
+struct DotStreams
+{
+	float   *state;      // DotStateChannels::Count arrays of stride floats
+	uint32  stride;
+	float   *positions;  // World space positions, interleaved xyz
+	float   *dirs;       // Noise directions read by the kernels, 3 arrays of dirStride floats;
+	uint32  dirStride;   // the Dir channels unless they only last for the step or are all zero
+
+	float *channel( int c ) const { return state + c * stride; }
+	float *direction( int c ) const { return dirs + c * dirStride; }
+
+	DotStreams offset( uint32 first ) const
+	{
+		DotStreams streams = *this;
+		streams.state += first;
+		streams.positions += first * 3;
+		streams.dirs += first;
+		return streams;
+	}
+};
+
+// Moves the first count dots by one step and decreases their life. Dots that leave the aperture
+// are wrapped to the opposite side, dots that die get a new lifetime. The indices of the dots that
+// died or can't be wrapped are written to indices in ascending order, since the caller has to place
+// them again; returns their number.
+typedef uint32 (*DotMoveFunc)( const DotStreams &streams, uint32 count, const DotFieldStepParams &params,
+                               uint32 *indices );
+
+// Writes the world space positions of the first count dots
+typedef void (*DotTransformFunc)( const DotStreams &streams, uint32 count, const DotFieldStepParams &params );
+
+// Random values of a chunk of dots come from a xoshiro128+ generator with four lanes, which is
+// seeded with Philox from the seed of the field, the step and the index of the chunk. A value takes
+// a few instructions instead of the ten Philox rounds, and it still only depends on the seed, the
+// step and the dot, since chunks have a fixed size and are updated in order on one thread.
+struct DotRandomStream
+{
+	uint32  words[4][4];  // State words of the four lanes
+};
+
+// Gives noise dots a new direction for DotNoiseTypes::Walk or a new position for
+// DotNoiseTypes::Position. Each group of four dots draws the same number of values from the
+// stream, one per dot and lane, also if the group is not complete.
+typedef void (*DotNoiseFunc)( const DotStreams &streams, uint32 count, const DotFieldStepParams &params,
+                              DotRandomStream &stream );
+
+// Places the count dots with the given indices at a random position in the aperture, with a random
+// direction and signal value; the values are drawn like those of DotNoiseFunc
+typedef void (*DotPlaceFunc)( const DotStreams &streams, const uint32 *indices, uint32 count,
+                              const DotFieldStepParams &params, DotRandomStream &stream );
+
+// The kernels are selected together with the particle simulation kernels, see ParticleSimKernels;
+// return 0x0 if the kernel is not available
+DotMoveFunc getDotMoveFunc( int kernel );
+DotTransformFunc getDotTransformFunc( int kernel );
+DotNoiseFunc getDotNoiseFunc( int kernel );
+DotPlaceFunc getDotPlaceFunc( int kernel );
+
+
+// =================================================================================================
+// DotField Node
+// =================================================================================================
+
+struct DotFieldNodeParams
+{
+	enum List
+	{
+		MatResI = 800,
+		DotCountI,
+		SeedI,
+		ApertureShapeI,
+		NoiseTypeI,
+		DepthSortI,
+		ApertureF3,
+		DirectionF3,
+		SpeedF,
+		CoherenceF,
+		LifetimeF,
+		DotSizeF,
+		ColorF4
+	};
+};
+
+// =================================================================================================
+
+struct DotFieldNodeTpl : public SceneNodeTpl
+{
+	PMaterialResource  matRes;
+	uint32             dotCount;
+	uint32             seed;
+	bool               hasSeed;  // Otherwise a seed is drawn from rand()
+	int                apertureShape, noiseType;
+	bool               depthSort;
+	float              aperture[3], direction[3];
+	float              speed, coherence, lifetime;
+	float              dotSize, color[4];
+
+	DotFieldNodeTpl( const std::string &name, MaterialResource *materialRes, uint32 dotCount ) :
+		SceneNodeTpl( SceneNodeTypes::DotField, name ),
+		matRes( materialRes ), dotCount( dotCount ), seed( 0 ), hasSeed( false ),
+		apertureShape( DotApertureShapes::Ellipsoid ), noiseType( DotNoiseTypes::Direction ),
+		depthSort( false ), speed( 1 ), coherence( 1 ), lifetime( 0 ), dotSize( 0.02f )
+	{
+		aperture[0] = 1; aperture[1] = 1; aperture[2] = 0;
+		direction[0] = 1; direction[1] = 0; direction[2] = 0;
+		color[0] = 1; color[1] = 1; color[2] = 1; color[3] = 1;
+	}
+};
+
+// =================================================================================================
+
+// Random dot kinematogram: a fixed number of dots inside an aperture, of which the coherent fraction
+// moves in a common direction and the rest moves according to the noise type. Dots that leave the
+// aperture are wrapped to the opposite side, dots that reach the end of their lifetime are placed
+// at a random position. All random values are a function of the seed, the step and the dot index
+// (see DotRandomStream), so a seed reproduces the same stimulus on every run, kernel and thread
+// count.
+class DotFieldNode : public ParticleNode
+{
+public:
+	static SceneNodeTpl *parsingFunc( std::map< std::string, std::string > &attribs );
+	static SceneNode *factoryFunc( const SceneNodeTpl &nodeTpl );
+
+	~DotFieldNode();
+
+	int getParamI( int param );
+	void setParamI( int param, int value );
+	float getParamF( int param, int compIdx );
+	void setParamF( int param, int compIdx, float value );
+
+	void update( float timeDelta );
+	int getDotData( int maxCount, float *positions, float *signal );
+
+public:
+	static DotMoveFunc         moveFunc;  // Kernels selected at init
+	static DotTransformFunc    transformFunc;
+	static DotNoiseFunc        noiseFunc;
+	static DotPlaceFunc        placeFunc;
+
+protected:
+	DotFieldNode( const DotFieldNodeTpl &dotFieldTpl );
+	void setDotCount( uint32 dotCount );
+	void placeDots( bool livesOnly );
+	void updateRenderData();
+	void updateBounds();
+	DotStreams getStreams();
+	void setupStep( float timeDelta );
+	void updateChunk( uint32 first, uint32 count );
+	static void updateChunkFunc( void *userData, unsigned int index );
+
+protected:
+	uint32              _dotCount;
+	uint32              _seed;
+	uint32              _step;  // Steps since the dots were placed; part of the random counter
+	int                 _apertureShape, _noiseType;
+	Vec3f               _aperture, _direction;
+	float               _speed, _coherence, _lifetime;
+	float               _dotSize, _color[4];
+
+	float               *_dotState;  // See DotStateChannels
+	DotFieldStepParams  _stepParams;
+	bool                _renderDataDirty[2];  // Sizes and colors have to be written again, per set of arrays
+
+	friend class SceneManager;
+	friend class Renderer;
+};
+
+}
+#endif // _egDotField_H_
@@ -0,0 +1,522 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egFrame.h"
+#include "egModules.h"
+#include "egCom.h"
+#include "egScene.h"
+#include "egModel.h"
+#include "egParticle.h"
+#include "egDotField.h"
+#include "utThreadPool.h"
+#include <set>
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+using namespace std;
+
+// Particles per work item of a batched emitter update; a multiple of the SIMD width
+static const uint32 ParticleChunkSize = 8192;
+
+
+// *************************************************************************************************
+// Class FrameManager
+// *************************************************************************************************
+
+FrameManager::FrameManager() :
+	_jobReady( false ), _busy( false ), _quit( false ), _recording( false ), _pending( false ),
+	_snapshotComplete( true )
+{
+}
+
+
+FrameManager::~FrameManager()
+{
+	// Let a running update finish; its results are discarded since the render device
+	// may not be available anymore
+	_mutex.lock();
+	_quit = true;
+	_mutex.unlock();
+	_jobCond.signal();
+	_thread.join();
+}
+
+
+void FrameManager::workerFunc( void *userData )
+{
+	FrameManager *frameMan = (FrameManager *)userData;
+
+	frameMan->_mutex.lock();
+	for(;;)
+	{
+		while( !frameMan->_jobReady && !frameMan->_quit ) frameMan->_jobCond.wait( frameMan->_mutex );
+		if( frameMan->_quit ) break;
+		frameMan->_jobReady = false;
+		frameMan->_mutex.unlock();
+
+		frameMan->runJobs();
+
+		frameMan->_mutex.lock();
+		frameMan->_busy = false;
+		frameMan->_doneCond.broadcast();
+	}
+	frameMan->_mutex.unlock();
+}
+
+
+void FrameManager::runJobs()
+{
+	SceneManager &sceneMan = Modules::sceneMan();
+
+	_jobEmitters.resize( 0 );
+	_jobTimeDeltas.resize( 0 );
+	
+	for( size_t i = 0, s = _workJobs.size(); i < s; ++i )
+	{
+		FrameUpdateJob &job = _workJobs[i];
+
+		// Nodes are resolved late since the application may have removed them after recording
+		SceneNode *sn = sceneMan.resolveNodeHandle( job.node );
+		if( sn == 0x0 ) continue;
+
+		// Nodes are only touched within their own subtree, the rest of the scene is read by the renderer
+		if( job.type == FrameUpdateJob::Model && sn->getType() == SceneNodeTypes::Model )
+		{
+			ModelNode *model = (ModelNode *)sn;
+
+			if( job.flags & ModelUpdateFlags::Animation ) model->update( ModelUpdateFlags::Animation );
+
+			// Vertex data is only computed here, the upload has to happen on the thread owning the GL context
+			if( job.flags & ModelUpdateFlags::Geometry )
+			{
+				Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
+				if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+				
+				if( model->calcGeometry() ) _uploadList.push_back( job.node );
+
+				timer->setEnabled( false );
+			}
+		}
+		else if( job.type == FrameUpdateJob::Emitter && sn->getType() == SceneNodeTypes::Emitter )
+		{
+			_jobEmitters.push_back( (EmitterNode *)sn );
+			_jobTimeDeltas.push_back( job.timeDelta );
+		}
+		else if( job.type == FrameUpdateJob::DotField && sn->getType() == SceneNodeTypes::DotField )
+		{
+			// Dot fields split their update over the thread pool themselves
+			((DotFieldNode *)sn)->update( job.timeDelta );
+		}
+	}
+
+	// Emitters of the frame are simulated together so that they can use the thread pool
+	if( !_jobEmitters.empty() )
+		runEmitters( &_jobEmitters[0], &_jobTimeDeltas[0], (uint32)_jobEmitters.size() );
+}
+
+
+void FrameManager::captureSnapshot()
+{
+	SceneManager &sceneMan = Modules::sceneMan();
+
+	for( size_t i = 0, s = _workJobs.size(); i < s; ++i )
+	{
+		FrameUpdateJob &job = _workJobs[i];
+		SceneNode *sn = sceneMan.resolveNodeHandle( job.node );
+		if( sn == 0x0 ) continue;
+
+		// Emitters that are simulated on the GPU only record a step for the renderer, so they are
+		// updated right away
+		if( job.type == FrameUpdateJob::Emitter && sn->getType() == SceneNodeTypes::Emitter &&
+		    ((EmitterNode *)sn)->isSimulatedOnGPU() )
+		{
+			((EmitterNode *)sn)->update( job.timeDelta );
+			job.node = 0;
+			continue;
+		}
+
+		// Lazily animated models above the node would move it when they are evaluated by the culling
+		for( SceneNode *node = sn->getParent(); node != 0x0; node = node->getParent() )
+		{
+			if( node->getType() == SceneNodeTypes::Model && ((ModelNode *)node)->evaluatePendingAnim() )
+				node->markParentsDirty();
+		}
+	}
+
+	// The update thread only recomputes the transformations of the nodes it changes
+	sceneMan.updateNodes();
+
+	_snapshotComplete = true;
+	for( size_t i = 0, s = _workJobs.size(); i < s; ++i )
+	{
+		SceneNode *sn = sceneMan.resolveNodeHandle( _workJobs[i].node );
+		if( sn != 0x0 ) captureSubtree( *sn );
+	}
+}
+
+
+void FrameManager::captureSubtree( SceneNode &node )
+{
+	// Already captured as part of another job
+	if( node.isInSnapshot() ) return;
+
+	switch( node.getType() )
+	{
+	case SceneNodeTypes::Group:
+	case SceneNodeTypes::Joint:
+	case SceneNodeTypes::Mesh:
+	case SceneNodeTypes::Emitter:
+	case SceneNodeTypes::DotField:
+		break;
+	case SceneNodeTypes::Model:
+		// The renderer cannot evaluate a lazily animated model while the update thread animates it
+		if( ((ModelNode *)&node)->evaluatePendingAnim() ) node.markParentsDirty();
+		break;
+	default:
+		// Lights, cameras and extension nodes are read by the renderer beyond their render state
+		_snapshotComplete = false;
+		break;
+	}
+
+	node.captureRenderState();
+	_snapshotNodes.push_back( &node );
+
+	for( size_t i = 0, s = node.getChildren().size(); i < s; ++i )
+	{
+		captureSubtree( *node.getChildren()[i] );
+	}
+}
+
+
+void FrameManager::releaseSnapshot()
+{
+	// Nodes cannot be removed without a sync, so all captured nodes still exist
+	for( size_t i = 0, s = _snapshotNodes.size(); i < s; ++i )
+	{
+		_snapshotNodes[i]->releaseRenderState();
+	}
+	_snapshotNodes.resize( 0 );
+	_snapshotComplete = true;
+}
+
+
+void FrameManager::beginFrame()
+{
+	// An update that is still running is not waited for, rendering uses the snapshot
+	if( _recording )
+	{
+		Modules::setError( "Missing h3dEndFrame before h3dBeginFrame" );
+		return;
+	}
+
+	_recording = true;
+}
+
+
+void FrameManager::endFrame()
+{
+	if( !_recording )
+	{
+		Modules::setError( "Missing h3dBeginFrame before h3dEndFrame" );
+		return;
+	}
+	_recording = false;
+
+	// The update of the previous frame has to be finished before the next one starts
+	sync();
+
+	if( _recordedJobs.empty() ) return;
+
+	_workJobs.swap( _recordedJobs );
+	_recordedJobs.clear();
+	_pending = true;
+
+	if( Modules::config().threadedUpdate && !_thread.isRunning() )
+	{
+		_quit = false;
+		if( !_thread.start( workerFunc, this ) )
+			Modules::log().writeWarning( "Failed to create update thread, falling back to immediate update" );
+	}
+
+	if( Modules::config().threadedUpdate && _thread.isRunning() )
+	{
+		captureSnapshot();
+		
+		_mutex.lock();
+		_jobReady = true;
+		_busy = true;
+		_mutex.unlock();
+		_jobCond.signal();
+	}
+	else
+	{
+		// Option was disabled while recording
+		runJobs();
+		sync();
+	}
+}
+
+
+void FrameManager::sync()
+{
+	if( !_pending ) return;
+
+	_mutex.lock();
+	while( _busy ) _doneCond.wait( _mutex );
+	_mutex.unlock();
+
+	// Publish results: the GPU copy of the dynamic vertex data still holds the previous
+	// frame until this point
+	for( size_t i = 0, s = _uploadList.size(); i < s; ++i )
+	{
+		SceneNode *sn = Modules::sceneMan().resolveNodeHandle( _uploadList[i] );
+		if( sn == 0x0 || sn->getType() != SceneNodeTypes::Model ) continue;
+
+		GeometryResource *geoRes = ((ModelNode *)sn)->getGeometryResource();
+		if( geoRes != 0x0 ) geoRes->updateDynamicVertData();
+	}
+	_uploadList.resize( 0 );
+
+	releaseSnapshot();
+
+	// Animated models change the bounds of their parents, which were not touched by the update thread
+	for( size_t i = 0, s = _workJobs.size(); i < s; ++i )
+	{
+		if( _workJobs[i].type != FrameUpdateJob::Model ) continue;
+		
+		SceneNode *sn = Modules::sceneMan().resolveNodeHandle( _workJobs[i].node );
+		if( sn != 0x0 ) sn->markParentsDirty();
+	}
+	Modules::sceneMan().updateNodes();
+	
+	_workJobs.clear();
+	_pending = false;
+}
+
+
+void FrameManager::syncRender()
+{
+	// Without a complete snapshot, the renderer would read nodes that are being updated
+	if( !_snapshotComplete ) sync();
+}
+
+
+bool FrameManager::deferModelUpdate( NodeHandle node, int flags )
+{
+	if( !_recording || !Modules::config().threadedUpdate ) return false;
+
+	_recordedJobs.push_back( FrameUpdateJob( node, FrameUpdateJob::Model, flags, 0 ) );
+	return true;
+}
+
+
+bool FrameManager::deferEmitterUpdate( NodeHandle node, float timeDelta )
+{
+	if( !_recording || !Modules::config().threadedUpdate ) return false;
+
+	_recordedJobs.push_back( FrameUpdateJob( node, FrameUpdateJob::Emitter, 0, timeDelta ) );
+	return true;
+}
+
+
+bool FrameManager::deferDotFieldUpdate( NodeHandle node, float timeDelta )
+{
+	if( !_recording || !Modules::config().threadedUpdate ) return false;
+
+	_recordedJobs.push_back( FrameUpdateJob( node, FrameUpdateJob::DotField, 0, timeDelta ) );
+	return true;
+}
+
+
+void FrameManager::animateModelFunc( void *userData, unsigned int index )
+{
+	FrameManager *frameMan = (FrameManager *)userData;
+	frameMan->_batchResults[index] = frameMan->_batchModels[index]->updateAnimation() ? 1 : 0;
+}
+
+
+void FrameManager::calcModelGeometryFunc( void *userData, unsigned int index )
+{
+	FrameManager *frameMan = (FrameManager *)userData;
+	frameMan->_batchResults[index] = frameMan->_batchModels[index]->calcGeometry() ? 1 : 0;
+}
+
+
+void FrameManager::updateModels( ModelNode **models, uint32 count, int flags )
+{
+	sync();
+
+	// Models are independent unless one is attached below another one of the same batch,
+	// e.g. a weapon in the hand of a character; those are updated serially afterwards
+	set< ModelNode * > batchSet( models, models + count ), addedSet;
+	
+	_batchModels.resize( 0 );
+	_serialModels.resize( 0 );
+	for( uint32 i = 0; i < count; ++i )
+	{
+		if( !addedSet.insert( models[i] ).second ) continue;  // Duplicate
+		
+		bool nested = false;
+		for( SceneNode *node = models[i]->getParent(); node != 0x0 && !nested; node = node->getParent() )
+		{
+			nested = node->getType() == SceneNodeTypes::Model && batchSet.count( (ModelNode *)node ) > 0;
+		}
+
+		if( nested ) _serialModels.push_back( models[i] );
+		else _batchModels.push_back( models[i] );
+	}
+	
+	uint32 numModels = (uint32)_batchModels.size();
+	_batchResults.resize( numModels );
+	
+	if( flags & ModelUpdateFlags::Animation )
+	{
+		Timer *timer = Modules::stats().getTimer( EngineStats::AnimationTime );
+		if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+		
+		Modules::threadPool().parallelFor( numModels, animateModelFunc, this );
+
+		timer->setEnabled( false );
+
+		for( uint32 i = 0; i < numModels; ++i )
+		{
+			if( _batchResults[i] ) _batchModels[i]->markParentsDirty();
+		}
+	}
+
+	if( flags & ModelUpdateFlags::Geometry )
+	{
+		Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
+		if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+
+		Modules::threadPool().parallelFor( numModels, calcModelGeometryFunc, this );
+
+		// Upload has to happen on the thread owning the GL context
+		for( uint32 i = 0; i < numModels; ++i )
+		{
+			if( _batchResults[i] ) _batchModels[i]->getGeometryResource()->updateDynamicVertData();
+		}
+
+		timer->setEnabled( false );
+	}
+
+	for( size_t i = 0, s = _serialModels.size(); i < s; ++i )
+	{
+		_serialModels[i]->update( flags );
+	}
+}
+
+
+
+void FrameManager::spawnParticlesFunc( void *userData, unsigned int index )
+{
+	FrameManager *frameMan = (FrameManager *)userData;
+	frameMan->_batchEmitters[index].emitter->spawnPending();
+}
+
+
+void FrameManager::simulateParticlesFunc( void *userData, unsigned int index )
+{
+	FrameManager *frameMan = (FrameManager *)userData;
+	ParticleChunk &chunk = frameMan->_particleChunks[index];
+	
+	chunk.emitter->simulate( chunk.first, chunk.count, chunk.bounds );
+}
+
+
+void FrameManager::finishEmitterFunc( void *userData, unsigned int index )
+{
+	FrameManager *frameMan = (FrameManager *)userData;
+	EmitterBatchItem &item = frameMan->_batchEmitters[index];
+	
+	float bounds[6] = { Math::MaxFloat, Math::MaxFloat, Math::MaxFloat,
+	                    -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat };
+	for( uint32 i = item.firstChunk; i < item.firstChunk + item.chunkCount; ++i )
+	{
+		const float *chunkBounds = frameMan->_particleChunks[i].bounds;
+		for( uint32 c = 0; c < 3; ++c )
+		{
+			bounds[c] = minf( bounds[c], chunkBounds[c] );
+			bounds[c + 3] = maxf( bounds[c + 3], chunkBounds[c + 3] );
+		}
+	}
+
+	item.emitter->endUpdate( bounds );
+}
+
+
+void FrameManager::updateEmitters( EmitterNode **emitters, const float *timeDeltas, uint32 count )
+{
+	sync();
+
+	runEmitters( emitters, timeDeltas, count );
+}
+
+
+void FrameManager::runEmitters( EmitterNode **emitters, const float *timeDeltas, uint32 count )
+{
+	// Emission and transformations are handled serially since they touch the scene graph
+	set< EmitterNode * > addedSet;
+	
+	_batchEmitters.resize( 0 );
+	for( uint32 i = 0; i < count; ++i )
+	{
+		if( !addedSet.insert( emitters[i] ).second ) continue;  // Duplicate
+		if( !emitters[i]->beginUpdate( timeDeltas[i] ) ) continue;
+
+		EmitterBatchItem item;
+		item.emitter = emitters[i];
+		item.firstChunk = 0;
+		item.chunkCount = 0;
+		_batchEmitters.push_back( item );
+	}
+	
+	uint32 numEmitters = (uint32)_batchEmitters.size();
+	if( numEmitters == 0 ) return;
+
+	Timer *timer = Modules::stats().getTimer( EngineStats::ParticleSimTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	ThreadPool &threadPool = Modules::threadPool();
+	threadPool.parallelFor( numEmitters, spawnParticlesFunc, this );
+
+	// Split the live particles of all emitters into chunks of similar size
+	_particleChunks.resize( 0 );
+	for( uint32 i = 0; i < numEmitters; ++i )
+	{
+		EmitterBatchItem &item = _batchEmitters[i];
+		uint32 aliveCount = item.emitter->getAliveCount();
+		
+		item.firstChunk = (uint32)_particleChunks.size();
+		for( uint32 first = 0; first < aliveCount; first += ParticleChunkSize )
+		{
+			ParticleChunk chunk;
+			chunk.emitter = item.emitter;
+			chunk.first = first;
+			chunk.count = std::min( ParticleChunkSize, aliveCount - first );
+			chunk.bounds[0] = chunk.bounds[1] = chunk.bounds[2] = Math::MaxFloat;
+			chunk.bounds[3] = chunk.bounds[4] = chunk.bounds[5] = -Math::MaxFloat;
+			_particleChunks.push_back( chunk );
+		}
+		item.chunkCount = (uint32)_particleChunks.size() - item.firstChunk;
+	}
+
+	threadPool.parallelFor( (uint32)_particleChunks.size(), simulateParticlesFunc, this );
+	threadPool.parallelFor( numEmitters, finishEmitterFunc, this );
+
+	timer->setEnabled( false );
+}
+
+}  // namespace
@@ -0,0 +1,133 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egFrame_H_
+#define _egFrame_H_
+
+#include "egPrerequisites.h"
+#include "utThreading.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+class SceneNode;
+class ModelNode;
+class EmitterNode;
+
+
+// =================================================================================================
+// Frame Manager
+// =================================================================================================
+
+struct FrameUpdateJob
+{
+	enum Type
+	{
+		Model,
+		Emitter,
+		DotField
+	};
+
+	NodeHandle  node;
+	int         type;
+	int         flags;      // Model update flags
+	float       timeDelta;  // Emitter and dot field time delta
+
+	FrameUpdateJob( NodeHandle node, int type, int flags, float timeDelta ) :
+		node( node ), type( type ), flags( flags ), timeDelta( timeDelta )
+	{
+	}
+};
+
+// =================================================================================================
+
+class FrameManager
+{
+public:
+	FrameManager();
+	~FrameManager();
+
+	void beginFrame();
+	void endFrame();
+	void sync();  // Called by every API function that accesses scene nodes or resources
+	void syncRender();  // Called by the render functions, which can work with the snapshot
+
+	bool deferModelUpdate( NodeHandle node, int flags );
+	bool deferEmitterUpdate( NodeHandle node, float timeDelta );
+	bool deferDotFieldUpdate( NodeHandle node, float timeDelta );
+
+	void updateModels( ModelNode **models, uint32 count, int flags );
+	void updateEmitters( EmitterNode **emitters, const float *timeDeltas, uint32 count );
+
+	bool isRecording() const { return _recording; }
+	bool isUpdatePending() const { return _pending; }
+
+protected:
+	static void workerFunc( void *userData );
+	static void animateModelFunc( void *userData, unsigned int index );
+	static void calcModelGeometryFunc( void *userData, unsigned int index );
+	static void spawnParticlesFunc( void *userData, unsigned int index );
+	static void simulateParticlesFunc( void *userData, unsigned int index );
+	static void finishEmitterFunc( void *userData, unsigned int index );
+	void runJobs();
+	void runEmitters( EmitterNode **emitters, const float *timeDeltas, uint32 count );
+	void captureSnapshot();
+	void captureSubtree( SceneNode &node );
+	void releaseSnapshot();
+
+protected:
+	// Job lists are double-buffered: the application records into one list while
+	// the update thread processes the other
+	std::vector< FrameUpdateJob >  _recordedJobs;
+	std::vector< FrameUpdateJob >  _workJobs;
+	std::vector< NodeHandle >      _uploadList;  // Models with CPU-side vertex data waiting for upload
+
+	Thread                         _thread;
+	Mutex                          _mutex;
+	Condition                      _jobCond, _doneCond;
+	bool                           _jobReady, _busy, _quit;
+
+	bool                           _recording;
+	bool                           _pending;  // Update submitted by endFrame and not yet synced
+
+	// Nodes that are changed by the running update keep a copy of their render state, so that the
+	// renderer does not need to wait for the update
+	std::vector< SceneNode * >     _snapshotNodes;
+	bool                           _snapshotComplete;  // Snapshot has everything the renderer reads
+
+	// Batched model update
+	std::vector< ModelNode * >     _batchModels, _serialModels;
+	std::vector< unsigned char >   _batchResults;
+
+	// Batched emitter update; large emitters are split into chunks of particles
+	struct EmitterBatchItem
+	{
+		EmitterNode  *emitter;
+		uint32       firstChunk, chunkCount;
+	};
+
+	struct ParticleChunk
+	{
+		EmitterNode  *emitter;
+		uint32       first, count;
+		float        bounds[6];
+	};
+
+	std::vector< EmitterBatchItem >  _batchEmitters;
+	std::vector< ParticleChunk >     _particleChunks;
+	std::vector< EmitterNode * >     _jobEmitters;
+	std::vector< float >             _jobTimeDeltas;
+};
+
+}
+#endif // _egFrame_H_
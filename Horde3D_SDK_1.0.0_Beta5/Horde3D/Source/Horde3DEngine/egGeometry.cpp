@@ -31,6 +31,24 @@ uint32 GeometryResource::defIndexBuffer = 0;
 int GeometryResource::mappedWriteStream = -1;
 
 
+GeometryData::GeometryData() :
+	DecodedResData( ResourceTypes::Geometry ), indexCount( 0 ), vertCount( 0 ), indices16( false ),
+	indexData( 0x0 ), vertPosData( 0x0 ), vertTanData( 0x0 ), vertStaticData( 0x0 ), minMorphIndex( 0 ),
+	maxMorphIndex( 0 ), unsupportedBaseStream( false ), unsupportedMorphStream( false )
+{
+	skelAABB.clear();
+}
+
+
+GeometryData::~GeometryData()
+{
+	delete[] indexData;
+	delete[] vertPosData;
+	delete[] vertTanData;
+	delete[] vertStaticData;
+}
+
+
 void GeometryResource::initializationFunc()
 {
 	defVertBuffer = gRDI->createVertexBuffer( 0, 0x0 );
@@ -61,27 +79,51 @@ GeometryResource::~GeometryResource()
 Resource *GeometryResource::clone()
 {
 	GeometryResource *res = new GeometryResource( "", _flags );
+	GeometryResource &src = shared();
 
-	*res = *this;
+	*res = src;
 
-	// Make a deep copy of the data
+	// Make a deep copy of the data; dynamic streams are taken from this resource in case it is an instance
 	res->_indexData = new char[_indexCount * (_16BitIndices ? 2 : 4)];
 	res->_vertPosData = new Vec3f[_vertCount];
 	res->_vertTanData = new VertexDataTan[_vertCount];
 	res->_vertStaticData = new VertexDataStatic[_vertCount];
-	memcpy( res->_indexData, _indexData, _indexCount * (_16BitIndices ? 2 : 4) );
+	memcpy( res->_indexData, src._indexData, _indexCount * (_16BitIndices ? 2 : 4) );
 	memcpy( res->_vertPosData, _vertPosData, _vertCount * sizeof( Vec3f ) );
 	memcpy( res->_vertTanData, _vertTanData, _vertCount * sizeof( VertexDataTan ) );
-	memcpy( res->_vertStaticData, _vertStaticData, _vertCount * sizeof( VertexDataStatic ) );
-	res->_indexBuf = gRDI->createIndexBuffer( _indexCount * (_16BitIndices ? 2 : 4), _indexData );
+	memcpy( res->_vertStaticData, src._vertStaticData, _vertCount * sizeof( VertexDataStatic ) );
+	if( src._vertSkinData != 0x0 )
+	{
+		res->_vertSkinData = new VertexDataSkin[_vertCount];
+		memcpy( res->_vertSkinData, src._vertSkinData, _vertCount * sizeof( VertexDataSkin ) );
+	}
+	res->_indexBuf = gRDI->createIndexBuffer( _indexCount * (_16BitIndices ? 2 : 4), src._indexData );
 	res->_posVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( Vec3f ), _vertPosData );
 	res->_tanVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataTan ), _vertTanData );
-	res->_staticVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataStatic ), _vertStaticData );
+	res->_staticVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataStatic ), src._vertStaticData );
 	
 	return res;
 }
 
 
+GeometryResource *GeometryResource::createInstance()
+{
+	GeometryResource *res = new GeometryResource( "", _flags );
+	
+	res->_sharedRes = &shared();
+	res->_loaded = _loaded;
+	res->_vertCount = _vertCount;
+	res->_vertPosData = new Vec3f[_vertCount];
+	res->_vertTanData = new VertexDataTan[_vertCount];
+	memcpy( res->_vertPosData, _vertPosData, _vertCount * sizeof( Vec3f ) );
+	memcpy( res->_vertTanData, _vertTanData, _vertCount * sizeof( VertexDataTan ) );
+	res->_posVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( Vec3f ), _vertPosData );
+	res->_tanVBuf = gRDI->createVertexBuffer( _vertCount * sizeof( VertexDataTan ), _vertTanData );
+
+	return res;
+}
+
+
 void GeometryResource::initDefault()
 {
 	_indexCount = 0;
@@ -90,12 +132,15 @@ void GeometryResource::initDefault()
 	_vertPosData = 0x0;
 	_vertTanData = 0x0;
 	_vertStaticData = 0x0;
+	_vertSkinData = 0x0;
 	_16BitIndices = false;
 	_indexBuf = defIndexBuffer;
 	_posVBuf = defVertBuffer;
 	_tanVBuf = defVertBuffer;
 	_staticVBuf = defVertBuffer;
 	_minMorphIndex = 0; _maxMorphIndex = 0;
+	_dynVertStart = 0; _dynVertEnd = 0;
+	_sharedRes = 0x0;
 	_skelAABB.min = Vec3f( 0, 0, 0 );
 	_skelAABB.max = Vec3f( 0, 0, 0 );
 }
@@ -129,8 +174,10 @@ void GeometryResource::release()
 	delete[] _vertPosData; _vertPosData = 0x0;
 	delete[] _vertTanData; _vertTanData = 0x0;
 	delete[] _vertStaticData; _vertStaticData = 0x0;
+	delete[] _vertSkinData; _vertSkinData = 0x0;
 	_joints.clear();
 	_morphTargets.clear();
+	_sharedRes = 0x0;
 }
 
 
@@ -146,13 +193,14 @@ bool GeometryResource::raiseError( const string &msg )
 }
 
 
-bool GeometryResource::load( const char *data, int size )
+const char *GeometryResource::parseData( const char *data, int size, GeometryData &geo )
 {
-	if( !Resource::load( data, size ) ) return false;
+	// Returns an error message or 0x0 on success; called by decodeGeometry, so no engine state
+	// must be accessed
 
 	// Make sure header is available
 	if( size < 8 )
-		return raiseError( "Invalid geometry resource" );
+		return "Invalid geometry resource";
 	
 	char *pData = (char *)data;
 	
@@ -160,23 +208,20 @@ bool GeometryResource::load( const char *data, int size )
 	char id[4];
 	memcpy( &id, pData, 4 ); pData += 4;
 	if( id[0] != 'H' || id[1] != '3' || id[2] != 'D' || id[3] != 'G' )
-		return raiseError( "Invalid geometry resource" );
+		return "Invalid geometry resource";
 
 	uint32 version;
 	memcpy( &version, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-	if( version != 5 ) return raiseError( "Unsupported version of geometry file" );
+	if( version != 5 ) return "Unsupported version of geometry file";
 
 	// Load joints
 	uint32 count;
 	memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 
-	if( count > 75 )
-		Modules::log().writeWarning( "Geometry resource '%s': Model has more than 75 joints; this may cause defective behavior", _name.c_str() );
-
-	_joints.resize( count );
+	geo.joints.resize( count );
 	for( uint32 i = 0; i < count; ++i )
 	{
-		Joint &joint = _joints[i];
+		Joint &joint = geo.joints[i];
 		
 		// Inverse bind matrix
 		for( uint32 j = 0; j < 16; ++j )
@@ -190,17 +235,17 @@ bool GeometryResource::load( const char *data, int size )
 	memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );			// Number of streams
 	memcpy( &streamSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );	// Number of vertices
 
-	_vertCount = streamSize;
-	_vertPosData = new Vec3f[_vertCount];
-	_vertTanData = new VertexDataTan[_vertCount];
-	_vertStaticData = new VertexDataStatic[_vertCount];
-	Vec3f *bitangents = new Vec3f[_vertCount];
+	geo.vertCount = streamSize;
+	geo.vertPosData = new Vec3f[geo.vertCount];
+	geo.vertTanData = new VertexDataTan[geo.vertCount];
+	geo.vertStaticData = new VertexDataStatic[geo.vertCount];
+	Vec3f *bitangents = new Vec3f[geo.vertCount];
 
 	// Init with default data
-	memset( _vertPosData, 0, _vertCount * sizeof( Vec3f ) );
-	memset( _vertTanData, 0, _vertCount * sizeof( VertexDataTan ) );
-	memset( _vertStaticData, 0, _vertCount * sizeof( VertexDataStatic ) );
-	for( uint32 i = 0; i < _vertCount; ++i ) _vertStaticData[i].weightVec[0] = 1;
+	memset( geo.vertPosData, 0, geo.vertCount * sizeof( Vec3f ) );
+	memset( geo.vertTanData, 0, geo.vertCount * sizeof( VertexDataTan ) );
+	memset( geo.vertStaticData, 0, geo.vertCount * sizeof( VertexDataStatic ) );
+	for( uint32 i = 0; i < geo.vertCount; ++i ) geo.vertStaticData[i].weightVec[0] = 1;
 
 	for( uint32 i = 0; i < count; ++i )
 	{
@@ -209,53 +254,53 @@ bool GeometryResource::load( const char *data, int size )
 		uint32 streamID, streamElemSize;
 		memcpy( &streamID, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 		memcpy( &streamElemSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-		std::string errormsg;
+		const char *errorMsg = 0x0;
 
 		switch( streamID )
 		{
 		case 0:		// Position
 			if( streamElemSize != 12 )
 			{
-				errormsg = "Invalid position base stream";
+				errorMsg = "Invalid position base stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &_vertPosData[j].x, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertPosData[j].y, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertPosData[j].z, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertPosData[j].x, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertPosData[j].y, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertPosData[j].z, pData, sizeof( float ) ); pData += sizeof( float );
 			}
 			break;
 		case 1:		// Normal
 			if( streamElemSize != 6 )
 			{
-				errormsg = "Invalid normal base stream";
+				errorMsg = "Invalid normal base stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].normal.x = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].normal.y = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].normal.z = sh / 32767.0f;
+				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); geo.vertTanData[j].normal.x = sh / 32767.0f;
+				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); geo.vertTanData[j].normal.y = sh / 32767.0f;
+				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); geo.vertTanData[j].normal.z = sh / 32767.0f;
 			}
 			break;
 		case 2:		// Tangent
 			if( streamElemSize != 6 )
 			{
-				errormsg = "Invalid tangent base stream";
+				errorMsg = "Invalid tangent base stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].tangent.x = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].tangent.y = sh / 32767.0f;
-				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); _vertTanData[j].tangent.z = sh / 32767.0f;
+				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); geo.vertTanData[j].tangent.x = sh / 32767.0f;
+				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); geo.vertTanData[j].tangent.y = sh / 32767.0f;
+				memcpy( &sh, pData, sizeof( short ) ); pData += sizeof( short ); geo.vertTanData[j].tangent.z = sh / 32767.0f;
 			}
 			break;
 		case 3:		// Bitangent
 			if( streamElemSize != 6 )
 			{
-				errormsg = "Invalid bitangent base stream";
+				errorMsg = "Invalid bitangent base stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
@@ -268,84 +313,84 @@ bool GeometryResource::load( const char *data, int size )
 		case 4:		// Joint indices
 			if( streamElemSize != 4 )
 			{
-				errormsg = "Invalid joint stream";
+				errorMsg = "Invalid joint stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[0] = (float)uc;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[1] = (float)uc;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[2] = (float)uc;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].jointVec[3] = (float)uc;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].jointVec[0] = (float)uc;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].jointVec[1] = (float)uc;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].jointVec[2] = (float)uc;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].jointVec[3] = (float)uc;
 			}
 			break;
 		case 5:		// Weights
 			if( streamElemSize != 4 )
 			{
-				errormsg = "Invalid weight stream";
+				errorMsg = "Invalid weight stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[0] = uc / 255.0f;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[1] = uc / 255.0f;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[2] = uc / 255.0f;
-				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); _vertStaticData[j].weightVec[3] = uc / 255.0f;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].weightVec[0] = uc / 255.0f;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].weightVec[1] = uc / 255.0f;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].weightVec[2] = uc / 255.0f;
+				memcpy( &uc, pData, sizeof( char ) ); pData += sizeof( char ); geo.vertStaticData[j].weightVec[3] = uc / 255.0f;
 			}
 			break;
 		case 6:		// Texture Coord Set 1
 			if( streamElemSize != 8 )
 			{
-				errormsg = "Invalid texCoord1 stream";
+				errorMsg = "Invalid texCoord1 stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &_vertStaticData[j].u0, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertStaticData[j].v0, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertStaticData[j].u0, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertStaticData[j].v0, pData, sizeof( float ) ); pData += sizeof( float );
 			}
 			break;
 		case 7:		// Texture Coord Set 2
 			if( streamElemSize != 8 )
 			{
-				errormsg = "Invalid texCoord2 stream";
+				errorMsg = "Invalid texCoord2 stream";
 				break;
 			}
 			for( uint32 j = 0; j < streamSize; ++j )
 			{
-				memcpy( &_vertStaticData[j].u1, pData, sizeof( float ) ); pData += sizeof( float );
-				memcpy( &_vertStaticData[j].v1, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertStaticData[j].u1, pData, sizeof( float ) ); pData += sizeof( float );
+				memcpy( &geo.vertStaticData[j].v1, pData, sizeof( float ) ); pData += sizeof( float );
 			}
 			break;
 		default:
 			pData += streamElemSize * streamSize;
-			Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex base stream", _name.c_str() );
+			geo.unsupportedBaseStream = true;
 			continue;
 		}
-		if (!errormsg.empty())
+		if( errorMsg != 0x0 )
 		{
 			delete[] bitangents;
-			return raiseError(errormsg);
+			return errorMsg;
 		}
 	}
 
 	// Prepare bitangent data (TODO: Should be done in ColladaConv)
-	for( uint32 i = 0; i < _vertCount; ++i )
+	for( uint32 i = 0; i < geo.vertCount; ++i )
 	{
-		_vertTanData[i].handedness = _vertTanData[i].normal.cross( _vertTanData[i].tangent ).dot( bitangents[i] ) < 0 ? -1.0f : 1.0f;
+		geo.vertTanData[i].handedness = geo.vertTanData[i].normal.cross( geo.vertTanData[i].tangent ).dot( bitangents[i] ) < 0 ? -1.0f : 1.0f;
 	}
 	delete[] bitangents;
 		
 	// Load triangle indices
 	memcpy( &count, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 
-	_indexCount = count;
-    _16BitIndices = _vertCount<= 65536;
-	_indexData = new char[count * (_16BitIndices ? 2 : 4)];
-	if( _16BitIndices )
+	geo.indexCount = count;
+    geo.indices16 = geo.vertCount<= 65536;
+	geo.indexData = new char[count * (geo.indices16 ? 2 : 4)];
+	if( geo.indices16 )
 	{
 		uint32 index;
-		uint16 *pIndexData = (uint16 *)_indexData;
+		uint16 *pIndexData = (uint16 *)geo.indexData;
 		for( uint32 i = 0; i < count; ++i )
 		{
 			memcpy( &index, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
@@ -354,7 +399,7 @@ bool GeometryResource::load( const char *data, int size )
 	}
 	else
 	{
-		uint32 *pIndexData = (uint32 *)_indexData;
+		uint32 *pIndexData = (uint32 *)geo.indexData;
 		for( uint32 i = 0; i < count; ++i )
 		{
 			memcpy( &pIndexData[i], pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
@@ -365,10 +410,10 @@ bool GeometryResource::load( const char *data, int size )
 	uint32 numTargets;
 	memcpy( &numTargets, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
 
-	_morphTargets.resize( numTargets );
+	geo.morphTargets.resize( numTargets );
 	for( uint32 i = 0; i < numTargets; ++i )
 	{
-		MorphTarget &mt = _morphTargets[i];
+		MorphTarget &mt = geo.morphTargets[i];
 		char name[256];
 		
 		memcpy( name, pData, 256 ); pData += 256;
@@ -377,10 +422,19 @@ bool GeometryResource::load( const char *data, int size )
 		// Read vertex indices
 		uint32 morphStreamSize;
 		memcpy( &morphStreamSize, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
-		mt.diffs.resize( morphStreamSize );
+		mt.vertIndices.resize( morphStreamSize );
+		mt.posDiffs.resize( morphStreamSize, Vec3f( 0, 0, 0 ) );
+		mt.normDiffs.resize( morphStreamSize, Vec3f( 0, 0, 0 ) );
+		mt.tanDiffs.resize( morphStreamSize, Vec3f( 0, 0, 0 ) );
+		mt.minVertIndex = geo.vertCount;
+		mt.maxVertIndex = 0;
 		for( uint32 j = 0; j < morphStreamSize; ++j )
 		{
-			memcpy( &mt.diffs[j].vertIndex, pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+			memcpy( &mt.vertIndices[j], pData, sizeof( uint32 ) ); pData += sizeof( uint32 );
+			if( mt.vertIndices[j] >= geo.vertCount ) return "Invalid vertex index in morph target";
+			
+			mt.minVertIndex = std::min( mt.minVertIndex, mt.vertIndices[j] );
+			mt.maxVertIndex = std::max( mt.maxVertIndex, mt.vertIndices[j] );
 		}
 		
 		// Loop over streams
@@ -394,80 +448,144 @@ bool GeometryResource::load( const char *data, int size )
 			switch( streamID )
 			{
 			case 0:		// Position
-				if( streamElemSize != 12 ) return raiseError( "Invalid position morph stream" );
+				if( streamElemSize != 12 ) return "Invalid position morph stream";
 				for( uint32 k = 0; k < morphStreamSize; ++k )
 				{
-					memcpy( &mt.diffs[k].posDiff.x, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].posDiff.y, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].posDiff.z, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.posDiffs[k].x, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.posDiffs[k].y, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.posDiffs[k].z, pData, sizeof( float ) ); pData += sizeof( float );
 				}
 				break;
 			case 1:		// Normal
-				if( streamElemSize != 12 ) return raiseError( "Invalid normal morph stream" );
+				if( streamElemSize != 12 ) return "Invalid normal morph stream";
 				for( uint32 k = 0; k < morphStreamSize; ++k )
 				{
-					memcpy( &mt.diffs[k].normDiff.x, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].normDiff.y, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].normDiff.z, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.normDiffs[k].x, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.normDiffs[k].y, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.normDiffs[k].z, pData, sizeof( float ) ); pData += sizeof( float );
 				}
 				break;
 			case 2:		// Tangent
-				if( streamElemSize != 12 ) return raiseError( "Invalid tangent morph stream" );
+				if( streamElemSize != 12 ) return "Invalid tangent morph stream";
 				for( uint32 k = 0; k < morphStreamSize; ++k )
 				{
-					memcpy( &mt.diffs[k].tanDiff.x, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].tanDiff.y, pData, sizeof( float ) ); pData += sizeof( float );
-					memcpy( &mt.diffs[k].tanDiff.z, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.tanDiffs[k].x, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.tanDiffs[k].y, pData, sizeof( float ) ); pData += sizeof( float );
+					memcpy( &mt.tanDiffs[k].z, pData, sizeof( float ) ); pData += sizeof( float );
 				}
 				break;
 			case 3:		// Bitangent
-				if( streamElemSize != 12 ) return raiseError( "Invalid bitangent morph stream" );
+				if( streamElemSize != 12 ) return "Invalid bitangent morph stream";
 				
 				// Skip data (TODO: remove from format)
 				pData += morphStreamSize * sizeof( float ) * 3;
 				break;
 			default:
 				pData += streamElemSize * morphStreamSize;
-				Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex morph stream", _name.c_str() );
+				geo.unsupportedMorphStream = true;
 				continue;
 			}
 		}
 	}
 
 	// Find min/max morph target vertex indices
-	_minMorphIndex = (unsigned)_vertCount;
-	_maxMorphIndex = 0;
-	for( uint32 i = 0; i < _morphTargets.size(); ++i )
+	geo.minMorphIndex = (unsigned)geo.vertCount;
+	geo.maxMorphIndex = 0;
+	for( uint32 i = 0; i < geo.morphTargets.size(); ++i )
 	{
-		for( uint32 j = 0; j < _morphTargets[i].diffs.size(); ++j )
-		{
-			_minMorphIndex = std::min( _minMorphIndex, _morphTargets[i].diffs[j].vertIndex );
-			_maxMorphIndex = std::max( _maxMorphIndex, _morphTargets[i].diffs[j].vertIndex );
-		}
+		if( geo.morphTargets[i].vertIndices.empty() ) continue;
+		geo.minMorphIndex = std::min( geo.minMorphIndex, geo.morphTargets[i].minVertIndex );
+		geo.maxMorphIndex = std::max( geo.maxMorphIndex, geo.morphTargets[i].maxVertIndex );
 	}
-	if( _minMorphIndex > _maxMorphIndex )
+	if( geo.minMorphIndex > geo.maxMorphIndex )
 	{
-		_minMorphIndex = 0; _maxMorphIndex = 0;
+		geo.minMorphIndex = 0; geo.maxMorphIndex = 0;
 	}
 
 	// Find AABB of skeleton in bind pose
-	for( uint32 i = 0; i < (uint32)_joints.size(); ++i )
+	for( uint32 i = 0; i < (uint32)geo.joints.size(); ++i )
 	{
-		Vec3f pos = _joints[i].invBindMat.inverted() * Vec3f( 0, 0, 0 );
-		if( pos.x < _skelAABB.min.x ) _skelAABB.min.x = pos.x;
-		if( pos.y < _skelAABB.min.y ) _skelAABB.min.y = pos.y;
-		if( pos.z < _skelAABB.min.z ) _skelAABB.min.z = pos.z;
-		if( pos.x > _skelAABB.max.x ) _skelAABB.max.x = pos.x;
-		if( pos.y > _skelAABB.max.y ) _skelAABB.max.y = pos.y;
-		if( pos.z > _skelAABB.max.z ) _skelAABB.max.z = pos.z;
+		Vec3f pos = geo.joints[i].invBindMat.inverted() * Vec3f( 0, 0, 0 );
+		if( pos.x < geo.skelAABB.min.x ) geo.skelAABB.min.x = pos.x;
+		if( pos.y < geo.skelAABB.min.y ) geo.skelAABB.min.y = pos.y;
+		if( pos.z < geo.skelAABB.min.z ) geo.skelAABB.min.z = pos.z;
+		if( pos.x > geo.skelAABB.max.x ) geo.skelAABB.max.x = pos.x;
+		if( pos.y > geo.skelAABB.max.y ) geo.skelAABB.max.y = pos.y;
+		if( pos.z > geo.skelAABB.max.z ) geo.skelAABB.max.z = pos.z;
 	}
 
 	// Add default joint if necessary
-	if( _joints.empty() )
+	if( geo.joints.empty() )
 	{
-		_joints.push_back( Joint() );
+		geo.joints.push_back( Joint() );
 	}
 
+	return 0x0;
+}
+
+
+DecodedResData *GeometryResource::decodeGeometry( const char *data, int size )
+{
+	// Must not access any engine state since this can be called from any thread
+	if( data == 0x0 || size <= 0 ) return 0x0;
+
+	GeometryData *geo = new GeometryData();
+	if( parseData( data, size, *geo ) != 0x0 )
+	{
+		// The error is reported when the original data is loaded
+		delete geo;
+		return 0x0;
+	}
+
+	return geo;
+}
+
+
+bool GeometryResource::load( const char *data, int size )
+{
+	if( !Resource::load( data, size ) ) return false;
+
+	GeometryData geo;
+	const char *errorMsg = parseData( data, size, geo );
+	if( errorMsg != 0x0 ) return raiseError( errorMsg );
+
+	return loadGeometry( geo );
+}
+
+
+bool GeometryResource::loadDecodedData( DecodedResData &resData )
+{
+	return loadGeometry( (GeometryData &)resData );
+}
+
+
+bool GeometryResource::loadGeometry( GeometryData &geo )
+{
+	if( geo.joints.size() > 75 && !Modules::renderer().hasSkinPalette() )
+		Modules::log().writeWarning( "Geometry resource '%s': Model has more than 75 joints; this may cause defective behavior", _name.c_str() );
+	if( geo.unsupportedBaseStream )
+		Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex base stream", _name.c_str() );
+	if( geo.unsupportedMorphStream )
+		Modules::log().writeWarning( "Geometry resource '%s': Ignoring unsupported vertex morph stream", _name.c_str() );
+
+	// Take over the data
+	_indexCount = geo.indexCount;
+	_vertCount = geo.vertCount;
+	_16BitIndices = geo.indices16;
+	_indexData = geo.indexData; geo.indexData = 0x0;
+	_vertPosData = geo.vertPosData; geo.vertPosData = 0x0;
+	_vertTanData = geo.vertTanData; geo.vertTanData = 0x0;
+	_vertStaticData = geo.vertStaticData; geo.vertStaticData = 0x0;
+	_joints.swap( geo.joints );
+	_skelAABB = geo.skelAABB;
+	_morphTargets.swap( geo.morphTargets );
+	_minMorphIndex = geo.minMorphIndex;
+	_maxMorphIndex = geo.maxMorphIndex;
+	geo.indexCount = 0;
+	geo.vertCount = 0;
+
+	updateSkinData();
+
 	// Upload data
 	if( _vertCount > 0 && _indexCount > 0 )
 	{
@@ -504,9 +622,9 @@ int GeometryResource::getElemParamI( int elem, int elemIdx, int param )
 		switch( param )
 		{
 		case GeometryResData::GeoIndexCountI:
-			return (int)_indexCount;
+			return (int)shared()._indexCount;
 		case GeometryResData::GeoIndices16I:
-			return _16BitIndices ? 1 : 0;
+			return shared()._16BitIndices ? 1 : 0;
 		case GeometryResData::GeoVertexCountI:
 			return (int)_vertCount;
 		}
@@ -529,8 +647,9 @@ void *GeometryResource::mapStream( int elem, int elemIdx, int stream, bool read,
 			switch( stream )
 			{
 			case GeometryResData::GeoIndexStream:
+				if( write && isInstance() ) break;  // Shared data is read-only
 				if( write ) mappedWriteStream = GeometryResData::GeoIndexStream;
-				return _indexData;
+				return shared()._indexData;
 			case GeometryResData::GeoVertPosStream:
 				if( write ) mappedWriteStream = GeometryResData::GeoVertPosStream;
 				return _vertPosData != 0x0 ? _vertPosData : 0x0;
@@ -538,8 +657,9 @@ void *GeometryResource::mapStream( int elem, int elemIdx, int stream, bool read,
 				if( write ) mappedWriteStream = GeometryResData::GeoVertTanStream;
 				return _vertTanData != 0x0 ? _vertTanData : 0x0;
 			case GeometryResData::GeoVertStaticStream:
+				if( write && isInstance() ) break;
 				if( write ) mappedWriteStream = GeometryResData::GeoVertStaticStream;
-				return _vertStaticData != 0x0 ? _vertStaticData : 0x0;
+				return shared()._vertStaticData;
 			}
 		}
 	}
@@ -569,6 +689,7 @@ void GeometryResource::unmapStream()
 		case GeometryResData::GeoVertStaticStream:
 			if( _vertStaticData != 0x0 )
 				gRDI->updateBufferData( _staticVBuf, 0, _vertCount * sizeof( VertexDataStatic ), _vertStaticData );
+			updateSkinData();
 			break;
 		}
 
@@ -577,16 +698,65 @@ void GeometryResource::unmapStream()
 }
 
 
+void GeometryResource::updateSkinData()
+{
+	// Skinning data is only required if there is a skeleton; for geometry without joints,
+	// all vertices are bound to the default joint
+	if( _vertStaticData == 0x0 || _joints.size() < 2 ) return;
+
+	if( _vertSkinData == 0x0 ) _vertSkinData = new VertexDataSkin[_vertCount];
+
+	uint32 maxJoint = (uint32)_joints.size() - 1;
+	for( uint32 i = 0; i < _vertCount; ++i )
+	{
+		for( uint32 j = 0; j < 4; ++j )
+		{
+			int joint = ftoi_r( _vertStaticData[i].jointVec[j] );
+			_vertSkinData[i].joints[j] = (uint16)std::min( (uint32)std::max( joint, 0 ), maxJoint );
+			_vertSkinData[i].weights[j] = _vertStaticData[i].weightVec[j];
+		}
+	}
+}
+
+
+void GeometryResource::markDynamicVertData( uint32 firstVert, uint32 lastVert )
+{
+	ASSERT( firstVert <= lastVert && lastVert < _vertCount );
+	
+	if( _dynVertStart < _dynVertEnd )
+	{
+		_dynVertStart = std::min( _dynVertStart, firstVert );
+		_dynVertEnd = std::max( _dynVertEnd, lastVert + 1 );
+	}
+	else
+	{
+		_dynVertStart = firstVert;
+		_dynVertEnd = lastVert + 1;
+	}
+}
+
+
 void GeometryResource::updateDynamicVertData()
 {
+	// Upload range marked as modified or everything if nothing was marked
+	uint32 start = 0, count = _vertCount;
+	if( _dynVertStart < _dynVertEnd )
+	{
+		start = _dynVertStart;
+		count = _dynVertEnd - _dynVertStart;
+	}
+	_dynVertStart = 0; _dynVertEnd = 0;
+	
 	// Upload dynamic stream data
 	if( _vertPosData != 0x0 )
 	{
-		gRDI->updateBufferData( _posVBuf, 0, _vertCount * sizeof( Vec3f ), _vertPosData );
+		gRDI->updateBufferData( _posVBuf, start * sizeof( Vec3f ), count * sizeof( Vec3f ),
+		                        _vertPosData + start );
 	}
 	if( _vertTanData != 0x0 )
 	{
-		gRDI->updateBufferData( _tanVBuf, 0, _vertCount * sizeof( VertexDataTan ), _vertTanData );
+		gRDI->updateBufferData( _tanVBuf, start * sizeof( VertexDataTan ), count * sizeof( VertexDataTan ),
+		                        _vertTanData + start );
 	}
 }
 
@@ -57,6 +57,12 @@ struct VertexDataStatic		// Vertex data that is usally static
 	float  u1, v1;
 };
 
+struct VertexDataSkin		// CPU-side copy of skinning data with integer joint indices
+{
+	float   weights[4];
+	uint16  joints[4];
+};
+
 
 struct Joint
 {
@@ -64,18 +70,36 @@ struct Joint
 };
 
 
-struct MorphDiff
+struct MorphTarget
 {
-	uint32  vertIndex;
-	Vec3f   posDiff;
-	Vec3f   normDiff, tanDiff;
+	std::string               name;
+	
+	// Diffs are stored as one array per attribute so that each can be accumulated in a tight loop
+	std::vector< uint32 >     vertIndices;
+	std::vector< Vec3f >      posDiffs, normDiffs, tanDiffs;
+	uint32                    minVertIndex, maxVertIndex;
 };
 
 
-struct MorphTarget
+// Contents of a geometry file; they are parsed without OpenGL, so that this can also be done in
+// advance by decodeGeometry
+struct GeometryData : public DecodedResData
 {
-	std::string               name;
-	std::vector< MorphDiff >  diffs;
+	uint32                      indexCount, vertCount;
+	bool                        indices16;
+	char                        *indexData;
+	Vec3f                       *vertPosData;
+	VertexDataTan               *vertTanData;
+	VertexDataStatic            *vertStaticData;
+	
+	std::vector< Joint >        joints;
+	BoundingBox                 skelAABB;
+	std::vector< MorphTarget >  morphTargets;
+	uint32                      minMorphIndex, maxMorphIndex;
+	bool                        unsupportedBaseStream, unsupportedMorphStream;  // Reported when loaded
+
+	GeometryData();
+	~GeometryData();
 };
 
 // =================================================================================================
@@ -91,34 +115,49 @@ public:
 	GeometryResource( const std::string &name, int flags );
 	~GeometryResource();
 	Resource *clone();
+	GeometryResource *createInstance();
 	
 	void initDefault();
 	void release();
 	bool load( const char *data, int size );
+	static DecodedResData *decodeGeometry( const char *data, int size );
 
 	int getElemCount( int elem );
 	int getElemParamI( int elem, int elemIdx, int param );
 	void *mapStream( int elem, int elemIdx, int stream, bool read, bool write );
 	void unmapStream();
 
+	void markDynamicVertData( uint32 firstVert, uint32 lastVert );
 	void updateDynamicVertData();
 
 	uint32 getVertCount() { return _vertCount; }
-	char *getIndexData() { return _indexData; }
+	uint32 getIndexCount() { return shared()._indexCount; }
+	char *getIndexData() { return shared()._indexData; }
+	bool has16BitIndices() { return shared()._16BitIndices; }
 	Vec3f *getVertPosData() { return _vertPosData; }
 	VertexDataTan *getVertTanData() { return _vertTanData; }
-	VertexDataStatic *getVertStaticData() { return _vertStaticData; }
+	VertexDataStatic *getVertStaticData() { return shared()._vertStaticData; }
+	VertexDataSkin *getVertSkinData() { return shared()._vertSkinData; }
 	uint32 getPosVBuf() { return _posVBuf; }
 	uint32 getTanVBuf() { return _tanVBuf; }
-	uint32 getStaticVBuf() { return _staticVBuf; }
-	uint32 getIndexBuf() { return _indexBuf; }
-	Matrix4f &getInvBindMat( uint32 jointIndex ) { return _joints[jointIndex].invBindMat; }
+	uint32 getStaticVBuf() { return shared()._staticVBuf; }
+	uint32 getIndexBuf() { return shared()._indexBuf; }
+	Matrix4f &getInvBindMat( uint32 jointIndex ) { return shared()._joints[jointIndex].invBindMat; }
+	uint32 getJointCount() { return (uint32)shared()._joints.size(); }
+	std::vector< MorphTarget > &getMorphTargets() { return shared()._morphTargets; }
+	const BoundingBox &getSkelAABB() { return shared()._skelAABB; }
+	bool isInstance() { return _sharedRes != 0x0; }
 
 public:
 	static uint32 defVertBuffer, defIndexBuffer;
 
 private:
 	bool raiseError( const std::string &msg );
+	static const char *parseData( const char *data, int size, GeometryData &geo );
+	bool loadDecodedData( DecodedResData &resData );
+	bool loadGeometry( GeometryData &geo );
+	void updateSkinData();
+	GeometryResource &shared() { return _sharedRes != 0x0 ? *_sharedRes : *this; }
 
 private:
 	static int                  mappedWriteStream;
@@ -131,11 +170,17 @@ private:
 	Vec3f                       *_vertPosData;
 	VertexDataTan               *_vertTanData;
 	VertexDataStatic            *_vertStaticData;
+	VertexDataSkin              *_vertSkinData;  // Only for geometry with joint stream
 	
 	std::vector< Joint >        _joints;
 	BoundingBox                 _skelAABB;
 	std::vector< MorphTarget >  _morphTargets;
 	uint32                      _minMorphIndex, _maxMorphIndex;
+	uint32                      _dynVertStart, _dynVertEnd;  // Range of dynamic data pending for upload
+
+	// Instances only own the dynamic position and tangent streams; all other data
+	// is read from the shared resource
+	SmartResPtr< GeometryResource >  _sharedRes;
 
 	friend class Renderer;
 	friend class ModelNode;
@@ -0,0 +1,247 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egLightCluster.h"
+#include <algorithm>
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+using namespace std;
+
+
+static inline Vec3f unprojectPoint( const Matrix4f &invProjMat, float x, float y, float z )
+{
+	Vec4f p = invProjMat * Vec4f( x, y, z, 1.0f );
+	return Vec3f( p.x / p.w, p.y / p.w, p.z / p.w );
+}
+
+
+static inline float sqrDistToAABB( const Vec3f &pos, const BoundingBox &box )
+{
+	Vec3f nearest( clamp( pos.x, box.min.x, box.max.x ), clamp( pos.y, box.min.y, box.max.y ),
+	               clamp( pos.z, box.min.z, box.max.z ) );
+	Vec3f delta = pos - nearest;
+
+	return delta.x * delta.x + delta.y * delta.y + delta.z * delta.z;
+}
+
+
+// *************************************************************************************************
+// Class LightClusterGrid
+// *************************************************************************************************
+
+LightClusterGrid::LightClusterGrid() :
+	_near( 0 ), _far( 1 ), _sliceScale( DimZ ), _sliceBias( 0 ), _logSlices( false ), _droppedCount( 0 )
+{
+	_clusterBoxes.resize( NumClusters );
+	_clusterLights.resize( NumClusters * MaxLightsPerCluster );
+	_clusterOffsets.resize( NumClusters, 0 );
+	_clusterCounts.resize( NumClusters, 0 );
+}
+
+
+float LightClusterGrid::getSliceDepth( uint32 slice ) const
+{
+	float t = (float)slice / DimZ;
+
+	if( _logSlices ) return _near * powf( _far / _near, t );
+	else return _near + (_far - _near) * t;
+}
+
+
+int LightClusterGrid::getSlice( float depth ) const
+{
+	float f = _logSlices ? logf( maxf( depth, _near ) ) : depth;
+	int slice = ftoi_t( floorf( f * _sliceScale + _sliceBias ) );
+
+	return std::max( 0, std::min( slice, (int)DimZ - 1 ) );
+}
+
+
+void LightClusterGrid::setup( const Matrix4f &projMat )
+{
+	// The grid is derived from the projection matrix alone so that off-axis and custom
+	// projections set with h3dSetupCameraView or a projection matrix work as well
+	_projMat = projMat;
+	_invProjMat = projMat.inverted();
+
+	_near = -unprojectPoint( _invProjMat, 0, 0, -1 ).z;
+	_far = -unprojectPoint( _invProjMat, 0, 0, 1 ).z;
+	if( _far <= _near ) _far = _near + 1.0f;
+
+	// Exponential slices give clusters of roughly uniform shape but require a positive near plane
+	_logSlices = _near > Math::Epsilon;
+	if( _logSlices )
+	{
+		_sliceScale = DimZ / logf( _far / _near );
+		_sliceBias = -logf( _near ) * _sliceScale;
+	}
+	else
+	{
+		_sliceScale = DimZ / (_far - _near);
+		_sliceBias = -_near * _sliceScale;
+	}
+
+	float sliceDepths[DimZ + 1];
+	for( uint32 z = 0; z <= DimZ; ++z ) sliceDepths[z] = getSliceDepth( z );
+
+	for( uint32 y = 0; y < DimY; ++y )
+	{
+		for( uint32 x = 0; x < DimX; ++x )
+		{
+			// Corner rays of the tile through near and far plane
+			Vec3f nearPts[4], farPts[4];
+			for( uint32 i = 0; i < 4; ++i )
+			{
+				float ndcX = (float)(x + (i & 1)) / DimX * 2.0f - 1.0f;
+				float ndcY = (float)(y + (i >> 1)) / DimY * 2.0f - 1.0f;
+				nearPts[i] = unprojectPoint( _invProjMat, ndcX, ndcY, -1 );
+				farPts[i] = unprojectPoint( _invProjMat, ndcX, ndcY, 1 );
+			}
+
+			for( uint32 z = 0; z < DimZ; ++z )
+			{
+				BoundingBox &box = _clusterBoxes[getClusterIndex( x, y, z )];
+				box.min = Vec3f( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
+				box.max = Vec3f( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
+
+				for( uint32 i = 0; i < 4; ++i )
+				{
+					float dNear = -nearPts[i].z, dFar = -farPts[i].z;
+					float invRange = fabsf( dFar - dNear ) > Math::Epsilon ? 1.0f / (dFar - dNear) : 0.0f;
+
+					for( uint32 j = 0; j < 2; ++j )
+					{
+						float t = (sliceDepths[z + j] - dNear) * invRange;
+						Vec3f p = nearPts[i] + (farPts[i] - nearPts[i]) * t;
+
+						box.min = Vec3f( minf( box.min.x, p.x ), minf( box.min.y, p.y ), minf( box.min.z, p.z ) );
+						box.max = Vec3f( maxf( box.max.x, p.x ), maxf( box.max.y, p.y ), maxf( box.max.z, p.z ) );
+					}
+				}
+			}
+		}
+	}
+}
+
+
+bool LightClusterGrid::addLight( const Vec3f &viewPos, float radius )
+{
+	if( _lights.size() >= MaxLights ) return false;
+
+	_lights.push_back( Vec4f( viewPos.x, viewPos.y, viewPos.z, radius ) );
+	return true;
+}
+
+
+void LightClusterGrid::build()
+{
+	_droppedCount = 0;
+	for( uint32 i = 0; i < NumClusters; ++i ) _clusterCounts[i] = 0;
+
+	for( uint32 i = 0, s = (uint32)_lights.size(); i < s; ++i )
+	{
+		const Vec4f &light = _lights[i];
+		float depth = -light.z, radius = light.w;
+		if( depth + radius < _near || depth - radius > _far ) continue;
+
+		int z0 = getSlice( depth - radius ), z1 = getSlice( depth + radius );
+		int x0 = 0, x1 = DimX - 1, y0 = 0, y1 = DimY - 1;
+
+		// Narrow down the tile range using the projected bounds of the sphere if it is in front of the camera
+		float ndcMinX = Math::MaxFloat, ndcMinY = Math::MaxFloat;
+		float ndcMaxX = -Math::MaxFloat, ndcMaxY = -Math::MaxFloat;
+		bool projectable = true;
+
+		for( uint32 j = 0; j < 8 && projectable; ++j )
+		{
+			Vec4f corner( light.x + ((j & 1) ? radius : -radius), light.y + ((j & 2) ? radius : -radius),
+			              light.z + ((j & 4) ? radius : -radius), 1.0f );
+			Vec4f p = _projMat * corner;
+			if( p.w <= Math::Epsilon )
+			{
+				projectable = false;
+				break;
+			}
+			ndcMinX = minf( ndcMinX, p.x / p.w ); ndcMaxX = maxf( ndcMaxX, p.x / p.w );
+			ndcMinY = minf( ndcMinY, p.y / p.w ); ndcMaxY = maxf( ndcMaxY, p.y / p.w );
+		}
+
+		if( projectable )
+		{
+			if( ndcMaxX < -1 || ndcMinX > 1 || ndcMaxY < -1 || ndcMinY > 1 ) continue;
+
+			x0 = ftoi_t( clamp( (ndcMinX * 0.5f + 0.5f) * DimX, 0, DimX - 1 ) );
+			x1 = ftoi_t( clamp( (ndcMaxX * 0.5f + 0.5f) * DimX, 0, DimX - 1 ) );
+			y0 = ftoi_t( clamp( (ndcMinY * 0.5f + 0.5f) * DimY, 0, DimY - 1 ) );
+			y1 = ftoi_t( clamp( (ndcMaxY * 0.5f + 0.5f) * DimY, 0, DimY - 1 ) );
+		}
+
+		// Exact sphere-box test for the candidate clusters
+		Vec3f center( light.x, light.y, light.z );
+		float radiusSq = radius * radius;
+
+		for( int z = z0; z <= z1; ++z )
+		{
+			for( int y = y0; y <= y1; ++y )
+			{
+				for( int x = x0; x <= x1; ++x )
+				{
+					uint32 cluster = getClusterIndex( x, y, z );
+					if( sqrDistToAABB( center, _clusterBoxes[cluster] ) > radiusSq ) continue;
+
+					if( _clusterCounts[cluster] < MaxLightsPerCluster )
+						_clusterLights[cluster * MaxLightsPerCluster + _clusterCounts[cluster]++] = (unsigned char)i;
+					else
+						++_droppedCount;
+				}
+			}
+		}
+	}
+
+	// Compact the per-cluster lists into a single index array
+	_lightIndices.resize( 0 );
+	for( uint32 i = 0; i < NumClusters; ++i )
+	{
+		uint32 count = _clusterCounts[i];
+		if( _lightIndices.size() + count > MaxLightIndices )
+		{
+			_droppedCount += count - (MaxLightIndices - (uint32)_lightIndices.size());
+			count = MaxLightIndices - (uint32)_lightIndices.size();
+		}
+
+		_clusterOffsets[i] = (uint32)_lightIndices.size();
+		_clusterCounts[i] = count;
+		for( uint32 j = 0; j < count; ++j )
+			_lightIndices.push_back( _clusterLights[i * MaxLightsPerCluster + j] );
+	}
+}
+
+
+int LightClusterGrid::findCluster( const Vec3f &viewPos ) const
+{
+	Vec4f p = _projMat * Vec4f( viewPos );
+	if( p.w <= Math::Epsilon ) return -1;
+
+	float ndcX = p.x / p.w, ndcY = p.y / p.w, depth = -viewPos.z;
+	if( ndcX < -1 || ndcX > 1 || ndcY < -1 || ndcY > 1 || depth < _near || depth > _far ) return -1;
+
+	int x = std::min( ftoi_t( (ndcX * 0.5f + 0.5f) * DimX ), (int)DimX - 1 );
+	int y = std::min( ftoi_t( (ndcY * 0.5f + 0.5f) * DimY ), (int)DimY - 1 );
+
+	return (int)getClusterIndex( x, y, getSlice( depth ) );
+}
+
+}  // namespace
@@ -0,0 +1,88 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egLightCluster_H_
+#define _egLightCluster_H_
+
+#include "egPrerequisites.h"
+#include "egPrimitives.h"
+#include "utMath.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+// =================================================================================================
+// Light Cluster Grid
+// =================================================================================================
+
+// Subdivides the view frustum into screen space tiles and exponential depth slices and assigns
+// each light to the clusters its bounding sphere touches. Everything happens in view space on
+// the CPU; the renderer uploads the resulting lists for the clustered forward pass.
+
+class LightClusterGrid
+{
+public:
+	enum
+	{
+		DimX = 16,
+		DimY = 8,
+		DimZ = 16,
+		NumClusters = DimX * DimY * DimZ,
+		MaxLights = 256,
+		MaxLightsPerCluster = 32,
+		MaxLightIndices = 8192
+	};
+
+	LightClusterGrid();
+
+	void setup( const Matrix4f &projMat );
+	void clearLights() { _lights.resize( 0 ); }
+	bool addLight( const Vec3f &viewPos, float radius );
+	void build();
+
+	static uint32 getClusterIndex( uint32 x, uint32 y, uint32 z ) { return (z * DimY + y) * DimX + x; }
+	int findCluster( const Vec3f &viewPos ) const;
+
+	uint32 getLightCount() const { return (uint32)_lights.size(); }
+	uint32 getClusterOffset( uint32 cluster ) const { return _clusterOffsets[cluster]; }
+	uint32 getClusterLightCount( uint32 cluster ) const { return _clusterCounts[cluster]; }
+	const std::vector< uint32 > &getLightIndices() const { return _lightIndices; }
+	uint32 getDroppedCount() const { return _droppedCount; }
+	const BoundingBox &getClusterBox( uint32 cluster ) const { return _clusterBoxes[cluster]; }
+
+	// Slice of a view space depth d: floor( f( d ) * scale + bias ) with f = log for
+	// logarithmic slicing and f = identity otherwise
+	float getSliceScale() const { return _sliceScale; }
+	float getSliceBias() const { return _sliceBias; }
+	bool hasLogSlices() const { return _logSlices; }
+
+protected:
+	float getSliceDepth( uint32 slice ) const;
+	int getSlice( float depth ) const;
+
+protected:
+	Matrix4f                      _projMat, _invProjMat;
+	float                         _near, _far;
+	float                         _sliceScale, _sliceBias;
+	bool                          _logSlices;
+
+	std::vector< BoundingBox >    _clusterBoxes;  // View space
+	std::vector< Vec4f >          _lights;  // View space position and radius
+	std::vector< unsigned char >  _clusterLights;  // Fixed size list per cluster, filled by build
+	std::vector< uint32 >         _clusterOffsets, _clusterCounts;
+	std::vector< uint32 >         _lightIndices;
+	uint32                        _droppedCount;
+};
+
+}
+#endif // _egLightCluster_H_
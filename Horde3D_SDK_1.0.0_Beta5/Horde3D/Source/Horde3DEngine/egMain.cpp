@@ -18,7 +18,9 @@
 #include "egLight.h"
 #include "egCamera.h"
 #include "egParticle.h"
+#include "egDotField.h"
 #include "egTexture.h"
+#include "egFrame.h"
 #include <cstdlib>
 #include <cstring>
 #include <string>
@@ -80,6 +82,8 @@ DLLEXP bool h3dCheckExtension( const char *extensionName )
 
 DLLEXP bool h3dGetError()
 {
+	Modules::frameMan().sync();
+
 	return Modules::getError();
 }
 
@@ -110,18 +114,34 @@ DLLEXP void h3dRender( NodeHandle cameraNode )
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( cameraNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Camera, "h3dRender", APIFUNC_RET_VOID );
 	
+	Modules::frameMan().syncRender();
 	Modules::renderer().render( (CameraNode *)sn );
 }
 
 
 DLLEXP void h3dFinalizeFrame()
 {
+	Modules::frameMan().syncRender();
+
 	Modules::renderer().finalizeFrame();
 }
 
 
+DLLEXP void h3dBeginFrame()
+{
+	Modules::frameMan().beginFrame();
+}
+
+
+DLLEXP void h3dEndFrame()
+{
+	Modules::frameMan().endFrame();
+}
+
+
 DLLEXP void h3dClear()
 {
+	Modules::frameMan().sync();
 	Modules::sceneMan().removeNode( Modules::sceneMan().getRootNode() );
 	Modules::resMan().clear();
 }
@@ -133,6 +153,8 @@ DLLEXP void h3dClear()
 
 DLLEXP const char *h3dGetMessage( int *level, float *time )
 {
+	Modules::frameMan().sync();
+
 	static string msgText;
 	static LogMessage msg;
 	
@@ -155,12 +177,15 @@ DLLEXP float h3dGetOption( EngineOptions::List param )
 
 DLLEXP bool h3dSetOption( EngineOptions::List param, float value )
 {
+	Modules::frameMan().sync();
+
 	return Modules::config().setOption( param, value );
 }
 
 
 DLLEXP float h3dGetStat( EngineStats::List param, bool reset )
 {
+	Modules::frameMan().sync();
 	return Modules::stats().getStat( param, reset );
 }
 
@@ -168,6 +193,8 @@ DLLEXP float h3dGetStat( EngineStats::List param, bool reset )
 DLLEXP void h3dShowOverlays( const float *verts, int vertCount, float colR, float colG,
                              float colB, float colA, uint32 materialRes, int flags )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( materialRes ); 
 	APIFUNC_VALIDATE_RES_TYPE( resObj, ResourceTypes::Material, "h3dShowOverlays", APIFUNC_RET_VOID );
 
@@ -178,6 +205,8 @@ DLLEXP void h3dShowOverlays( const float *verts, int vertCount, float colR, floa
 
 DLLEXP void h3dClearOverlays()
 {
+	Modules::frameMan().sync();
+
 	Modules::renderer().clearOverlays();
 }
 
@@ -188,6 +217,8 @@ DLLEXP void h3dClearOverlays()
 
 DLLEXP int h3dGetResType( ResHandle res )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dGetResType", ResourceTypes::Undefined );
 	
@@ -197,6 +228,8 @@ DLLEXP int h3dGetResType( ResHandle res )
 
 DLLEXP const char *h3dGetResName( ResHandle res )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dGetResName", emptyCString );
 	
@@ -206,6 +239,8 @@ DLLEXP const char *h3dGetResName( ResHandle res )
 
 DLLEXP ResHandle h3dGetNextResource( int type, ResHandle start )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().getNextResource( type, start );
 	
 	return resObj != 0x0 ? resObj->getHandle() : 0;
@@ -214,6 +249,8 @@ DLLEXP ResHandle h3dGetNextResource( int type, ResHandle start )
 
 DLLEXP ResHandle h3dFindResource( int type, const char *name )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().findResource( type, safeStr( name, 0 ) );
 	
 	return resObj != 0x0 ? resObj->getHandle() : 0;
@@ -222,12 +259,16 @@ DLLEXP ResHandle h3dFindResource( int type, const char *name )
 
 DLLEXP ResHandle h3dAddResource( int type, const char *name, int flags )
 {
+	Modules::frameMan().sync();
+
 	return Modules::resMan().addResource( type, safeStr( name, 0 ), flags, true );
 }
 
 
 DLLEXP ResHandle h3dCloneResource( ResHandle sourceRes, const char *name )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( sourceRes );
 	APIFUNC_VALIDATE_RES( resObj, "h3dCloneResource", 0 );
 	
@@ -237,6 +278,8 @@ DLLEXP ResHandle h3dCloneResource( ResHandle sourceRes, const char *name )
 
 DLLEXP int h3dRemoveResource( ResHandle res )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dRemoveResource", -1 );
 	
@@ -246,6 +289,8 @@ DLLEXP int h3dRemoveResource( ResHandle res )
 
 DLLEXP bool h3dIsResLoaded( ResHandle res )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dIsResLoaded", false );
 	
@@ -255,6 +300,8 @@ DLLEXP bool h3dIsResLoaded( ResHandle res )
 
 DLLEXP bool h3dLoadResource( ResHandle res, const char *data, int size )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dLoadResource", false );
 	
@@ -263,8 +310,58 @@ DLLEXP bool h3dLoadResource( ResHandle res, const char *data, int size )
 }
 
 
+DLLEXP DecodedResData *h3dDecodeResourceData( int type, const char *data, int size )
+{
+	// No validation through the API macros since this can be called from any thread
+	switch( type )
+	{
+	case ResourceTypes::Texture:
+		return TextureResource::decodeImage( data, size );
+	case ResourceTypes::Geometry:
+		return GeometryResource::decodeGeometry( data, size );
+	case ResourceTypes::SceneGraph:
+	case ResourceTypes::Material:
+	case ResourceTypes::ParticleEffect:
+	case ResourceTypes::Pipeline:
+		return Resource::decodeXML( type, data, size );
+	default:
+		return 0x0;
+	}
+}
+
+
+DLLEXP bool h3dLoadDecodedResource( ResHandle res, DecodedResData *decodedData )
+{
+	Modules::frameMan().sync();
+
+	Resource *resObj = Modules::resMan().resolveResHandle( res );
+	APIFUNC_VALIDATE_RES( resObj, "h3dLoadDecodedResource", false );
+	if( decodedData == 0x0 || decodedData->type != resObj->getType() )
+	{
+		Modules::setError( "Invalid decoded data in h3dLoadDecodedResource" );
+		return false;
+	}
+	if( decodedData->consumed )
+	{
+		Modules::setError( "Decoded data already loaded in h3dLoadDecodedResource" );
+		return false;
+	}
+	
+	Modules::log().writeInfo( "Loading resource '%s'", resObj->getName().c_str() );
+	return resObj->loadDecoded( *decodedData );
+}
+
+
+DLLEXP void h3dFreeDecodedResourceData( DecodedResData *decodedData )
+{
+	delete decodedData;
+}
+
+
 DLLEXP void h3dUnloadResource( ResHandle res )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dUnloadResource", APIFUNC_RET_VOID );
 
@@ -274,6 +371,8 @@ DLLEXP void h3dUnloadResource( ResHandle res )
 
 DLLEXP int h3dGetResElemCount( ResHandle res, int elem )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dGetResElemCount", 0 );
 
@@ -283,6 +382,8 @@ DLLEXP int h3dGetResElemCount( ResHandle res, int elem )
 
 DLLEXP int h3dFindResElem( ResHandle res, int elem, int param, const char *value )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dFindResElem", -1 );
 
@@ -292,6 +393,8 @@ DLLEXP int h3dFindResElem( ResHandle res, int elem, int param, const char *value
 
 DLLEXP int h3dGetResParamI( ResHandle res, int elem, int elemIdx, int param )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dGetResParamI", Horde3D::Math::MinInt32 );
 	
@@ -301,6 +404,8 @@ DLLEXP int h3dGetResParamI( ResHandle res, int elem, int elemIdx, int param )
 
 DLLEXP void h3dSetResParamI( ResHandle res, int elem, int elemIdx, int param, int value )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dSetResParamI", APIFUNC_RET_VOID );
 
@@ -310,6 +415,8 @@ DLLEXP void h3dSetResParamI( ResHandle res, int elem, int elemIdx, int param, in
 
 DLLEXP float h3dGetResParamF( ResHandle res, int elem, int elemIdx, int param, int compIdx )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dGetResParamF", Horde3D::Math::NaN );
 
@@ -319,6 +426,8 @@ DLLEXP float h3dGetResParamF( ResHandle res, int elem, int elemIdx, int param, i
 
 DLLEXP void h3dSetResParamF( ResHandle res, int elem, int elemIdx, int param, int compIdx, float value )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dSetResParamF", APIFUNC_RET_VOID );
 
@@ -328,6 +437,8 @@ DLLEXP void h3dSetResParamF( ResHandle res, int elem, int elemIdx, int param, in
 
 DLLEXP const char *h3dGetResParamStr( ResHandle res, int elem, int elemIdx, int param )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dGetResParamStr", emptyCString );
 
@@ -337,6 +448,8 @@ DLLEXP const char *h3dGetResParamStr( ResHandle res, int elem, int elemIdx, int
 
 DLLEXP void h3dSetResParamStr( ResHandle res, int elem, int elemIdx, int param, const char *value )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dSetResParamStr", APIFUNC_RET_VOID );
 	
@@ -346,6 +459,8 @@ DLLEXP void h3dSetResParamStr( ResHandle res, int elem, int elemIdx, int param,
 
 DLLEXP void *h3dMapResStream( ResHandle res, int elem, int elemIdx, int stream, bool read, bool write )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dMapResStream", 0x0 );
 
@@ -355,6 +470,8 @@ DLLEXP void *h3dMapResStream( ResHandle res, int elem, int elemIdx, int stream,
 
 DLLEXP void h3dUnmapResStream( ResHandle res )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( res );
 	APIFUNC_VALIDATE_RES( resObj, "h3dUnmapResStream", APIFUNC_RET_VOID );
 
@@ -364,18 +481,24 @@ DLLEXP void h3dUnmapResStream( ResHandle res )
 
 DLLEXP ResHandle h3dQueryUnloadedResource( int index )
 {
+	Modules::frameMan().sync();
+
 	return Modules::resMan().queryUnloadedResource( index );
 }
 
 
 DLLEXP void h3dReleaseUnusedResources()
 {
+	Modules::frameMan().sync();
+
 	Modules::resMan().releaseUnusedResources();
 }
 
 
 DLLEXP ResHandle h3dCreateTexture( const char *name, int width, int height, int fmt, int flags )
 {
+	Modules::frameMan().sync();
+
 	TextureResource *texRes = new TextureResource( safeStr( name, 0 ), (uint32)width,
 		(uint32)height, 1, (TextureFormats::List)fmt, flags );
 
@@ -392,12 +515,16 @@ DLLEXP ResHandle h3dCreateTexture( const char *name, int width, int height, int
 
 DLLEXP void h3dSetShaderPreambles( const char *vertPreamble, const char *fragPreamble )
 {
+	Modules::frameMan().sync();
+
 	ShaderResource::setPreambles( safeStr( vertPreamble, 0 ), safeStr( fragPreamble, 1 ) );
 }
 
 
 DLLEXP bool h3dSetMaterialUniform( ResHandle materialRes, const char *name, float a, float b, float c, float d )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( materialRes );
 	APIFUNC_VALIDATE_RES_TYPE( resObj, ResourceTypes::Material, "h3dSetMaterialUniform", false );
 
@@ -407,6 +534,8 @@ DLLEXP bool h3dSetMaterialUniform( ResHandle materialRes, const char *name, floa
 
 DLLEXP void h3dResizePipelineBuffers( ResHandle pipeRes, int width, int height )
 {
+	Modules::frameMan().sync();
+
 	Resource *resObj = Modules::resMan().resolveResHandle( pipeRes );
 	APIFUNC_VALIDATE_RES_TYPE( resObj, ResourceTypes::Pipeline, "h3dResizePipelineBuffers", APIFUNC_RET_VOID );
 
@@ -418,6 +547,8 @@ DLLEXP void h3dResizePipelineBuffers( ResHandle pipeRes, int width, int height )
 DLLEXP bool h3dGetRenderTargetData( ResHandle pipelineRes, const char *targetName, int bufIndex,
                                     int *width, int *height, int *compCount, void *dataBuffer, int bufferSize )
 {
+	Modules::frameMan().sync();
+
 	if( pipelineRes != 0 )
 	{
 		Resource *resObj = Modules::resMan().resolveResHandle( pipelineRes );
@@ -439,6 +570,8 @@ DLLEXP bool h3dGetRenderTargetData( ResHandle pipelineRes, const char *targetNam
 
 DLLEXP int h3dGetNodeType( NodeHandle node )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeType", SceneNodeTypes::Undefined );
 	
@@ -448,6 +581,8 @@ DLLEXP int h3dGetNodeType( NodeHandle node )
 
 DLLEXP NodeHandle h3dGetNodeParent( NodeHandle node )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeParent", 0 );
 	
@@ -457,6 +592,8 @@ DLLEXP NodeHandle h3dGetNodeParent( NodeHandle node )
 
 DLLEXP bool h3dSetNodeParent( NodeHandle node, NodeHandle parent )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeParent", false );
 	SceneNode *snp = Modules::sceneMan().resolveNodeHandle( parent );
@@ -468,6 +605,8 @@ DLLEXP bool h3dSetNodeParent( NodeHandle node, NodeHandle parent )
 
 DLLEXP NodeHandle h3dGetNodeChild( NodeHandle parent, int index )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeChild", 0 );
 
@@ -480,6 +619,8 @@ DLLEXP NodeHandle h3dGetNodeChild( NodeHandle parent, int index )
 
 DLLEXP NodeHandle h3dAddNodes( NodeHandle parent, ResHandle sceneGraphRes )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddNodes", 0 );
 	
@@ -499,6 +640,8 @@ DLLEXP NodeHandle h3dAddNodes( NodeHandle parent, ResHandle sceneGraphRes )
 
 DLLEXP void h3dRemoveNode( NodeHandle node )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dRemoveNode", APIFUNC_RET_VOID );
 
@@ -509,6 +652,8 @@ DLLEXP void h3dRemoveNode( NodeHandle node )
 
 DLLEXP bool h3dCheckNodeTransFlag( NodeHandle node, bool reset )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dCheckNodeTransFlag", false );
 	
@@ -519,6 +664,8 @@ DLLEXP bool h3dCheckNodeTransFlag( NodeHandle node, bool reset )
 DLLEXP void h3dGetNodeTransform( NodeHandle node, float *tx, float *ty, float *tz,
                                  float *rx, float *ry, float *rz, float *sx, float *sy, float *sz )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeTransform", APIFUNC_RET_VOID );
 	
@@ -534,6 +681,8 @@ DLLEXP void h3dGetNodeTransform( NodeHandle node, float *tx, float *ty, float *t
 DLLEXP void h3dSetNodeTransform( NodeHandle node, float tx, float ty, float tz,
                                  float rx, float ry, float rz, float sx, float sy, float sz )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeTransform", APIFUNC_RET_VOID );
 	
@@ -543,6 +692,8 @@ DLLEXP void h3dSetNodeTransform( NodeHandle node, float tx, float ty, float tz,
 
 DLLEXP void h3dGetNodeTransMats( NodeHandle node, const float **relMat, const float **absMat )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeTransMats", APIFUNC_RET_VOID );
 	
@@ -552,6 +703,8 @@ DLLEXP void h3dGetNodeTransMats( NodeHandle node, const float **relMat, const fl
 
 DLLEXP void h3dSetNodeTransMat( NodeHandle node, const float *mat4x4 )
 {
+	Modules::frameMan().sync();
+
 	static Matrix4f mat;
 	
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
@@ -569,6 +722,8 @@ DLLEXP void h3dSetNodeTransMat( NodeHandle node, const float *mat4x4 )
 
 DLLEXP int h3dGetNodeParamI( NodeHandle node, int param )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeParamI", Horde3D::Math::MinInt32 );
 
@@ -578,6 +733,8 @@ DLLEXP int h3dGetNodeParamI( NodeHandle node, int param )
 
 DLLEXP void h3dSetNodeParamI( NodeHandle node, int param, int value )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeParamI", APIFUNC_RET_VOID );
 
@@ -587,6 +744,8 @@ DLLEXP void h3dSetNodeParamI( NodeHandle node, int param, int value )
 
 DLLEXP float h3dGetNodeParamF( NodeHandle node, int param, int compIdx )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeParamF", Horde3D::Math::NaN );
 	
@@ -596,6 +755,8 @@ DLLEXP float h3dGetNodeParamF( NodeHandle node, int param, int compIdx )
 
 DLLEXP void h3dSetNodeParamF( NodeHandle node, int param, int compIdx, float value )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeParamF", APIFUNC_RET_VOID );
 
@@ -605,6 +766,8 @@ DLLEXP void h3dSetNodeParamF( NodeHandle node, int param, int compIdx, float val
 
 DLLEXP const char *h3dGetNodeParamStr( NodeHandle node, int param )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeParamStr", emptyCString );
 	
@@ -614,6 +777,8 @@ DLLEXP const char *h3dGetNodeParamStr( NodeHandle node, int param )
 
 DLLEXP void h3dSetNodeParamStr( NodeHandle node, int param, const char *name )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeParamStr", APIFUNC_RET_VOID );
 	
@@ -623,6 +788,8 @@ DLLEXP void h3dSetNodeParamStr( NodeHandle node, int param, const char *name )
 
 DLLEXP int h3dGetNodeFlags( NodeHandle node )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeFlags", 0 );
 	return sn->getFlags();
@@ -631,6 +798,8 @@ DLLEXP int h3dGetNodeFlags( NodeHandle node )
 
 DLLEXP void h3dSetNodeFlags( NodeHandle node, int flags, bool recursive )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeFlags", APIFUNC_RET_VOID );
 	sn->setFlags( flags, recursive );
@@ -640,6 +809,8 @@ DLLEXP void h3dSetNodeFlags( NodeHandle node, int flags, bool recursive )
 DLLEXP void h3dGetNodeAABB( NodeHandle node, float *minX, float *minY, float *minZ,
                             float *maxX, float *maxY, float *maxZ )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dGetNodeAABB", APIFUNC_RET_VOID );
 
@@ -655,6 +826,8 @@ DLLEXP void h3dGetNodeAABB( NodeHandle node, float *minX, float *minY, float *mi
 
 DLLEXP int h3dFindNodes( NodeHandle startNode, const char *name, int type )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( startNode );
 	APIFUNC_VALIDATE_NODE( sn, "h3dFindNodes", 0 );
 
@@ -665,6 +838,8 @@ DLLEXP int h3dFindNodes( NodeHandle startNode, const char *name, int type )
 
 DLLEXP NodeHandle h3dGetNodeFindResult( int index )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().getFindResult( index );
 	
 	return sn != 0x0 ? sn->getHandle() : 0;
@@ -673,6 +848,8 @@ DLLEXP NodeHandle h3dGetNodeFindResult( int index )
 
 DLLEXP void h3dSetNodeUniforms( NodeHandle node, float *uniformData, int count )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dSetNodeUniforms", APIFUNC_RET_VOID );
 	sn->setCustomInstData( uniformData, (uint32)count );
@@ -681,6 +858,8 @@ DLLEXP void h3dSetNodeUniforms( NodeHandle node, float *uniformData, int count )
 
 DLLEXP NodeHandle h3dCastRay( NodeHandle node, float ox, float oy, float oz, float dx, float dy, float dz, int numNearest )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dCastRay", 0 );
 
@@ -691,6 +870,8 @@ DLLEXP NodeHandle h3dCastRay( NodeHandle node, float ox, float oy, float oz, flo
 
 DLLEXP bool h3dGetCastRayResult( int index, NodeHandle *node, float *distance, float *intersection )
 {
+	Modules::frameMan().sync();
+
 	CastRayResult crr;
 	if( Modules::sceneMan().getCastRayResult( index, crr ) )
 	{
@@ -712,6 +893,8 @@ DLLEXP bool h3dGetCastRayResult( int index, NodeHandle *node, float *distance, f
 
 DLLEXP int h3dCheckNodeVisibility( NodeHandle node, NodeHandle cameraNode, bool checkOcclusion, bool calcLod )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( node );
 	APIFUNC_VALIDATE_NODE( sn, "h3dCheckNodeVisibility", -1 );
 	SceneNode *cam = Modules::sceneMan().resolveNodeHandle( cameraNode );
@@ -723,6 +906,8 @@ DLLEXP int h3dCheckNodeVisibility( NodeHandle node, NodeHandle cameraNode, bool
 
 DLLEXP NodeHandle h3dAddGroupNode( NodeHandle parent, const char *name )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddGroupNode", 0 );
 
@@ -735,6 +920,8 @@ DLLEXP NodeHandle h3dAddGroupNode( NodeHandle parent, const char *name )
 
 DLLEXP NodeHandle h3dAddModelNode( NodeHandle parent, const char *name, ResHandle geometryRes )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddModelNode", 0 );
 	Resource *geoRes = Modules::resMan().resolveResHandle( geometryRes );
@@ -750,6 +937,8 @@ DLLEXP NodeHandle h3dAddModelNode( NodeHandle parent, const char *name, ResHandl
 DLLEXP void h3dSetupModelAnimStage( NodeHandle modelNode, int stage, ResHandle animationRes, int layer,
                                     const char *startNode, bool additive )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dSetupModelAnimStage", APIFUNC_RET_VOID );
 	Resource *animRes = 0x0;
@@ -764,8 +953,23 @@ DLLEXP void h3dSetupModelAnimStage( NodeHandle modelNode, int stage, ResHandle a
 }
 
 
+DLLEXP void h3dPrewarmModelAnim( NodeHandle modelNode, ResHandle animationRes, const char *startNode )
+{
+	Modules::frameMan().sync();
+
+	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
+	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dPrewarmModelAnim", APIFUNC_RET_VOID );
+	Resource *animRes = Modules::resMan().resolveResHandle( animationRes );
+	APIFUNC_VALIDATE_RES_TYPE( animRes, ResourceTypes::Animation, "h3dPrewarmModelAnim", APIFUNC_RET_VOID );
+	
+	((ModelNode *)sn)->prewarmAnim( (AnimationResource *)animRes, safeStr( startNode, 0 ) );
+}
+
+
 DLLEXP void h3dGetModelAnimParams( NodeHandle modelNode, int stage, float *time, float *weight )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dGetModelAnimParams", APIFUNC_RET_VOID );
 	
@@ -775,6 +979,8 @@ DLLEXP void h3dGetModelAnimParams( NodeHandle modelNode, int stage, float *time,
 
 DLLEXP void h3dSetModelAnimParams( NodeHandle modelNode, int stage, float time, float weight )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dSetModelAnimParams", APIFUNC_RET_VOID );
 	
@@ -784,6 +990,8 @@ DLLEXP void h3dSetModelAnimParams( NodeHandle modelNode, int stage, float time,
 
 DLLEXP bool h3dSetModelMorpher( NodeHandle modelNode, const char *target, float weight )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dSetModelMorpher", false );
 	
@@ -796,13 +1004,63 @@ DLLEXP void h3dUpdateModel( NodeHandle modelNode, int flags )
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dUpdateModel", APIFUNC_RET_VOID );
 
+	if( Modules::frameMan().deferModelUpdate( modelNode, flags ) ) return;
+	
+	Modules::frameMan().sync();
 	((ModelNode *)sn)->update( flags );
 }
 
 
+DLLEXP void h3dUpdateModels( int count, const NodeHandle *modelNodes, int stage, const float *times,
+                              const float *weights, int flags )
+{
+	// The animation parameters are set below, so the update thread must not run anymore
+	Modules::frameMan().sync();
+
+	if( count <= 0 ) return;
+	if( modelNodes == 0x0 )
+	{
+		Modules::setError( "Invalid pointer in h3dUpdateModels" );
+		return;
+	}
+	
+	static vector< ModelNode * > models;
+	models.resize( 0 );
+	
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = Modules::sceneMan().resolveNodeHandle( modelNodes[i] );
+		APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Model, "h3dUpdateModels", APIFUNC_RET_VOID );
+		models.push_back( (ModelNode *)sn );
+	}
+
+	// Animation parameters are cheap to set and mark the parents dirty, so this is done serially
+	if( times != 0x0 || weights != 0x0 )
+	{
+		for( int i = 0; i < count; ++i )
+		{
+			float time = 0, weight = 0;
+			models[i]->getAnimParams( stage, &time, &weight );
+			models[i]->setAnimParams( stage, times != 0x0 ? times[i] : time, weights != 0x0 ? weights[i] : weight );
+		}
+	}
+
+	bool deferred = false;
+	for( int i = 0; i < count; ++i )
+	{
+		deferred |= Modules::frameMan().deferModelUpdate( modelNodes[i], flags );
+	}
+	if( deferred ) return;
+
+	Modules::frameMan().updateModels( &models[0], (uint32)count, flags );
+}
+
+
 DLLEXP NodeHandle h3dAddMeshNode( NodeHandle parent, const char *name, ResHandle materialRes,
                                   int batchStart, int batchCount, int vertRStart, int vertREnd )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddMeshNode", 0 );
 	Resource *matRes = Modules::resMan().resolveResHandle( materialRes );
@@ -818,6 +1076,8 @@ DLLEXP NodeHandle h3dAddMeshNode( NodeHandle parent, const char *name, ResHandle
 
 DLLEXP NodeHandle h3dAddJointNode( NodeHandle parent, const char *name, int jointIndex )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddJointNode", 0 );
 
@@ -831,6 +1091,8 @@ DLLEXP NodeHandle h3dAddJointNode( NodeHandle parent, const char *name, int join
 DLLEXP NodeHandle h3dAddLightNode( NodeHandle parent, const char *name, ResHandle materialRes,
                                    const char *lightingContext, const char *shadowContext )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddLightNode", 0 );
 	Resource *matRes = Modules::resMan().resolveResHandle( materialRes );
@@ -849,6 +1111,8 @@ DLLEXP NodeHandle h3dAddLightNode( NodeHandle parent, const char *name, ResHandl
 
 DLLEXP NodeHandle h3dAddCameraNode( NodeHandle parent, const char *name, ResHandle pipelineRes )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddCameraNode", 0 );
 	Resource *pipeRes = Modules::resMan().resolveResHandle( pipelineRes );
@@ -863,6 +1127,8 @@ DLLEXP NodeHandle h3dAddCameraNode( NodeHandle parent, const char *name, ResHand
 
 DLLEXP void h3dSetupCameraView( NodeHandle cameraNode, float fov, float aspect, float nearDist, float farDist )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( cameraNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Camera, "h3dSetupCameraView", APIFUNC_RET_VOID );
 	
@@ -872,6 +1138,8 @@ DLLEXP void h3dSetupCameraView( NodeHandle cameraNode, float fov, float aspect,
 
 DLLEXP void h3dGetCameraProjMat( NodeHandle cameraNode, float *projMat )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( cameraNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Camera, "h3dGetCameraProjMat", APIFUNC_RET_VOID );
 	if( projMat == 0x0 )
@@ -886,6 +1154,8 @@ DLLEXP void h3dGetCameraProjMat( NodeHandle cameraNode, float *projMat )
 
 DLLEXP void h3dSetCameraProjMat( NodeHandle cameraNode, float *projMat )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( cameraNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Camera, "h3dSetCameraProjMat", APIFUNC_RET_VOID );
 	if( projMat == 0x0 )
@@ -902,6 +1172,8 @@ DLLEXP void h3dSetCameraProjMat( NodeHandle cameraNode, float *projMat )
 DLLEXP NodeHandle h3dAddEmitterNode( NodeHandle parent, const char *name, ResHandle materialRes,
                                      ResHandle particleEffectRes, int maxParticleCount, int respawnCount )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
 	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddEmitterNode", 0 );
 	Resource *matRes = Modules::resMan().resolveResHandle( materialRes );
@@ -922,12 +1194,49 @@ DLLEXP void h3dUpdateEmitter( NodeHandle emitterNode, float timeDelta )
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( emitterNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Emitter, "h3dUpdateEmitter", APIFUNC_RET_VOID );
 	
+	if( Modules::frameMan().deferEmitterUpdate( emitterNode, timeDelta ) ) return;
+	
+	Modules::frameMan().sync();
 	((EmitterNode *)sn)->update( timeDelta );
 }
 
 
+DLLEXP void h3dUpdateEmitters( int count, const NodeHandle *emitterNodes, float timeDelta )
+{
+	if( count <= 0 ) return;
+	if( emitterNodes == 0x0 )
+	{
+		Modules::setError( "Invalid pointer in h3dUpdateEmitters" );
+		return;
+	}
+	
+	static vector< EmitterNode * > emitters;
+	static vector< float > timeDeltas;
+	emitters.resize( 0 );
+	
+	for( int i = 0; i < count; ++i )
+	{
+		SceneNode *sn = Modules::sceneMan().resolveNodeHandle( emitterNodes[i] );
+		APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Emitter, "h3dUpdateEmitters", APIFUNC_RET_VOID );
+		emitters.push_back( (EmitterNode *)sn );
+	}
+
+	bool deferred = false;
+	for( int i = 0; i < count; ++i )
+	{
+		deferred |= Modules::frameMan().deferEmitterUpdate( emitterNodes[i], timeDelta );
+	}
+	if( deferred ) return;
+
+	timeDeltas.assign( count, timeDelta );
+	Modules::frameMan().updateEmitters( &emitters[0], &timeDeltas[0], (uint32)count );
+}
+
+
 DLLEXP bool h3dHasEmitterFinished( NodeHandle emitterNode )
 {
+	Modules::frameMan().sync();
+
 	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( emitterNode );
 	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Emitter, "h3dHasEmitterFinished", false );
 	
@@ -935,6 +1244,59 @@ DLLEXP bool h3dHasEmitterFinished( NodeHandle emitterNode )
 }
 
 
+DLLEXP int h3dGetEmitterParticleData( NodeHandle emitterNode, int maxCount, float *positions,
+                                      float *sizesAndRotations, float *colors )
+{
+	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( emitterNode );
+	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::Emitter, "h3dGetEmitterParticleData", 0 );
+	
+	Modules::frameMan().sync();
+	return ((EmitterNode *)sn)->getParticleData( maxCount, positions, sizesAndRotations, colors );
+}
+
+
+DLLEXP NodeHandle h3dAddDotFieldNode( NodeHandle parent, const char *name, ResHandle materialRes, int dotCount )
+{
+	Modules::frameMan().sync();
+
+	SceneNode *parentNode = Modules::sceneMan().resolveNodeHandle( parent );
+	APIFUNC_VALIDATE_NODE( parentNode, "h3dAddDotFieldNode", 0 );
+	Resource *matRes = Modules::resMan().resolveResHandle( materialRes );
+	APIFUNC_VALIDATE_RES_TYPE( matRes, ResourceTypes::Material, "h3dAddDotFieldNode", 0 );
+	if( dotCount < 0 )
+	{
+		Modules::setError( "Invalid dot count in h3dAddDotFieldNode" );
+		return 0;
+	}
+	
+	DotFieldNodeTpl tpl( safeStr( name, 0 ), (MaterialResource *)matRes, (unsigned)dotCount );
+	SceneNode *sn = Modules::sceneMan().findType( SceneNodeTypes::DotField )->factoryFunc( tpl );
+	return Modules::sceneMan().addNode( sn, *parentNode );
+}
+
+
+DLLEXP void h3dUpdateDotField( NodeHandle dotFieldNode, float timeDelta )
+{
+	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( dotFieldNode );
+	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::DotField, "h3dUpdateDotField", APIFUNC_RET_VOID );
+	
+	if( Modules::frameMan().deferDotFieldUpdate( dotFieldNode, timeDelta ) ) return;
+	
+	Modules::frameMan().sync();
+	((DotFieldNode *)sn)->update( timeDelta );
+}
+
+
+DLLEXP int h3dGetDotFieldData( NodeHandle dotFieldNode, int maxCount, float *positions, float *signal )
+{
+	SceneNode *sn = Modules::sceneMan().resolveNodeHandle( dotFieldNode );
+	APIFUNC_VALIDATE_NODE_TYPE( sn, SceneNodeTypes::DotField, "h3dGetDotFieldData", 0 );
+	
+	Modules::frameMan().sync();
+	return ((DotFieldNode *)sn)->getDotData( maxCount, positions, signal );
+}
+
+
 // =================================================================================================
 // DLL entry point
 // =================================================================================================
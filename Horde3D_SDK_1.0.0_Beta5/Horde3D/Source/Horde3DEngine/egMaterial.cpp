@@ -90,6 +90,13 @@ bool MaterialResource::load( const char *data, int size )
 	
 	XMLDoc doc;
 	doc.parseBuffer( data, size );
+
+	return loadXML( doc );
+}
+
+
+bool MaterialResource::loadXML( const XMLDoc &doc )
+{
 	if( doc.hasError() )
 		return raiseError( "XML parsing error" );
 
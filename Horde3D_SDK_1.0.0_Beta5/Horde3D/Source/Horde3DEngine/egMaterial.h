@@ -93,6 +93,7 @@ public:
 	void setElemParamStr( int elem, int elemIdx, int param, const char *value );
 
 private:
+	bool loadXML( const XMLDoc &doc );
 	bool raiseError( const std::string &msg, int line = -1 );
 
 private:
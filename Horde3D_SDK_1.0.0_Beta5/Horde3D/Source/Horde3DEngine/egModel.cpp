@@ -15,6 +15,7 @@
 #include "egModules.h"
 #include "egRenderer.h"
 #include "egCom.h"
+#include "utThreadPool.h"
 #include <cstring>
 
 #include "utDebug.h"
@@ -24,13 +25,109 @@ namespace Horde3D {
 
 using namespace std;
 
+SkinningFunc ModelNode::skinningFunc = getSkinningFunc( SkinningKernels::Scalar );
+
+
+// =================================================================================================
+// Morph Target Blending
+// =================================================================================================
+
+// Vertex lists and morph targets are split into chunks of this size for the thread pool
+static const uint32 MorphChunkSize = 2048;
+
+struct MorphJob
+{
+	const MorphTarget    *target;
+	float                weight;
+	const uint32         *vertList;    // Vertices to reset or normalize; NULL for all vertices
+	uint32               count;
+	Vec3f                *posData;
+	VertexDataTan        *tanData;
+	const Vec3f          *basePosData;
+	const VertexDataTan  *baseTanData;
+	const uint32         *vertStamps;  // Only vertices with the current stamp are morphed; NULL for all
+	uint32               stamp;
+};
+
+
+static void resetMorphVertsFunc( void *userData, unsigned int index )
+{
+	MorphJob &job = *(MorphJob *)userData;
+	uint32 end = std::min( (index + 1) * MorphChunkSize, job.count );
+
+	for( uint32 i = index * MorphChunkSize; i < end; ++i )
+	{
+		uint32 vert = job.vertList[i];
+		job.posData[vert] = job.basePosData[vert];
+		job.tanData[vert] = job.baseTanData[vert];
+	}
+}
+
+
+static void accumulateMorphFunc( void *userData, unsigned int index )
+{
+	MorphJob &job = *(MorphJob *)userData;
+	const MorphTarget &mt = *job.target;
+	const uint32 *vertIndices = &mt.vertIndices[0];
+	uint32 begin = index * MorphChunkSize, end = std::min( begin + MorphChunkSize, job.count );
+
+	// Vertex indices are unique within a target, so chunks of the same target can run in parallel
+	if( job.vertStamps == 0x0 )
+	{
+		for( uint32 i = begin; i < end; ++i ) job.posData[vertIndices[i]] += mt.posDiffs[i] * job.weight;
+		for( uint32 i = begin; i < end; ++i ) job.tanData[vertIndices[i]].normal += mt.normDiffs[i] * job.weight;
+		for( uint32 i = begin; i < end; ++i ) job.tanData[vertIndices[i]].tangent += mt.tanDiffs[i] * job.weight;
+	}
+	else
+	{
+		for( uint32 i = begin; i < end; ++i )
+		{
+			uint32 vert = vertIndices[i];
+			if( job.vertStamps[vert] != job.stamp ) continue;
+
+			job.posData[vert] += mt.posDiffs[i] * job.weight;
+			job.tanData[vert].normal += mt.normDiffs[i] * job.weight;
+			job.tanData[vert].tangent += mt.tanDiffs[i] * job.weight;
+		}
+	}
+}
+
+
+static void normalizeMorphVertsFunc( void *userData, unsigned int index )
+{
+	MorphJob &job = *(MorphJob *)userData;
+	uint32 end = std::min( (index + 1) * MorphChunkSize, job.count );
+
+	for( uint32 i = index * MorphChunkSize; i < end; ++i )
+	{
+		uint32 vert = job.vertList != 0x0 ? job.vertList[i] : i;
+		job.tanData[vert].normal.normalize();
+		job.tanData[vert].tangent.normalize();
+	}
+}
+
+
+static void runMorphJob( ParallelForFunc func, MorphJob &job )
+{
+	Modules::threadPool().parallelFor( (job.count + MorphChunkSize - 1) / MorphChunkSize, func, &job );
+}
+
+
+// *************************************************************************************************
+// Class ModelNode
+// *************************************************************************************************
+
 
 ModelNode::ModelNode( const ModelNodeTpl &modelTpl ) :
 	SceneNode( modelTpl ), _geometryRes( modelTpl.geoRes ), _baseGeoRes( 0x0 ),
 	_lodDist1( modelTpl.lodDist1 ), _lodDist2( modelTpl.lodDist2 ),
 	_lodDist3( modelTpl.lodDist3 ), _lodDist4( modelTpl.lodDist4 ),
+	_skinRowsStamp( 0 ), _snapSkinRowsStamp( 0 ), _skinPaletteOffset( -1 ), _skinPaletteRows( 0 ),
+	_skinPaletteStamp( 0 ), _skinPaletteShared( false ),
 	_softwareSkinning( modelTpl.softwareSkinning ), _skinningDirty( false ),
-	_nodeListDirty( false ), _morpherUsed( false ), _morpherDirty( false )
+	_nodeListDirty( false ), _morpherUsed( false ), _morpherDirty( false ),
+	_morphBlendValid( false ), _lazyAnim( false ), _animPending( false ), _geoUpdatePending( false ),
+	_jointMatsCached( false ), _morphStamp( 0 )
 {
 	if( _geometryRes != 0x0 )
 		setParamI( ModelNodeParams::GeoResI, _geometryRes->getHandle() );
@@ -137,6 +234,14 @@ void ModelNode::setupAnimStage( int stage, AnimationResource *anim, int layer,
 }
 
 
+void ModelNode::prewarmAnim( AnimationResource *anim, const string &startNode )
+{
+	if( _nodeListDirty ) recreateNodeList();
+	
+	_animCtrl.prewarm( anim, startNode );
+}
+
+
 void ModelNode::getAnimParams( int stage, float *time, float *weight )
 {
 	_animCtrl.getAnimParams( stage, time, weight );
@@ -222,29 +327,33 @@ void ModelNode::updateLocalMeshAABBs()
 void ModelNode::setGeometryRes( GeometryResource &geoRes )
 {
 	// Init joint data
-	_skinMatRows.resize( geoRes._joints.size() * 3 );
+	_skinMatRows.resize( geoRes.getJointCount() * 3 );
 	for( uint32 i = 0; i < _skinMatRows.size() / 3; ++i )
 	{
 		_skinMatRows[i * 3 + 0] = Vec4f( 1, 0, 0, 0 );
 		_skinMatRows[i * 3 + 1] = Vec4f( 0, 1, 0, 0 );
 		_skinMatRows[i * 3 + 2] = Vec4f( 0, 0, 1, 0 );
 	}
+	++_skinRowsStamp;
 
 	// Copy morph targets
-	_morphers.resize( geoRes._morphTargets.size() );
+	_morphers.resize( geoRes.getMorphTargets().size() );
 	for( uint32 i = 0; i < _morphers.size(); ++i )
 	{	
 		Morpher &morpher = _morphers[i]; 
 		
-		morpher.name = geoRes._morphTargets[i].name;
+		morpher.name = geoRes.getMorphTargets()[i].name;
 		morpher.index = i;
 		morpher.weight = 0;
+		morpher.appliedWeight = 0;
 	}
+	_morphVertStamps.clear();
 
 	if( !_morphers.empty() || _softwareSkinning )
 	{
+		// Private copy only holds the vertex streams rewritten by morphing and skinning
 		Resource *clonedRes = Modules::resMan().resolveResHandle(
-			Modules::resMan().cloneResource( geoRes, "" ) );
+			Modules::resMan().addClonedResource( *geoRes.createInstance(), geoRes, "" ) );
 		_geometryRes = (GeometryResource *)clonedRes;
 		_baseGeoRes = &geoRes;
 	}
@@ -255,6 +364,7 @@ void ModelNode::setGeometryRes( GeometryResource &geoRes )
 	}
 
 	_skinningDirty = true;
+	_morphBlendValid = true;
 	updateLocalMeshAABBs();
 }
 
@@ -267,6 +377,8 @@ int ModelNode::getParamI( int param )
 		return _geometryRes != 0x0 ? _geometryRes->_handle : 0;
 	case ModelNodeParams::SWSkinningI:
 		return _softwareSkinning ? 1 : 0;
+	case ModelNodeParams::LazyAnimI:
+		return _lazyAnim ? 1 : 0;
 	}
 
 	return SceneNode::getParamI( param );
@@ -296,6 +408,10 @@ void ModelNode::setParamI( int param, int value )
 			// Remove the local resource copy by removing reference
 			setParamI( ModelNodeParams::GeoResI, _baseGeoRes->getHandle() );
 		return;
+	case ModelNodeParams::LazyAnimI:
+		_lazyAnim = (value != 0);
+		if( !_lazyAnim && evaluatePendingAnim() ) markParentsDirty();
+		return;
 	}
 
 	SceneNode::setParamI( param, value );
@@ -346,24 +462,195 @@ void ModelNode::update( int flags )
 {
 	if( flags & ModelUpdateFlags::Animation )
 	{
-		if( _animCtrl.animate() )
-		{	
-			_skinningDirty = true;
-			markDirty();
-			SceneNode::updateTree();
+		Timer *timer = Modules::stats().getTimer( EngineStats::AnimationTime );
+		if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+		
+		// In lazy mode, only conservative bounds are computed and the pose is evaluated when the model
+		// passes the culling of a render pass. A model that is updated in the background is always
+		// evaluated, since the renderer works with the snapshot meanwhile; its parents are marked
+		// dirty by FrameManager::sync.
+		if( _lazyAnim && !_inSnapshot && _animCtrl.isDirty() && predictAnimBounds() ) markParentsDirty();
+		else
+		{
+			_animPending = false;
+			if( updateAnimation() && !_inSnapshot ) markParentsDirty();
 		}
+
+		timer->setEnabled( false );
 	}
 	
-	if( flags & ModelUpdateFlags::Geometry )
+	if( (flags & ModelUpdateFlags::Geometry) || _geoUpdatePending )
 	{
 		// Update geometry for morphers or software skinning
+		_geoUpdatePending = _animPending;
+		if( !_animPending ) updateGeometry();
+	}
+}
+
+
+bool ModelNode::evaluatePendingAnim()
+{
+	if( !_animPending ) return false;
+
+	Timer *timer = Modules::stats().getTimer( EngineStats::AnimationTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	_animPending = false;
+	updateAnimation();
+	
+	timer->setEnabled( false );
+	
+	if( _geoUpdatePending )
+	{
+		_geoUpdatePending = false;
 		updateGeometry();
 	}
+
+	return true;
+}
+
+
+bool ModelNode::predictAnimBounds()
+{
+	if( _nodeListDirty ) recreateNodeList();
+	if( !_animCtrl.predictNodeBounds( _nodeReach, _nodeScale ) ) return false;
+	
+	// Meshes and joints are registered in the same order as they appear in the mesh list
+	const vector< IAnimatableNode * > &nodeList = _animCtrl.getNodeList();
+	float jointReach = 0, jointScale = 0;
+	for( size_t i = 0, j = 0, s = nodeList.size(); i < s; ++i )
+	{
+		if( j < _meshList.size() && nodeList[i] == (IAnimatableNode *)_meshList[j] ) ++j;
+		else
+		{
+			jointReach = maxf( jointReach, _nodeReach[i] );
+			jointScale = maxf( jointScale, _nodeScale[i] );
+		}
+	}
+
+	// Skinned vertices are at most as far from their joints as in the bind pose
+	float bindReach = 0;
+	if( !_jointList.empty() && _geometryRes != 0x0 )
+	{
+		const BoundingBox &skelBox = _geometryRes->getSkelAABB();
+		bindReach = Vec3f( maxf( fabsf( skelBox.min.x ), fabsf( skelBox.max.x ) ),
+		                   maxf( fabsf( skelBox.min.y ), fabsf( skelBox.max.y ) ),
+		                   maxf( fabsf( skelBox.min.z ), fabsf( skelBox.max.z ) ) ).length();
+	}
+
+	_predMeshExtents.resize( _meshList.size() );
+	for( size_t i = 0, j = 0, s = nodeList.size(); i < s && j < _meshList.size(); ++i )
+	{
+		if( nodeList[i] != (IAnimatableNode *)_meshList[j] ) continue;
+
+		const BoundingBox &localBox = _meshList[j]->_localBBox;
+		float extent = Vec3f( maxf( fabsf( localBox.min.x ), fabsf( localBox.max.x ) ),
+		                      maxf( fabsf( localBox.min.y ), fabsf( localBox.max.y ) ),
+		                      maxf( fabsf( localBox.min.z ), fabsf( localBox.max.z ) ) ).length();
+		if( !_jointList.empty() ) extent = jointReach + jointScale * (extent + bindReach);
+		
+		_predMeshExtents[j++] = _nodeReach[i] + _nodeScale[i] * extent;
+	}
+	
+	// Apply the predicted boxes in onFinishedUpdate
+	_animPending = true;
+	_dirty = true;
+	SceneNode::updateTree();
+
+	return true;
+}
+
+
+bool ModelNode::updateAnimation()
+{
+	// Note: Only the model's own subtree is touched here so that independent models can be
+	//       animated in parallel; the caller is responsible for marking the parents dirty
+	
+	const AnimPoseCacheEntry *pose = 0x0;
+	bool cachePose = Modules::config().animPoseCache && _animCtrl.getPoseKey( _poseKey );
+	if( cachePose )
+	{
+		// The skinning matrices additionally depend on the inverse bind matrices
+		GeometryResource *bindGeoRes = _baseGeoRes != 0x0 ? _baseGeoRes : _geometryRes;
+		_poseKey.push_back( bindGeoRes != 0x0 ? (uint32)bindGeoRes->getHandle() : 0 );
+		
+		pose = AnimationController::poseCache.find( _poseKey );
+		if( pose != 0x0 ) _animCtrl.applyCachedPose( *pose );
+	}
+	if( pose == 0x0 && !_animCtrl.animate() ) return false;
+	
+	_skinningDirty = true;
+	_dirty = true;
+	_transformed = true;
+	markChildrenDirty();
+
+	// Joints skip their matrix updates if the complete skeleton is covered by the cached pose
+	if( pose != 0x0 && !pose->jointMats.empty() )
+	{
+		for( size_t i = 0, s = _jointList.size(); i < s; ++i )
+			_jointList[i]->_relModelMat = pose->jointMats[i];
+		_skinMatRows = pose->skinMatRows;
+		++_skinRowsStamp;
+		_jointMatsCached = true;
+	}
+	SceneNode::updateTree();
+	_jointMatsCached = false;
+
+	if( cachePose && pose == 0x0 )
+	{
+		AnimPoseCacheEntry entry;
+		entry.key = _poseKey;
+		_animCtrl.capturePose( entry );
+		if( _geometryRes != 0x0 && areJointsAnimated( entry.animatedNodes ) )
+		{
+			entry.jointMats.resize( _jointList.size() );
+			for( size_t i = 0, s = _jointList.size(); i < s; ++i )
+				entry.jointMats[i] = _jointList[i]->_relModelMat;
+			entry.skinMatRows = _skinMatRows;
+		}
+		AnimationController::poseCache.insert( entry );
+	}
+
+	return true;
+}
+
+
+bool ModelNode::areJointsAnimated( const vector< unsigned char > &animatedNodes )
+{
+	// Meshes and joints are registered in the same order as they appear in the mesh list
+	const vector< IAnimatableNode * > &nodeList = _animCtrl.getNodeList();
+	for( size_t i = 0, j = 0, s = nodeList.size(); i < s; ++i )
+	{
+		if( j < _meshList.size() && nodeList[i] == (IAnimatableNode *)_meshList[j] ) ++j;
+		else if( !animatedNodes[i] ) return false;
+	}
+
+	return true;
 }
 
 
 bool ModelNode::updateGeometry()
 {
+	Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	bool updated = calcGeometry();
+	
+	timer->setEnabled( false );
+	if( !updated ) return false;
+	
+	// Upload geometry
+	_geometryRes->updateDynamicVertData();
+
+	return true;
+}
+
+
+bool ModelNode::calcGeometry()
+{
+	// Note: This must not issue any render device calls or touch other nodes since it may run
+	//       on the update thread or in parallel for several models
+
 	_skinningDirty |= _morpherDirty;
 	_skinningDirty &= _softwareSkinning;
 	
@@ -373,9 +660,13 @@ bool ModelNode::updateGeometry()
 	    _baseGeoRes->getVertTanData() == 0x0 || _baseGeoRes->getVertStaticData() == 0x0 ) return false;
 	if( _geometryRes == 0x0 || _geometryRes->getVertPosData() == 0x0 ||
 		_geometryRes->getVertTanData() == 0x0 || _geometryRes->getVertStaticData() == 0x0 ) return false;
-	
-	Timer *timer = Modules::stats().getTimer( EngineStats::GeoUpdateTime );
-	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	if( _geometryRes->getVertCount() == 0 || _geometryRes->getVertCount() != _baseGeoRes->getVertCount() ) return false;
+
+	if( !_skinningDirty && _morphBlendValid )
+	{
+		_morpherDirty = false;
+		return calcMorphedVerts();
+	}
 	
 	// Reset vertices to base data
 	memcpy( _geometryRes->getVertPosData(), _baseGeoRes->getVertPosData(),
@@ -387,82 +678,128 @@ bool ModelNode::updateGeometry()
 	VertexDataTan *tanData = _geometryRes->getVertTanData();
 	VertexDataStatic *staticData = _geometryRes->getVertStaticData();
 
-	if( _morpherUsed )
+	MorphJob job;
+	job.vertList = 0x0;
+	job.posData = posData;
+	job.tanData = tanData;
+	job.vertStamps = 0x0;
+	
+	// Recalculate vertex positions for morph targets
+	for( uint32 i = 0; i < _morphers.size(); ++i )
 	{
-		// Recalculate vertex positions for morph targets
-		for( uint32 i = 0; i < _morphers.size(); ++i )
-		{
-			if( _morphers[i].weight > Math::Epsilon )
-			{
-				MorphTarget &mt = _geometryRes->_morphTargets[_morphers[i].index];
-				float weight = _morphers[i].weight;
-				
-				for( uint32 j = 0; j < mt.diffs.size(); ++j )
-				{
-					MorphDiff &md = mt.diffs[j];
-					
-					posData[md.vertIndex] += md.posDiff * weight;
-					tanData[md.vertIndex].normal += md.normDiff * weight;
-					tanData[md.vertIndex].tangent += md.tanDiff * weight;
-				}
-			}
-		}
+		Morpher &morpher = _morphers[i];
+		morpher.appliedWeight = morpher.weight > Math::Epsilon ? morpher.weight : 0;
+		if( morpher.appliedWeight == 0 ) continue;
+		
+		job.target = &_baseGeoRes->getMorphTargets()[morpher.index];
+		job.weight = morpher.appliedWeight;
+		job.count = (uint32)job.target->vertIndices.size();
+		runMorphJob( accumulateMorphFunc, job );
 	}
 
 	if( _skinningDirty )
 	{
-		Matrix4f skinningMat;
-		Vec4f *rows = &_skinMatRows[0];
-
-		for( uint32 i = 0, s = _geometryRes->getVertCount(); i < s; ++i )
-		{
-			Vec4f *row0 = &rows[ftoi_r( staticData[i].jointVec[0] ) * 3];
-			Vec4f *row1 = &rows[ftoi_r( staticData[i].jointVec[1] ) * 3];
-			Vec4f *row2 = &rows[ftoi_r( staticData[i].jointVec[2] ) * 3];
-			Vec4f *row3 = &rows[ftoi_r( staticData[i].jointVec[3] ) * 3];
-
-			Vec4f weights = *((Vec4f *)&staticData[i].weightVec[0]);
-
-			skinningMat.x[0] = (row0)->x * weights.x + (row1)->x * weights.y + (row2)->x * weights.z + (row3)->x * weights.w;
-			skinningMat.x[1] = (row0+1)->x * weights.x + (row1+1)->x * weights.y + (row2+1)->x * weights.z + (row3+1)->x * weights.w;
-			skinningMat.x[2] = (row0+2)->x * weights.x + (row1+2)->x * weights.y + (row2+2)->x * weights.z + (row3+2)->x * weights.w;
-			skinningMat.x[4] = (row0)->y * weights.x + (row1)->y * weights.y + (row2)->y * weights.z + (row3)->y * weights.w;
-			skinningMat.x[5] = (row0+1)->y * weights.x + (row1+1)->y * weights.y + (row2+1)->y * weights.z + (row3+1)->y * weights.w;
-			skinningMat.x[6] = (row0+2)->y * weights.x + (row1+2)->y * weights.y + (row2+2)->y * weights.z + (row3+2)->y * weights.w;
-			skinningMat.x[8] = (row0)->z * weights.x + (row1)->z * weights.y + (row2)->z * weights.z + (row3)->z * weights.w;
-			skinningMat.x[9] = (row0+1)->z * weights.x + (row1+1)->z * weights.y + (row2 + 1)->z * weights.z + (row3+1)->z * weights.w;
-			skinningMat.x[10] = (row0+2)->z * weights.x + (row1+2)->z * weights.y + (row2+2)->z * weights.z + (row3+2)->z * weights.w;
-			skinningMat.x[12] = (row0)->w * weights.x + (row1)->w * weights.y + (row2)->w * weights.z + (row3)->w * weights.w;
-			skinningMat.x[13] = (row0+1)->w * weights.x + (row1+1)->w * weights.y + (row2+1)->w * weights.z + (row3+1)->w * weights.w;
-			skinningMat.x[14] = (row0+2)->w * weights.x + (row1+2)->w * weights.y + (row2+2)->w * weights.z + (row3+2)->w * weights.w;
-
-			// Skin position
-			posData[i] = skinningMat * posData[i];
-
-			// Skin tangent space basis
-			// Note: We skip the normalization of the tangent space basis for performance reasons;
-			//       the error is usually not huge and should be hardly noticable
-			tanData[i].normal = skinningMat.mult33Vec( tanData[i].normal ); //.normalized();
-			tanData[i].tangent = skinningMat.mult33Vec( tanData[i].tangent ); //.normalized();
-		}
+		if( _geometryRes->getVertSkinData() != 0x0 )
+			skinningFunc( &_skinMatRows[0], _geometryRes->getVertSkinData(), posData, tanData, _geometryRes->getVertCount() );
+		else
+			skinVerticesStatic( &_skinMatRows[0], staticData, posData, tanData, _geometryRes->getVertCount() );
+		_morphBlendValid = false;
 	}
-	else if( _morpherUsed )
+	else
 	{
-		// Renormalize tangent space basis
-		for( uint32 i = 0, s = _geometryRes->getVertCount(); i < s; ++i )
+		if( _morpherUsed )
 		{
-			tanData[i].normal.normalize();
-			tanData[i].tangent.normalize();
+			// Renormalize tangent space basis
+			job.count = _geometryRes->getVertCount();
+			runMorphJob( normalizeMorphVertsFunc, job );
 		}
+		_morphBlendValid = true;
 	}
 
 	_morpherDirty = false;
 	_skinningDirty = false;
+	_geometryRes->markDynamicVertData( 0, _geometryRes->getVertCount() - 1 );
+
+	return true;
+}
+
+
+bool ModelNode::calcMorphedVerts()
+{
+	// Only the vertices of targets with a changed weight are reset and blended again from all
+	// active targets; the rest of the vertex data is still valid
+
+	uint32 vertCount = _geometryRes->getVertCount();
+	if( _morphVertStamps.size() != vertCount )
+	{
+		_morphVertStamps.assign( vertCount, 0 );
+		_morphStamp = 0;
+	}
+	if( ++_morphStamp == 0 )
+	{
+		std::fill( _morphVertStamps.begin(), _morphVertStamps.end(), 0 );
+		_morphStamp = 1;
+	}
+
+	// Collect affected vertices
+	uint32 firstVert = vertCount, lastVert = 0;
+	_morphVerts.resize( 0 );
+	for( uint32 i = 0; i < _morphers.size(); ++i )
+	{
+		Morpher &morpher = _morphers[i];
+		float weight = morpher.weight > Math::Epsilon ? morpher.weight : 0;
+		if( weight == morpher.appliedWeight ) continue;
+
+		MorphTarget &mt = _baseGeoRes->getMorphTargets()[morpher.index];
+		if( mt.vertIndices.empty() ) continue;
+		
+		for( uint32 j = 0, s = (uint32)mt.vertIndices.size(); j < s; ++j )
+		{
+			uint32 vert = mt.vertIndices[j];
+			if( _morphVertStamps[vert] == _morphStamp ) continue;
+			
+			_morphVertStamps[vert] = _morphStamp;
+			_morphVerts.push_back( vert );
+		}
+		firstVert = std::min( firstVert, mt.minVertIndex );
+		lastVert = std::max( lastVert, mt.maxVertIndex );
+	}
+
+	for( uint32 i = 0; i < _morphers.size(); ++i )
+	{
+		_morphers[i].appliedWeight = _morphers[i].weight > Math::Epsilon ? _morphers[i].weight : 0;
+	}
 	
-	// Upload geometry
-	_geometryRes->updateDynamicVertData();
+	if( _morphVerts.empty() ) return false;
+
+	MorphJob job;
+	job.vertList = &_morphVerts[0];
+	job.count = (uint32)_morphVerts.size();
+	job.posData = _geometryRes->getVertPosData();
+	job.tanData = _geometryRes->getVertTanData();
+	job.basePosData = _baseGeoRes->getVertPosData();
+	job.baseTanData = _baseGeoRes->getVertTanData();
+	job.vertStamps = &_morphVertStamps[0];
+	job.stamp = _morphStamp;
+	runMorphJob( resetMorphVertsFunc, job );
+	
+	for( uint32 i = 0; i < _morphers.size(); ++i )
+	{
+		if( _morphers[i].appliedWeight == 0 ) continue;
+		
+		MorphTarget &mt = _baseGeoRes->getMorphTargets()[_morphers[i].index];
+		if( mt.vertIndices.empty() || mt.minVertIndex > lastVert || mt.maxVertIndex < firstVert ) continue;
+		
+		job.target = &mt;
+		job.weight = _morphers[i].appliedWeight;
+		job.count = (uint32)mt.vertIndices.size();
+		runMorphJob( accumulateMorphFunc, job );
+	}
 
-	timer->setEnabled( false );
+	job.count = (uint32)_morphVerts.size();
+	runMorphJob( normalizeMorphVertsFunc, job );
+
+	_geometryRes->markDynamicVertData( firstVert, lastVert );
 
 	return true;
 }
@@ -470,7 +807,8 @@ bool ModelNode::updateGeometry()
 
 uint32 ModelNode::calcLodLevel( const Vec3f &viewPoint )
 {
-	Vec3f pos( _absTrans.c[3][0], _absTrans.c[3][1], _absTrans.c[3][2] );
+	const Matrix4f &absTrans = getRenderTrans();
+	Vec3f pos( absTrans.c[3][0], absTrans.c[3][1], absTrans.c[3][2] );
 	float dist = (pos - viewPoint).length();
 	uint32 curLod = 4;
 	
@@ -489,6 +827,14 @@ void ModelNode::setCustomInstData( float *data, uint32 count )
 }
 
 
+void ModelNode::captureRenderState()
+{
+	SceneNode::captureRenderState();
+	_snapSkinMatRows = _skinMatRows;
+	_snapSkinRowsStamp = _skinRowsStamp;
+}
+
+
 void ModelNode::onPostUpdate()
 {
 	if( _nodeListDirty ) recreateNodeList();
@@ -497,8 +843,19 @@ void ModelNode::onPostUpdate()
 
 void ModelNode::onFinishedUpdate()
 {
+	if( _animPending && _predMeshExtents.size() == _meshList.size() )
+	{
+		// Conservative boxes that contain the meshes for any time and weight of the animation stages
+		for( uint32 i = 0, s = (uint32)_meshList.size(); i < s; ++i )
+		{
+			float extent = _predMeshExtents[i];
+			_meshList[i]->_bBox.min = Vec3f( -extent, -extent, -extent );
+			_meshList[i]->_bBox.max = Vec3f( extent, extent, extent );
+			_meshList[i]->_bBox.transform( _absTrans );
+		}
+	}
 	// Update AABBs of skinned meshes
-	if( _skinningDirty && !_jointList.empty() && _geometryRes != 0x0 )
+	else if( _skinningDirty && !_jointList.empty() && _geometryRes != 0x0 )
 	{
 		Vec3f bmin( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
 		Vec3f bmax( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
@@ -521,8 +878,8 @@ void ModelNode::onFinishedUpdate()
 		//       will become too large but not too small
 		for( uint32 i = 0, s = (uint32)_meshList.size(); i < s; ++i )
 		{
-			Vec3f dmin = bmin - _geometryRes->_skelAABB.min;
-			Vec3f dmax = bmax - _geometryRes->_skelAABB.max;
+			Vec3f dmin = bmin - _geometryRes->getSkelAABB().min;
+			Vec3f dmax = bmax - _geometryRes->getSkelAABB().max;
 			
 			// Clamp so that bounding boxes can only grow and not shrink
 			if( dmin.x > 0 ) dmin.x = 0; if( dmin.y > 0 ) dmin.y = 0; if( dmin.z > 0 ) dmin.z = 0;
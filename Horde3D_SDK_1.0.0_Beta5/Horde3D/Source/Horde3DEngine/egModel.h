@@ -19,6 +19,7 @@
 #include "egGeometry.h"
 #include "egAnimation.h"
 #include "egMaterial.h"
+#include "egSkinning.h"
 #include "utMath.h"
 
 
@@ -40,7 +41,8 @@ struct ModelNodeParams
 		LodDist2F,
 		LodDist3F,
 		LodDist4F,
-		AnimCountI
+		AnimCountI,
+		LazyAnimI
 	};
 };
 
@@ -77,6 +79,7 @@ struct Morpher	// Morph modifier
 	std::string  name;
 	uint32       index;  // Index of morph target in Geometry resource
 	float        weight;
+	float        appliedWeight;  // Weight contained in the current vertex data
 };
 
 // =================================================================================================
@@ -94,6 +97,7 @@ public:
 	                     const std::string &startNode, bool additive );
 	void getAnimParams( int stage, float *time, float *weight );
 	void setAnimParams( int stage, float time, float weight );
+	void prewarmAnim( AnimationResource *anim, const std::string &startNode );
 	bool setMorphParam( const std::string &targetName, float weight );
 
 	int getParamI( int param );
@@ -102,6 +106,7 @@ public:
 	void setParamF( int param, int compIdx, float value );
 
 	void update( int flags );
+	bool evaluatePendingAnim();
 	uint32 calcLodLevel( const Vec3f &viewPoint );
 
 	void setCustomInstData( float *data, uint32 count );
@@ -111,8 +116,19 @@ public:
 	void setSkinningMat( uint32 index, const Matrix4f &mat )
 		{ _skinMatRows[index * 3 + 0] = mat.getRow( 0 );
 		  _skinMatRows[index * 3 + 1] = mat.getRow( 1 );
-		  _skinMatRows[index * 3 + 2] = mat.getRow( 2 ); }
+		  _skinMatRows[index * 3 + 2] = mat.getRow( 2 );
+		  ++_skinRowsStamp; }
 	void markNodeListDirty() { _nodeListDirty = true; }
+	bool hasCachedJointMats() { return _jointMatsCached; }
+
+	void captureRenderState();
+	const std::vector< Vec4f > &getRenderSkinMatRows() const
+		{ return _inSnapshot ? _snapSkinMatRows : _skinMatRows; }
+	uint32 getRenderSkinRowsStamp() const
+		{ return _inSnapshot ? _snapSkinRowsStamp : _skinRowsStamp; }
+
+public:
+	static SkinningFunc           skinningFunc;  // Software skinning kernel selected at init
 
 protected:
 	ModelNode( const ModelNodeTpl &modelTpl );
@@ -121,7 +137,12 @@ protected:
 	void updateLocalMeshAABBs();
 	void setGeometryRes( GeometryResource &geoRes );
 
+	bool updateAnimation();
+	bool areJointsAnimated( const std::vector< unsigned char > &animatedNodes );
+	bool predictAnimBounds();
 	bool updateGeometry();
+	bool calcGeometry();
+	bool calcMorphedVerts();
 
 	void onPostUpdate();
 	void onFinishedUpdate();
@@ -134,6 +155,11 @@ protected:
 	std::vector< MeshNode * >     _meshList;  // List of the model's meshes
 	std::vector< JointNode * >    _jointList;
 	std::vector< Vec4f >          _skinMatRows;
+	std::vector< Vec4f >          _snapSkinMatRows;  // Rendered while the model is in the snapshot
+	uint32                        _skinRowsStamp, _snapSkinRowsStamp;  // Incremented when skin rows change
+	int                           _skinPaletteOffset;  // First texel in renderer skin palette or -1
+	uint32                        _skinPaletteRows, _skinPaletteStamp;  // Size and stamp of palette slot
+	bool                          _skinPaletteShared;  // Slot is the shared identity block
 	AnimationController           _animCtrl;
 
 	Vec4f                         _customInstData[ModelCustomVecCount];
@@ -142,10 +168,21 @@ protected:
 	bool                          _softwareSkinning, _skinningDirty;
 	bool                          _nodeListDirty;  // An animatable node has been attached to model
 	bool                          _morpherUsed, _morpherDirty;
+	bool                          _morphBlendValid;  // Vertex data is base data plus applied morph weights
+	bool                          _lazyAnim;
+	bool                          _animPending, _geoUpdatePending;  // Deferred until the model is visible
+	std::vector< float >          _nodeReach, _nodeScale;
+	std::vector< float >          _predMeshExtents;  // Half size of conservative mesh boxes in model space
+	std::vector< uint32 >         _poseKey;
+	bool                          _jointMatsCached;  // Joint matrices were taken from the pose cache
+	uint32                        _morphStamp;
+	std::vector< uint32 >         _morphVertStamps;  // Marks vertices collected for the current update
+	std::vector< uint32 >         _morphVerts;
 
 	friend class SceneManager;
 	friend class SceneNode;
 	friend class Renderer;
+	friend class FrameManager;
 };
 
 }
@@ -18,11 +18,15 @@
 #include "egScene.h"
 #include "egLight.h"
 #include "egCamera.h"
+#include "egDotField.h"
 #include "egResource.h"
 #include "egRendererBase.h"
 #include "egRenderer.h"
 #include "egPipeline.h"
 #include "egExtensions.h"
+#include "egFrame.h"
+#include "egAnimBlend.h"
+#include "utThreadPool.h"
 
 // Extensions
 #ifdef CMAKE
@@ -50,6 +54,8 @@ ResourceManager        *Modules::_resourceManager = 0x0;
 RenderDevice           *Modules::_renderDevice = 0x0;
 Renderer               *Modules::_renderer = 0x0;
 ExtensionManager       *Modules::_extensionManager = 0x0;
+FrameManager           *Modules::_frameManager = 0x0;
+ThreadPool             *Modules::_threadPool = 0x0;
 
 RenderDevice *gRDI = 0x0;
 
@@ -77,10 +83,28 @@ bool Modules::init()
 	gRDI = _renderDevice;
 	if( _renderer == 0x0 ) _renderer = new Renderer();
 	if( _statManager == 0x0 ) _statManager = new StatManager();
+	if( _frameManager == 0x0 ) _frameManager = new FrameManager();
+	if( _threadPool == 0x0 ) _threadPool = new ThreadPool();
+	threadPool().setWorkerCount( config().workerThreads );
 
 	// Init modules
 	if( !renderer().init() ) return false;
 
+	int skinningKernel = getBestSkinningKernel();
+	ModelNode::skinningFunc = getSkinningFunc( skinningKernel );
+	log().writeInfo( "Using %s software skinning", getSkinningKernelName( skinningKernel ) );
+	int animBlendKernel = getBestAnimBlendKernel();
+	AnimationController::blendFuncs = getAnimBlendFuncs( animBlendKernel );
+	log().writeInfo( "Using %s animation blending", getAnimBlendKernelName( animBlendKernel ) );
+	int particleSimKernel = getBestParticleSimKernel();
+	EmitterNode::simulateFunc = getParticleSimFunc( particleSimKernel );
+	EmitterNode::randomFunc = getParticleRandomFunc( particleSimKernel );
+	DotFieldNode::moveFunc = getDotMoveFunc( particleSimKernel );
+	DotFieldNode::transformFunc = getDotTransformFunc( particleSimKernel );
+	DotFieldNode::noiseFunc = getDotNoiseFunc( particleSimKernel );
+	DotFieldNode::placeFunc = getDotPlaceFunc( particleSimKernel );
+	log().writeInfo( "Using %s particle simulation", getParticleSimKernelName( particleSimKernel ) );
+
 	// Register resource types
 	resMan().registerResType( ResourceTypes::SceneGraph, "SceneGraph", 0x0, 0x0,
 		SceneGraphResource::factoryFunc );
@@ -116,10 +140,13 @@ bool Modules::init()
 		CameraNode::parsingFunc, CameraNode::factoryFunc );
 	sceneMan().registerNodeType( SceneNodeTypes::Emitter, "Emitter",
 		EmitterNode::parsingFunc, EmitterNode::factoryFunc );
+	sceneMan().registerNodeType( SceneNodeTypes::DotField, "DotField",
+		DotFieldNode::parsingFunc, DotFieldNode::factoryFunc );
 
 	// Register render functions
 	renderer().registerRenderFunc( SceneNodeTypes::Mesh, Renderer::drawMeshes );
 	renderer().registerRenderFunc( SceneNodeTypes::Emitter, Renderer::drawParticles );
+	renderer().registerRenderFunc( SceneNodeTypes::DotField, Renderer::drawParticles );
 	
 	// Install extensions
 	installExtensions();
@@ -165,6 +192,8 @@ void Modules::release()
 	if( _renderer ) _renderer->clearOverlays();
 	
 	// Order of destruction is important
+	delete _frameManager; _frameManager = 0x0;  // Waits for a running update
+	delete _threadPool; _threadPool = 0x0;
 	delete _extensionManager; _extensionManager = 0x0;
 	delete _sceneManager; _sceneManager = 0x0;
 	delete _resourceManager; _resourceManager = 0x0;
@@ -27,6 +27,8 @@ class ResourceManager;
 class RenderDevice;
 class Renderer;
 class ExtensionManager;
+class FrameManager;
+class ThreadPool;
 
 
 // =================================================================================================
@@ -49,6 +51,8 @@ public:
 	static ResourceManager &resMan() { return *_resourceManager; }
 	static Renderer &renderer() { return *_renderer; }
 	static ExtensionManager &extMan() { return *_extensionManager; }
+	static FrameManager &frameMan() { return *_frameManager; }
+	static ThreadPool &threadPool() { return *_threadPool; }
 
 public:
 	static const char *versionString;
@@ -67,6 +71,8 @@ private:
 	static RenderDevice           *_renderDevice;
 	static Renderer               *_renderer;
 	static ExtensionManager       *_extensionManager;
+	static FrameManager           *_frameManager;
+	static ThreadPool             *_threadPool;
 };
 
 extern RenderDevice  *gRDI;
@@ -0,0 +1,319 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egOcclusion.h"
+#include "egPrimitives.h"
+#include <algorithm>
+
+#if defined( __SSE__ ) || defined( _M_X64 ) || (defined( _M_IX86_FP ) && _M_IX86_FP >= 1)
+#	define H3D_OCCLUSION_SSE
+#	include <xmmintrin.h>
+#endif
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+using namespace std;
+
+
+static inline Vec4f lerpClipVert( const Vec4f &a, const Vec4f &b, float t )
+{
+	return Vec4f( a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t );
+}
+
+
+// *************************************************************************************************
+// Class OcclusionBuffer
+// *************************************************************************************************
+
+OcclusionBuffer::OcclusionBuffer() :
+	_triCount( 0 ), _active( false )
+{
+	uint32 size = 0;
+	for( uint32 i = 0; i < NumLevels; ++i )
+	{
+		_levelOffsets[i] = size;
+		size += (Width >> i) * (Height >> i);
+	}
+	_depthBuf.resize( size, 1.0f );
+}
+
+
+void OcclusionBuffer::begin( const Matrix4f &viewProjMat )
+{
+	_viewProjMat = viewProjMat;
+	fill( _depthBuf.begin(), _depthBuf.begin() + Width * Height, 1.0f );
+	_triCount = 0;
+	_active = false;
+}
+
+
+void OcclusionBuffer::rasterizeMesh( const Matrix4f &worldMat, const Vec3f *vertPos, const char *indexData,
+                                     bool indices16, uint32 firstIndex, uint32 indexCount,
+                                     uint32 firstVert, uint32 lastVert )
+{
+	if( vertPos == 0x0 || indexData == 0x0 || lastVert < firstVert ) return;
+
+	// Transform all vertices of the batch once
+	Matrix4f mat = _viewProjMat * worldMat;
+	uint32 numVerts = lastVert - firstVert + 1;
+	if( _clipVerts.size() < numVerts ) _clipVerts.resize( numVerts );
+
+	for( uint32 i = 0; i < numVerts; ++i )
+		_clipVerts[i] = mat * Vec4f( vertPos[firstVert + i] );
+
+	for( uint32 i = firstIndex, e = firstIndex + indexCount; i + 2 < e; i += 3 )
+	{
+		uint32 i0, i1, i2;
+		if( indices16 )
+		{
+			const uint16 *indices = (const uint16 *)indexData;
+			i0 = indices[i]; i1 = indices[i + 1]; i2 = indices[i + 2];
+		}
+		else
+		{
+			const uint32 *indices = (const uint32 *)indexData;
+			i0 = indices[i]; i1 = indices[i + 1]; i2 = indices[i + 2];
+		}
+
+		if( i0 < firstVert || i0 > lastVert || i1 < firstVert || i1 > lastVert ||
+		    i2 < firstVert || i2 > lastVert ) continue;
+
+		clipTriangle( _clipVerts[i0 - firstVert], _clipVerts[i1 - firstVert], _clipVerts[i2 - firstVert] );
+	}
+}
+
+
+void OcclusionBuffer::end()
+{
+	buildHiZ();
+
+	// An empty buffer can't occlude anything, so skip the tests altogether
+	_active = _triCount > 0;
+}
+
+
+void OcclusionBuffer::clipTriangle( const Vec4f &v0, const Vec4f &v1, const Vec4f &v2 )
+{
+	// Reject triangles that are completely outside of one frustum plane
+	if( (v0.x > v0.w && v1.x > v1.w && v2.x > v2.w) || (v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w) ||
+	    (v0.y > v0.w && v1.y > v1.w && v2.y > v2.w) || (v0.y < -v0.w && v1.y < -v1.w && v2.y < -v2.w) ||
+	    (v0.z > v0.w && v1.z > v1.w && v2.z > v2.w) ) return;
+
+	// Only the near plane needs real clipping, the other planes are handled by the screen bounds
+	float dist[3] = { v0.z + v0.w, v1.z + v1.w, v2.z + v2.w };
+
+	if( dist[0] >= 0 && dist[1] >= 0 && dist[2] >= 0 )
+	{
+		rasterizeTriangle( v0, v1, v2 );
+		return;
+	}
+	if( dist[0] < 0 && dist[1] < 0 && dist[2] < 0 ) return;
+
+	// Clipping a triangle against a single plane results in a triangle or a quad
+	const Vec4f *verts[3] = { &v0, &v1, &v2 };
+	Vec4f poly[4];
+	uint32 numPolyVerts = 0;
+
+	for( uint32 i = 0; i < 3; ++i )
+	{
+		uint32 j = (i + 1) % 3;
+
+		if( dist[i] >= 0 ) poly[numPolyVerts++] = *verts[i];
+		if( (dist[i] >= 0) != (dist[j] >= 0) )
+			poly[numPolyVerts++] = lerpClipVert( *verts[i], *verts[j], dist[i] / (dist[i] - dist[j]) );
+	}
+
+	for( uint32 i = 2; i < numPolyVerts; ++i )
+		rasterizeTriangle( poly[0], poly[i - 1], poly[i] );
+}
+
+
+void OcclusionBuffer::rasterizeTriangle( const Vec4f &v0, const Vec4f &v1, const Vec4f &v2 )
+{
+	if( v0.w <= 0 || v1.w <= 0 || v2.w <= 0 ) return;
+
+	// Project to buffer coordinates; depth is kept in NDC
+	float invW = 1.0f / v0.w;
+	float x0 = (v0.x * invW * 0.5f + 0.5f) * Width, y0 = (v0.y * invW * 0.5f + 0.5f) * Height, z0 = v0.z * invW;
+	invW = 1.0f / v1.w;
+	float x1 = (v1.x * invW * 0.5f + 0.5f) * Width, y1 = (v1.y * invW * 0.5f + 0.5f) * Height, z1 = v1.z * invW;
+	invW = 1.0f / v2.w;
+	float x2 = (v2.x * invW * 0.5f + 0.5f) * Width, y2 = (v2.y * invW * 0.5f + 0.5f) * Height, z2 = v2.z * invW;
+
+	// Both windings are accepted so that occluders don't depend on the face orientation
+	float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+	if( fabsf( area ) < Math::Epsilon ) return;
+	if( area < 0 )
+	{
+		swap( x1, x2 ); swap( y1, y2 ); swap( z1, z2 );
+		area = -area;
+	}
+
+	// Covered pixel centers, clamped to buffer
+	float fxMin = maxf( ceilf( minf( x0, minf( x1, x2 ) ) - 0.5f ), 0.0f );
+	float fxMax = minf( floorf( maxf( x0, maxf( x1, x2 ) ) - 0.5f ), (float)(Width - 1) );
+	float fyMin = maxf( ceilf( minf( y0, minf( y1, y2 ) ) - 0.5f ), 0.0f );
+	float fyMax = minf( floorf( maxf( y0, maxf( y1, y2 ) ) - 0.5f ), (float)(Height - 1) );
+	if( fxMin > fxMax || fyMin > fyMax ) return;
+
+	int xMin = ftoi_t( fxMin ), xMax = ftoi_t( fxMax );
+	int yMin = ftoi_t( fyMin ), yMax = ftoi_t( fyMax );
+
+	++_triCount;
+
+	// Edge functions e = a * (x - xv) + b * (y - yv), non-negative inside of the triangle
+	float a0 = y0 - y1, b0 = x1 - x0;
+	float a1 = y1 - y2, b1 = x2 - x1;
+	float a2 = y2 - y0, b2 = x0 - x2;
+
+	// Depth plane gradients
+	float invArea = 1.0f / area;
+	float dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) * invArea;
+	float dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) * invArea;
+
+#ifdef H3D_OCCLUSION_SSE
+	// Process groups of four pixels; the buffer width is a multiple of four
+	int xStart = xMin & ~3;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 offsets = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+	const __m128 stepE0 = _mm_set1_ps( 4 * a0 ), stepE1 = _mm_set1_ps( 4 * a1 ), stepE2 = _mm_set1_ps( 4 * a2 );
+	const __m128 stepZ = _mm_set1_ps( 4 * dzdx );
+	const __m128 offsE0 = _mm_mul_ps( _mm_set1_ps( a0 ), offsets );
+	const __m128 offsE1 = _mm_mul_ps( _mm_set1_ps( a1 ), offsets );
+	const __m128 offsE2 = _mm_mul_ps( _mm_set1_ps( a2 ), offsets );
+	const __m128 offsZ = _mm_mul_ps( _mm_set1_ps( dzdx ), offsets );
+#else
+	int xStart = xMin;
+#endif
+
+	for( int y = yMin; y <= yMax; ++y )
+	{
+		float cx = (float)xStart + 0.5f, cy = (float)y + 0.5f;
+		float e0 = a0 * (cx - x0) + b0 * (cy - y0);
+		float e1 = a1 * (cx - x1) + b1 * (cy - y1);
+		float e2 = a2 * (cx - x2) + b2 * (cy - y2);
+		float z = z0 + dzdx * (cx - x0) + dzdy * (cy - y0);
+		float *row = &_depthBuf[y * Width];
+
+#ifdef H3D_OCCLUSION_SSE
+		__m128 ve0 = _mm_add_ps( _mm_set1_ps( e0 ), offsE0 );
+		__m128 ve1 = _mm_add_ps( _mm_set1_ps( e1 ), offsE1 );
+		__m128 ve2 = _mm_add_ps( _mm_set1_ps( e2 ), offsE2 );
+		__m128 vz = _mm_add_ps( _mm_set1_ps( z ), offsZ );
+
+		for( int x = xStart; x <= xMax; x += 4 )
+		{
+			__m128 mask = _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( ve0, zero ), _mm_cmpge_ps( ve1, zero ) ),
+			                          _mm_cmpge_ps( ve2, zero ) );
+			if( _mm_movemask_ps( mask ) != 0 )
+			{
+				__m128 depth = _mm_loadu_ps( row + x );
+				__m128 newDepth = _mm_min_ps( depth, vz );
+				_mm_storeu_ps( row + x, _mm_or_ps( _mm_and_ps( mask, newDepth ), _mm_andnot_ps( mask, depth ) ) );
+			}
+
+			ve0 = _mm_add_ps( ve0, stepE0 );
+			ve1 = _mm_add_ps( ve1, stepE1 );
+			ve2 = _mm_add_ps( ve2, stepE2 );
+			vz = _mm_add_ps( vz, stepZ );
+		}
+#else
+		for( int x = xStart; x <= xMax; ++x )
+		{
+			if( e0 >= 0 && e1 >= 0 && e2 >= 0 && z < row[x] ) row[x] = z;
+
+			e0 += a0; e1 += a1; e2 += a2;
+			z += dzdx;
+		}
+#endif
+	}
+}
+
+
+void OcclusionBuffer::buildHiZ()
+{
+	// Each texel stores the farthest depth of the four texels it covers in the finer level
+	for( uint32 level = 1; level < NumLevels; ++level )
+	{
+		const float *src = &_depthBuf[_levelOffsets[level - 1]];
+		float *dst = &_depthBuf[_levelOffsets[level]];
+		uint32 srcWidth = Width >> (level - 1);
+		uint32 dstWidth = Width >> level, dstHeight = Height >> level;
+
+		for( uint32 y = 0; y < dstHeight; ++y )
+		{
+			for( uint32 x = 0; x < dstWidth; ++x )
+			{
+				const float *s = src + y * 2 * srcWidth + x * 2;
+				dst[y * dstWidth + x] = maxf( maxf( s[0], s[1] ), maxf( s[srcWidth], s[srcWidth + 1] ) );
+			}
+		}
+	}
+}
+
+
+bool OcclusionBuffer::testAABB( const BoundingBox &bBox ) const
+{
+	if( !_active ) return true;
+
+	float minX = Math::MaxFloat, minY = Math::MaxFloat, minZ = Math::MaxFloat;
+	float maxX = -Math::MaxFloat, maxY = -Math::MaxFloat;
+
+	for( uint32 i = 0; i < 8; ++i )
+	{
+		Vec4f p = _viewProjMat * Vec4f( bBox.getCorner( i ) );
+
+		// Box intersects near plane, so there are no meaningful screen space extents
+		if( p.w < Math::Epsilon || p.z < -p.w ) return true;
+
+		float invW = 1.0f / p.w;
+		minX = minf( minX, p.x * invW ); maxX = maxf( maxX, p.x * invW );
+		minY = minf( minY, p.y * invW ); maxY = maxf( maxY, p.y * invW );
+		minZ = minf( minZ, p.z * invW );
+	}
+
+	// Leave boxes outside of the screen to frustum culling
+	if( maxX < -1 || minX > 1 || maxY < -1 || minY > 1 ) return true;
+
+	// The rasterizer samples pixel centers, so a pixel may hold the depth of an occluder that covers
+	// only part of it. Each point of the box lies between four pixel centers within one pixel of the
+	// covered rectangle. For occluder surfaces without holes or folds smaller than a pixel, their
+	// farthest depth bounds the occluders at that point, so the rectangle is grown by one pixel.
+	int x0 = ftoi_t( clamp( (minX * 0.5f + 0.5f) * Width - 1, 0, Width - 1 ) );
+	int x1 = ftoi_t( clamp( (maxX * 0.5f + 0.5f) * Width + 1, 0, Width - 1 ) );
+	int y0 = ftoi_t( clamp( (minY * 0.5f + 0.5f) * Height - 1, 0, Height - 1 ) );
+	int y1 = ftoi_t( clamp( (maxY * 0.5f + 0.5f) * Height + 1, 0, Height - 1 ) );
+
+	// Select the finest level where the rectangle covers at most 2x2 texels
+	uint32 level = 0;
+	while( level < NumLevels - 1 && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1) )
+		++level;
+
+	const float *buf = &_depthBuf[_levelOffsets[level]];
+	int levelWidth = Width >> level;
+
+	for( int y = y0 >> level; y <= y1 >> level; ++y )
+	{
+		for( int x = x0 >> level; x <= x1 >> level; ++x )
+		{
+			if( buf[y * levelWidth + x] >= minZ ) return true;
+		}
+	}
+
+	return false;
+}
+
+}  // namespace
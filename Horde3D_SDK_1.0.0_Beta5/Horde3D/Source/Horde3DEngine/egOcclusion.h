@@ -0,0 +1,73 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egOcclusion_H_
+#define _egOcclusion_H_
+
+#include "egPrerequisites.h"
+#include "utMath.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+struct BoundingBox;
+
+
+// =================================================================================================
+// Software Occlusion Buffer
+// =================================================================================================
+
+// Low resolution depth buffer that is filled on the CPU with the triangles of occluder meshes.
+// After rasterization the buffer is reduced to a max-depth pyramid (hierarchical z) which allows
+// testing bounding boxes with a constant number of texel fetches. No render device calls are made.
+
+class OcclusionBuffer
+{
+public:
+	enum
+	{
+		Width = 256,
+		Height = 128,
+		NumLevels = 8  // Down to 2x1
+	};
+
+	OcclusionBuffer();
+
+	void begin( const Matrix4f &viewProjMat );
+	void rasterizeMesh( const Matrix4f &worldMat, const Vec3f *vertPos, const char *indexData,
+	                    bool indices16, uint32 firstIndex, uint32 indexCount, uint32 firstVert, uint32 lastVert );
+	void end();
+	void invalidate() { _active = false; }
+
+	// Returns false only if the box is guaranteed to be hidden by the rasterized occluders
+	bool testAABB( const BoundingBox &bBox ) const;
+
+	bool isActive() const { return _active; }
+	uint32 getTriCount() const { return _triCount; }
+
+protected:
+	void clipTriangle( const Vec4f &v0, const Vec4f &v1, const Vec4f &v2 );
+	void rasterizeTriangle( const Vec4f &v0, const Vec4f &v1, const Vec4f &v2 );
+	void buildHiZ();
+
+protected:
+	Matrix4f              _viewProjMat;
+	std::vector< float >  _depthBuf;  // NDC depth of all pyramid levels, finest level first
+	uint32                _levelOffsets[NumLevels];
+	std::vector< Vec4f >  _clipVerts;  // Scratch buffer for transformed vertices
+	uint32                _triCount;
+	bool                  _active;  // Buffer holds valid data for the current view
+};
+
+}
+#endif // _egOcclusion_H_
@@ -16,6 +16,9 @@
 #include "egCom.h"
 #include "egRenderer.h"
 #include "utXML.h"
+#include <algorithm>
+#include <functional>
+#include <cstring>
 
 #include "utDebug.h"
 
@@ -37,6 +40,7 @@ ParticleChannel::ParticleChannel()
 void ParticleChannel::reset()
 {
 	startMin = 0; startMax = 0; endRate = 0;
+	curve.clear();
 }
 
 
@@ -52,16 +56,70 @@ bool ParticleChannel::parse( XMLNode &node )
 	
 	endRate = (float)atof( node.getAttribute( "endRate", "1" ) );
 
+	// Keys define a piecewise linear curve over the normalized age that replaces endRate; it is
+	// baked into a table so that the simulation needs a single lookup per particle
+	vector< pair< float, float > > keys;
+	XMLNode keyNode = node.getFirstChild( "Key" );
+	while( !keyNode.isEmpty() )
+	{
+		if( keyNode.getAttribute( "time" ) != 0x0 && keyNode.getAttribute( "value" ) != 0x0 )
+		{
+			keys.push_back( pair< float, float >( (float)atof( keyNode.getAttribute( "time" ) ),
+			                                      (float)atof( keyNode.getAttribute( "value" ) ) ) );
+		}
+		keyNode = keyNode.getNextSibling( "Key" );
+	}
+
+	curve.clear();
+	if( keys.empty() ) return true;
+	std::stable_sort( keys.begin(), keys.end() );
+	
+	curve.resize( ParticleCurveSamples );
+	size_t key = 0;
+	for( uint32 i = 0; i < ParticleCurveSamples; ++i )
+	{
+		float t = (float)i / (float)(ParticleCurveSamples - 1);
+		while( key < keys.size() && keys[key].first <= t ) ++key;
+
+		if( key == 0 ) curve[i] = keys.front().second;
+		else if( key == keys.size() ) curve[i] = keys.back().second;
+		else
+		{
+			const pair< float, float > &k0 = keys[key - 1], &k1 = keys[key];
+			curve[i] = k0.second + (k1.second - k0.second) * (t - k0.first) / (k1.first - k0.first);
+		}
+	}
+
 	return true;
 }
 
 
+void ParticleChannel::bakeLinearCurve()
+{
+	curve.resize( ParticleCurveSamples );
+	for( uint32 i = 0; i < ParticleCurveSamples; ++i )
+		curve[i] = 1.0f + (endRate - 1.0f) * (float)i / (float)(ParticleCurveSamples - 1);
+}
+
+
+float ParticleChannel::getMaxFactor() const
+{
+	float factor = 1.0f;
+	if( curve.empty() ) return maxf( factor, fabsf( endRate ) );
+	
+	for( size_t i = 0; i < curve.size(); ++i )
+		factor = maxf( factor, fabsf( curve[i] ) );
+	return factor;
+}
+
+
 // *************************************************************************************************
 // ParticleEffectResource
 // *************************************************************************************************
 
 ParticleEffectResource::ParticleEffectResource( const string &name, int flags ) :
-	Resource( ResourceTypes::ParticleEffect, name, flags )
+	Resource( ResourceTypes::ParticleEffect, name, flags ), _curveTex( 0 ), _curveVersion( 0 ),
+	_curveTexVersion( 0 )
 {
 	initDefault();	
 }
@@ -84,11 +142,17 @@ void ParticleEffectResource::initDefault()
 	_colG.reset();
 	_colB.reset();
 	_colA.reset();
+	updateCurveTable();
 }
 
 
 void ParticleEffectResource::release()
 {
+	if( _curveTex != 0 )
+	{
+		gRDI->destroyTexture( _curveTex );
+		_curveTex = 0;
+	}
 }
 
 
@@ -113,6 +177,13 @@ bool ParticleEffectResource::load( const char *data, int size )
 
 	XMLDoc doc;
 	doc.parseBuffer( data, size );
+
+	return loadXML( doc );
+}
+
+
+bool ParticleEffectResource::loadXML( const XMLDoc &doc )
+{
 	if( doc.hasError() )
 		return raiseError( "XML parsing error" );
 
@@ -145,6 +216,7 @@ bool ParticleEffectResource::load( const char *data, int size )
 		
 		node1 = node1.getNextSibling( "ChannelOverLife" );
 	}
+	updateCurveTable();
 	
 	return true;
 }
@@ -221,6 +293,10 @@ float ParticleEffectResource::getElemParamF( int elem, int elemIdx, int param, i
 			return chan->startMax;
 		case ParticleEffectResData::ChanEndRateF:
 			return chan->endRate;
+		case ParticleEffectResData::ChanCurveF:
+			if( (unsigned)compIdx >= ParticleCurveSamples ) break;
+			if( !chan->curve.empty() ) return chan->curve[compIdx];
+			return 1.0f + (chan->endRate - 1.0f) * (float)compIdx / (float)(ParticleCurveSamples - 1);
 		}
 	}
 
@@ -283,6 +359,17 @@ void ParticleEffectResource::setElemParamF( int elem, int elemIdx, int param, in
 			return;
 		case ParticleEffectResData::ChanEndRateF:
 			chan->endRate = value;
+			if( !chan->curve.empty() )
+			{
+				chan->curve.clear();
+				updateCurveTable();
+			}
+			return;
+		case ParticleEffectResData::ChanCurveF:
+			if( (unsigned)compIdx >= ParticleCurveSamples ) break;
+			if( chan->curve.empty() ) chan->bakeLinearCurve();
+			chan->curve[compIdx] = value;
+			updateCurveTable();
 			return;
 		}
 	}
@@ -291,14 +378,228 @@ void ParticleEffectResource::setElemParamF( int elem, int elemIdx, int param, in
 }
 
 
+void ParticleEffectResource::updateCurveTable()
+{
+	const ParticleChannel *channels[] = { &_moveVel, &_rotVel, &_drag, &_size, &_colR, &_colG, &_colB, &_colA };
+	
+	_curveMask = 0;
+	for( uint32 c = 0; c < ParticleCurveChannels::Count; ++c )
+		if( !channels[c]->curve.empty() ) _curveMask |= 1 << c;
+	
+	// Channels without a curve are 1 in the table and use their rate
+	_curveTable.resize( _curveMask != 0 ? ParticleCurveSamples * ParticleCurveChannels::Count : 0 );
+	for( uint32 i = 0; i < _curveTable.size(); ++i )
+	{
+		const ParticleChannel &chan = *channels[i % ParticleCurveChannels::Count];
+		_curveTable[i] = chan.curve.empty() ? 1.0f : chan.curve[i / ParticleCurveChannels::Count];
+	}
+	++_curveVersion;
+}
+
+
+uint32 ParticleEffectResource::getCurveTex()
+{
+	// A row of the table is stored in two texels; without curves the shader only reads ones
+	if( _curveTex != 0 && _curveTexVersion == _curveVersion ) return _curveTex;
+
+	vector< float > ones;
+	const float *data = !_curveTable.empty() ? &_curveTable[0] : 0x0;
+	if( data == 0x0 )
+	{
+		ones.resize( ParticleCurveSamples * ParticleCurveChannels::Count, 1.0f );
+		data = &ones[0];
+	}
+
+	if( _curveTex == 0 )
+	{
+		_curveTex = gRDI->createTexture( TextureTypes::Tex2D, ParticleCurveSamples * ParticleCurveChannels::Count / 4, 1, 1,
+		                                 TextureFormats::RGBA32F, false, false, false, false );
+		gRDI->uploadTextureData( _curveTex, 0, 0, data );
+	}
+	else
+		gRDI->updateTextureData( _curveTex, 0, 0, data );
+	_curveTexVersion = _curveVersion;
+	
+	return _curveTex;
+}
+
+
+// *************************************************************************************************
+// ParticleNode
+// *************************************************************************************************
+
+ParticleNode::ParticleNode( const SceneNodeTpl &tpl ) :
+	SceneNode( tpl )
+{
+	_renderable = true;
+	_aliveCount = 0;
+	_parPositions = 0x0;
+	_parSizesANDRotations = 0x0;
+	_parColors = 0x0;
+	_parBackPositions = 0x0;
+	_parBackSizesANDRotations = 0x0;
+	_parBackColors = 0x0;
+	_parCapacity = 0;
+	_parBuffer = 0;
+	_snapAliveCount = 0;
+	_snapDataVersion = 0;
+	_snapPositions = 0x0;
+	_snapSizesANDRotations = 0x0;
+	_snapColors = 0x0;
+	_gpuState = 0x0;
+	_parTex = 0;
+	_parTexHeight = 0;
+	_parTexVersion = 0;
+	_parDataVersion = 1;
+	_depthSort = false;
+	_sortCamera = 0x0;
+	_sortFrame = 0;
+	_sortDataVersion = 0;
+	_depthOrderVersion = 1;
+	_parOrderVBO = 0;
+	_parOrderVBOSize = 0;
+	_parOrderVBOVersion = 0;
+}
+
+
+ParticleNode::~ParticleNode()
+{
+	for( uint32 i = 0; i < _occQueries.size(); ++i )
+	{
+		if( _occQueries[i] != 0 )
+			gRDI->destroyQuery( _occQueries[i] );
+	}
+	
+	gRDI->destroyTexture( _parTex );
+	gRDI->destroyBuffer( _parOrderVBO );
+
+	allocRenderData( 0 );
+}
+
+
+void ParticleNode::allocRenderData( uint32 count )
+{
+	delete[] _parPositions; _parPositions = 0x0;
+	delete[] _parSizesANDRotations; _parSizesANDRotations = 0x0;
+	delete[] _parColors; _parColors = 0x0;
+	delete[] _parBackPositions; _parBackPositions = 0x0;
+	delete[] _parBackSizesANDRotations; _parBackSizesANDRotations = 0x0;
+	delete[] _parBackColors; _parBackColors = 0x0;
+
+	// Only the live range is ever read, so the arrays are left uninitialized
+	_parCapacity = count;
+	_parBuffer = 0;
+	if( count > 0 )
+	{
+		_parPositions = new float[count * 3];
+		_parSizesANDRotations = new float[count * 2];
+		_parColors = new float[count * 4];
+	}
+}
+
+
+bool ParticleNode::detachSnapshotData()
+{
+	// Called by the update before it writes the render data. The renderer keeps using the arrays of
+	// the snapshot, so the update continues in the other set of arrays; returns true if the caller
+	// has to take over data from the snapshot.
+	if( !_inSnapshot || _parPositions != _snapPositions || _parCapacity == 0 ) return false;
+
+	if( _parBackPositions == 0x0 )
+	{
+		_parBackPositions = new float[_parCapacity * 3];
+		_parBackSizesANDRotations = new float[_parCapacity * 2];
+		_parBackColors = new float[_parCapacity * 4];
+	}
+	std::swap( _parPositions, _parBackPositions );
+	std::swap( _parSizesANDRotations, _parBackSizesANDRotations );
+	std::swap( _parColors, _parBackColors );
+	_parBuffer ^= 1;
+
+	return true;
+}
+
+
+void ParticleNode::captureRenderState()
+{
+	SceneNode::captureRenderState();
+	
+	_snapAliveCount = _aliveCount;
+	_snapDataVersion = _parDataVersion;
+	_snapPositions = _parPositions;
+	_snapSizesANDRotations = _parSizesANDRotations;
+	_snapColors = _parColors;
+}
+
+
+uint32 ParticleNode::newRandomSeed()
+{
+	// rand() may only deliver 15 bits, so several calls are combined
+	uint32 seed = (uint32)rand();
+	seed = (seed << 15) ^ (uint32)rand();
+	seed = (seed << 15) ^ (uint32)rand();
+	
+	return seed;
+}
+
+
+
 // *************************************************************************************************
 // EmitterNode
 // *************************************************************************************************
 
+ParticleSimFunc EmitterNode::simulateFunc = getParticleSimFunc( ParticleSimKernels::Scalar );
+ParticleRandomFunc EmitterNode::randomFunc = getParticleRandomFunc( ParticleSimKernels::Scalar );
+
+
+ParticleGPUState::ParticleGPUState() :
+	slotCount( 0 ), time( 0 ), curStateBuf( 0 ), attribBuf( 0 ), capacity( 0 )
+{
+	stateBufs[0] = 0;
+	stateBufs[1] = 0;
+}
+
+
+ParticleGPUState::~ParticleGPUState()
+{
+	releaseBuffers();
+}
+
+
+void ParticleGPUState::reset( uint32 particleCount )
+{
+	steps.clear();
+	spawnSlots.clear();
+	spawnAttribs.clear();
+	spawnStates.clear();
+	deaths.clear();
+	boundsSamples.clear();
+	slotCount = 0;
+	time = 0;
+
+	// An ascending sequence is a valid min-heap
+	freeSlots.resize( particleCount );
+	for( uint32 i = 0; i < particleCount; ++i ) freeSlots[i] = i;
+}
+
+
+void ParticleGPUState::releaseBuffers()
+{
+	gRDI->destroyBuffer( stateBufs[0] );
+	gRDI->destroyBuffer( stateBufs[1] );
+	gRDI->destroyBuffer( attribBuf );
+	stateBufs[0] = 0;
+	stateBufs[1] = 0;
+	attribBuf = 0;
+	curStateBuf = 0;
+	capacity = 0;
+}
+
+
+
 EmitterNode::EmitterNode( const EmitterNodeTpl &emitterTpl ) :
-	SceneNode( emitterTpl )
+	ParticleNode( emitterTpl )
 {
-	_renderable = true;
 	_materialRes = emitterTpl.matRes;
 	_effectRes = emitterTpl.effectRes;
 	_particleCount = emitterTpl.maxParticleCount;
@@ -307,31 +608,40 @@ EmitterNode::EmitterNode( const EmitterNodeTpl &emitterTpl ) :
 	_emissionRate = emitterTpl.emissionRate;
 	_spreadAngle = emitterTpl.spreadAngle;
 	_force = Vec3f( emitterTpl.fx, emitterTpl.fy, emitterTpl.fz );
+	_seed = emitterTpl.hasSeed ? emitterTpl.seed : newRandomSeed();
+	_randomCounter = 0;
 
 	_emissionAccum = 0;
 	_prevAbsTrans = _absTrans;
 
-	_particles = 0x0;
-	_parPositions = 0x0;
-	_parSizesANDRotations = 0x0;
-	_parColors = 0x0;
+	_spawnedCount = 0;
+	_parState = 0x0;
+	_depthSort = emitterTpl.depthSort;
+
+	_lodDist = emitterTpl.lodDist;
+	_lodCountScale = emitterTpl.lodCountScale;
+	_lodUpdateInterval = emitterTpl.lodUpdateInterval;
+	_cullFrames = emitterTpl.cullFrames;
+	_lodSkippedSteps = 0;
+	_lodSkippedTime = 0;
+	_visibleFrame = Modules::renderer().getFrameID();  // New emitters are not culled right away
+	_visibleDist = 0;
+	_snapVisibleFrame = _visibleFrame;
+	_snapVisibleDist = 0;
+	_snapFrameID = _visibleFrame;
+	_stepSpawnCount = 0;
+	_stepCopyCount = 0;
 
 	setMaxParticleCount( _particleCount );
+	if( emitterTpl.gpuSimulation && !setGPUSimulation( true ) )
+		Modules::log().writeWarning( "Emitter node '%s': GPU particle simulation not supported", _name.c_str() );
 }
 
 
 EmitterNode::~EmitterNode()
 {
-	for( uint32 i = 0; i < _occQueries.size(); ++i )
-	{
-		if( _occQueries[i] != 0 )
-			gRDI->destroyQuery( _occQueries[i] );
-	}
-	
-	delete[] _particles;
-	delete[] _parPositions;
-	delete[] _parSizesANDRotations;
-	delete[] _parColors;
+	delete _gpuState;
+	delete[] _parState;
 }
 
 
@@ -376,6 +686,32 @@ SceneNodeTpl *EmitterNode::parsingFunc( map< string, string > &attribs )
 	if( itr != attribs.end() ) emitterTpl->fy = (float)atof( itr->second.c_str() );
 	itr = attribs.find( "forceZ" );
 	if( itr != attribs.end() ) emitterTpl->fz = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "seed" );
+	if( itr != attribs.end() )
+	{
+		emitterTpl->seed = (uint32)atoi( itr->second.c_str() );
+		emitterTpl->hasSeed = true;
+	}
+	itr = attribs.find( "gpuSimulation" );
+	if( itr != attribs.end() )
+	{
+		if ( _stricmp( itr->second.c_str(), "true" ) == 0 || _stricmp( itr->second.c_str(), "1" ) == 0 )
+			emitterTpl->gpuSimulation = true;
+	}
+	itr = attribs.find( "depthSort" );
+	if( itr != attribs.end() )
+	{
+		if ( _stricmp( itr->second.c_str(), "true" ) == 0 || _stricmp( itr->second.c_str(), "1" ) == 0 )
+			emitterTpl->depthSort = true;
+	}
+	itr = attribs.find( "lodDist" );
+	if( itr != attribs.end() ) emitterTpl->lodDist = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "lodUpdateInterval" );
+	if( itr != attribs.end() ) emitterTpl->lodUpdateInterval = (uint32)std::max( atoi( itr->second.c_str() ), 1 );
+	itr = attribs.find( "lodCountScale" );
+	if( itr != attribs.end() ) emitterTpl->lodCountScale = (float)atof( itr->second.c_str() );
+	itr = attribs.find( "cullFrames" );
+	if( itr != attribs.end() ) emitterTpl->cullFrames = (uint32)std::max( atoi( itr->second.c_str() ), 0 );
 	
 	if( !result )
 	{
@@ -397,32 +733,57 @@ SceneNode *EmitterNode::factoryFunc( const SceneNodeTpl &nodeTpl )
 void EmitterNode::setMaxParticleCount( uint32 maxParticleCount )
 {
 	// Delete particles
-	delete[] _particles; _particles = 0x0;
-	delete[] _parPositions; _parPositions = 0x0;
-	delete[] _parSizesANDRotations; _parSizesANDRotations = 0x0;
-	delete[] _parColors; _parColors = 0x0;
+	delete[] _parState; _parState = 0x0;
+	allocRenderData( 0 );
 	
-	// Initialize particles
+	// Initialize particles; only the live range is ever read, so the arrays are left uninitialized
 	_particleCount = maxParticleCount;
-	_particles = new ParticleData[_particleCount];
-	_parPositions = new float[_particleCount * 3];
-	_parSizesANDRotations = new float[_particleCount * 2];
-	_parColors = new float[_particleCount * 4];
-	for( uint32 i = 0; i < _particleCount; ++i )
-	{
-		_particles[i].life = 0;
-		_particles[i].respawnCounter = 0;
-		
-		_parPositions[i*3+0] = 0.0f;
-		_parPositions[i*3+1] = 0.0f;
-		_parPositions[i*3+2] = 0.0f;
-		_parSizesANDRotations[i*2+0] = 0.0f;
-		_parSizesANDRotations[i*2+1] = 0.0f;
-		_parColors[i*4+0] = 0.0f;
-		_parColors[i*4+1] = 0.0f;
-		_parColors[i*4+2] = 0.0f;
-		_parColors[i*4+3] = 0.0f;
+	_aliveCount = 0;
+	_spawnedCount = 0;
+	if( _gpuState != 0x0 )
+	{
+		// The GPU buffers are resized when the emitter is simulated next
+		_gpuState->reset( _particleCount );
+	}
+	else
+	{
+		_parState = new float[_particleCount * ParticleStateChannels::Count];
+		allocRenderData( _particleCount );
+	}
+	++_parDataVersion;
+}
+
+
+bool EmitterNode::setGPUSimulation( bool enabled )
+{
+	if( enabled == (_gpuState != 0x0) ) return true;
+	if( enabled && !Modules::renderer().hasGPUParticles() ) return false;
+
+	if( enabled )
+	{
+		_gpuState = new ParticleGPUState();
+	}
+	else
+	{
+		delete _gpuState; _gpuState = 0x0;
 	}
+	
+	// The particles are not transferred, the emitter starts again
+	setMaxParticleCount( _particleCount );
+	return true;
+}
+
+
+ParticleStreams EmitterNode::getStreams()
+{
+	ParticleStreams streams;
+	streams.state = _parState;
+	streams.stride = _particleCount;
+	streams.positions = _parPositions;
+	streams.sizesAndRotations = _parSizesANDRotations;
+	streams.colors = _parColors;
+	
+	return streams;
 }
 
 
@@ -440,6 +801,16 @@ int EmitterNode::getParamI( int param )
 		return (int)_particleCount;
 	case EmitterNodeParams::RespawnCountI:
 		return _respawnCount;
+	case EmitterNodeParams::SeedI:
+		return (int)_seed;
+	case EmitterNodeParams::GPUSimulationI:
+		return _gpuState != 0x0 ? 1 : 0;
+	case EmitterNodeParams::DepthSortI:
+		return _depthSort ? 1 : 0;
+	case EmitterNodeParams::LodUpdateIntervalI:
+		return (int)_lodUpdateInterval;
+	case EmitterNodeParams::CullFramesI:
+		return (int)_cullFrames;
 	}
 
 	return SceneNode::getParamI( param );
@@ -472,6 +843,26 @@ void EmitterNode::setParamI( int param, int value )
 	case EmitterNodeParams::RespawnCountI:
 		_respawnCount = value;
 		return;
+	case EmitterNodeParams::SeedI:
+		// Restart the stream so that the same seed yields the same particles again
+		_seed = (uint32)value;
+		_randomCounter = 0;
+		return;
+	case EmitterNodeParams::GPUSimulationI:
+		if( !setGPUSimulation( value != 0 ) )
+			Modules::setError( "GPU particle simulation not supported in h3dSetNodeParamI for H3DEmitter::GPUSimulationI" );
+		return;
+	case EmitterNodeParams::DepthSortI:
+		_depthSort = value != 0;
+		return;
+	case EmitterNodeParams::LodUpdateIntervalI:
+		if( value >= 1 ) _lodUpdateInterval = (uint32)value;
+		else Modules::setError( "Invalid value in h3dSetNodeParamI for H3DEmitter::LodUpdateIntervalI" );
+		return;
+	case EmitterNodeParams::CullFramesI:
+		if( value >= 0 ) _cullFrames = (uint32)value;
+		else Modules::setError( "Invalid value in h3dSetNodeParamI for H3DEmitter::CullFramesI" );
+		return;
 	}
 
 	SceneNode::setParamI( param, value );
@@ -491,6 +882,10 @@ float EmitterNode::getParamF( int param, int compIdx )
 	case EmitterNodeParams::ForceF3:
 		if( (unsigned)compIdx < 3 ) return _force[compIdx];
 		break;
+	case EmitterNodeParams::LodDistF:
+		return _lodDist;
+	case EmitterNodeParams::LodCountScaleF:
+		return _lodCountScale;
 	}
 
 	return SceneNode::getParamF( param, compIdx );
@@ -517,144 +912,277 @@ void EmitterNode::setParamF( int param, int compIdx, float value )
 			return;
 		}
 		break;
+	case EmitterNodeParams::LodDistF:
+		_lodDist = value;
+		return;
+	case EmitterNodeParams::LodCountScaleF:
+		_lodCountScale = value;
+		return;
 	}
 
 	SceneNode::setParamF( param, compIdx, value );
 }
 
 
-float randomF( float min, float max )
+void EmitterNode::spawnParticles( const ParticleStreams &streams, uint32 count, const Vec3f &motionVec,
+                                  float stepWidth, float timeDelta )
 {
-	return (rand() / (float)RAND_MAX) * (max - min) + min;
+	// Random values are generated for batches of particles
+	const uint32 batchSize = 64;
+	float rnd[ParticleRandomValues::Count * batchSize];
+	
+	float angle = degToRad( _spreadAngle / 2 );
+	Matrix4f m = _absTrans;
+	m.c[3][0] = 0; m.c[3][1] = 0; m.c[3][2] = 0;
+	Vec3f dragVec = motionVec / timeDelta;
+	float curStep = 0;
+	const ParticleEffectResource &eff = *_effectRes;
+
+	for( uint32 j = 0; j < count; ++j )
+	{
+		uint32 k = j % batchSize;
+		if( k == 0 )
+			randomFunc( _seed, _randomCounter + j, std::min( batchSize, count - j ), ParticleRandomValues::Count,
+			            rnd, batchSize );
+		
+		uint32 i = j;
+		
+		float maxLife = eff._lifeMin + rnd[ParticleRandomValues::Life * batchSize + k] * (eff._lifeMax - eff._lifeMin);
+		streams.channel( ParticleStateChannels::Life )[i] = maxLife;
+		streams.channel( ParticleStateChannels::InvMaxLife )[i] = maxLife > 0 ? 1.0f / maxLife : 0.0f;
+		
+		Matrix4f dirMat = m;
+		dirMat.rotate( (rnd[ParticleRandomValues::SpreadX * batchSize + k] * 2 - 1) * angle,
+		               (rnd[ParticleRandomValues::SpreadY * batchSize + k] * 2 - 1) * angle,
+		               (rnd[ParticleRandomValues::SpreadZ * batchSize + k] * 2 - 1) * angle );
+		Vec3f dir = (dirMat * Vec3f( 0, 0, -1 )).normalized();
+		for( uint32 c = 0; c < 3; ++c )
+		{
+			streams.channel( ParticleStateChannels::DirX + c )[i] = dir[c];
+			streams.channel( ParticleStateChannels::DragX + c )[i] = dragVec[c];
+		}
+
+		// Generate start values
+		const ParticleChannel *channels[] = { &eff._moveVel, &eff._rotVel, &eff._drag, &eff._size,
+		                                      &eff._colR, &eff._colG, &eff._colB, &eff._colA };
+		float start[8];
+		for( uint32 c = 0; c < 8; ++c )
+		{
+			start[c] = channels[c]->startMin +
+				rnd[(ParticleRandomValues::MoveVel + c) * batchSize + k] * (channels[c]->startMax - channels[c]->startMin);
+		}
+		streams.channel( ParticleStateChannels::MoveVel0 )[i] = start[0];
+		streams.channel( ParticleStateChannels::RotVel0 )[i] = start[1];
+		streams.channel( ParticleStateChannels::Drag0 )[i] = start[2];
+		streams.channel( ParticleStateChannels::Size0 )[i] = start[3];
+		for( uint32 c = 0; c < 4; ++c )
+			streams.channel( ParticleStateChannels::ColR0 + c )[i] = start[4 + c];
+		
+		// Particles are distributed along emitter's motion vector to avoid blobs when fps is low
+		streams.positions[i * 3 + 0] = _absTrans.c[3][0] - motionVec.x * curStep;
+		streams.positions[i * 3 + 1] = _absTrans.c[3][1] - motionVec.y * curStep;
+		streams.positions[i * 3 + 2] = _absTrans.c[3][2] - motionVec.z * curStep;
+		streams.sizesAndRotations[i * 2 + 0] = start[3];
+		streams.sizesAndRotations[i * 2 + 1] = rnd[ParticleRandomValues::Rotation * batchSize + k] * 360;
+		for( uint32 c = 0; c < 4; ++c ) streams.colors[i * 4 + c] = start[4 + c];
+
+		curStep += stepWidth;
+	}
+
+	_spawnedCount += count;
+	_randomCounter += count;
 }
 
 
-void EmitterNode::update( float timeDelta )
+void EmitterNode::markVisible( const Vec3f &viewPoint )
 {
-	if( timeDelta == 0 || _effectRes == 0x0 ) return;
+	float dist = (getRenderTrans().getTrans() - viewPoint).length();
+	uint32 frame = Modules::renderer().getFrameID();
 	
-	// Update absolute transformation
-	updateTree();
+	// The nearest camera that renders the emitter in a frame decides. While the emitter is updated in
+	// the background, the visibility is recorded separately and taken over by releaseRenderState.
+	uint32 &visibleFrame = _inSnapshot ? _snapVisibleFrame : _visibleFrame;
+	float &visibleDist = _inSnapshot ? _snapVisibleDist : _visibleDist;
+	visibleDist = visibleFrame == frame ? minf( visibleDist, dist ) : dist;
+	visibleFrame = frame;
+}
+
+
+void EmitterNode::captureRenderState()
+{
+	ParticleNode::captureRenderState();
+
+	_snapVisibleFrame = _visibleFrame;
+	_snapVisibleDist = _visibleDist;
+	_snapFrameID = Modules::renderer().getFrameID();
+}
+
+
+void EmitterNode::releaseRenderState()
+{
+	ParticleNode::releaseRenderState();
+
+	_visibleFrame = _snapVisibleFrame;
+	_visibleDist = _snapVisibleDist;
+}
+
+
+bool EmitterNode::applyLod( float &timeDelta, float &countScale )
+{
+	countScale = 1.0f;
 	
-	Timer *timer = Modules::stats().getTimer( EngineStats::ParticleSimTime );
-	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	// The renderer keeps counting frames during a background update
+	uint32 frame = _inSnapshot ? _snapFrameID : Modules::renderer().getFrameID();
+	if( _cullFrames > 0 && frame - _visibleFrame > _cullFrames )
+	{
+		// The emitter is paused and the time is not caught up later. The box is extended to the
+		// emitter, so that an emitter that moves into view is noticed by the culling.
+		Vec3f pos = _absTrans.getTrans();
+		_bBox.min = Vec3f( minf( _bBox.min.x, pos.x ), minf( _bBox.min.y, pos.y ), minf( _bBox.min.z, pos.z ) );
+		_bBox.max = Vec3f( maxf( _bBox.max.x, pos.x ), maxf( _bBox.max.y, pos.y ), maxf( _bBox.max.z, pos.z ) );
+		_prevAbsTrans = _absTrans;
+		_lodSkippedSteps = 0;
+		_lodSkippedTime = 0;
+		Modules::stats().incStat( EngineStats::EmitterCullSkipCount, 1 );
+		return false;
+	}
+
+	if( _lodDist > 0 && _visibleDist >= _lodDist )
+	{
+		countScale = _lodCountScale;
+		if( ++_lodSkippedSteps < _lodUpdateInterval )
+		{
+			_lodSkippedTime += timeDelta;
+			Modules::stats().incStat( EngineStats::EmitterLodSkipCount, 1 );
+			return false;
+		}
+	}
+
+	// The skipped time is simulated in one step
+	timeDelta += _lodSkippedTime;
+	_lodSkippedSteps = 0;
+	_lodSkippedTime = 0;
+	return true;
+}
+
+
+bool EmitterNode::beginUpdate( float timeDelta )
+{
+	if( timeDelta == 0 || _effectRes == 0x0 ) return false;
 	
-	Vec3f bBMin( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
-	Vec3f bBMax( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
+	// Update absolute transformation
+	updateTree();
+
+	float countScale;
+	if( !applyLod( timeDelta, countScale ) ) return false;
 	
 	if( _delay <= 0 )
-		_emissionAccum += _emissionRate * timeDelta;
+		_emissionAccum += _emissionRate * countScale * timeDelta;
 	else
 		_delay -= timeDelta;
 
-	Vec3f motionVec = _absTrans.getTrans() - _prevAbsTrans.getTrans();
+	_stepMotionVec = _absTrans.getTrans() - _prevAbsTrans.getTrans();
 
-	// Check how many particles will be spawned
-	float spawnCount = 0;
-	for( uint32 i = 0; i < _particleCount; ++i )
+	if( _gpuState != 0x0 )
 	{
-		ParticleData &p = _particles[i];
-		if( p.life <= 0 && ((int)p.respawnCounter < _respawnCount || _respawnCount < 0) )
+		// The GPU decrements the life in single precision, so a slot is only reused when its
+		// particle has been dead for at least one step
+		ParticleGPUState &gs = *_gpuState;
+		while( !gs.deaths.empty() && gs.deaths.front().first + timeDelta <= gs.time )
 		{
-			spawnCount += 1.0f;
-			if( spawnCount >= _emissionAccum ) break;
+			std::pop_heap( gs.deaths.begin(), gs.deaths.end(), std::greater< std::pair< double, uint32 > >() );
+			gs.freeSlots.push_back( gs.deaths.back().second );
+			std::push_heap( gs.freeSlots.begin(), gs.freeSlots.end(), std::greater< uint32 >() );
+			gs.deaths.pop_back();
 		}
+		_aliveCount = (uint32)gs.deaths.size();
+		if( _aliveCount == 0 ) gs.slotCount = 0;
 	}
 
-	// Particles are distributed along emitter's motion vector to avoid blobs when fps is low
-	float curStep = 0, stepWidth = 0.5f;
-	if( spawnCount > 2.0f ) stepWidth = motionVec.length() / spawnCount;
-	
-	for( uint32 i = 0; i < _particleCount; ++i )
+	// Free slots that may still be used considering the respawn count
+	uint32 available = _particleCount - _aliveCount;
+	if( _respawnCount >= 0 )
 	{
-		ParticleData &p = _particles[i];
-		
-		// Create particle
-		if( p.life <= 0 && ((int)p.respawnCounter < _respawnCount || _respawnCount < 0) )
-		{
-			if( _emissionAccum >= 1.0f )
-			{
-				// Respawn
-				p.maxLife = randomF( _effectRes->_lifeMin, _effectRes->_lifeMax );
-				p.life = p.maxLife;
-				float angle = degToRad( _spreadAngle / 2 );
-				Matrix4f m = _absTrans;
-				m.c[3][0] = 0; m.c[3][1] = 0; m.c[3][2] = 0;
-				m.rotate( randomF( -angle, angle ), randomF( -angle, angle ), randomF( -angle, angle ) );
-				p.dir = (m * Vec3f( 0, 0, -1 )).normalized();
-				p.dragVec = motionVec / timeDelta;
-				++p.respawnCounter;
-
-				// Generate start values
-				p.moveVel0 = randomF( _effectRes->_moveVel.startMin, _effectRes->_moveVel.startMax );
-				p.rotVel0 = randomF( _effectRes->_rotVel.startMin, _effectRes->_rotVel.startMax );
-				p.drag0 = randomF( _effectRes->_drag.startMin, _effectRes->_drag.startMax );
-				p.size0 = randomF( _effectRes->_size.startMin, _effectRes->_size.startMax );
-				p.r0 = randomF( _effectRes->_colR.startMin, _effectRes->_colR.startMax );
-				p.g0 = randomF( _effectRes->_colG.startMin, _effectRes->_colG.startMax );
-				p.b0 = randomF( _effectRes->_colB.startMin, _effectRes->_colB.startMax );
-				p.a0 = randomF( _effectRes->_colA.startMin, _effectRes->_colA.startMax );
-				
-				// Update arrays
-				_parPositions[i * 3 + 0] = _absTrans.c[3][0] - motionVec.x * curStep;
-				_parPositions[i * 3 + 1] = _absTrans.c[3][1] - motionVec.y * curStep;
-				_parPositions[i * 3 + 2] = _absTrans.c[3][2] - motionVec.z * curStep;
-				_parSizesANDRotations[i * 2 + 0] = p.size0;
-				_parSizesANDRotations[i * 2 + 1] = randomF( 0, 360 );
-				_parColors[i * 4 + 0] = p.r0;
-				_parColors[i * 4 + 1] = p.g0;
-				_parColors[i * 4 + 2] = p.b0;
-				_parColors[i * 4 + 3] = p.a0;
-
-				// Update emitter
-				_emissionAccum -= 1.f;
-				if( _emissionAccum < 0 ) _emissionAccum = 0.f;
-
-				curStep += stepWidth;
-			}
-		}
+		uint64 limit = (uint64)_particleCount * (uint64)_respawnCount;
+		available = _spawnedCount < limit ? (uint32)std::min( (uint64)available, limit - _spawnedCount ) : 0;
+	}
+
+	_stepSpawnCount = 0;
+	_stepWidth = 0;
+	if( available > 0 )
+	{
+		// The step width refers to the number of started emissions, including a fractional one
+		float spawnCount = minf( (float)available, maxf( ceilf( _emissionAccum ), 1.0f ) );
+		_stepWidth = spawnCount > 2.0f ? _stepMotionVec.length() / spawnCount : 0.5f;
 		
-		// Update particle
-		if( p.life > 0 )
-		{
-			// Interpolate data
-			float fac = 1.0f - (p.life / p.maxLife);
-			
-			float moveVel = p.moveVel0 * (1.0f + (_effectRes->_moveVel.endRate - 1.0f) * fac);
-			float rotVel = p.rotVel0 * (1.0f + (_effectRes->_rotVel.endRate - 1.0f) * fac);
-			float drag = p.drag0 * (1.0f + (_effectRes->_drag.endRate - 1.0f) * fac);
-			_parSizesANDRotations[i * 2 + 0] = p.size0 * (1.0f + (_effectRes->_size.endRate - 1.0f) * fac);
-			_parSizesANDRotations[i * 2 + 0] *= 2;  // Keep compatibility with old particle vertex shader
-			_parColors[i * 4 + 0] = p.r0 * (1.0f + (_effectRes->_colR.endRate - 1.0f) * fac);
-			_parColors[i * 4 + 1] = p.g0 * (1.0f + (_effectRes->_colG.endRate - 1.0f) * fac);
-			_parColors[i * 4 + 2] = p.b0 * (1.0f + (_effectRes->_colB.endRate - 1.0f) * fac);
-			_parColors[i * 4 + 3] = p.a0 * (1.0f + (_effectRes->_colA.endRate - 1.0f) * fac);
-
-			// Update particle position and rotation
-			_parPositions[i * 3 + 0] += (p.dir.x * moveVel + p.dragVec.x * drag + _force.x) * timeDelta;
-			_parPositions[i * 3 + 1] += (p.dir.y * moveVel + p.dragVec.y * drag + _force.y) * timeDelta;
-			_parPositions[i * 3 + 2] += (p.dir.z * moveVel + p.dragVec.z * drag + _force.z) * timeDelta;
-			_parSizesANDRotations[i * 2 + 1] += degToRad( rotVel ) * timeDelta;
-
-			// Decrease lifetime
-			p.life -= timeDelta;
-			
-			// Check if particle is dying
-			if( p.life <= 0 )
-			{
-				_parSizesANDRotations[i * 2 + 0] = 0.0f;
-			}
-		}
+		_stepSpawnCount = _emissionAccum >= (float)available ? available : (uint32)maxf( _emissionAccum, 0.0f );
+		_emissionAccum = maxf( _emissionAccum - (float)_stepSpawnCount, 0.0f );
+	}
+
+	// The resource values are read once per step instead of per particle
+	_stepParams.timeDelta = timeDelta;
+	_stepParams.force[0] = _force.x; _stepParams.force[1] = _force.y; _stepParams.force[2] = _force.z;
+	_stepParams.moveVelRate = _effectRes->_moveVel.endRate - 1.0f;
+	_stepParams.rotVelRate = _effectRes->_rotVel.endRate - 1.0f;
+	_stepParams.dragRate = _effectRes->_drag.endRate - 1.0f;
+	_stepParams.sizeRate = _effectRes->_size.endRate - 1.0f;
+	_stepParams.colRate[0] = _effectRes->_colR.endRate - 1.0f;
+	_stepParams.colRate[1] = _effectRes->_colG.endRate - 1.0f;
+	_stepParams.colRate[2] = _effectRes->_colB.endRate - 1.0f;
+	_stepParams.colRate[3] = _effectRes->_colA.endRate - 1.0f;
+
+	_stepParams.curveMask = _effectRes->_curveMask;
+	_stepParams.curveTable = _effectRes->_curveMask != 0 ? &_effectRes->_curveTable[0] : 0x0;
+
+	if( _gpuState != 0x0 )
+	{
+		// Nothing to do for the CPU, the step is run when the emitter is rendered next
+		recordGPUStep();
+		return false;
+	}
+
+	// In the snapshot, the live particles continue in the second set of arrays
+	_stepCopyCount = detachSnapshotData() ? _aliveCount : 0;
+
+	return true;
+}
 
-		// Update bounding box
-		Vec3f vertPos( _parPositions[i*3+0], _parPositions[i*3+1], _parPositions[i*3+2] );
-		if( vertPos.x < bBMin.x ) bBMin.x = vertPos.x;
-		if( vertPos.y < bBMin.y ) bBMin.y = vertPos.y;
-		if( vertPos.z < bBMin.z ) bBMin.z = vertPos.z;
-		if( vertPos.x > bBMax.x ) bBMax.x = vertPos.x;
-		if( vertPos.y > bBMax.y ) bBMax.y = vertPos.y;
-		if( vertPos.z > bBMax.z ) bBMax.z = vertPos.z;
+
+void EmitterNode::spawnPending()
+{
+	spawnParticles( getStreams().offset( _aliveCount ), _stepSpawnCount, _stepMotionVec, _stepWidth,
+	                _stepParams.timeDelta );
+	_aliveCount += _stepSpawnCount;
+	_stepSpawnCount = 0;
+}
+
+
+void EmitterNode::simulate( uint32 first, uint32 count, float *bounds )
+{
+	ParticleStreams streams = getStreams().offset( first );
+	
+	// Positions and rotations are advanced, sizes and colors are computed from the state anyway
+	uint32 copyEnd = std::min( first + count, _stepCopyCount );
+	if( first < copyEnd )
+	{
+		memcpy( streams.positions, _snapPositions + first * 3, (copyEnd - first) * 3 * sizeof( float ) );
+		memcpy( streams.sizesAndRotations, _snapSizesANDRotations + first * 2,
+		        (copyEnd - first) * 2 * sizeof( float ) );
 	}
+	
+	simulateFunc( streams, count, _stepParams, bounds );
+}
+
+
+void EmitterNode::endUpdate( const float *bounds )
+{
+	if( _gpuState == 0x0 )
+		_aliveCount = removeDeadParticles( getStreams(), _aliveCount );
+	_stepCopyCount = 0;
+	
+	Vec3f bBMin( bounds[0], bounds[1], bounds[2] );
+	Vec3f bBMax( bounds[3], bounds[4], bounds[5] );
+	if( bBMin.x > bBMax.x ) bBMin = bBMax = _absTrans.getTrans();
 
 	// Avoid zero box dimensions for planes
 	if( bBMax.x - bBMin.x == 0 ) bBMax.x += Math::Epsilon;
@@ -665,6 +1193,23 @@ void EmitterNode::update( float timeDelta )
 	_bBox.max = bBMax;
 
 	_prevAbsTrans = _absTrans;
+	++_parDataVersion;
+}
+
+
+void EmitterNode::update( float timeDelta )
+{
+	if( !beginUpdate( timeDelta ) ) return;
+	
+	Timer *timer = Modules::stats().getTimer( EngineStats::ParticleSimTime );
+	if( Modules::config().gatherTimeStats ) timer->setEnabled( true );
+	
+	spawnPending();
+
+	float bounds[6] = { Math::MaxFloat, Math::MaxFloat, Math::MaxFloat,
+	                    -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat };
+	simulate( 0, _aliveCount, bounds );
+	endUpdate( bounds );
 
 	timer->setEnabled( false );
 }
@@ -674,15 +1219,175 @@ bool EmitterNode::hasFinished()
 {
 	if( _respawnCount < 0 ) return false;
 
-	for( uint32 i = 0; i < _particleCount; ++i )
-	{	
-		if( _particles[i].life > 0 || (int)_particles[i].respawnCounter < _respawnCount )
+	return _aliveCount == 0 && _spawnedCount >= (uint64)_particleCount * (uint64)_respawnCount;
+}
+
+
+void EmitterNode::recordGPUStep()
+{
+	ParticleGPUState &gs = *_gpuState;
+	uint32 count = _stepSpawnCount;
+	_stepSpawnCount = 0;
+
+	ParticleGPUStep step;
+	step.params = _stepParams;
+	step.firstSpawn = (uint32)gs.spawnSlots.size();
+	step.spawnCount = count;
+
+	if( count > 0 )
+	{
+		// Particles are spawned exactly as on the CPU and then converted to the GPU layout
+		gs.spawnScratch.resize( count * (ParticleStateChannels::Count + 9) );
+		ParticleStreams streams;
+		streams.state = &gs.spawnScratch[0];
+		streams.stride = count;
+		streams.positions = streams.state + count * ParticleStateChannels::Count;
+		streams.sizesAndRotations = streams.positions + count * 3;
+		streams.colors = streams.sizesAndRotations + count * 2;
+		spawnParticles( streams, count, _stepMotionVec, _stepWidth, _stepParams.timeDelta );
+
+		ParticleGPUBoundsSample sample;
+		sample.time = gs.time;
+		sample.spawnMin = Vec3f( Math::MaxFloat, Math::MaxFloat, Math::MaxFloat );
+		sample.spawnMax = Vec3f( -Math::MaxFloat, -Math::MaxFloat, -Math::MaxFloat );
+		sample.emitterSpeed = _stepMotionVec.length() / _stepParams.timeDelta;
+
+		size_t attribOffset = gs.spawnAttribs.size(), stateOffset = gs.spawnStates.size();
+		gs.spawnAttribs.resize( attribOffset + count * 16 );
+		gs.spawnStates.resize( stateOffset + count * 12 );
+		float *attribs = &gs.spawnAttribs[attribOffset];
+		float *states = &gs.spawnStates[stateOffset];
+		
+		for( uint32 i = 0; i < count; ++i )
 		{
-			return false;
+			std::pop_heap( gs.freeSlots.begin(), gs.freeSlots.end(), std::greater< uint32 >() );
+			uint32 slot = gs.freeSlots.back();
+			gs.freeSlots.pop_back();
+			gs.spawnSlots.push_back( slot );
+			gs.slotCount = std::max( gs.slotCount, slot + 1 );
+			
+			float life = streams.channel( ParticleStateChannels::Life )[i];
+			gs.deaths.push_back( std::make_pair( gs.time + life, slot ) );
+			std::push_heap( gs.deaths.begin(), gs.deaths.end(), std::greater< std::pair< double, uint32 > >() );
+
+			// Constant attributes: 1 / maxLife, direction, drag vector and start values
+			for( uint32 c = 0; c < 16; ++c )
+				attribs[c] = c < 11 ? streams.channel( ParticleStateChannels::InvMaxLife + c )[i] : 0.0f;
+			for( uint32 c = 0; c < 4; ++c )
+				attribs[12 + c] = streams.channel( ParticleStateChannels::ColR0 + c )[i];
+
+			// Position and size, color, rotation and life
+			for( uint32 c = 0; c < 3; ++c )
+			{
+				states[c] = streams.positions[i * 3 + c];
+				sample.spawnMin[c] = minf( sample.spawnMin[c], states[c] );
+				sample.spawnMax[c] = maxf( sample.spawnMax[c], states[c] );
+			}
+			states[3] = streams.sizesAndRotations[i * 2 + 0];
+			for( uint32 c = 0; c < 4; ++c ) states[4 + c] = streams.colors[i * 4 + c];
+			states[8] = streams.sizesAndRotations[i * 2 + 1];
+			states[9] = life;
+			states[10] = 0;
+			states[11] = 0;
+			
+			attribs += 16;
+			states += 12;
 		}
+
+		gs.boundsSamples.push_back( sample );
+		_aliveCount += count;
 	}
 	
-	return true;
+	step.slotCount = gs.slotCount;
+	gs.steps.push_back( step );
+	gs.time += _stepParams.timeDelta;
+
+	float bounds[6];
+	estimateGPUBounds( bounds );
+	endUpdate( bounds );
+}
+
+
+void EmitterNode::estimateGPUBounds( float *bounds )
+{
+	// The particles are not read back, so the box contains all positions that particles spawned
+	// during the last maximal lifetime can have reached
+	ParticleGPUState &gs = *_gpuState;
+	const ParticleEffectResource &eff = *_effectRes;
+	float lifeMax = eff._lifeMax;
+	
+	size_t numDead = 0;
+	while( numDead < gs.boundsSamples.size() &&
+	       gs.boundsSamples[numDead].time + lifeMax + _stepParams.timeDelta <= gs.time ) ++numDead;
+	gs.boundsSamples.erase( gs.boundsSamples.begin(), gs.boundsSamples.begin() + numDead );
+
+	// The channels are scaled over the lifetime by the factors of their curve or linear change
+	float maxMoveVel = maxf( fabsf( eff._moveVel.startMin ), fabsf( eff._moveVel.startMax ) ) *
+	                   eff._moveVel.getMaxFactor();
+	float maxDrag = maxf( fabsf( eff._drag.startMin ), fabsf( eff._drag.startMax ) ) *
+	                eff._drag.getMaxFactor();
+
+	bounds[0] = bounds[1] = bounds[2] = Math::MaxFloat;
+	bounds[3] = bounds[4] = bounds[5] = -Math::MaxFloat;
+	for( size_t i = 0, s = gs.boundsSamples.size(); i < s; ++i )
+	{
+		ParticleGPUBoundsSample &sample = gs.boundsSamples[i];
+		float age = minf( (float)(gs.time - sample.time), lifeMax );
+		float reach = age * (maxMoveVel + maxDrag * sample.emitterSpeed);
+		
+		for( uint32 c = 0; c < 3; ++c )
+		{
+			float shift = _force[c] * age;
+			bounds[c] = minf( bounds[c], sample.spawnMin[c] - reach + minf( shift, 0.0f ) );
+			bounds[c + 3] = maxf( bounds[c + 3], sample.spawnMax[c] + reach + maxf( shift, 0.0f ) );
+		}
+	}
+}
+
+
+int EmitterNode::getParticleData( int maxCount, float *positions, float *sizesAndRotations, float *colors )
+{
+	if( _gpuState == 0x0 )
+	{
+		uint32 count = std::min( (uint32)std::max( maxCount, 0 ), _aliveCount );
+		if( positions != 0x0 ) memcpy( positions, _parPositions, count * 3 * sizeof( float ) );
+		if( sizesAndRotations != 0x0 ) memcpy( sizesAndRotations, _parSizesANDRotations, count * 2 * sizeof( float ) );
+		if( colors != 0x0 ) memcpy( colors, _parColors, count * 4 * sizeof( float ) );
+		
+		return (int)_aliveCount;
+	}
+
+	// Run the recorded steps and read the slots back; free slots have no life left
+	ParticleGPUState &gs = *_gpuState;
+	Modules::renderer().simulateParticlesGPU( this );
+	if( gs.slotCount == 0 ) return 0;
+	
+	vector< float > data( gs.slotCount * 12 );
+	if( !gRDI->getBufferData( gs.stateBufs[gs.curStateBuf], 0, gs.slotCount * 12 * sizeof( float ), &data[0] ) )
+		return 0;
+	
+	int count = 0;
+	for( uint32 i = 0; i < gs.slotCount; ++i )
+	{
+		const float *src = &data[i * 12];
+		if( src[9] <= 0 ) continue;
+
+		if( count < maxCount )
+		{
+			if( positions != 0x0 )
+				for( uint32 c = 0; c < 3; ++c ) positions[count * 3 + c] = src[c];
+			if( sizesAndRotations != 0x0 )
+			{
+				sizesAndRotations[count * 2 + 0] = src[3];
+				sizesAndRotations[count * 2 + 1] = src[8];
+			}
+			if( colors != 0x0 )
+				for( uint32 c = 0; c < 4; ++c ) colors[count * 4 + c] = src[4 + c];
+		}
+		++count;
+	}
+
+	return count;
 }
 
 }  // namespace
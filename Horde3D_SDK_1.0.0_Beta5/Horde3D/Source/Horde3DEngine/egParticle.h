@@ -17,11 +17,13 @@
 #include "utMath.h"
 #include "egMaterial.h"
 #include "egScene.h"
+#include "egParticleSim.h"
 
 
 namespace Horde3D {
 
 class XMLNode;
+class CameraNode;
 
 
 // =================================================================================================
@@ -45,7 +47,8 @@ struct ParticleEffectResData
 		ChanStartMinF,
 		ChanStartMaxF,
 		ChanEndRateF,
-		ChanDragElem    // TODO: Move behind ChanRotVelElem
+		ChanDragElem,   // TODO: Move behind ChanRotVelElem
+		ChanCurveF
 	};
 };
 
@@ -53,12 +56,15 @@ struct ParticleEffectResData
 
 struct ParticleChannel
 {
-	float  startMin, startMax;
-	float  endRate;
+	float                 startMin, startMax;
+	float                 endRate;
+	std::vector< float >  curve;  // ParticleCurveSamples factors replacing endRate, or empty
 
 	ParticleChannel();
 	void reset();
 	bool parse( XMLNode &node );
+	void bakeLinearCurve();
+	float getMaxFactor() const;
 };
 
 // =================================================================================================
@@ -80,8 +86,12 @@ public:
 	float getElemParamF( int elem, int elemIdx, int param, int compIdx );
 	void setElemParamF( int elem, int elemIdx, int param, int compIdx, float value );
 
+	uint32 getCurveTex();
+
 private:
+	bool loadXML( const XMLDoc &doc );
 	bool raiseError( const std::string &msg, int line = -1 );
+	void updateCurveTable();
 
 private:
 	float            _lifeMin, _lifeMax;
@@ -89,7 +99,13 @@ private:
 	ParticleChannel  _size;
 	ParticleChannel  _colR, _colG, _colB, _colA;
 
+	std::vector< float >  _curveTable;  // See ParticleSimParams; empty without curves
+	uint32                _curveMask;
+	uint32                _curveTex;  // Curve table for the GPU simulation, created on demand
+	uint32                _curveVersion, _curveTexVersion;
+
 	friend class EmitterNode;
+	friend class Renderer;
 };
 
 typedef SmartResPtr< ParticleEffectResource > PParticleEffectResource;
@@ -110,7 +126,14 @@ struct EmitterNodeParams
 		DelayF,
 		EmissionRateF,
 		SpreadAngleF,
-		ForceF3
+		ForceF3,
+		SeedI,
+		GPUSimulationI,
+		DepthSortI,
+		LodDistF,
+		LodUpdateIntervalI,
+		LodCountScaleF,
+		CullFramesI
 	};
 };
 
@@ -124,34 +147,142 @@ struct EmitterNodeTpl : public SceneNodeTpl
 	int                      respawnCount;
 	float                    delay, emissionRate, spreadAngle;
 	float                    fx, fy, fz;
+	uint32                   seed;
+	bool                     hasSeed;  // Otherwise a seed is drawn from rand()
+	bool                     gpuSimulation;
+	bool                     depthSort;
+	float                    lodDist, lodCountScale;
+	uint32                   lodUpdateInterval, cullFrames;
 
 	EmitterNodeTpl( const std::string &name, MaterialResource *materialRes,
 		ParticleEffectResource *effectRes, uint32 maxParticleCount, int respawnCount) :
 		SceneNodeTpl( SceneNodeTypes::Emitter, name ),
 		matRes( materialRes ), effectRes( effectRes ), maxParticleCount( maxParticleCount ),
 		respawnCount( respawnCount ), delay( 0 ), emissionRate( 0 ), spreadAngle( 0 ),
-		fx( 0 ), fy( 0 ), fz( 0 )
+		fx( 0 ), fy( 0 ), fz( 0 ), seed( 0 ), hasSeed( false ), gpuSimulation( false ),
+		depthSort( false ), lodDist( 0 ), lodCountScale( 1 ), lodUpdateInterval( 1 ), cullFrames( 0 )
 	{
 	}
 };
 
 // =================================================================================================
 
-struct ParticleData
+// A step recorded by EmitterNode::update for an emitter that is simulated on the GPU
+struct ParticleGPUStep
 {
-	float   life, maxLife;
-	Vec3f   dir, dragVec;
-	uint32  respawnCounter;
-
-	// Start values
-	float  moveVel0, rotVel0, drag0;
-	float  size0;
-	float  r0, g0, b0, a0;
+	ParticleSimParams  params;
+	uint32             firstSpawn, spawnCount;
+	uint32             slotCount;
 };
 
+struct ParticleGPUBoundsSample
+{
+	double  time;
+	Vec3f   spawnMin, spawnMax;
+	float   emitterSpeed;
+};
+
+// Particle state of an emitter that is kept in GPU buffers and advanced with transform feedback by
+// Renderer::simulateParticlesGPU. The CPU only spawns particles and tracks when their slots become
+// free again, so it never touches the particles during their lifetime.
+struct ParticleGPUState
+{
+	// Steps that were not yet run on the GPU, with the data of the particles they spawn
+	std::vector< ParticleGPUStep >  steps;
+	std::vector< uint32 >           spawnSlots;
+	std::vector< float >            spawnAttribs;  // Constant attributes, 16 floats per particle
+	std::vector< float >            spawnStates;   // Render data as in the particle texture, 12 floats
+	std::vector< float >            spawnScratch;
+
+	// Slot allocation; both are min-heaps, so spawned particles get the lowest and mostly
+	// contiguous slots
+	std::vector< uint32 >                        freeSlots;
+	std::vector< std::pair< double, uint32 > >   deaths;  // Time of death and slot
+	uint32                                       slotCount;  // Live particles are in [0, slotCount)
+	double                                       time;
+
+	// Where particles spawned during the last maximal lifetime may be
+	std::vector< ParticleGPUBoundsSample >       boundsSamples;
+
+	uint32  stateBufs[2], curStateBuf;  // Render data of all slots, written by transform feedback
+	uint32  attribBuf;
+	uint32  capacity;
+
+	ParticleGPUState();
+	~ParticleGPUState();
+	void reset( uint32 particleCount );
+	void releaseBuffers();
+};
+
+
+// =================================================================================================
+// Particle Node
 // =================================================================================================
 
-class EmitterNode : public SceneNode
+// Base of the nodes that are rendered by Renderer::drawParticles. A derived node provides the
+// render data of its particles in world space, the renderer keeps the GPU resources made from it.
+class ParticleNode : public SceneNode
+{
+public:
+	~ParticleNode();
+
+	void captureRenderState();
+	uint32 getRenderCount() const { return _inSnapshot ? _snapAliveCount : _aliveCount; }
+	uint32 getRenderDataVersion() const { return _inSnapshot ? _snapDataVersion : _parDataVersion; }
+	const float *getRenderPositions() const { return _inSnapshot ? _snapPositions : _parPositions; }
+	const float *getRenderSizesAndRotations() const
+		{ return _inSnapshot ? _snapSizesANDRotations : _parSizesANDRotations; }
+	const float *getRenderColors() const { return _inSnapshot ? _snapColors : _parColors; }
+
+protected:
+	ParticleNode( const SceneNodeTpl &tpl );
+	static uint32 newRandomSeed();
+	void allocRenderData( uint32 count );
+	bool detachSnapshotData();
+
+protected:
+	PMaterialResource        _materialRes;
+
+	// Render data of the first _aliveCount particles, allocated by the derived node with
+	// allocRenderData. The second set of arrays is only used when the node is updated in the
+	// background, see detachSnapshotData.
+	uint32                   _aliveCount;
+	float                    *_parPositions;
+	float                    *_parSizesANDRotations;
+	float                    *_parColors;
+	float                    *_parBackPositions, *_parBackSizesANDRotations, *_parBackColors;
+	uint32                   _parCapacity;
+	uint32                   _parBuffer;  // Index of the current set of arrays
+
+	// Render data that is rendered while the node is in the snapshot
+	uint32                   _snapAliveCount, _snapDataVersion;
+	const float              *_snapPositions, *_snapSizesANDRotations, *_snapColors;
+
+	ParticleGPUState         *_gpuState;  // Only for emitters that are simulated on the GPU
+
+	// Render data in a float texture, see Renderer::uploadParticleTex
+	uint32                   _parTex, _parTexHeight;
+	uint32                   _parTexVersion, _parDataVersion;
+
+	// Back-to-front order for the current camera, see Renderer::sortParticles
+	bool                     _depthSort;
+	ParticleDepthOrder       _depthOrder;
+	const CameraNode         *_sortCamera;
+	uint32                   _sortFrame, _sortDataVersion;
+	uint32                   _depthOrderVersion;
+	uint32                   _parOrderVBO, _parOrderVBOSize;  // Particle quads in sorted order
+	uint32                   _parOrderVBOVersion;
+
+	std::vector< uint32 >    _occQueries;
+	std::vector< uint32 >    _lastVisited;
+
+	friend class SceneManager;
+	friend class Renderer;
+};
+
+// =================================================================================================
+
+class EmitterNode : public ParticleNode
 {
 public:
 	static SceneNodeTpl *parsingFunc( std::map< std::string, std::string > &attribs );
@@ -167,31 +298,73 @@ public:
 	void update( float timeDelta );
 	bool hasFinished();
 
+	// Phases of update, used by FrameManager::updateEmitters to run the particle work of many
+	// emitters in parallel. beginUpdate touches the scene graph and must run serially; it returns
+	// false if there is nothing to simulate. The other phases only access data of this emitter,
+	// simulate may also run concurrently on disjoint particle ranges of the same emitter.
+	bool beginUpdate( float timeDelta );
+	void spawnPending();
+	void simulate( uint32 first, uint32 count, float *bounds );
+	void endUpdate( const float *bounds );
+
+	uint32 getAliveCount() const { return _aliveCount; }
+	bool isSimulatedOnGPU() const { return _gpuState != 0x0; }
+	int getParticleData( int maxCount, float *positions, float *sizesAndRotations, float *colors );
+	void markVisible( const Vec3f &viewPoint );
+
+	void captureRenderState();
+	void releaseRenderState();
+
+public:
+	static ParticleSimFunc     simulateFunc;  // Particle kernels selected at init
+	static ParticleRandomFunc  randomFunc;
+
 protected:
 	EmitterNode( const EmitterNodeTpl &emitterTpl );
 	void setMaxParticleCount( uint32 maxParticleCount );
+	ParticleStreams getStreams();
+	void spawnParticles( const ParticleStreams &streams, uint32 count, const Vec3f &motionVec,
+	                     float stepWidth, float timeDelta );
+	bool setGPUSimulation( bool enabled );
+	bool applyLod( float &timeDelta, float &countScale );
+	void recordGPUStep();
+	void estimateGPUBounds( float *bounds );
 
 protected:
 	// Emitter data
 	float                    _emissionAccum;
 	Matrix4f                 _prevAbsTrans;
+
+	// Current step, set up by beginUpdate
+	ParticleSimParams        _stepParams;
+	Vec3f                    _stepMotionVec;
+	float                    _stepWidth;
+	uint32                   _stepSpawnCount;
+	uint32                   _stepCopyCount;  // Particles that are taken over from the snapshot arrays
 	
 	// Emitter params
-	PMaterialResource        _materialRes;
 	PParticleEffectResource  _effectRes;
 	uint32                   _particleCount;
 	int                      _respawnCount;
 	float                    _delay, _emissionRate, _spreadAngle;
 	Vec3f                    _force;
-
-	// Particle data
-	ParticleData             *_particles;
-	float                    *_parPositions;
-	float                    *_parSizesANDRotations;
-	float                    *_parColors;
-
-	std::vector< uint32 >    _occQueries;
-	std::vector< uint32 >    _lastVisited;
+	uint32                   _seed;
+	uint64                   _randomCounter;  // Spawn index of the next particle in the random stream
+
+	// Level of detail; the visibility is recorded by SpatialGraph::updateQueues
+	float                    _lodDist, _lodCountScale;
+	uint32                   _lodUpdateInterval, _cullFrames;
+	uint32                   _lodSkippedSteps;
+	float                    _lodSkippedTime;
+	uint32                   _visibleFrame;  // Renderer frame in which the bounds last passed culling
+	float                    _visibleDist;   // Distance to the nearest camera in that frame
+	uint32                   _snapVisibleFrame;  // Visibility recorded while the emitter is in the snapshot
+	float                    _snapVisibleDist;
+	uint32                   _snapFrameID;  // Renderer frame in which the snapshot was taken
+
+	// Particle data; live particles are kept in front of the arrays
+	uint64                   _spawnedCount;  // Limited to _particleCount * _respawnCount
+	float                    *_parState;     // Simulation state, see ParticleStateChannels
 
 	friend class SceneManager;
 	friend class Renderer;
@@ -0,0 +1,757 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egParticleSim.h"
+#include "utSIMD.h"
+#include <cstring>
+#include <algorithm>
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+// The start values of a particle are scaled linearly over its lifetime: value0 * (1 + rate * fac)
+// with fac going from 0 at birth to 1 at death, or by the curve sample for fac
+
+// =================================================================================================
+// Scalar kernel
+// =================================================================================================
+
+static inline float scaleOverLife( float value0, uint32 chan, const float *factors, uint32 curveMask,
+                                   float rate, float fac )
+{
+	return value0 * ((curveMask & (1 << chan)) != 0 ? factors[chan] : 1.0f + rate * fac);
+}
+
+
+static void simulateParticlesScalar( const ParticleStreams &s, uint32 count,
+                                     const ParticleSimParams &params, float *bounds )
+{
+	float *life = s.channel( ParticleStateChannels::Life );
+	const float *invMaxLife = s.channel( ParticleStateChannels::InvMaxLife );
+	const float *moveVel0 = s.channel( ParticleStateChannels::MoveVel0 );
+	const float *rotVel0 = s.channel( ParticleStateChannels::RotVel0 );
+	const float *drag0 = s.channel( ParticleStateChannels::Drag0 );
+	const float *size0 = s.channel( ParticleStateChannels::Size0 );
+	const float *dir[3], *dragVec[3], *col0[4];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		dir[c] = s.channel( ParticleStateChannels::DirX + c );
+		dragVec[c] = s.channel( ParticleStateChannels::DragX + c );
+	}
+	for( uint32 c = 0; c < 4; ++c ) col0[c] = s.channel( ParticleStateChannels::ColR0 + c );
+
+	uint32 curveMask = params.curveMask;
+
+	float bmin[3] = { bounds[0], bounds[1], bounds[2] };
+	float bmax[3] = { bounds[3], bounds[4], bounds[5] };
+	float rotScale = degToRad( params.timeDelta );
+
+	for( uint32 i = 0; i < count; ++i )
+	{
+		float fac = 1.0f - life[i] * invMaxLife[i];
+		const float *factors = curveMask != 0 ?
+			params.curveTable + getParticleCurveSample( fac ) * ParticleCurveChannels::Count : 0x0;
+
+		float moveVel = scaleOverLife( moveVel0[i], ParticleCurveChannels::MoveVel, factors, curveMask,
+		                               params.moveVelRate, fac );
+		float rotVel = scaleOverLife( rotVel0[i], ParticleCurveChannels::RotVel, factors, curveMask,
+		                              params.rotVelRate, fac );
+		float drag = scaleOverLife( drag0[i], ParticleCurveChannels::Drag, factors, curveMask, params.dragRate, fac );
+
+		// Size is doubled to keep compatibility with old particle vertex shader
+		s.sizesAndRotations[i * 2 + 0] =
+			scaleOverLife( size0[i], ParticleCurveChannels::Size, factors, curveMask, params.sizeRate, fac ) * 2;
+		s.sizesAndRotations[i * 2 + 1] += rotVel * rotScale;
+		for( uint32 c = 0; c < 4; ++c )
+		{
+			s.colors[i * 4 + c] = scaleOverLife( col0[c][i], ParticleCurveChannels::ColR + c, factors, curveMask,
+			                                     params.colRate[c], fac );
+		}
+
+		life[i] -= params.timeDelta;
+		bool alive = life[i] > 0;
+
+		for( uint32 c = 0; c < 3; ++c )
+		{
+			float pos = s.positions[i * 3 + c] +
+				(dir[c][i] * moveVel + dragVec[c][i] * drag + params.force[c]) * params.timeDelta;
+			s.positions[i * 3 + c] = pos;
+			if( alive )
+			{
+				bmin[c] = minf( bmin[c], pos );
+				bmax[c] = maxf( bmax[c], pos );
+			}
+		}
+	}
+
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		bounds[c] = bmin[c];
+		bounds[c + 3] = bmax[c];
+	}
+}
+
+
+// =================================================================================================
+// SSE2 kernel
+// =================================================================================================
+
+#if defined( SIMD_SSE2 )
+
+SIMD_SSE2_FUNC static inline __m128 scaleOverLifeSSE2( const float *value0, uint32 i, float rate, __m128 fac,
+                                                       __m128 curveFactor, __m128 curveMask )
+{
+	__m128 factor = _mm_add_ps( _mm_set1_ps( 1.0f ), _mm_mul_ps( _mm_set1_ps( rate ), fac ) );
+	factor = _mm_or_ps( _mm_and_ps( curveMask, curveFactor ), _mm_andnot_ps( curveMask, factor ) );
+	return _mm_mul_ps( _mm_loadu_ps( value0 + i ), factor );
+}
+
+
+// Reads the table rows of four particles and transposes them into one vector per channel
+SIMD_SSE2_FUNC static inline void loadCurveFactorsSSE2( const float *table, __m128 fac, __m128 *factors )
+{
+	__m128 f = _mm_min_ps( _mm_max_ps( fac, _mm_setzero_ps() ), _mm_set1_ps( 1.0f ) );
+	f = _mm_add_ps( _mm_mul_ps( f, _mm_set1_ps( (float)(ParticleCurveSamples - 1) ) ), _mm_set1_ps( 0.5f ) );
+	uint32 samples[4];
+	_mm_storeu_si128( (__m128i *)samples, _mm_cvttps_epi32( f ) );
+
+	for( uint32 half = 0; half < ParticleCurveChannels::Count; half += 4 )
+	{
+		__m128 *v = factors + half;
+		for( uint32 k = 0; k < 4; ++k )
+			v[k] = _mm_loadu_ps( table + samples[k] * ParticleCurveChannels::Count + half );
+		_MM_TRANSPOSE4_PS( v[0], v[1], v[2], v[3] );
+	}
+}
+
+
+SIMD_SSE2_FUNC static void simulateParticlesSSE2( const ParticleStreams &s, uint32 count,
+                                                  const ParticleSimParams &params, float *bounds )
+{
+	float *life = s.channel( ParticleStateChannels::Life );
+	const float *invMaxLife = s.channel( ParticleStateChannels::InvMaxLife );
+	const float *dirX = s.channel( ParticleStateChannels::DirX );
+	const float *dirY = s.channel( ParticleStateChannels::DirY );
+	const float *dirZ = s.channel( ParticleStateChannels::DirZ );
+	const float *dragX = s.channel( ParticleStateChannels::DragX );
+	const float *dragY = s.channel( ParticleStateChannels::DragY );
+	const float *dragZ = s.channel( ParticleStateChannels::DragZ );
+
+	__m128 one = _mm_set1_ps( 1.0f );
+	__m128 curveFactors[ParticleCurveChannels::Count], curveMasks[ParticleCurveChannels::Count];
+	for( uint32 c = 0; c < ParticleCurveChannels::Count; ++c )
+	{
+		curveFactors[c] = one;
+		curveMasks[c] = _mm_castsi128_ps( _mm_set1_epi32( (params.curveMask & (1 << c)) != 0 ? -1 : 0 ) );
+	}
+	__m128 dt = _mm_set1_ps( params.timeDelta );
+	__m128 rotScale = _mm_set1_ps( degToRad( params.timeDelta ) );
+	__m128 fx = _mm_set1_ps( params.force[0] );
+	__m128 fy = _mm_set1_ps( params.force[1] );
+	__m128 fz = _mm_set1_ps( params.force[2] );
+
+	// Positions are interleaved, so lane k of the j-th accumulator holds component (4 * j + k) % 3
+	__m128 bmin[3], bmax[3];
+	for( uint32 j = 0; j < 3; ++j )
+	{
+		bmin[j] = _mm_set1_ps( Math::MaxFloat );
+		bmax[j] = _mm_set1_ps( -Math::MaxFloat );
+	}
+
+	uint32 i = 0;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128 l = _mm_loadu_ps( life + i );
+		__m128 fac = _mm_sub_ps( one, _mm_mul_ps( l, _mm_loadu_ps( invMaxLife + i ) ) );
+		if( params.curveMask != 0 ) loadCurveFactorsSSE2( params.curveTable, fac, curveFactors );
+
+		__m128 moveVel = scaleOverLifeSSE2( s.channel( ParticleStateChannels::MoveVel0 ), i, params.moveVelRate, fac,
+		                                    curveFactors[ParticleCurveChannels::MoveVel],
+		                                    curveMasks[ParticleCurveChannels::MoveVel] );
+		__m128 rotVel = scaleOverLifeSSE2( s.channel( ParticleStateChannels::RotVel0 ), i, params.rotVelRate, fac,
+		                                   curveFactors[ParticleCurveChannels::RotVel],
+		                                   curveMasks[ParticleCurveChannels::RotVel] );
+		__m128 drag = scaleOverLifeSSE2( s.channel( ParticleStateChannels::Drag0 ), i, params.dragRate, fac,
+		                                 curveFactors[ParticleCurveChannels::Drag], curveMasks[ParticleCurveChannels::Drag] );
+		__m128 size = scaleOverLifeSSE2( s.channel( ParticleStateChannels::Size0 ), i, params.sizeRate, fac,
+		                                 curveFactors[ParticleCurveChannels::Size], curveMasks[ParticleCurveChannels::Size] );
+		size = _mm_add_ps( size, size );
+
+		// Velocities of the four particles
+		__m128 vx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( dirX + i ), moveVel ),
+		                                    _mm_mul_ps( _mm_loadu_ps( dragX + i ), drag ) ), fx );
+		__m128 vy = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( dirY + i ), moveVel ),
+		                                    _mm_mul_ps( _mm_loadu_ps( dragY + i ), drag ) ), fy );
+		__m128 vz = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( dirZ + i ), moveVel ),
+		                                    _mm_mul_ps( _mm_loadu_ps( dragZ + i ), drag ) ), fz );
+		vx = _mm_mul_ps( vx, dt );
+		vy = _mm_mul_ps( vy, dt );
+		vz = _mm_mul_ps( vz, dt );
+
+		// Interleave to x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+		__m128 xy01 = _mm_unpacklo_ps( vx, vy );
+		__m128 xy23 = _mm_unpackhi_ps( vx, vy );
+		__m128 t0 = _mm_shuffle_ps( vz, xy01, _MM_SHUFFLE( 2, 2, 0, 0 ) );
+		__m128 t1 = _mm_shuffle_ps( xy01, vz, _MM_SHUFFLE( 1, 1, 3, 3 ) );
+		__m128 t2 = _mm_shuffle_ps( vz, xy23, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+		__m128 t3 = _mm_shuffle_ps( xy23, vz, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		__m128 v[3];
+		v[0] = _mm_shuffle_ps( xy01, t0, _MM_SHUFFLE( 2, 0, 1, 0 ) );
+		v[1] = _mm_shuffle_ps( t1, xy23, _MM_SHUFFLE( 1, 0, 2, 0 ) );
+		v[2] = _mm_shuffle_ps( t2, t3, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+
+		// Particles that die in this step don't extend the bounds; the alive mask is spread like
+		// the positions to m0 m0 m0 m1 | m1 m1 m2 m2 | m2 m3 m3 m3
+		__m128 newLife = _mm_sub_ps( l, dt );
+		__m128 alive = _mm_cmpgt_ps( newLife, _mm_setzero_ps() );
+		__m128 mask[3];
+		mask[0] = _mm_shuffle_ps( alive, alive, _MM_SHUFFLE( 1, 0, 0, 0 ) );
+		mask[1] = _mm_shuffle_ps( alive, alive, _MM_SHUFFLE( 2, 2, 1, 1 ) );
+		mask[2] = _mm_shuffle_ps( alive, alive, _MM_SHUFFLE( 3, 3, 3, 2 ) );
+
+		float *pos = s.positions + i * 3;
+		for( uint32 j = 0; j < 3; ++j )
+		{
+			__m128 p = _mm_add_ps( _mm_loadu_ps( pos + j * 4 ), v[j] );
+			_mm_storeu_ps( pos + j * 4, p );
+			// Dead lanes are replaced by the accumulator itself, which needs no extra registers
+			bmin[j] = _mm_min_ps( bmin[j], _mm_xor_ps( bmin[j], _mm_and_ps( _mm_xor_ps( p, bmin[j] ), mask[j] ) ) );
+			bmax[j] = _mm_max_ps( bmax[j], _mm_xor_ps( bmax[j], _mm_and_ps( _mm_xor_ps( p, bmax[j] ), mask[j] ) ) );
+		}
+
+		// Sizes and rotations are stored as pairs
+		float *sizeRot = s.sizesAndRotations + i * 2;
+		__m128 sr01 = _mm_loadu_ps( sizeRot );
+		__m128 sr23 = _mm_loadu_ps( sizeRot + 4 );
+		__m128 rot = _mm_shuffle_ps( sr01, sr23, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+		rot = _mm_add_ps( rot, _mm_mul_ps( rotVel, rotScale ) );
+		_mm_storeu_ps( sizeRot, _mm_unpacklo_ps( size, rot ) );
+		_mm_storeu_ps( sizeRot + 4, _mm_unpackhi_ps( size, rot ) );
+
+		__m128 col[4];
+		for( uint32 c = 0; c < 4; ++c )
+		{
+			col[c] = scaleOverLifeSSE2( s.channel( ParticleStateChannels::ColR0 + c ), i, params.colRate[c], fac,
+			                            curveFactors[ParticleCurveChannels::ColR + c],
+			                            curveMasks[ParticleCurveChannels::ColR + c] );
+		}
+		_MM_TRANSPOSE4_PS( col[0], col[1], col[2], col[3] );
+		for( uint32 c = 0; c < 4; ++c )
+			_mm_storeu_ps( s.colors + (i + c) * 4, col[c] );
+
+		_mm_storeu_ps( life + i, newLife );
+	}
+
+	float mins[3][4], maxs[3][4];
+	for( uint32 j = 0; j < 3; ++j )
+	{
+		_mm_storeu_ps( mins[j], bmin[j] );
+		_mm_storeu_ps( maxs[j], bmax[j] );
+	}
+	for( uint32 j = 0; j < 3; ++j )
+	{
+		for( uint32 k = 0; k < 4; ++k )
+		{
+			uint32 c = (j * 4 + k) % 3;
+			bounds[c] = minf( bounds[c], mins[j][k] );
+			bounds[c + 3] = maxf( bounds[c + 3], maxs[j][k] );
+		}
+	}
+
+	if( i < count ) simulateParticlesScalar( s.offset( i ), count - i, params, bounds );
+}
+
+#endif
+
+
+// =================================================================================================
+// NEON kernel
+// =================================================================================================
+
+#if defined( SIMD_NEON )
+
+static inline float32x4_t scaleOverLifeNEON( const float *value0, uint32 i, float rate, float32x4_t fac,
+                                             float32x4_t curveFactor, uint32x4_t curveMask )
+{
+	float32x4_t factor = vbslq_f32( curveMask, curveFactor, vmlaq_n_f32( vdupq_n_f32( 1.0f ), fac, rate ) );
+	return vmulq_f32( vld1q_f32( value0 + i ), factor );
+}
+
+
+static inline void loadCurveFactorsNEON( const float *table, float32x4_t fac, float32x4_t *factors )
+{
+	float32x4_t f = vminq_f32( vmaxq_f32( fac, vdupq_n_f32( 0.0f ) ), vdupq_n_f32( 1.0f ) );
+	uint32 samples[4];
+	vst1q_u32( samples, vcvtq_u32_f32( vmlaq_n_f32( vdupq_n_f32( 0.5f ), f, (float)(ParticleCurveSamples - 1) ) ) );
+
+	for( uint32 half = 0; half < ParticleCurveChannels::Count; half += 4 )
+	{
+		float32x4_t r[4];
+		for( uint32 k = 0; k < 4; ++k )
+			r[k] = vld1q_f32( table + samples[k] * ParticleCurveChannels::Count + half );
+		float32x4x2_t t01 = vtrnq_f32( r[0], r[1] ), t23 = vtrnq_f32( r[2], r[3] );
+		factors[half + 0] = vcombine_f32( vget_low_f32( t01.val[0] ), vget_low_f32( t23.val[0] ) );
+		factors[half + 1] = vcombine_f32( vget_low_f32( t01.val[1] ), vget_low_f32( t23.val[1] ) );
+		factors[half + 2] = vcombine_f32( vget_high_f32( t01.val[0] ), vget_high_f32( t23.val[0] ) );
+		factors[half + 3] = vcombine_f32( vget_high_f32( t01.val[1] ), vget_high_f32( t23.val[1] ) );
+	}
+}
+
+
+static void simulateParticlesNEON( const ParticleStreams &s, uint32 count,
+                                   const ParticleSimParams &params, float *bounds )
+{
+	float *life = s.channel( ParticleStateChannels::Life );
+	const float *invMaxLife = s.channel( ParticleStateChannels::InvMaxLife );
+	float32x4_t one = vdupq_n_f32( 1.0f );
+	float32x4_t curveFactors[ParticleCurveChannels::Count];
+	uint32x4_t curveMasks[ParticleCurveChannels::Count];
+	for( uint32 c = 0; c < ParticleCurveChannels::Count; ++c )
+	{
+		curveFactors[c] = one;
+		curveMasks[c] = vdupq_n_u32( (params.curveMask & (1 << c)) != 0 ? 0xFFFFFFFF : 0 );
+	}
+	float32x4_t maxFloat = vdupq_n_f32( Math::MaxFloat );
+	float32x4_t minFloat = vdupq_n_f32( -Math::MaxFloat );
+	float32x4_t dt = vdupq_n_f32( params.timeDelta );
+	float rotScale = degToRad( params.timeDelta );
+
+	float32x4_t bmin[3], bmax[3];
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		bmin[c] = maxFloat;
+		bmax[c] = minFloat;
+	}
+
+	uint32 i = 0;
+	for( ; i + 4 <= count; i += 4 )
+	{
+		float32x4_t l = vld1q_f32( life + i );
+		float32x4_t fac = vmlsq_f32( one, l, vld1q_f32( invMaxLife + i ) );
+		if( params.curveMask != 0 ) loadCurveFactorsNEON( params.curveTable, fac, curveFactors );
+
+		float32x4_t moveVel = scaleOverLifeNEON( s.channel( ParticleStateChannels::MoveVel0 ), i, params.moveVelRate, fac,
+		                                         curveFactors[ParticleCurveChannels::MoveVel],
+		                                         curveMasks[ParticleCurveChannels::MoveVel] );
+		float32x4_t rotVel = scaleOverLifeNEON( s.channel( ParticleStateChannels::RotVel0 ), i, params.rotVelRate, fac,
+		                                        curveFactors[ParticleCurveChannels::RotVel],
+		                                        curveMasks[ParticleCurveChannels::RotVel] );
+		float32x4_t drag = scaleOverLifeNEON( s.channel( ParticleStateChannels::Drag0 ), i, params.dragRate, fac,
+		                                      curveFactors[ParticleCurveChannels::Drag],
+		                                      curveMasks[ParticleCurveChannels::Drag] );
+		float32x4_t size = scaleOverLifeNEON( s.channel( ParticleStateChannels::Size0 ), i, params.sizeRate, fac,
+		                                      curveFactors[ParticleCurveChannels::Size],
+		                                      curveMasks[ParticleCurveChannels::Size] );
+
+		// Particles that die in this step don't extend the bounds
+		float32x4_t newLife = vsubq_f32( l, dt );
+		uint32x4_t alive = vcgtq_f32( newLife, vdupq_n_f32( 0.0f ) );
+
+		// Structure loads and stores take care of the interleaved render data
+		float32x4x3_t pos = vld3q_f32( s.positions + i * 3 );
+		for( uint32 c = 0; c < 3; ++c )
+		{
+			float32x4_t v = vmulq_f32( vld1q_f32( s.channel( ParticleStateChannels::DirX + c ) + i ), moveVel );
+			v = vmlaq_f32( v, vld1q_f32( s.channel( ParticleStateChannels::DragX + c ) + i ), drag );
+			v = vaddq_f32( v, vdupq_n_f32( params.force[c] ) );
+			pos.val[c] = vmlaq_f32( pos.val[c], v, dt );
+			bmin[c] = vminq_f32( bmin[c], vbslq_f32( alive, pos.val[c], maxFloat ) );
+			bmax[c] = vmaxq_f32( bmax[c], vbslq_f32( alive, pos.val[c], minFloat ) );
+		}
+		vst3q_f32( s.positions + i * 3, pos );
+
+		float32x4x2_t sizeRot = vld2q_f32( s.sizesAndRotations + i * 2 );
+		sizeRot.val[0] = vaddq_f32( size, size );
+		sizeRot.val[1] = vmlaq_n_f32( sizeRot.val[1], rotVel, rotScale );
+		vst2q_f32( s.sizesAndRotations + i * 2, sizeRot );
+
+		float32x4x4_t col;
+		for( uint32 c = 0; c < 4; ++c )
+		{
+			col.val[c] = scaleOverLifeNEON( s.channel( ParticleStateChannels::ColR0 + c ), i, params.colRate[c], fac,
+			                                curveFactors[ParticleCurveChannels::ColR + c],
+			                                curveMasks[ParticleCurveChannels::ColR + c] );
+		}
+		vst4q_f32( s.colors + i * 4, col );
+
+		vst1q_f32( life + i, newLife );
+	}
+
+	for( uint32 c = 0; c < 3; ++c )
+	{
+		float mins[4], maxs[4];
+		vst1q_f32( mins, bmin[c] );
+		vst1q_f32( maxs, bmax[c] );
+		for( uint32 k = 0; k < 4; ++k )
+		{
+			bounds[c] = minf( bounds[c], mins[k] );
+			bounds[c + 3] = maxf( bounds[c + 3], maxs[k] );
+		}
+	}
+
+	if( i < count ) simulateParticlesScalar( s.offset( i ), count - i, params, bounds );
+}
+
+#endif
+
+
+// =================================================================================================
+// Random numbers
+// =================================================================================================
+
+// Constants of Philox2x32 as given by Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"
+static const uint32 PhiloxMultiplier = 0xD256D193;
+static const uint32 PhiloxKeyIncrement = 0x9E3779B9;
+static const uint32 PhiloxRounds = 10;
+
+// Each Philox block yields two values; the first counter word is the spawn index, the second one
+// the block index combined with the upper bits of the spawn index
+static const uint32 RandomBlockBits = 3;
+
+// 24 random bits are converted exactly, so that all kernels produce identical values
+static const float RandomScale = 1.0f / 16777216.0f;
+
+
+static inline void philoxRounds( uint32 key, uint32 &ctr0, uint32 &ctr1 )
+{
+	for( uint32 r = 0; r < PhiloxRounds; ++r )
+	{
+		uint64 prod = (uint64)PhiloxMultiplier * ctr0;
+		ctr0 = (uint32)(prod >> 32) ^ key ^ ctr1;
+		ctr1 = (uint32)prod;
+		key += PhiloxKeyIncrement;
+	}
+}
+
+
+void philox2x32( uint32 key, uint32 &ctr0, uint32 &ctr1 )
+{
+	philoxRounds( key, ctr0, ctr1 );
+}
+
+
+static void generateRandomScalar( uint32 seed, uint64 first, uint32 count, uint32 numValues,
+                                  float *values, uint32 stride )
+{
+	ASSERT( numValues <= MaxParticleRandomValues );
+	uint32 numBlocks = (numValues + 1) / 2;
+	
+	for( uint32 i = 0; i < count; ++i )
+	{
+		uint64 index = first + i;
+		
+		for( uint32 b = 0; b < numBlocks; ++b )
+		{
+			uint32 ctr0 = (uint32)index;
+			uint32 ctr1 = b | ((uint32)(index >> 32) << RandomBlockBits);
+			philoxRounds( seed, ctr0, ctr1 );
+
+			values[(b * 2) * stride + i] = (float)(ctr0 >> 8) * RandomScale;
+			if( b * 2 + 1 < numValues )
+				values[(b * 2 + 1) * stride + i] = (float)(ctr1 >> 8) * RandomScale;
+		}
+	}
+}
+
+
+#if defined( SIMD_SSE2 )
+
+// Four particles form a group; _mm_mul_epu32 provides the 32x32 to 64 bit products Philox is built
+// on, for two lanes per instruction. The rounds of a group depend on each other, so several groups
+// are interleaved to hide the latency of the multiplications
+template< uint32 NumGroups >
+SIMD_SSE2_FUNC static inline void generateRandomGroupsSSE2( uint32 seed, uint64 first, uint32 numValues,
+                                                            float *values, uint32 stride )
+{
+	const __m128i mul = _mm_set1_epi32( (int)PhiloxMultiplier );
+	const __m128i lowMask = _mm_set1_epi64x( 0xFFFFFFFF );
+	const __m128 scale = _mm_set1_ps( RandomScale );
+	uint32 numBlocks = (numValues + 1) / 2;
+	__m128i low[NumGroups], high[NumGroups];
+
+	for( uint32 g = 0; g < NumGroups; ++g )
+	{
+		uint64 index = first + g * 4;
+		uint32 indexHigh[4];
+		for( uint32 k = 0; k < 4; ++k ) indexHigh[k] = (uint32)((index + k) >> 32) << RandomBlockBits;
+		high[g] = _mm_setr_epi32( (int)indexHigh[0], (int)indexHigh[1], (int)indexHigh[2], (int)indexHigh[3] );
+		low[g] = _mm_add_epi32( _mm_set1_epi32( (int)(uint32)index ), _mm_setr_epi32( 0, 1, 2, 3 ) );
+	}
+
+	for( uint32 b = 0; b < numBlocks; ++b )
+	{
+		__m128i ctr0[NumGroups], ctr1[NumGroups];
+		for( uint32 g = 0; g < NumGroups; ++g )
+		{
+			ctr0[g] = low[g];
+			ctr1[g] = _mm_or_si128( high[g], _mm_set1_epi32( (int)b ) );
+		}
+		uint32 key = seed;
+
+		for( uint32 r = 0; r < PhiloxRounds; ++r )
+		{
+			__m128i keyVec = _mm_set1_epi32( (int)key );
+			for( uint32 g = 0; g < NumGroups; ++g )
+			{
+				// Products of the even lanes are shifted and masked into place instead of being shuffled,
+				// shuffles compete for a single port on many processors
+				__m128i prod02 = _mm_mul_epu32( ctr0[g], mul );
+				__m128i prod13 = _mm_mul_epu32( _mm_srli_epi64( ctr0[g], 32 ), mul );
+				__m128i prodLow = _mm_or_si128( _mm_and_si128( prod02, lowMask ), _mm_slli_epi64( prod13, 32 ) );
+				__m128i prodHigh = _mm_or_si128( _mm_srli_epi64( prod02, 32 ), _mm_andnot_si128( lowMask, prod13 ) );
+				
+				ctr0[g] = _mm_xor_si128( _mm_xor_si128( prodHigh, keyVec ), ctr1[g] );
+				ctr1[g] = prodLow;
+			}
+			key += PhiloxKeyIncrement;
+		}
+
+		for( uint32 g = 0; g < NumGroups; ++g )
+		{
+			_mm_storeu_ps( values + (b * 2) * stride + g * 4,
+			               _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( ctr0[g], 8 ) ), scale ) );
+			if( b * 2 + 1 < numValues )
+				_mm_storeu_ps( values + (b * 2 + 1) * stride + g * 4,
+				               _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( ctr1[g], 8 ) ), scale ) );
+		}
+	}
+}
+
+
+SIMD_SSE2_FUNC static void generateRandomSSE2( uint32 seed, uint64 first, uint32 count, uint32 numValues,
+                                               float *values, uint32 stride )
+{
+	uint32 i = 0;
+	for( ; i + 16 <= count; i += 16 )
+		generateRandomGroupsSSE2< 4 >( seed, first + i, numValues, values + i, stride );
+	for( ; i + 4 <= count; i += 4 )
+		generateRandomGroupsSSE2< 1 >( seed, first + i, numValues, values + i, stride );
+
+	if( i < count ) generateRandomScalar( seed, first + i, count - i, numValues, values + i, stride );
+}
+
+#endif
+
+
+// =================================================================================================
+// Live range compaction
+// =================================================================================================
+
+uint32 removeDeadParticles( const ParticleStreams &s, uint32 count )
+{
+	const float *life = s.channel( ParticleStateChannels::Life );
+
+	uint32 i = 0;
+	while( i < count )
+	{
+		if( life[i] > 0 )
+		{
+			++i;
+			continue;
+		}
+
+		// The moved particle can be dead as well, so slot i is checked again
+		if( i == --count ) break;
+		for( uint32 c = 0; c < ParticleStateChannels::Count; ++c )
+			s.state[c * s.stride + i] = s.state[c * s.stride + count];
+		memcpy( s.positions + i * 3, s.positions + count * 3, 3 * sizeof( float ) );
+		memcpy( s.sizesAndRotations + i * 2, s.sizesAndRotations + count * 2, 2 * sizeof( float ) );
+		memcpy( s.colors + i * 4, s.colors + count * 4, 4 * sizeof( float ) );
+	}
+
+	return count;
+}
+
+
+// =================================================================================================
+// Depth sorting
+// =================================================================================================
+
+// The insertion sort gives up after this many moves per particle and the radix sort takes over
+static const uint32 MaxInsertionMovesPerParticle = 2;
+
+
+static bool insertionSortKeys( uint16 *keys, uint32 *order, uint32 count, uint32 maxMoves )
+{
+	uint32 moves = 0;
+	
+	for( uint32 i = 1; i < count; ++i )
+	{
+		uint16 key = keys[i];
+		if( key >= keys[i - 1] ) continue;
+
+		uint32 index = order[i], j = i;
+		do
+		{
+			keys[j] = keys[j - 1];
+			order[j] = order[j - 1];
+			--j;
+		} while( j > 0 && key < keys[j - 1] );
+		keys[j] = key;
+		order[j] = index;
+
+		// Keys and order stay consistent when giving up, so the radix sort can continue from here
+		moves += i - j;
+		if( moves > maxMoves ) return false;
+	}
+
+	return true;
+}
+
+
+static void radixSortKeys( ParticleDepthOrder &o, uint32 count )
+{
+	for( uint32 shift = 0; shift < 16; shift += 8 )
+	{
+		uint32 offsets[256];
+		memset( offsets, 0, sizeof( offsets ) );
+		for( uint32 i = 0; i < count; ++i ) ++offsets[(o.keys[i] >> shift) & 255];
+		
+		// Skip passes where all keys have the same digit, e.g. for flat emitters
+		if( offsets[(o.keys[0] >> shift) & 255] == count ) continue;
+		
+		for( uint32 b = 0, sum = 0; b < 256; ++b )
+		{
+			uint32 n = offsets[b];
+			offsets[b] = sum;
+			sum += n;
+		}
+
+		for( uint32 i = 0; i < count; ++i )
+		{
+			uint32 dst = offsets[(o.keys[i] >> shift) & 255]++;
+			o.tmpKeys[dst] = o.keys[i];
+			o.tmpOrder[dst] = o.order[i];
+		}
+		o.keys.swap( o.tmpKeys );
+		o.order.swap( o.tmpOrder );
+	}
+}
+
+
+void sortParticlesByDepth( const float *positions, uint32 count, const Vec3f &viewDir,
+                           ParticleDepthOrder &o )
+{
+	// Indices of removed particles are dropped; slots they moved into keep their place in the
+	// order, and particles spawned since the last call are appended
+	uint32 kept = std::min( o.count, count ), n = 0;
+	for( uint32 i = 0; i < o.count; ++i )
+	{
+		if( o.order[i] < kept ) o.order[n++] = o.order[i];
+	}
+	if( o.order.size() < count )
+	{
+		o.order.resize( count );
+		o.tmpOrder.resize( count );
+		o.keys.resize( count );
+		o.tmpKeys.resize( count );
+		o.depths.resize( count );
+	}
+	for( uint32 i = kept; i < count; ++i ) o.order[n++] = i;
+	o.count = count;
+	if( count < 2 ) return;
+
+	float minDepth = Math::MaxFloat, maxDepth = -Math::MaxFloat;
+	for( uint32 i = 0; i < count; ++i )
+	{
+		const float *pos = positions + i * 3;
+		float depth = pos[0] * viewDir.x + pos[1] * viewDir.y + pos[2] * viewDir.z;
+		o.depths[i] = depth;
+		minDepth = std::min( minDepth, depth );
+		maxDepth = std::max( maxDepth, depth );
+	}
+
+	// The farthest particle gets key 0
+	float scale = maxDepth > minDepth ? 65535.0f / (maxDepth - minDepth) : 0.0f;
+	for( uint32 i = 0; i < count; ++i )
+		o.keys[i] = (uint16)std::min( (maxDepth - o.depths[o.order[i]]) * scale, 65535.0f );
+
+	if( !insertionSortKeys( &o.keys[0], &o.order[0], count, count * MaxInsertionMovesPerParticle ) )
+		radixSortKeys( o, count );
+}
+
+
+// =================================================================================================
+// Kernel selection
+// =================================================================================================
+
+ParticleSimFunc getParticleSimFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return simulateParticlesScalar;
+#if defined( SIMD_SSE2 )
+	case ParticleSimKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? simulateParticlesSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case ParticleSimKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? simulateParticlesNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+ParticleRandomFunc getParticleRandomFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return generateRandomScalar;
+#if defined( SIMD_SSE2 )
+	case ParticleSimKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? generateRandomSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case ParticleSimKernels::NEON:
+		// There is no NEON version of Philox: ARM uses the scalar generator, which yields the same
+		// values and is cheap compared to the simulation since only new particles need numbers
+		return (getCPUFeatures() & CPUFeatures::NEON) ? generateRandomScalar : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+int getBestParticleSimKernel()
+{
+	for( int i = ParticleSimKernels::Count - 1; i > ParticleSimKernels::Scalar; --i )
+	{
+		if( getParticleSimFunc( i ) != 0x0 ) return i;
+	}
+
+	return ParticleSimKernels::Scalar;
+}
+
+
+const char *getParticleSimKernelName( int kernel )
+{
+	switch( kernel )
+	{
+	case ParticleSimKernels::Scalar:
+		return "scalar";
+	case ParticleSimKernels::SSE2:
+		return "SSE2";
+	case ParticleSimKernels::NEON:
+		return "NEON";
+	default:
+		return "unknown";
+	}
+}
+
+}  // namespace
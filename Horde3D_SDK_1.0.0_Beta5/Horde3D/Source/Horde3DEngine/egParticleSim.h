@@ -0,0 +1,214 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egParticleSim_H_
+#define _egParticleSim_H_
+
+#include "egPrerequisites.h"
+#include "utMath.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+// =================================================================================================
+// Particle Simulation
+// =================================================================================================
+
+// Simulation state of an emitter is stored as structure of arrays: each channel is an array of
+// stride floats. Live particles are kept in the range [0, count) so that the cost of a step does
+// not depend on the capacity of the emitter.
+struct ParticleStateChannels
+{
+	enum List
+	{
+		Life = 0,
+		InvMaxLife,
+		DirX,
+		DirY,
+		DirZ,
+		DragX,
+		DragY,
+		DragZ,
+		MoveVel0,
+		RotVel0,
+		Drag0,
+		Size0,
+		ColR0,
+		ColG0,
+		ColB0,
+		ColA0,
+		Count
+	};
+};
+
+struct ParticleStreams
+{
+	float   *state;              // ParticleStateChannels::Count arrays of stride floats
+	uint32  stride;
+	float   *positions;          // Render data, interleaved like the particle shader uniforms:
+	float   *sizesAndRotations;  // xyz, size and rotation, rgba
+	float   *colors;
+
+	float *channel( int c ) const { return state + c * stride; }
+	
+	// Streams starting at particle first, e.g. for processing an emitter in chunks
+	ParticleStreams offset( uint32 first ) const
+	{
+		ParticleStreams streams = *this;
+		streams.state += first;
+		streams.positions += first * 3;
+		streams.sizesAndRotations += first * 2;
+		streams.colors += first * 4;
+		return streams;
+	}
+};
+
+// Channels whose start values change over the lifetime of a particle
+struct ParticleCurveChannels
+{
+	enum List
+	{
+		MoveVel = 0,
+		RotVel,
+		Drag,
+		Size,
+		ColR,
+		ColG,
+		ColB,
+		ColA,
+		Count
+	};
+};
+
+// A curve holds the factors for the start value of a channel at evenly spaced points of the
+// lifetime, from birth to death; a particle uses the sample nearest to its age. The curves of all
+// channels are interleaved, so that a particle reads its factors from a single row of the table.
+const uint32 ParticleCurveSamples = 256;
+
+// Values that are equal for all particles of an emitter during a step
+struct ParticleSimParams
+{
+	float        timeDelta;
+	float        force[3];
+	float        moveVelRate, rotVelRate, dragRate, sizeRate;  // Change of start values over lifetime,
+	float        colRate[4];                                    // i.e. endRate - 1 of the channels
+	const float  *curveTable;  // ParticleCurveSamples rows of ParticleCurveChannels::Count factors
+	uint32       curveMask;    // Bit c is set if channel c uses the table instead of its rate
+
+	ParticleSimParams() : curveTable( 0x0 ), curveMask( 0 ) {}
+};
+
+// Index of the curve sample for fac, the elapsed fraction of the lifetime; computed the same way by
+// all kernels
+inline uint32 getParticleCurveSample( float fac )
+{
+	return (uint32)(minf( maxf( fac, 0.0f ), 1.0f ) * (float)(ParticleCurveSamples - 1) + 0.5f);
+}
+
+struct ParticleSimKernels
+{
+	enum List
+	{
+		Scalar = 0,
+		SSE2,
+		NEON,
+		Count
+	};
+};
+
+// Advances the first count particles by one step, decreases their life and extends bounds
+// (min xyz, max xyz) by the new positions of the particles that are still alive. Particles that
+// die in this step are still updated and have to be removed afterwards with removeDeadParticles.
+typedef void (*ParticleSimFunc)( const ParticleStreams &streams, uint32 count,
+                                 const ParticleSimParams &params, float *bounds );
+
+// Returns 0x0 if the kernel was not compiled in or is not supported by the CPU
+ParticleSimFunc getParticleSimFunc( int kernel );
+int getBestParticleSimKernel();
+const char *getParticleSimKernelName( int kernel );
+
+// Moves the last live particle into the slot of each dead one; returns the new live count
+uint32 removeDeadParticles( const ParticleStreams &streams, uint32 count );
+
+
+// =================================================================================================
+// Particle Depth Sorting
+// =================================================================================================
+
+// Back-to-front order of the particles of an emitter, kept from frame to frame
+struct ParticleDepthOrder
+{
+	std::vector< uint32 >  order;  // Particle indices, farthest particle first
+	uint32                 count;
+	
+	std::vector< uint32 >  tmpOrder;
+	std::vector< uint16 >  keys, tmpKeys;
+	std::vector< float >   depths;
+
+	ParticleDepthOrder() : count( 0 ) {}
+};
+
+// Sorts the first count particles by decreasing depth along viewDir. Depths are quantized to 16 bit
+// and sorted with a stable radix sort. The sort starts from the order of the previous call, so an
+// order that is still almost right is only repaired by an insertion sort, and particles with equal
+// keys keep their order. Indices that became invalid by removeDeadParticles are replaced.
+void sortParticlesByDepth( const float *positions, uint32 count, const Vec3f &viewDir,
+                           ParticleDepthOrder &depthOrder );
+
+
+// =================================================================================================
+// Particle Random Numbers
+// =================================================================================================
+
+// Random values needed to spawn a particle
+struct ParticleRandomValues
+{
+	enum List
+	{
+		Life = 0,
+		SpreadX,
+		SpreadY,
+		SpreadZ,
+		MoveVel,
+		RotVel,
+		Drag,
+		Size,
+		ColR,
+		ColG,
+		ColB,
+		ColA,
+		Rotation,
+		Count
+	};
+};
+
+// The values are generated by the counter-based Philox2x32-10 generator: the values of a particle
+// are a function of the emitter seed and the spawn index of the particle only. No state is shared
+// between emitters, and a seed reproduces the same particles on every run, kernel and thread count.
+// Writes numValues arrays of stride floats in [0, 1) for the particles with the spawn indices first
+// to first + count - 1; emitters use ParticleRandomValues::Count values. Value v of an index does not
+// depend on numValues, which may be at most MaxParticleRandomValues. There is a scalar and an SSE2
+// version; there is no NEON version of Philox, so the NEON kernel uses the scalar generator on ARM.
+const uint32 MaxParticleRandomValues = 16;
+typedef void (*ParticleRandomFunc)( uint32 seed, uint64 first, uint32 count, uint32 numValues,
+                                    float *values, uint32 stride );
+
+// Uses the kernels of the simulation; returns 0x0 if the kernel is not available
+ParticleRandomFunc getParticleRandomFunc( int kernel );
+
+// Applies the ten Philox2x32 rounds with the given key to a counter; for generators that are seeded
+// with raw random words
+void philox2x32( uint32 key, uint32 &ctr0, uint32 &ctr1 );
+
+}
+#endif // _egParticleSim_H_
@@ -231,6 +231,23 @@ const string PipelineResource::parseStage( XMLNode &node, PipelineStage &stage )
 			params[0].setString( node1.getAttribute( "context", "" ) );
 			params[1].setBool( _stricmp( node1.getAttribute( "noShadows", "false" ), "true" ) == 0 );
 		}
+		else if( strcmp( node1.getName(), "DrawClusteredGeometry" ) == 0 )
+		{
+			if( !node1.getAttribute( "context" ) ) return "Missing DrawClusteredGeometry attribute 'context'";
+			
+			const char *orderStr = node1.getAttribute( "order", "" );
+			int order = RenderingOrder::StateChanges;
+			if( _stricmp( orderStr, "FRONT_TO_BACK" ) == 0 ) order = RenderingOrder::FrontToBack;
+			else if( _stricmp( orderStr, "BACK_TO_FRONT" ) == 0 ) order = RenderingOrder::BackToFront;
+			else if( _stricmp( orderStr, "NONE" ) == 0 ) order = RenderingOrder::None;
+			
+			stage.commands.push_back( PipelineCommand( PipelineCommands::DrawClusteredGeometry ) );
+			vector< PipeCmdParam > &params = stage.commands.back().params;
+			params.resize( 3 );
+			params[0].setString( node1.getAttribute( "context" ) );
+			params[1].setString( node1.getAttribute( "class", "" ) );
+			params[2].setInt( order );
+		}
 		else if( strcmp( node1.getName(), "SetUniform" ) == 0 )
 		{
 			if( !node1.getAttribute( "material" ) ) return "Missing SetUniform attribute 'material'";
@@ -328,6 +345,13 @@ bool PipelineResource::load( const char *data, int size )
 
 	XMLDoc doc;
 	doc.parseBuffer( data, size );
+
+	return loadXML( doc );
+}
+
+
+bool PipelineResource::loadXML( const XMLDoc &doc )
+{
 	if( doc.hasError() )
 		return raiseError( "XML parsing error" );
 
@@ -53,6 +53,7 @@ struct PipelineCommands
 		DrawQuad,
 		DoForwardLightLoop,
 		DoDeferredLightLoop,
+		DrawClusteredGeometry,
 		SetUniform
 	};
 };
@@ -174,6 +175,7 @@ public:
 	                          int *compCount, void *dataBuffer, int bufferSize );
 
 private:
+	bool loadXML( const XMLDoc &doc );
 	bool raiseError( const std::string &msg, int line = -1 );
 	const std::string parseStage( XMLNode &node, PipelineStage &stage );
 
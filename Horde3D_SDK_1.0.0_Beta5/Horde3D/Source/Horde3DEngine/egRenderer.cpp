@@ -16,6 +16,8 @@
 #include "egCamera.h"
 #include "egModules.h"
 #include "egCom.h"
+#include "egFrame.h"
+#include "utThreadPool.h"
 #include <cstring>
 
 #include "utDebug.h"
@@ -25,6 +27,53 @@ namespace Horde3D {
 
 using namespace std;
 
+// Advances the particles of an emitter by one step like simulateParticlesScalar; particles that
+// are dead or die in this step get a size of zero. Warning: The number of curve samples is hardcoded,
+// see ParticleCurveSamples
+static const char *vsParticleSim =
+	"uniform float parSimTimeDelta;\n"
+	"uniform vec4 parSimForce;\n"     // Force and rotation scale
+	"uniform vec4 parSimRates;\n"     // Move velocity, rotation velocity, drag and size
+	"uniform vec4 parSimColRates;\n"
+	"uniform vec4 parSimCurveMasks[2];\n"  // 1 for the rates that are replaced by a curve
+	"uniform sampler2D parSimCurves;\n"    // Curve table, two texels per sample
+	"attribute vec4 parPosSize;\n"
+	"attribute vec4 parColor;\n"
+	"attribute vec4 parRotLife;\n"
+	"attribute vec4 parAttribs0;\n"   // 1 / maxLife, direction
+	"attribute vec4 parAttribs1;\n"   // Drag vector, start move velocity
+	"attribute vec4 parAttribs2;\n"   // Start rotation velocity, drag and size
+	"attribute vec4 parAttribs3;\n"   // Start color
+	"varying vec4 outPosSize;\n"
+	"varying vec4 outColor;\n"
+	"varying vec4 outRotLife;\n"
+	"void main() {\n"
+	"	outPosSize = vec4( parPosSize.xyz, 0.0 );\n"
+	"	outColor = parColor;\n"
+	"	outRotLife = parRotLife;\n"
+	"	float life = parRotLife.y;\n"
+	"	if( life > 0.0 ) {\n"
+	"		float fac = 1.0 - life * parAttribs0.x;\n"
+	"		float sample = floor( clamp( fac, 0.0, 1.0 ) * 255.0 + 0.5 ) * 2.0;\n"
+	"		vec4 scales = mix( vec4( 1.0 ) + parSimRates * fac,\n"
+	"			texture2DLod( parSimCurves, vec2( (sample + 0.5) / 512.0, 0.5 ), 0.0 ), parSimCurveMasks[0] );\n"
+	"		vec4 colScales = mix( vec4( 1.0 ) + parSimColRates * fac,\n"
+	"			texture2DLod( parSimCurves, vec2( (sample + 1.5) / 512.0, 0.5 ), 0.0 ), parSimCurveMasks[1] );\n"
+	"		float moveVel = parAttribs1.w * scales.x;\n"
+	"		float rotVel = parAttribs2.x * scales.y;\n"
+	"		float drag = parAttribs2.y * scales.z;\n"
+	"		life -= parSimTimeDelta;\n"
+	"		outPosSize.xyz += (parAttribs0.yzw * moveVel + parAttribs1.xyz * drag + parSimForce.xyz) * parSimTimeDelta;\n"
+	"		outPosSize.w = life > 0.0 ? parAttribs2.z * scales.w * 2.0 : 0.0;\n"
+	"		outColor = parAttribs3 * colScales;\n"
+	"		outRotLife.xy = vec2( parRotLife.x + rotVel * parSimForce.w, life );\n"
+	"	}\n"
+	"	gl_Position = vec4( 0.0 );\n"
+	"}\n";
+
+static const char *particleSimVaryings[3] = { "outPosSize", "outColor", "outRotLife" };
+
+
 Renderer::Renderer()
 {
 	_scratchBuf = 0x0;
@@ -32,8 +81,25 @@ Renderer::Renderer()
 	_scratchBufSize = 0;
 	_frameID = 1;
 	_defShadowMap = 0;
+	_clusterLightTex = 0;
+	_clusterGridTex = 0;
+	_skinPaletteSupported = false;
+	_skinPaletteTex = 0;
+	_skinPaletteHeight = 0;
+	_skinPaletteFrame = 0;
+	_skinPaletteDirty = false;
 	_quadIdxBuf = 0;
 	_particleVBO = 0;
+	_particleTexSupported = false;
+	_particleTexVBO = 0;
+	_particleTexIdxBuf = 0;
+	_particleSimShader = 0;
+	_parSimShader_timeDelta = -1;
+	_parSimShader_force = -1;
+	_parSimShader_rates = -1;
+	_parSimShader_colRates = -1;
+	_parSimShader_curveMasks = -1;
+	_parSimShader_curves = -1;
 	_curCamera = 0x0;
 	_curLight = 0x0;
 	_curShader = 0x0;
@@ -41,11 +107,16 @@ Renderer::Renderer()
 	_curShaderUpdateStamp = 1;
 	_maxAnisoMask = 0;
 	_smSize = 0;
+	for( uint32 i = 0; i < 4; ++i )
+	{
+		_clusterDims[i] = 0; _clusterDepthParams[i] = 0; _clusterViewport[i] = 0;
+	}
 	_shadowRB = 0;
 	_vlPosOnly = 0;
 	_vlOverlay = 0;
 	_vlModel = 0;
 	_vlParticle = 0;
+	_vlParticleSim = 0;
 }
 
 
@@ -53,7 +124,13 @@ Renderer::~Renderer()
 {
 	releaseShadowRB();
 	gRDI->destroyTexture( _defShadowMap );
+	gRDI->destroyTexture( _clusterLightTex );
+	gRDI->destroyTexture( _clusterGridTex );
+	gRDI->destroyTexture( _skinPaletteTex );
 	gRDI->destroyBuffer( _particleVBO );
+	gRDI->destroyBuffer( _particleTexVBO );
+	gRDI->destroyBuffer( _particleTexIdxBuf );
+	gRDI->destroyShader( _particleSimShader );
 	releaseShaderComb( _defColorShader );
 
 	delete[] _scratchBuf;
@@ -100,6 +177,14 @@ bool Renderer::init()
 	if( !gRDI->getCaps().rtMultisampling )
 		Modules::log().writeWarning( "Renderer: No multisampling for render targets available" );
 	
+	// Skinning matrices are fetched from a float texture in the vertex shader if possible
+	_skinPaletteSupported = gRDI->getCaps().texVertexFetch;
+	if( !_skinPaletteSupported )
+		Modules::log().writeWarning( "Renderer: No vertex texture fetch available, skeletons are limited to 75 joints" );
+	
+	// The same applies to particle attributes, which otherwise need a draw call for every 64 particles
+	_particleTexSupported = gRDI->getCaps().texVertexFetch;
+	
 	// Create vertex layouts
 	VertexLayoutAttrib attribsPosOnly[1] = {
 		{"vertPos", 0, 3, 0}
@@ -128,6 +213,17 @@ bool Renderer::init()
 		{"parIdx", 0, 1, 8}
 	};
 	_vlParticle = gRDI->registerVertexLayout( 2, attribsParticle );
+
+	VertexLayoutAttrib attribsParticleSim[7] = {
+		{"parPosSize", 0, 4, 0},
+		{"parColor", 0, 4, 16},
+		{"parRotLife", 0, 4, 32},
+		{"parAttribs0", 1, 4, 0},
+		{"parAttribs1", 1, 4, 16},
+		{"parAttribs2", 1, 4, 32},
+		{"parAttribs3", 1, 4, 48}
+	};
+	_vlParticleSim = gRDI->registerVertexLayout( 7, attribsParticleSim );
 	
 	// Upload default shaders
 	if( !createShaderComb( gRDI->getDefaultVSCode(), gRDI->getDefaultFSCode(), _defColorShader ) )
@@ -138,6 +234,24 @@ bool Renderer::init()
 
 	// Cache common uniforms
 	_defColShader_color = gRDI->getShaderConstLoc( _defColorShader.shaderObj, "color" );
+
+	// Emitters can be simulated on the GPU if the result can be rendered from the particle texture
+	if( _particleTexSupported && gRDI->getCaps().transformFeedback )
+	{
+		_particleSimShader = gRDI->createFeedbackShader( vsParticleSim, particleSimVaryings, 3 );
+		if( _particleSimShader == 0 )
+			Modules::log().writeWarning( "Renderer: Failed to compile particle simulation shader:\n%s",
+			                             gRDI->getShaderLog().c_str() );
+	}
+	if( _particleSimShader != 0 )
+	{
+		_parSimShader_timeDelta = gRDI->getShaderConstLoc( _particleSimShader, "parSimTimeDelta" );
+		_parSimShader_force = gRDI->getShaderConstLoc( _particleSimShader, "parSimForce" );
+		_parSimShader_rates = gRDI->getShaderConstLoc( _particleSimShader, "parSimRates" );
+		_parSimShader_colRates = gRDI->getShaderConstLoc( _particleSimShader, "parSimColRates" );
+		_parSimShader_curveMasks = gRDI->getShaderConstLoc( _particleSimShader, "parSimCurveMasks" );
+		_parSimShader_curves = gRDI->getShaderSamplerLoc( _particleSimShader, "parSimCurves" );
+	}
 	
 	// Create shadow map render target
 	if( !createShadowRB( Modules::config().shadowMapSize, Modules::config().shadowMapSize ) )
@@ -178,6 +292,27 @@ bool Renderer::init()
 	_particleVBO = gRDI->createVertexBuffer( ParticlesPerBatch * 4 * sizeof( ParticleVert ), (float *)parVerts );
 	delete[] parVerts; parVerts = 0x0;
 
+	// Larger particle geometry for particles with attributes in a texture; needs its own index buffer
+	// since the quad index buffer is sized for overlays
+	if( _particleTexSupported )
+	{
+		parVerts = new ParticleVert[ParticlesPerTexBatch * 4];
+		uint16 *parIndices = new uint16[ParticlesPerTexBatch * 6];
+		for( uint32 i = 0; i < ParticlesPerTexBatch; ++i )
+		{
+			parVerts[i * 4 + 0] = v0; parVerts[i * 4 + 0].index = (float)i;
+			parVerts[i * 4 + 1] = v1; parVerts[i * 4 + 1].index = (float)i;
+			parVerts[i * 4 + 2] = v2; parVerts[i * 4 + 2].index = (float)i;
+			parVerts[i * 4 + 3] = v3; parVerts[i * 4 + 3].index = (float)i;
+			parIndices[i*6+0] = i * 4 + 0; parIndices[i*6+1] = i * 4 + 1; parIndices[i*6+2] = i * 4 + 2;
+			parIndices[i*6+3] = i * 4 + 2; parIndices[i*6+4] = i * 4 + 3; parIndices[i*6+5] = i * 4 + 0;
+		}
+		_particleTexVBO = gRDI->createVertexBuffer( ParticlesPerTexBatch * 4 * sizeof( ParticleVert ), (float *)parVerts );
+		_particleTexIdxBuf = gRDI->createIndexBuffer( ParticlesPerTexBatch * 6 * sizeof( uint16 ), parIndices );
+		delete[] parVerts; parVerts = 0x0;
+		delete[] parIndices; parIndices = 0x0;
+	}
+
 	_overlayBatches.reserve( 64 );
 	_overlayVerts = new OverlayVert[MaxNumOverlayVerts];
 	_overlayVB = gRDI->createVertexBuffer( MaxNumOverlayVerts * sizeof( OverlayVert ), 0x0 );
@@ -358,6 +493,14 @@ bool Renderer::createShaderComb( const char *vertexShader, const char *fragmentS
 	// Set standard uniforms
 	int loc =gRDI-> getShaderSamplerLoc( shdObj, "shadowMap" );
 	if( loc >= 0 ) gRDI->setShaderSampler( loc, 12 );
+	loc = gRDI->getShaderSamplerLoc( shdObj, "clusterLightTex" );
+	if( loc >= 0 ) gRDI->setShaderSampler( loc, 13 );
+	loc = gRDI->getShaderSamplerLoc( shdObj, "clusterGridTex" );
+	if( loc >= 0 ) gRDI->setShaderSampler( loc, 14 );
+	loc = gRDI->getShaderSamplerLoc( shdObj, "skinPaletteTex" );
+	if( loc >= 0 ) gRDI->setShaderSampler( loc, 15 );
+	loc = gRDI->getShaderSamplerLoc( shdObj, "parTex" );
+	if( loc >= 0 ) gRDI->setShaderSampler( loc, 11 );
 
 	// Misc general uniforms
 	sc.uni_frameBufSize = gRDI->getShaderConstLoc( shdObj, "frameBufSize" );
@@ -376,6 +519,7 @@ bool Renderer::createShaderComb( const char *vertexShader, const char *fragmentS
 	sc.uni_nodeId = gRDI->getShaderConstLoc( shdObj, "nodeId" );
 	sc.uni_customInstData = gRDI->getShaderConstLoc( shdObj, "customInstData[0]" );
 	sc.uni_skinMatRows = gRDI->getShaderConstLoc( shdObj, "skinMatRows[0]" );
+	sc.uni_skinPalette = gRDI->getShaderConstLoc( shdObj, "skinPalette" );
 	
 	// Lighting uniforms
 	sc.uni_lightPos = gRDI->getShaderConstLoc( shdObj, "lightPos" );
@@ -386,10 +530,16 @@ bool Renderer::createShaderComb( const char *vertexShader, const char *fragmentS
 	sc.uni_shadowMapSize = gRDI->getShaderConstLoc( shdObj, "shadowMapSize" );
 	sc.uni_shadowBias = gRDI->getShaderConstLoc( shdObj, "shadowBias" );
 	
+	// Clustered lighting uniforms
+	sc.uni_clusterDims = gRDI->getShaderConstLoc( shdObj, "clusterDims" );
+	sc.uni_clusterDepthParams = gRDI->getShaderConstLoc( shdObj, "clusterDepthParams" );
+	sc.uni_clusterViewport = gRDI->getShaderConstLoc( shdObj, "clusterViewport" );
+	
 	// Particle-specific uniforms
 	sc.uni_parPosArray = gRDI->getShaderConstLoc( shdObj, "parPosArray" );
 	sc.uni_parSizeAndRotArray = gRDI->getShaderConstLoc( shdObj, "parSizeAndRotArray" );
 	sc.uni_parColorArray = gRDI->getShaderConstLoc( shdObj, "parColorArray" );
+	sc.uni_parTexParams = gRDI->getShaderConstLoc( shdObj, "parTexParams" );
 	
 	// Overlay-specific uniforms
 	sc.uni_olayColor = gRDI->getShaderConstLoc( shdObj, "olayColor" );
@@ -484,6 +634,16 @@ void Renderer::commitGeneralUniforms()
 				gRDI->setShaderConst( _curShader->uni_shadowBias, CONST_FLOAT, &_curLight->_shadowMapBias );
 		}
 
+		// Clustered lighting params
+		if( _curShader->uni_clusterDims >= 0 )
+			gRDI->setShaderConst( _curShader->uni_clusterDims, CONST_FLOAT4, _clusterDims );
+
+		if( _curShader->uni_clusterDepthParams >= 0 )
+			gRDI->setShaderConst( _curShader->uni_clusterDepthParams, CONST_FLOAT4, _clusterDepthParams );
+
+		if( _curShader->uni_clusterViewport >= 0 )
+			gRDI->setShaderConst( _curShader->uni_clusterViewport, CONST_FLOAT4, _clusterViewport );
+
 		_curShader->lastUpdateStamp = _curShaderUpdateStamp;
 	}
 }
@@ -754,7 +914,7 @@ Matrix4f Renderer::calcCropMatrix( const Frustum &frustSlice, const Vec3f lightP
 	
 	for( size_t i = 0, s = renderQueue.size(); i < s; ++i )
 	{
-		const BoundingBox &aabb = renderQueue[i].node->getBBox();
+		const BoundingBox &aabb = renderQueue[i].node->getRenderBBox();
 		
 		// Check if light is inside AABB
 		if( lightPos.x >= aabb.min.x && lightPos.y >= aabb.min.y && lightPos.z >= aabb.min.z &&
@@ -856,7 +1016,7 @@ void Renderer::updateShadowMap()
 		RenderingOrder::None, SceneNodeFlags::NoDraw | SceneNodeFlags::NoCastShadow, false, true );
 	for( size_t j = 0, s = Modules::sceneMan().getRenderQueue().size(); j < s; ++j )
 	{
-		aabb.makeUnion( Modules::sceneMan().getRenderQueue()[j].node->getBBox() );
+		aabb.makeUnion( Modules::sceneMan().getRenderQueue()[j].node->getRenderBBox() );
 	}
 
 	// Find depth range of lit geometry
@@ -1040,6 +1200,39 @@ void Renderer::drawOccProxies( uint32 list )
 }
 
 
+void Renderer::rasterizeOccluders()
+{
+	// Occluders are gathered front to back so that the nearest ones land in the buffer first
+	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), 0x0, RenderingOrder::FrontToBack,
+	                                  SceneNodeFlags::NoDraw, false, true );
+
+	_swOccBuffer.begin( _curCamera->getProjMat() * _curCamera->getViewMat() );
+
+	RenderQueue &renderQueue = Modules::sceneMan().getRenderQueue();
+	for( size_t i = 0, s = renderQueue.size(); i < s; ++i )
+	{
+		if( renderQueue[i].type != SceneNodeTypes::Mesh ) continue;
+		if( !(renderQueue[i].node->_flags & SceneNodeFlags::Occluder) ) continue;
+
+		MeshNode *meshNode = (MeshNode *)renderQueue[i].node;
+		ModelNode *modelNode = meshNode->getParentModel();
+		GeometryResource *geoRes = modelNode->getGeometryResource();
+		if( geoRes == 0x0 ) continue;
+
+		// The private vertex data of morphed and software skinned models is written by a running
+		// background update
+		if( modelNode->isInSnapshot() && modelNode->_baseGeoRes != 0x0 ) continue;
+
+		// Uses the CPU copy of the vertex data, so hardware skinned meshes are rasterized in bind pose
+		_swOccBuffer.rasterizeMesh( meshNode->getRenderTrans(), geoRes->getVertPosData(), geoRes->getIndexData(),
+		                            geoRes->has16BitIndices(), meshNode->getBatchStart(), meshNode->getBatchCount(),
+		                            meshNode->getVertRStart(), meshNode->getVertREnd() );
+	}
+
+	_swOccBuffer.end();
+}
+
+
 // =================================================================================================
 // Overlays
 // =================================================================================================
@@ -1204,7 +1397,7 @@ void Renderer::drawGeometry( const string &shaderContext, const string &theClass
                              RenderingOrder::List order, int occSet )
 {
 	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), 0x0, order,
-	                                  SceneNodeFlags::NoDraw , false, true );
+	                                  SceneNodeFlags::NoDraw , false, true, &_swOccBuffer );
 	
 	setupViewMatrices( _curCamera->getViewMat(), _curCamera->getProjMat() );
 	drawRenderables( shaderContext, theClass, false, &_curCamera->getFrustum(), 0x0, order, occSet );
@@ -1297,7 +1490,7 @@ void Renderer::drawLightGeometry( const string &shaderContext, const string &the
 		
 		// Render
 		Modules::sceneMan().updateQueues( _curCamera->getFrustum(), &_curLight->getFrustum(),
-		                                  order, SceneNodeFlags::NoDraw, false, true );
+		                                  order, SceneNodeFlags::NoDraw, false, true, &_swOccBuffer );
 		setupViewMatrices( _curCamera->getViewMat(), _curCamera->getProjMat() );
 		drawRenderables( shaderContext.empty() ? _curLight->_lightingContext : shaderContext,
 		                 theClass, false, &_curCamera->getFrustum(),
@@ -1443,10 +1636,227 @@ void Renderer::drawLightShapes( const string &shaderContext, bool noShadows, int
 }
 
 
+void Renderer::updateLightClusters()
+{
+	ASSERT( LightClusterGrid::NumClusters + LightClusterGrid::MaxLightIndices <=
+	        ClusterGridTexWidth * ClusterGridTexHeight );
+	
+	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), 0x0, RenderingOrder::None,
+	                                  SceneNodeFlags::NoDraw, true, false );
+
+	if( _clusterLightTex == 0 )
+	{
+		_clusterLightTex = gRDI->createTexture( TextureTypes::Tex2D, LightClusterGrid::MaxLights, 4, 1,
+		                                        TextureFormats::RGBA32F, false, false, false, false );
+		_clusterGridTex = gRDI->createTexture( TextureTypes::Tex2D, ClusterGridTexWidth, ClusterGridTexHeight, 1,
+		                                       TextureFormats::RGBA32F, false, false, false, false );
+	}
+	
+	_lightClusters.setup( _curCamera->getProjMat() );
+	_lightClusters.clearLights();
+
+	// Light texture: one column per light with position/radius, direction/cutoff and color rows
+	const uint32 lightTexWidth = LightClusterGrid::MaxLights;
+	_clusterTexData.assign( lightTexWidth * 4 * 4, 0.0f );
+	
+	for( size_t i = 0, s = Modules::sceneMan().getLightQueue().size(); i < s; ++i )
+	{
+		LightNode *light = (LightNode *)Modules::sceneMan().getLightQueue()[i];
+		
+		// Lights exceeding the limit are ignored
+		uint32 index = _lightClusters.getLightCount();
+		if( !_lightClusters.addLight( _curCamera->getViewMat() * light->_absPos, light->_radius ) ) break;
+
+		float *data = &_clusterTexData[index * 4];
+		data[0] = light->_absPos.x; data[1] = light->_absPos.y; data[2] = light->_absPos.z;
+		data[3] = light->_radius;
+
+		data = &_clusterTexData[(lightTexWidth + index) * 4];
+		data[0] = light->_spotDir.x; data[1] = light->_spotDir.y; data[2] = light->_spotDir.z;
+		data[3] = cosf( degToRad( light->_fov / 2.0f ) );
+
+		Vec3f col = light->_diffuseCol * light->_diffuseColMult;
+		data = &_clusterTexData[(2 * lightTexWidth + index) * 4];
+		data[0] = col.x; data[1] = col.y; data[2] = col.z;
+	}
+	gRDI->updateTextureData( _clusterLightTex, 0, 0, &_clusterTexData[0] );
+
+	_lightClusters.build();
+
+	// Grid texture: first texel of light list and light count per cluster, followed by the light indices
+	_clusterTexData.assign( ClusterGridTexWidth * ClusterGridTexHeight * 4, 0.0f );
+	
+	for( uint32 i = 0; i < LightClusterGrid::NumClusters; ++i )
+	{
+		_clusterTexData[i * 4 + 0] = (float)(LightClusterGrid::NumClusters + _lightClusters.getClusterOffset( i ));
+		_clusterTexData[i * 4 + 1] = (float)_lightClusters.getClusterLightCount( i );
+	}
+	
+	const vector< uint32 > &lightIndices = _lightClusters.getLightIndices();
+	for( size_t i = 0, s = lightIndices.size(); i < s; ++i )
+		_clusterTexData[(LightClusterGrid::NumClusters + i) * 4] = (float)lightIndices[i];
+	
+	gRDI->updateTextureData( _clusterGridTex, 0, 0, &_clusterTexData[0] );
+
+	_clusterDims[0] = (float)LightClusterGrid::DimX;
+	_clusterDims[1] = (float)LightClusterGrid::DimY;
+	_clusterDims[2] = (float)LightClusterGrid::DimZ;
+	_clusterDims[3] = (float)_lightClusters.getLightCount();
+	_clusterDepthParams[0] = _lightClusters.getSliceScale();
+	_clusterDepthParams[1] = _lightClusters.getSliceBias();
+	_clusterDepthParams[2] = _lightClusters.hasLogSlices() ? 1.0f : 0.0f;
+	_clusterViewport[0] = (float)gRDI->_vpX;
+	_clusterViewport[1] = (float)gRDI->_vpY;
+	_clusterViewport[2] = (float)gRDI->_vpWidth;
+	_clusterViewport[3] = (float)gRDI->_vpHeight;
+	
+	++_curShaderUpdateStamp;
+}
+
+
+void Renderer::drawClusteredGeometry( const string &shaderContext, const string &theClass,
+                                      RenderingOrder::List order, int occSet )
+{
+	updateLightClusters();
+	
+	Modules::sceneMan().updateQueues( _curCamera->getFrustum(), 0x0, order,
+	                                  SceneNodeFlags::NoDraw, false, true, &_swOccBuffer );
+
+	GPUTimer *timer = Modules::stats().getGPUTimer( EngineStats::FwdLightsGPUTime );
+	if( Modules::config().gatherTimeStats ) timer->beginQuery( _frameID );
+
+	uint32 sampState = SS_FILTER_POINT | SS_ANISO1 | SS_ADDR_CLAMP;
+	gRDI->setTexture( 13, _clusterLightTex, sampState );
+	gRDI->setTexture( 14, _clusterGridTex, sampState );
+
+	// All lights are applied in a single pass over the geometry
+	setupViewMatrices( _curCamera->getViewMat(), _curCamera->getProjMat() );
+	drawRenderables( shaderContext, theClass, false, &_curCamera->getFrustum(), 0x0, order, occSet );
+	Modules().stats().incStat( EngineStats::LightPassCount, 1 );
+
+	timer->endQuery();
+}
+
+
 // =================================================================================================
 // Scene Node Rendering Functions
 // =================================================================================================
 
+void Renderer::updateSkinPalette()
+{
+	if( !_skinPaletteSupported || _skinPaletteFrame == _frameID ) return;
+	_skinPaletteFrame = _frameID;
+	
+	collectSkinPalette();
+}
+
+
+void Renderer::collectSkinPalette()
+{
+	// Collect the skinning matrices of all models, so that the meshes only need to pass the offset
+	// into the palette instead of uploading the matrices for each draw call. Software skinned models
+	// and models without joints share a block of identity matrices at the start of the palette, so
+	// that a skinning shader leaves their vertices unchanged.
+	vector< SceneNode * > &nodes = Modules::sceneMan()._nodes;
+	uint32 identityRows = 0;
+	for( size_t i = 0, s = nodes.size(); i < s; ++i )
+	{
+		if( nodes[i] == 0x0 || nodes[i]->getType() != SceneNodeTypes::Model ) continue;
+		
+		ModelNode *modelNode = (ModelNode *)nodes[i];
+		if( modelNode->_jointList.empty() || modelNode->_softwareSkinning )
+			identityRows = std::max( identityRows, (uint32)modelNode->getRenderSkinMatRows().size() );
+	}
+	
+	_skinPaletteData.resize( identityRows );
+	for( uint32 i = 0; i < identityRows / 3; ++i )
+	{
+		_skinPaletteData[i * 3 + 0] = Vec4f( 1, 0, 0, 0 );
+		_skinPaletteData[i * 3 + 1] = Vec4f( 0, 1, 0, 0 );
+		_skinPaletteData[i * 3 + 2] = Vec4f( 0, 0, 1, 0 );
+	}
+	
+	for( size_t i = 0, s = nodes.size(); i < s; ++i )
+	{
+		if( nodes[i] == 0x0 || nodes[i]->getType() != SceneNodeTypes::Model ) continue;
+		
+		ModelNode *modelNode = (ModelNode *)nodes[i];
+		const vector< Vec4f > &skinMatRows = modelNode->getRenderSkinMatRows();
+		modelNode->_skinPaletteStamp = modelNode->getRenderSkinRowsStamp();
+		modelNode->_skinPaletteShared = modelNode->_jointList.empty() || modelNode->_softwareSkinning;
+		if( modelNode->_skinPaletteShared )
+		{
+			modelNode->_skinPaletteOffset = 0;
+			modelNode->_skinPaletteRows = identityRows;
+			continue;
+		}
+
+		modelNode->_skinPaletteOffset = (int)_skinPaletteData.size();
+		modelNode->_skinPaletteRows = (uint32)skinMatRows.size();
+		_skinPaletteData.insert( _skinPaletteData.end(), skinMatRows.begin(), skinMatRows.end() );
+	}
+	if( _skinPaletteData.empty() ) return;
+
+	uint32 height = 1;
+	while( height * SkinPaletteTexWidth < (uint32)_skinPaletteData.size() ) height *= 2;
+	
+	if( height > _skinPaletteHeight )
+	{
+		gRDI->destroyTexture( _skinPaletteTex );
+		_skinPaletteTex = gRDI->createTexture( TextureTypes::Tex2D, SkinPaletteTexWidth, height, 1,
+		                                       TextureFormats::RGBA32F, false, false, false, false );
+		_skinPaletteHeight = height;
+	}
+	
+	_skinPaletteData.resize( SkinPaletteTexWidth * _skinPaletteHeight );
+	_skinPaletteDirty = true;
+	gRDI->setTexture( 15, _skinPaletteTex, SS_FILTER_POINT | SS_ANISO1 | SS_ADDR_CLAMP );
+}
+
+
+void Renderer::refreshSkinPalette( uint32 firstItem, uint32 lastItem )
+{
+	if( !_skinPaletteSupported ) return;
+	
+	// Models can be animated, for example lazily during culling or by a second render call in the
+	// same frame, or be added after the palette was collected
+	const RenderQueue &renderQueue = Modules::sceneMan().getRenderQueue();
+	for( uint32 i = firstItem; i <= lastItem; ++i )
+	{
+		ModelNode *modelNode = ((MeshNode *)renderQueue[i].node)->getParentModel();
+		bool shared = modelNode->_jointList.empty() || modelNode->_softwareSkinning;
+		if( modelNode->_skinPaletteStamp == modelNode->getRenderSkinRowsStamp() &&
+		    modelNode->_skinPaletteShared == shared && modelNode->_skinPaletteOffset >= 0 ) continue;
+		
+		const vector< Vec4f > &skinMatRows = modelNode->getRenderSkinMatRows();
+		if( modelNode->_skinPaletteOffset < 0 || modelNode->_skinPaletteShared != shared ||
+		    (uint32)skinMatRows.size() > modelNode->_skinPaletteRows )
+		{
+			// The model has no suitable slot, so the palette is collected again for all models
+			collectSkinPalette();
+			return;
+		}
+		
+		if( !shared )
+		{
+			std::copy( skinMatRows.begin(), skinMatRows.end(),
+			           _skinPaletteData.begin() + modelNode->_skinPaletteOffset );
+			_skinPaletteDirty = true;
+		}
+		modelNode->_skinPaletteStamp = modelNode->getRenderSkinRowsStamp();
+	}
+}
+
+
+void Renderer::commitSkinPalette()
+{
+	if( !_skinPaletteDirty ) return;
+	
+	gRDI->updateTextureData( _skinPaletteTex, 0, 0, &_skinPaletteData[0] );
+	_skinPaletteDirty = false;
+}
+
+
 void Renderer::drawRenderables( const string &shaderContext, const string &theClass, bool debugView,
                                 const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order,
                                 int occSet )
@@ -1505,6 +1915,9 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 	GeometryResource *curGeoRes = 0x0;
 	MaterialResource *curMatRes = 0x0;
 
+	Modules::renderer().refreshSkinPalette( firstItem, lastItem );
+	Modules::renderer().commitSkinPalette();
+
 	// Loop over mesh queue
 	for( size_t i = firstItem; i <= lastItem; ++i )
 	{
@@ -1514,7 +1927,7 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 		// Check that mesh is valid
 		if( modelNode->getGeometryResource() == 0x0 )
 			continue;
-		if( meshNode->getBatchStart() + meshNode->getBatchCount() > modelNode->getGeometryResource()->_indexCount )
+		if( meshNode->getBatchStart() + meshNode->getBatchCount() > modelNode->getGeometryResource()->getIndexCount() )
 			continue;
 		
 		bool modelChanged = true;
@@ -1541,12 +1954,11 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 					meshNode->_lastVisited[occSet] = Modules::renderer().getFrameID();
 				
 					// Check query result (viewer must be outside of bounding box)
-					if( nearestDistToAABB( frust1->getOrigin(), meshNode->getBBox().min,
-					                       meshNode->getBBox().max ) > 0 &&
+					const BoundingBox &bBox = meshNode->getRenderBBox();
+					if( nearestDistToAABB( frust1->getOrigin(), bBox.min, bBox.max ) > 0 &&
 						gRDI->getQueryResult( meshNode->_occQueries[occSet] ) < 1 )
 					{
-						Modules::renderer().pushOccProxy( 0, meshNode->getBBox().min, meshNode->getBBox().max,
-						                                  meshNode->_occQueries[occSet] );
+						Modules::renderer().pushOccProxy( 0, bBox.min, bBox.max, meshNode->_occQueries[occSet] );
 						continue;
 					}
 					else
@@ -1563,7 +1975,7 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 		
 			// Indices
 			gRDI->setIndexBuffer( curGeoRes->getIndexBuf(),
-			                      curGeoRes->_16BitIndices ? IDXFMT_16 : IDXFMT_32 );
+			                      curGeoRes->has16BitIndices() ? IDXFMT_16 : IDXFMT_32 );
 
 			// Vertices
 			uint32 posVBuf = curGeoRes->getPosVBuf();
@@ -1619,27 +2031,38 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 		if( modelChanged || curShader != prevShader )
 		{
 			// Skeleton
-			if( curShader->uni_skinMatRows >= 0 && !modelNode->_skinMatRows.empty() )
+			if( curShader->uni_skinPalette >= 0 )
+			{
+				// Only the location of the model's matrices in the palette texture is required;
+				// refreshSkinPalette has given every queued model a slot
+				float palette[4] = { (float)modelNode->_skinPaletteOffset, 0,
+				                     1.0f / (float)SkinPaletteTexWidth,
+				                     1.0f / (float)Modules::renderer()._skinPaletteHeight };
+				gRDI->setShaderConst( curShader->uni_skinPalette, CONST_FLOAT4, palette );
+			}
+			else if( curShader->uni_skinMatRows >= 0 && !modelNode->getRenderSkinMatRows().empty() )
 			{
 				// Note:	OpenGL 2.1 supports mat4x3 but it is internally realized as mat4 on most
 				//			hardware so it would require 4 instead of 3 uniform slots per joint
 				
+				const vector< Vec4f > &skinMatRows = modelNode->getRenderSkinMatRows();
 				gRDI->setShaderConst( curShader->uni_skinMatRows, CONST_FLOAT4,
-				                      &modelNode->_skinMatRows[0], (int)modelNode->_skinMatRows.size() );
+				                      &skinMatRows[0], (int)skinMatRows.size() );
 			}
 
 			modelChanged = false;
 		}
 
 		// World transformation
+		const Matrix4f &absTrans = meshNode->getRenderTrans();
 		if( curShader->uni_worldMat >= 0 )
 		{
-			gRDI->setShaderConst( curShader->uni_worldMat, CONST_FLOAT44, &meshNode->_absTrans.x[0] );
+			gRDI->setShaderConst( curShader->uni_worldMat, CONST_FLOAT44, &absTrans.x[0] );
 		}
 		if( curShader->uni_worldNormalMat >= 0 )
 		{
 			// TODO: Optimize this
-			Matrix4f normalMat4 = meshNode->_absTrans.inverted().transposed();
+			Matrix4f normalMat4 = absTrans.inverted().transposed();
 			float normalMat[9] = { normalMat4.x[0], normalMat4.x[1], normalMat4.x[2],
 			                       normalMat4.x[4], normalMat4.x[5], normalMat4.x[6],
 			                       normalMat4.x[8], normalMat4.x[9], normalMat4.x[10] };
@@ -1677,6 +2100,222 @@ void Renderer::drawMeshes( uint32 firstItem, uint32 lastItem, const string &shad
 }
 
 
+void Renderer::simulateParticlesGPU( EmitterNode *emitter )
+{
+	ParticleGPUState &gs = *emitter->_gpuState;
+	if( gs.steps.empty() ) return;
+
+	// The buffers hold all slots of the emitter, rounded to whole rows of the particle texture
+	uint32 capacity = (emitter->_particleCount + ParticleGPUSlotGranularity - 1) /
+	                  ParticleGPUSlotGranularity * ParticleGPUSlotGranularity;
+	if( gs.capacity < capacity )
+	{
+		// Only happens after the emitter was reset, so no live particles are lost
+		gs.releaseBuffers();
+		gs.stateBufs[0] = gRDI->createVertexBuffer( capacity * 12 * sizeof( float ), 0x0 );
+		gs.stateBufs[1] = gRDI->createVertexBuffer( capacity * 12 * sizeof( float ), 0x0 );
+		gs.attribBuf = gRDI->createVertexBuffer( capacity * 16 * sizeof( float ), 0x0 );
+		gs.capacity = capacity;
+	}
+
+	setShaderComb( 0x0 );
+	gRDI->bindShader( _particleSimShader );
+	gRDI->setVertexLayout( _vlParticleSim );
+
+	// The curves of the current effect are used for all recorded steps; the texture is bound even
+	// without curves so that the masked samples are always defined
+	ParticleEffectResource &effectRes = *emitter->_effectRes;
+	float curveMasks[ParticleCurveChannels::Count];
+	for( uint32 c = 0; c < ParticleCurveChannels::Count; ++c )
+		curveMasks[c] = (effectRes._curveMask & (1 << c)) != 0 ? 1.0f : 0.0f;
+	gRDI->setShaderConst( _parSimShader_curveMasks, CONST_FLOAT4, curveMasks, 2 );
+	gRDI->setTexture( 0, effectRes.getCurveTex(), SS_FILTER_POINT | SS_ANISO1 | SS_ADDR_CLAMP );
+	gRDI->setShaderSampler( _parSimShader_curves, 0 );
+	
+	for( size_t i = 0, s = gs.steps.size(); i < s; ++i )
+	{
+		const ParticleGPUStep &step = gs.steps[i];
+		uint32 curBuf = gs.stateBufs[gs.curStateBuf];
+
+		// Spawned particles are written to the current state; slots are mostly contiguous, so
+		// runs of slots are uploaded together
+		for( uint32 j = 0; j < step.spawnCount; )
+		{
+			uint32 first = step.firstSpawn + j, slot = gs.spawnSlots[first], n = 1;
+			while( j + n < step.spawnCount && gs.spawnSlots[first + n] == slot + n ) ++n;
+			
+			gRDI->updateBufferData( gs.attribBuf, slot * 16 * sizeof( float ), n * 16 * sizeof( float ),
+			                        &gs.spawnAttribs[first * 16] );
+			gRDI->updateBufferData( curBuf, slot * 12 * sizeof( float ), n * 12 * sizeof( float ),
+			                        &gs.spawnStates[first * 12] );
+			j += n;
+		}
+		if( step.slotCount == 0 ) continue;
+
+		const ParticleSimParams &params = step.params;
+		float timeDelta = params.timeDelta;
+		float force[4] = { params.force[0], params.force[1], params.force[2], degToRad( params.timeDelta ) };
+		float rates[4] = { params.moveVelRate, params.rotVelRate, params.dragRate, params.sizeRate };
+		float colRates[4] = { params.colRate[0], params.colRate[1], params.colRate[2], params.colRate[3] };
+		gRDI->setShaderConst( _parSimShader_timeDelta, CONST_FLOAT, &timeDelta );
+		gRDI->setShaderConst( _parSimShader_force, CONST_FLOAT4, force );
+		gRDI->setShaderConst( _parSimShader_rates, CONST_FLOAT4, rates );
+		gRDI->setShaderConst( _parSimShader_colRates, CONST_FLOAT4, colRates );
+
+		gRDI->setVertexBuffer( 0, curBuf, 0, 12 * sizeof( float ) );
+		gRDI->setVertexBuffer( 1, gs.attribBuf, 0, 16 * sizeof( float ) );
+		gRDI->drawFeedback( gs.stateBufs[1 - gs.curStateBuf], 0, step.slotCount );
+		gs.curStateBuf = 1 - gs.curStateBuf;
+	}
+
+	gs.steps.resize( 0 );
+	gs.spawnSlots.resize( 0 );
+	gs.spawnAttribs.resize( 0 );
+	gs.spawnStates.resize( 0 );
+	
+	gRDI->setVertexLayout( 0 );
+	gRDI->bindShader( 0 );
+}
+
+
+void Renderer::updateGPUParticles()
+{
+	if( _particleSimShader == 0 ) return;
+	
+	// Recorded steps are run for all emitters, not only the visible ones
+	vector< SceneNode * > &nodes = Modules::sceneMan()._nodes;
+	for( size_t i = 0, s = nodes.size(); i < s; ++i )
+	{
+		if( nodes[i] == 0x0 || nodes[i]->getType() != SceneNodeTypes::Emitter ) continue;
+		
+		EmitterNode *emitter = (EmitterNode *)nodes[i];
+		if( emitter->_gpuState != 0x0 ) simulateParticlesGPU( emitter );
+	}
+}
+
+
+void Renderer::uploadParticleTex( ParticleNode *parNode )
+{
+	// The texture is shared by all passes and cameras until the node is updated again
+	if( parNode->_parTexVersion == parNode->getRenderDataVersion() ) return;
+	parNode->_parTexVersion = parNode->getRenderDataVersion();
+	
+	uint32 parCount = parNode->_gpuState != 0x0 ? parNode->_gpuState->slotCount : parNode->getRenderCount();
+	uint32 numRows = (parCount * 3 + ParticleTexWidth - 1) / ParticleTexWidth;
+	if( numRows == 0 ) return;
+	
+	if( numRows > parNode->_parTexHeight )
+	{
+		uint32 height = std::max( parNode->_parTexHeight, 1u );
+		while( height < numRows ) height *= 2;
+		
+		gRDI->destroyTexture( parNode->_parTex );
+		parNode->_parTex = gRDI->createTexture( TextureTypes::Tex2D, ParticleTexWidth, height, 1,
+		                                        TextureFormats::RGBA32F, false, false, false, false );
+		gRDI->uploadTextureData( parNode->_parTex, 0, 0, 0x0 );
+		parNode->_parTexHeight = height;
+	}
+
+	// The simulation output has the layout of the texture already
+	if( parNode->_gpuState != 0x0 )
+	{
+		ParticleGPUState &gs = *parNode->_gpuState;
+		gRDI->updateTextureRowsFromBuffer( parNode->_parTex, 0, numRows, gs.stateBufs[gs.curStateBuf] );
+		return;
+	}
+
+	// Three texels per particle: position and size, color, rotation
+	_particleTexData.resize( numRows * ParticleTexWidth * 4 );
+	float *dst = &_particleTexData[0];
+	const float *pos = parNode->getRenderPositions(), *sizeRot = parNode->getRenderSizesAndRotations();
+	const float *col = parNode->getRenderColors();
+	for( uint32 i = 0; i < parCount; ++i )
+	{
+		dst[0] = pos[0]; dst[1] = pos[1]; dst[2] = pos[2]; dst[3] = sizeRot[0];
+		dst[4] = col[0]; dst[5] = col[1]; dst[6] = col[2]; dst[7] = col[3];
+		dst[8] = sizeRot[1]; dst[9] = 0; dst[10] = 0; dst[11] = 0;
+		dst += 12; pos += 3; sizeRot += 2; col += 4;
+	}
+
+	gRDI->updateTextureRows( parNode->_parTex, 0, numRows, &_particleTexData[0] );
+}
+
+
+void Renderer::sortParticles( uint32 firstItem, uint32 lastItem, const string &theClass )
+{
+	const RenderQueue &renderQueue = Modules::sceneMan().getRenderQueue();
+
+	// Particles of GPU emitters are not available on the CPU
+	_sortNodes.resize( 0 );
+	for( uint32 i = firstItem; i <= lastItem; ++i )
+	{
+		ParticleNode *parNode = (ParticleNode *)renderQueue[i].node;
+		if( !parNode->_depthSort || parNode->_gpuState != 0x0 || parNode->getRenderCount() == 0 ) continue;
+		if( !parNode->_materialRes->isOfClass( theClass ) ) continue;
+
+		// The order is shared by all passes that render the node for the same camera
+		if( parNode->_sortCamera == _curCamera && parNode->_sortFrame == _frameID &&
+		    parNode->_sortDataVersion == parNode->getRenderDataVersion() ) continue;
+		parNode->_sortCamera = _curCamera;
+		parNode->_sortFrame = _frameID;
+		parNode->_sortDataVersion = parNode->getRenderDataVersion();
+		++parNode->_depthOrderVersion;
+		_sortNodes.push_back( parNode );
+	}
+	if( _sortNodes.empty() ) return;
+
+	// Viewing direction in world space
+	const Matrix4f &viewMat = _curCamera->getViewMat();
+	_particleSortDir = Vec3f( -viewMat.c[0][2], -viewMat.c[1][2], -viewMat.c[2][2] );
+
+	Modules::threadPool().parallelFor( (uint32)_sortNodes.size(), sortParticlesFunc, this );
+}
+
+
+void Renderer::sortParticlesFunc( void *userData, unsigned int index )
+{
+	Renderer *renderer = (Renderer *)userData;
+	ParticleNode *parNode = renderer->_sortNodes[index];
+
+	sortParticlesByDepth( parNode->getRenderPositions(), parNode->getRenderCount(), renderer->_particleSortDir,
+	                      parNode->_depthOrder );
+}
+
+
+void Renderer::uploadParticleOrder( ParticleNode *parNode )
+{
+	if( parNode->_parOrderVBOVersion == parNode->_depthOrderVersion ) return;
+	parNode->_parOrderVBOVersion = parNode->_depthOrderVersion;
+
+	const ParticleDepthOrder &depthOrder = parNode->_depthOrder;
+	if( depthOrder.count > parNode->_parOrderVBOSize )
+	{
+		uint32 size = std::max( parNode->_parOrderVBOSize, ParticlesPerBatch );
+		while( size < depthOrder.count ) size *= 2;
+
+		gRDI->destroyBuffer( parNode->_parOrderVBO );
+		parNode->_parOrderVBO = gRDI->createVertexBuffer( size * 4 * sizeof( ParticleVert ), 0x0 );
+		parNode->_parOrderVBOSize = size;
+	}
+	
+	// Same quads as the particle geometry, but with the indices of the sorted particles
+	static const ParticleVert corners[4] = {
+		ParticleVert( 0, 0 ), ParticleVert( 1, 0 ), ParticleVert( 1, 1 ), ParticleVert( 0, 1 ) };
+	_particleOrderData.resize( depthOrder.count * 4 );
+	for( uint32 i = 0; i < depthOrder.count; ++i )
+	{
+		for( uint32 j = 0; j < 4; ++j )
+		{
+			_particleOrderData[i * 4 + j] = corners[j];
+			_particleOrderData[i * 4 + j].index = (float)depthOrder.order[i];
+		}
+	}
+
+	gRDI->updateBufferData( parNode->_parOrderVBO, 0, depthOrder.count * 4 * sizeof( ParticleVert ),
+	                        &_particleOrderData[0] );
+}
+
+
 void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, const string &shaderContext, const string &theClass,
                               bool debugView, const Frustum *frust1, const Frustum * /*frust2*/, RenderingOrder::List /*order*/,
                               int occSet )
@@ -1690,60 +2329,58 @@ void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, const string &s
 	GPUTimer *timer = Modules::stats().getGPUTimer( EngineStats::ParticleGPUTime );
 	if( Modules::config().gatherTimeStats ) timer->beginQuery( Modules::renderer().getFrameID() );
 
-	// Bind particle geometry
-	gRDI->setVertexBuffer( 0, Modules::renderer().getParticleVBO(), 0, sizeof( ParticleVert ) );
-	gRDI->setIndexBuffer( Modules::renderer().getQuadIdxBuf(), IDXFMT_16 );
 	ASSERT( QuadIndexBufCount >= ParticlesPerBatch * 6 );
 
-	// Loop through emitter queue
+	Modules::renderer().sortParticles( firstItem, lastItem, theClass );
+
+	// Loop through particle node queue
 	for( uint32 i = firstItem; i <= lastItem; ++i )
 	{
-		EmitterNode *emitter = (EmitterNode *)renderQueue[i].node;
+		ParticleNode *parNode = (ParticleNode *)renderQueue[i].node;
 		
-		if( emitter->_particleCount == 0 ) continue;
-		if( !emitter->_materialRes->isOfClass( theClass ) ) continue;
+		if( parNode->getRenderCount() == 0 ) continue;
+		if( !parNode->_materialRes->isOfClass( theClass ) ) continue;
 		
 		// Occlusion culling
 		uint32 queryObj = 0;
 		if( occSet >= 0 )
 		{
-			if( occSet > (int)emitter->_occQueries.size() - 1 )
+			if( occSet > (int)parNode->_occQueries.size() - 1 )
 			{
-				emitter->_occQueries.resize( occSet + 1, 0 );
-				emitter->_lastVisited.resize( occSet + 1, 0 );
+				parNode->_occQueries.resize( occSet + 1, 0 );
+				parNode->_lastVisited.resize( occSet + 1, 0 );
 			}
-			if( emitter->_occQueries[occSet] == 0 )
+			if( parNode->_occQueries[occSet] == 0 )
 			{
 				queryObj = gRDI->createOcclusionQuery();
-				emitter->_occQueries[occSet] = queryObj;
-				emitter->_lastVisited[occSet] = 0;
+				parNode->_occQueries[occSet] = queryObj;
+				parNode->_lastVisited[occSet] = 0;
 			}
 			else
 			{
-				if( emitter->_lastVisited[occSet] != Modules::renderer().getFrameID() )
+				if( parNode->_lastVisited[occSet] != Modules::renderer().getFrameID() )
 				{
-					emitter->_lastVisited[occSet] = Modules::renderer().getFrameID();
+					parNode->_lastVisited[occSet] = Modules::renderer().getFrameID();
 				
 					// Check query result (viewer must be outside of bounding box)
-					if( nearestDistToAABB( frust1->getOrigin(), emitter->getBBox().min,
-					                       emitter->getBBox().max ) > 0 &&
-						gRDI->getQueryResult( emitter->_occQueries[occSet] ) < 1 )
+					const BoundingBox &bBox = parNode->getRenderBBox();
+					if( nearestDistToAABB( frust1->getOrigin(), bBox.min, bBox.max ) > 0 &&
+						gRDI->getQueryResult( parNode->_occQueries[occSet] ) < 1 )
 					{
-						Modules::renderer().pushOccProxy( 0, emitter->getBBox().min,
-							emitter->getBBox().max, emitter->_occQueries[occSet] );
+						Modules::renderer().pushOccProxy( 0, bBox.min, bBox.max, parNode->_occQueries[occSet] );
 						continue;
 					}
 					else
-						queryObj = emitter->_occQueries[occSet];
+						queryObj = parNode->_occQueries[occSet];
 				}
 			}
 		}
 		
 		// Set material
-		if( curMatRes != emitter->_materialRes )
+		if( curMatRes != parNode->_materialRes )
 		{
-			if( !Modules::renderer().setMaterial( emitter->_materialRes, shaderContext ) ) continue;
-			curMatRes = emitter->_materialRes;
+			if( !Modules::renderer().setMaterial( parNode->_materialRes, shaderContext ) ) continue;
+			curMatRes = parNode->_materialRes;
 		}
 
 		// Set vertex layout
@@ -1756,74 +2393,98 @@ void Renderer::drawParticles( uint32 firstItem, uint32 lastItem, const string &s
 		ShaderCombination *curShader = Modules::renderer().getCurShader();
 		if( curShader->uni_nodeId >= 0 )
 		{
-			float id = (float)emitter->getHandle();
+			float id = (float)parNode->getHandle();
 			gRDI->setShaderConst( curShader->uni_nodeId, CONST_FLOAT, &id );
 		}
 
-		// Divide particles in batches and render them
-		for( uint32 j = 0; j < emitter->_particleCount / ParticlesPerBatch; ++j )
+		// Emitters simulated on the GPU can only be rendered from the particle texture
+		uint32 parCount = parNode->getRenderCount();
+		if( parNode->_gpuState != 0x0 )
 		{
-			// Check if batch needs to be rendered
-			bool allDead = true;
-			for( uint32 k = 0; k < ParticlesPerBatch; ++k )
+			if( curShader->uni_parTexParams < 0 )
 			{
-				if( emitter->_particles[j*ParticlesPerBatch + k].life > 0 )
-				{
-					allDead = false;
-					break;
-				}
+				if( queryObj )
+					gRDI->endQuery( queryObj );
+				continue;
 			}
-			if( allDead ) continue;
-
-			// Render batch
-			if( curShader->uni_parPosArray >= 0 )
-				gRDI->setShaderConst( curShader->uni_parPosArray, CONST_FLOAT3,
-				                      (float *)emitter->_parPositions + j*ParticlesPerBatch*3, ParticlesPerBatch );
-			if( curShader->uni_parSizeAndRotArray >= 0 )
-				gRDI->setShaderConst( curShader->uni_parSizeAndRotArray, CONST_FLOAT2,
-				                      (float *)emitter->_parSizesANDRotations + j*ParticlesPerBatch*2, ParticlesPerBatch );
-			if( curShader->uni_parColorArray >= 0 )
-				gRDI->setShaderConst( curShader->uni_parColorArray, CONST_FLOAT4,
-				                      (float *)emitter->_parColors + j*ParticlesPerBatch*4, ParticlesPerBatch );
-
-			gRDI->drawIndexed( PRIM_TRILIST, 0, ParticlesPerBatch * 6, 0, ParticlesPerBatch * 4 );
-			Modules::stats().incStat( EngineStats::BatchCount, 1 );
-			Modules::stats().incStat( EngineStats::TriCount, ParticlesPerBatch * 2.0f );
+			parCount = parNode->_gpuState->slotCount;
 		}
+		bool sorted = parNode->_depthSort && parNode->_gpuState == 0x0;
 
-		uint32 count = emitter->_particleCount % ParticlesPerBatch;
-		if( count > 0 )
+		if( curShader->uni_parTexParams >= 0 )
 		{
-			uint32 offset = (emitter->_particleCount / ParticlesPerBatch) * ParticlesPerBatch;
+			// Particle attributes are fetched from a texture, so a single draw call can render
+			// as many particles as the particle geometry holds
+			Modules::renderer().uploadParticleTex( parNode );
+			gRDI->setTexture( 11, parNode->_parTex, SS_FILTER_POINT | SS_ANISO1 | SS_ADDR_CLAMP );
+			gRDI->setVertexBuffer( 0, Modules::renderer()._particleTexVBO, 0, sizeof( ParticleVert ) );
+			gRDI->setIndexBuffer( Modules::renderer()._particleTexIdxBuf, IDXFMT_16 );
+			if( sorted ) Modules::renderer().uploadParticleOrder( parNode );
 			
-			// Check if batch needs to be rendered
-			bool allDead = true;
-			for( uint32 k = 0; k < count; ++k )
+			for( uint32 offset = 0; offset < parCount; offset += ParticlesPerTexBatch )
 			{
-				if( emitter->_particles[offset + k].life > 0 )
+				uint32 count = std::min( parCount - offset, ParticlesPerTexBatch );
+				float params[4] = { (float)offset * 3, 0, 1.0f / (float)ParticleTexWidth,
+				                    1.0f / (float)parNode->_parTexHeight };
+				if( sorted )
 				{
-					allDead = false;
-					break;
+					// The quads of sorted particles hold absolute particle indices
+					gRDI->setVertexBuffer( 0, parNode->_parOrderVBO, offset * 4 * sizeof( ParticleVert ),
+					                       sizeof( ParticleVert ) );
+					params[0] = 0;
 				}
-			}
-			
-			if( !allDead )
-			{
-				// Render batch
-				if( curShader->uni_parPosArray >= 0 )
-					gRDI->setShaderConst( curShader->uni_parPosArray, CONST_FLOAT3,
-					                      (float *)emitter->_parPositions + offset*3, count );
-				if( curShader->uni_parSizeAndRotArray >= 0 )
-					gRDI->setShaderConst( curShader->uni_parSizeAndRotArray, CONST_FLOAT2,
-					                      (float *)emitter->_parSizesANDRotations + offset*2, count );
-				if( curShader->uni_parColorArray >= 0 )
-					gRDI->setShaderConst( curShader->uni_parColorArray, CONST_FLOAT4,
-					                      (float *)emitter->_parColors + offset*4, count );
-				
+				gRDI->setShaderConst( curShader->uni_parTexParams, CONST_FLOAT4, params );
+
 				gRDI->drawIndexed( PRIM_TRILIST, 0, count * 6, 0, count * 4 );
 				Modules::stats().incStat( EngineStats::BatchCount, 1 );
 				Modules::stats().incStat( EngineStats::TriCount, count * 2.0f );
 			}
+
+			if( queryObj )
+				gRDI->endQuery( queryObj );
+			continue;
+		}
+
+		// Divide live particles in batches and render them
+		gRDI->setVertexBuffer( 0, Modules::renderer().getParticleVBO(), 0, sizeof( ParticleVert ) );
+		gRDI->setIndexBuffer( Modules::renderer().getQuadIdxBuf(), IDXFMT_16 );
+		const float *parPositions = parNode->getRenderPositions();
+		const float *parSizesAndRotations = parNode->getRenderSizesAndRotations();
+		const float *parColors = parNode->getRenderColors();
+		for( uint32 offset = 0; offset < parCount; offset += ParticlesPerBatch )
+		{
+			uint32 count = std::min( parCount - offset, ParticlesPerBatch );
+			const float *positions = parPositions + offset*3;
+			const float *sizesAndRotations = parSizesAndRotations + offset*2;
+			const float *colors = parColors + offset*4;
+
+			float sortedData[ParticlesPerBatch * 9];
+			if( sorted )
+			{
+				// Gather the batch in sorted order
+				const uint32 *order = &parNode->_depthOrder.order[offset];
+				for( uint32 j = 0; j < count; ++j )
+				{
+					memcpy( sortedData + j*3, parPositions + order[j]*3, 3 * sizeof( float ) );
+					memcpy( sortedData + ParticlesPerBatch * 3 + j*2, parSizesAndRotations + order[j]*2,
+					        2 * sizeof( float ) );
+					memcpy( sortedData + ParticlesPerBatch * 5 + j*4, parColors + order[j]*4, 4 * sizeof( float ) );
+				}
+				positions = sortedData;
+				sizesAndRotations = sortedData + ParticlesPerBatch * 3;
+				colors = sortedData + ParticlesPerBatch * 5;
+			}
+			
+			if( curShader->uni_parPosArray >= 0 )
+				gRDI->setShaderConst( curShader->uni_parPosArray, CONST_FLOAT3, positions, count );
+			if( curShader->uni_parSizeAndRotArray >= 0 )
+				gRDI->setShaderConst( curShader->uni_parSizeAndRotArray, CONST_FLOAT2, sizesAndRotations, count );
+			if( curShader->uni_parColorArray >= 0 )
+				gRDI->setShaderConst( curShader->uni_parColorArray, CONST_FLOAT4, colors, count );
+
+			gRDI->drawIndexed( PRIM_TRILIST, 0, count * 6, 0, count * 4 );
+			Modules::stats().incStat( EngineStats::BatchCount, 1 );
+			Modules::stats().incStat( EngineStats::TriCount, count * 2.0f );
 		}
 
 		if( queryObj )
@@ -1858,6 +2519,12 @@ void Renderer::render( CameraNode *camNode )
 	else _maxAnisoMask = SS_ANISO16;
 	gRDI->beginRendering();
 	gRDI->setViewport( _curCamera->_vpX, _curCamera->_vpY, _curCamera->_vpWidth, _curCamera->_vpHeight );
+	
+	updateSkinPalette();
+	if( _skinPaletteTex != 0 )
+		gRDI->setTexture( 15, _skinPaletteTex, SS_FILTER_POINT | SS_ANISO1 | SS_ADDR_CLAMP );
+	updateGPUParticles();
+	
 	if( Modules::config().debugViewMode || _curCamera->_pipelineRes == 0x0 )
 	{
 		renderDebugView();
@@ -1872,6 +2539,10 @@ void Renderer::render( CameraNode *camNode )
 	else 
 		gRDI->setRenderBuffer( 0 );
 
+	// Software occlusion culling; the buffer is consumed by the geometry commands below
+	if( _curCamera->_swOccCulling ) rasterizeOccluders();
+	else _swOccBuffer.invalidate();
+
 	// Process pipeline commands
 	for( uint32 i = 0; i < _curCamera->_pipelineRes->_stages.size(); ++i )
 	{
@@ -1947,6 +2618,11 @@ void Renderer::render( CameraNode *camNode )
 				drawLightShapes( pc.params[0].getString(), pc.params[1].getBool(), _curCamera->_occSet );
 				break;
 
+			case PipelineCommands::DrawClusteredGeometry:
+				drawClusteredGeometry( pc.params[0].getString(), pc.params[1].getString(),
+				                       (RenderingOrder::List)pc.params[2].getInt(), _curCamera->_occSet );
+				break;
+
 			case PipelineCommands::SetUniform:
 				if( pc.params[0].getResource() && pc.params[0].getResource()->getType() == ResourceTypes::Material )
 				{
@@ -1973,6 +2649,10 @@ void Renderer::finalizeFrame()
 	Modules::stats().getStat( EngineStats::FrameTime, true );  // Reset
 	Modules::stats().incStat( EngineStats::FrameTime, timer->getElapsedTimeMS() );
 	timer->reset();
+
+	// Cached poses remain correct since their keys describe all inputs, so the cache is simply kept
+	// for another frame while a background update may still be using it
+	if( !Modules::frameMan().isUpdatePending() ) AnimationController::poseCache.clear();
 }
 
 
@@ -2005,7 +2685,7 @@ void Renderer::renderDebugView()
 	{
 		SceneNode *sn = Modules::sceneMan().getRenderQueue()[i].node;
 		
-		drawAABB( sn->_bBox.min, sn->_bBox.max );
+		drawAABB( sn->getRenderBBox().min, sn->getRenderBBox().max );
 	}
 	gRDI->setCullMode( RS_CULL_BACK );
 
@@ -17,6 +17,8 @@
 #include "egRendererBase.h"
 #include "egPrimitives.h"
 #include "egModel.h"
+#include "egOcclusion.h"
+#include "egLightCluster.h"
 #include <vector>
 #include <algorithm>
 
@@ -26,11 +28,19 @@ namespace Horde3D {
 class MaterialResource;
 class LightNode;
 class CameraNode;
+class EmitterNode;
+class ParticleNode;
 struct ShaderContext;
 
 const uint32 MaxNumOverlayVerts = 2048;
 const uint32 ParticlesPerBatch = 64;	// Warning: The GPU must have enough registers
 const uint32 QuadIndexBufCount = MaxNumOverlayVerts * 6;
+const uint32 ClusterGridTexWidth = 1024;  // Warning: The grid texture layout is hardcoded in the shaders
+const uint32 ClusterGridTexHeight = 16;
+const uint32 SkinPaletteTexWidth = 1024;  // Must be a power of two
+const uint32 ParticleTexWidth = 1024;  // Must be a power of two
+const uint32 ParticlesPerTexBatch = 16384;  // Four vertices per particle have to be addressable with 16 bit indices
+const uint32 ParticleGPUSlotGranularity = ParticleTexWidth;  // GPU buffers hold whole texture rows
 
 #define OCCPROXYLIST_RENDERABLES 0
 #define OCCPROXYLIST_LIGHTS 1
@@ -158,6 +168,12 @@ public:
 	void finalizeFrame();
 
 	uint32 getFrameID() { return _frameID; }
+	bool hasSkinPalette() { return _skinPaletteSupported; }
+	bool hasParticleTex() { return _particleTexSupported; }
+	bool hasGPUParticles() { return _particleSimShader != 0; }
+	void simulateParticlesGPU( EmitterNode *emitter );
+	void refreshSkinPalette( uint32 firstItem, uint32 lastItem );
+	void commitSkinPalette();
 	ShaderCombination *getCurShader() { return _curShader; }
 	CameraNode *getCurCamera() { return _curCamera; }
 	uint32 getQuadIdxBuf() { return _quadIdxBuf; }
@@ -184,6 +200,17 @@ protected:
 	void drawLightGeometry( const std::string &shaderContext, const std::string &theClass,
 	                        bool noShadows, RenderingOrder::List order, int occSet );
 	void drawLightShapes( const std::string &shaderContext, bool noShadows, int occSet );
+	void drawClusteredGeometry( const std::string &shaderContext, const std::string &theClass,
+	                            RenderingOrder::List order, int occSet );
+	void updateLightClusters();
+	void rasterizeOccluders();
+	void updateSkinPalette();
+	void collectSkinPalette();
+	void uploadParticleTex( ParticleNode *parNode );
+	void updateGPUParticles();
+	void sortParticles( uint32 firstItem, uint32 lastItem, const std::string &theClass );
+	static void sortParticlesFunc( void *userData, unsigned int index );
+	void uploadParticleOrder( ParticleNode *parNode );
 	
 	void drawRenderables( const std::string &shaderContext, const std::string &theClass, bool debugView,
 		const Frustum *frust1, const Frustum *frust2, RenderingOrder::List order, int occSet );
@@ -202,6 +229,25 @@ protected:
 	std::vector< PipeSamplerBinding >  _pipeSamplerBindings;
 	std::vector< char >                _occSets;  // Actually bool
 	std::vector< OccProxy >            _occProxies[2];  // 0: renderables, 1: lights
+	OcclusionBuffer                    _swOccBuffer;
+	LightClusterGrid                   _lightClusters;
+	uint32                             _clusterLightTex, _clusterGridTex;
+	std::vector< float >               _clusterTexData;
+	float                              _clusterDims[4], _clusterDepthParams[4], _clusterViewport[4];
+	bool                               _skinPaletteSupported;
+	uint32                             _skinPaletteTex, _skinPaletteHeight, _skinPaletteFrame;
+	bool                               _skinPaletteDirty;  // Data not yet uploaded
+	std::vector< Vec4f >               _skinPaletteData;
+	bool                               _particleTexSupported;
+	uint32                             _particleTexVBO, _particleTexIdxBuf;
+	std::vector< float >               _particleTexData;
+	uint32                             _particleSimShader;  // Transform feedback, see simulateParticlesGPU
+	int                                _parSimShader_timeDelta, _parSimShader_force;  // Uniform locations
+	int                                _parSimShader_rates, _parSimShader_colRates;
+	int                                _parSimShader_curveMasks, _parSimShader_curves;
+	std::vector< ParticleNode * >      _sortNodes;  // Nodes sorted by the current sortParticles
+	Vec3f                              _particleSortDir;
+	std::vector< ParticleVert >        _particleOrderData;
 	
 	std::vector< OverlayBatch >        _overlayBatches;
 	OverlayVert                        *_overlayVerts;
@@ -224,7 +270,7 @@ protected:
 	float                              _splitPlanes[5];
 	Matrix4f                           _lightMats[4];
 
-	uint32                             _vlPosOnly, _vlOverlay, _vlModel, _vlParticle;
+	uint32                             _vlPosOnly, _vlOverlay, _vlModel, _vlParticle, _vlParticleSim;
 	ShaderCombination                  _defColorShader;
 	int                                _defColShader_color;  // Uniform location
 	
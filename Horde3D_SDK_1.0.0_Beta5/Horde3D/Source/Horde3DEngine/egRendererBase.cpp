@@ -155,6 +155,10 @@ RenderDevice::RenderDevice()
 	_defaultFBO = 0;
 	_indexFormat = (uint32)IDXFMT_16;
 	_pendingMask = 0;
+	_curTexUnit = 0;
+
+	for( uint32 i = 0; i < 4; ++i ) _curViewport[i] = _curScissor[i] = -1;
+	for( uint32 i = 0; i < SC_COUNT; ++i ) _submittedStates[i] = _appliedStates[i] = 0;
 }
 
 
@@ -229,6 +233,10 @@ bool RenderDevice::init()
 	_caps.texFloat = glExt::ARB_texture_float ? 1 : 0;
 	_caps.texNPOT = glExt::ARB_texture_non_power_of_two ? 1 : 0;
 	_caps.rtMultisampling = glExt::EXT_framebuffer_multisample ? 1 : 0;
+	int vertTexUnits = 0;
+	glGetIntegerv( GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &vertTexUnits );
+	_caps.texVertexFetch = _caps.texFloat && vertTexUnits > 0;
+	_caps.transformFeedback = glExt::EXT_transform_feedback ? 1 : 0;
 
 	// Find supported depth format (some old ATI cards only support 16 bit depth for FBOs)
 	_depthFormat = GL_DEPTH_COMPONENT24;
@@ -303,6 +311,7 @@ uint32 RenderDevice::createIndexBuffer( uint32 size, const void *data )
 	glBindBuffer( buf.type, buf.glObj );
 	glBufferData( buf.type, size, data, GL_DYNAMIC_DRAW );
 	glBindBuffer( buf.type, 0 );
+	_curIndexBuf = 0;
 	
 	_bufferMem += size;
 	return _buffers.add( buf );
@@ -316,6 +325,13 @@ void RenderDevice::destroyBuffer( uint32 bufObj )
 	RDIBuffer &buf = _buffers.getRef( bufObj );
 	glDeleteBuffers( 1, &buf.glObj );
 
+	// Deleting a buffer unbinds it, and the handle may be reused by a new buffer
+	if( _curIndexBuf == bufObj ) _curIndexBuf = 0;
+	for( uint32 i = 0; i < 16; ++i )
+	{
+		if( _curVertBufSlots[i].vbObj == bufObj ) _curVertBufSlots[i].vbObj = 0;
+	}
+
 	_bufferMem -= buf.size;
 	_buffers.remove( bufObj );
 }
@@ -327,6 +343,7 @@ void RenderDevice::updateBufferData( uint32 bufObj, uint32 offset, uint32 size,
 	ASSERT( offset + size <= buf.size );
 	
 	glBindBuffer( buf.type, buf.glObj );
+	if( buf.type == GL_ELEMENT_ARRAY_BUFFER ) _curIndexBuf = bufObj;
 	
 	if( offset == 0 &&  size == buf.size )
 	{
@@ -339,6 +356,19 @@ void RenderDevice::updateBufferData( uint32 bufObj, uint32 offset, uint32 size,
 }
 
 
+bool RenderDevice::getBufferData( uint32 bufObj, uint32 offset, uint32 size, void *data )
+{
+	const RDIBuffer &buf = _buffers.getRef( bufObj );
+	if( offset + size > buf.size ) return false;
+	
+	glBindBuffer( buf.type, buf.glObj );
+	if( buf.type == GL_ELEMENT_ARRAY_BUFFER ) _curIndexBuf = bufObj;
+	glGetBufferSubData( buf.type, offset, size, data );
+
+	return true;
+}
+
+
 // =================================================================================================
 // Textures
 // =================================================================================================
@@ -417,7 +447,7 @@ uint32 RenderDevice::createTexture( TextureTypes::List type, int width, int heig
 	};
 	
 	glGenTextures( 1, &tex.glObj );
-	glActiveTexture( GL_TEXTURE15 );
+	activateTexUnit( 15 );
 	glBindTexture( tex.type, tex.glObj );
 	
 	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -427,8 +457,8 @@ uint32 RenderDevice::createTexture( TextureTypes::List type, int width, int heig
 	applySamplerState( tex );
 	
 	glBindTexture( tex.type, 0 );
-	if( _texSlots[15].texObj )
-		glBindTexture( _textures.getRef( _texSlots[15].texObj ).type, _textures.getRef( _texSlots[15].texObj ).glObj );
+	if( _curTexUnits[15].glObj != 0 )
+		glBindTexture( _curTexUnits[15].type, _curTexUnits[15].glObj );
 
 	// Calculate memory requirements
 	tex.memSize = calcTextureSize( format, width, height, depth );
@@ -445,7 +475,7 @@ void RenderDevice::uploadTextureData( uint32 texObj, int slice, int mipLevel, co
 	const RDITexture &tex = _textures.getRef( texObj );
 	TextureFormats::List format = tex.format;
 
-	glActiveTexture( GL_TEXTURE15 );
+	activateTexUnit( 15 );
 	glBindTexture( tex.type, tex.glObj );
 	
 	int inputFormat = GL_BGRA, inputType = GL_UNSIGNED_BYTE;
@@ -502,8 +532,8 @@ void RenderDevice::uploadTextureData( uint32 texObj, int slice, int mipLevel, co
 	}
 
 	glBindTexture( tex.type, 0 );
-	if( _texSlots[15].texObj )
-		glBindTexture( _textures.getRef( _texSlots[15].texObj ).type, _textures.getRef( _texSlots[15].texObj ).glObj );
+	if( _curTexUnits[15].glObj != 0 )
+		glBindTexture( _curTexUnits[15].type, _curTexUnits[15].glObj );
 }
 
 
@@ -514,6 +544,12 @@ void RenderDevice::destroyTexture( uint32 texObj )
 	const RDITexture &tex = _textures.getRef( texObj );
 	glDeleteTextures( 1, &tex.glObj );
 
+	// Deleted textures are unbound from all units and the GL name may be reused
+	for( uint32 i = 0; i < 16; ++i )
+	{
+		if( _curTexUnits[i].glObj == tex.glObj ) _curTexUnits[i].glObj = 0;
+	}
+
 	_textureMem -= tex.memSize;
 	_textures.remove( texObj );
 }
@@ -525,6 +561,52 @@ void RenderDevice::updateTextureData( uint32 texObj, int slice, int mipLevel, co
 }
 
 
+void RenderDevice::updateTextureRows( uint32 texObj, int firstRow, int numRows, const void *pixels )
+{
+	// Only used for data textures that change every frame, e.g. particle attributes
+	const RDITexture &tex = _textures.getRef( texObj );
+	ASSERT( tex.type == TextureTypes::Tex2D && firstRow + numRows <= tex.height );
+	
+	int inputFormat = GL_BGRA, inputType = GL_UNSIGNED_BYTE;
+	switch( tex.format )
+	{
+	case TextureFormats::RGBA16F:
+	case TextureFormats::RGBA32F:
+		inputFormat = GL_RGBA;
+		inputType = GL_FLOAT;
+		break;
+	case TextureFormats::BGRA8:
+		break;
+	default:
+		ASSERT( 0 );
+		return;
+	}
+	
+	activateTexUnit( 15 );
+	glBindTexture( tex.type, tex.glObj );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, firstRow, tex.width, numRows, inputFormat, inputType, pixels );
+	
+	glBindTexture( tex.type, 0 );
+	if( _curTexUnits[15].glObj != 0 )
+		glBindTexture( _curTexUnits[15].type, _curTexUnits[15].glObj );
+}
+
+
+void RenderDevice::updateTextureRowsFromBuffer( uint32 texObj, int firstRow, int numRows, uint32 bufObj )
+{
+	// Copies data that was generated on the GPU without a round trip through system memory
+	const RDIBuffer &buf = _buffers.getRef( bufObj );
+	const RDITexture &tex = _textures.getRef( texObj );
+	ASSERT( tex.format == TextureFormats::RGBA32F );
+	ASSERT( (uint32)(tex.width * numRows * 16) <= buf.size );
+	(void)tex;  // Only used by the assertions
+	
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, buf.glObj );
+	updateTextureRows( texObj, firstRow, numRows, 0x0 );
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+}
+
+
 bool RenderDevice::getTextureData( uint32 texObj, int slice, int mipLevel, void *buffer )
 {
 	const RDITexture &tex = _textures.getRef( texObj );
@@ -533,7 +615,7 @@ bool RenderDevice::getTextureData( uint32 texObj, int slice, int mipLevel, void
 	if( target == GL_TEXTURE_CUBE_MAP ) target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + slice;
 	
 	int fmt, type, compressed = 0;
-	glActiveTexture( GL_TEXTURE15 );
+	activateTexUnit( 15 );
 	glBindTexture( tex.type, tex.glObj );
 
 	switch( tex.format )
@@ -562,8 +644,8 @@ bool RenderDevice::getTextureData( uint32 texObj, int slice, int mipLevel, void
 		glGetTexImage( target, mipLevel, fmt, type, buffer );
 
 	glBindTexture( tex.type, 0 );
-	if( _texSlots[15].texObj )
-		glBindTexture( _textures.getRef( _texSlots[15].texObj ).type, _textures.getRef( _texSlots[15].texObj ).glObj );
+	if( _curTexUnits[15].glObj != 0 )
+		glBindTexture( _curTexUnits[15].type, _curTexUnits[15].glObj );
 
 	return true;
 }
@@ -609,6 +691,14 @@ uint32 RenderDevice::createShaderProgram( const char *vertexShaderSrc, const cha
 		return 0;
 	}
 
+	// Shader program
+	uint32 program = glCreateProgram();
+	glAttachShader( program, vs );
+	glDeleteShader( vs );
+	
+	// Programs for transform feedback have no fragment shader
+	if( fragmentShaderSrc == 0x0 ) return program;
+	
 	// Fragment shader
 	uint32 fs = glCreateShader( GL_FRAGMENT_SHADER );
 	glShaderSource( fs, 1, &fragmentShaderSrc, 0x0 );
@@ -625,16 +715,12 @@ uint32 RenderDevice::createShaderProgram( const char *vertexShaderSrc, const cha
 			delete[] infoLog; infoLog = 0x0;
 		}
 
-		glDeleteShader( vs );
 		glDeleteShader( fs );
+		glDeleteProgram( program );
 		return 0;
 	}
 
-	// Shader program
-	uint32 program = glCreateProgram();
-	glAttachShader( program, vs );
 	glAttachShader( program, fs );
-	glDeleteShader( vs );
 	glDeleteShader( fs );
 
 	return program;
@@ -674,6 +760,26 @@ uint32 RenderDevice::createShader( const char *vertexShaderSrc, const char *frag
 	if( programObj == 0 ) return 0;
 	if( !linkShaderProgram( programObj ) ) return 0;
 	
+	return addShader( programObj );
+}
+
+
+uint32 RenderDevice::createFeedbackShader( const char *vertexShaderSrc, const char **varyings, uint32 numVaryings )
+{
+	if( !_caps.transformFeedback ) return 0;
+	
+	// The captured varyings have to be specified before linking
+	uint32 programObj = createShaderProgram( vertexShaderSrc, 0x0 );
+	if( programObj == 0 ) return 0;
+	glTransformFeedbackVaryingsEXT( programObj, numVaryings, varyings, GL_INTERLEAVED_ATTRIBS_EXT );
+	if( !linkShaderProgram( programObj ) ) return 0;
+
+	return addShader( programObj );
+}
+
+
+uint32 RenderDevice::addShader( uint32 programObj )
+{
 	uint32 shaderId = _shaders.add( RDIShader() );
 	RDIShader &shader = _shaders.getRef( shaderId );
 	shader.oglProgramObj = programObj;
@@ -724,6 +830,22 @@ void RenderDevice::destroyShader( uint32 shaderId )
 	if( shaderId == 0 ) return;
 
 	RDIShader &shader = _shaders.getRef( shaderId );
+	
+	// Unbind program since the handle may be reused by a new shader
+	if( _curShaderId == shaderId )
+	{
+		glUseProgram( 0 );
+		_curShaderId = 0;
+		_pendingMask |= PM_VERTLAYOUT;
+	}
+	// The vertex layout skip in applyVertexLayout compares shader ids, so a new shader that
+	// reuses the slot must not be mistaken for the one whose attributes are still set up
+	if( _prevShaderId == shaderId )
+	{
+		_prevShaderId = 0;
+		_curVertLayout = 0;
+	}
+	
 	glDeleteProgram( shader.oglProgramObj );
 	_shaders.remove( shaderId );
 }
@@ -731,6 +853,9 @@ void RenderDevice::destroyShader( uint32 shaderId )
 
 void RenderDevice::bindShader( uint32 shaderId )
 {
+	++_submittedStates[SC_SHADER];
+	if( shaderId == _curShaderId ) return;
+	
 	if( shaderId != 0 )
 	{
 		RDIShader &shader = _shaders.getRef( shaderId );
@@ -741,6 +866,7 @@ void RenderDevice::bindShader( uint32 shaderId )
 		glUseProgram( 0 );
 	}
 	
+	++_appliedStates[SC_SHADER];
 	_curShaderId = shaderId;
 	_pendingMask |= PM_VERTLAYOUT;
 } 
@@ -760,27 +886,27 @@ int RenderDevice::getShaderSamplerLoc( uint32 shaderId, const char *name )
 }
 
 
-void RenderDevice::setShaderConst( int loc, RDIShaderConstType type, void *values, uint32 count )
+void RenderDevice::setShaderConst( int loc, RDIShaderConstType type, const void *values, uint32 count )
 {
 	switch( type )
 	{
 	case CONST_FLOAT:
-		glUniform1fv( loc, count, (float *)values );
+		glUniform1fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT2:
-		glUniform2fv( loc, count, (float *)values );
+		glUniform2fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT3:
-		glUniform3fv( loc, count, (float *)values );
+		glUniform3fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT4:
-		glUniform4fv( loc, count, (float *)values );
+		glUniform4fv( loc, count, (const float *)values );
 		break;
 	case CONST_FLOAT44:
-		glUniformMatrix4fv( loc, count, false, (float *)values );
+		glUniformMatrix4fv( loc, count, false, (const float *)values );
 		break;
 	case CONST_FLOAT33:
-		glUniformMatrix3fv( loc, count, false, (float *)values );
+		glUniformMatrix3fv( loc, count, false, (const float *)values );
 		break;
 	}
 }
@@ -1181,6 +1307,28 @@ bool RenderDevice::applyVertexLayout()
 {
 	uint32 newVertexAttribMask = 0;
 	
+	++_submittedStates[SC_VERTLAYOUT];
+	
+	// Skip if layout, shader and all referenced vertex buffer slots are unchanged
+	if( _newVertLayout == _curVertLayout && _curShaderId == _prevShaderId )
+	{
+		bool changed = false;
+		
+		if( _newVertLayout != 0 )
+		{
+			RDIVertexLayout &vl = _vertexLayouts[_newVertLayout - 1];
+			for( uint32 i = 0; i < vl.numAttribs && !changed; ++i )
+			{
+				const RDIVertBufSlot &vbSlot = _vertBufSlots[vl.attribs[i].vbSlot];
+				const RDIVertBufSlot &curVbSlot = _curVertBufSlots[vl.attribs[i].vbSlot];
+				changed = vbSlot.vbObj != curVbSlot.vbObj || vbSlot.offset != curVbSlot.offset ||
+				          vbSlot.stride != curVbSlot.stride;
+			}
+		}
+
+		if( !changed ) return true;
+	}
+	
 	if( _newVertLayout != 0 )
 	{
 		if( _curShaderId == 0 ) return false;
@@ -1193,6 +1341,7 @@ bool RenderDevice::applyVertexLayout()
 			return false;
 
 		// Set vertex attrib pointers
+		uint32 boundVB = 0;
 		for( uint32 i = 0; i < vl.numAttribs; ++i )
 		{
 			int8 attribIndex = inputLayout.attribIndices[i];
@@ -1204,7 +1353,11 @@ bool RenderDevice::applyVertexLayout()
 				ASSERT( _buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).glObj != 0 &&
 						_buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).type == GL_ARRAY_BUFFER );
 				
-				glBindBuffer( GL_ARRAY_BUFFER, _buffers.getRef( _vertBufSlots[attrib.vbSlot].vbObj ).glObj );
+				if( vbSlot.vbObj != boundVB )
+				{
+					glBindBuffer( GL_ARRAY_BUFFER, _buffers.getRef( vbSlot.vbObj ).glObj );
+					boundVB = vbSlot.vbObj;
+				}
 				glVertexAttribPointer( attribIndex, attrib.size, GL_FLOAT, GL_FALSE,
 									   vbSlot.stride, (char *)0 + vbSlot.offset + attrib.offset );
 
@@ -1224,6 +1377,9 @@ bool RenderDevice::applyVertexLayout()
 	}
 	_activeVertexAttribsMask = newVertexAttribMask;
 
+	for( uint32 i = 0; i < 16; ++i ) _curVertBufSlots[i] = _vertBufSlots[i];
+	++_appliedStates[SC_VERTLAYOUT];
+
 	return true;
 }
 
@@ -1263,32 +1419,53 @@ void RenderDevice::applySamplerState( RDITexture &tex )
 
 void RenderDevice::applyRenderStates()
 {
+	// Only the GL states that differ from the shadow copy are touched; a hash of 0xFFFFFFFF
+	// marks the shadow copy as unknown and forces all states of the category to be applied
+	
 	// Rasterizer state
 	if( _newRasterState.hash != _curRasterState.hash )
 	{
-		if( _newRasterState.fillMode == RS_FILL_SOLID ) glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
-		else glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
-
-		if( _newRasterState.cullMode == RS_CULL_BACK )
+		bool force = _curRasterState.hash == 0xFFFFFFFF;
+		
+		if( force || _newRasterState.fillMode != _curRasterState.fillMode )
 		{
-			glEnable( GL_CULL_FACE );
-			glCullFace( GL_BACK );
+			if( _newRasterState.fillMode == RS_FILL_SOLID ) glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+			else glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
+			++_appliedStates[SC_RENDERSTATES];
 		}
-		else if( _newRasterState.cullMode == RS_CULL_FRONT )
+
+		if( force || _newRasterState.cullMode != _curRasterState.cullMode )
 		{
-			glEnable( GL_CULL_FACE );
-			glCullFace( GL_FRONT );
+			if( _newRasterState.cullMode == RS_CULL_BACK )
+			{
+				glEnable( GL_CULL_FACE );
+				glCullFace( GL_BACK );
+			}
+			else if( _newRasterState.cullMode == RS_CULL_FRONT )
+			{
+				glEnable( GL_CULL_FACE );
+				glCullFace( GL_FRONT );
+			}
+			else
+			{
+				glDisable( GL_CULL_FACE );
+			}
+			++_appliedStates[SC_RENDERSTATES];
 		}
-		else
+
+		if( force || _newRasterState.scissorEnable != _curRasterState.scissorEnable )
 		{
-			glDisable( GL_CULL_FACE );
+			if( !_newRasterState.scissorEnable ) glDisable( GL_SCISSOR_TEST );
+			else glEnable( GL_SCISSOR_TEST );
+			++_appliedStates[SC_RENDERSTATES];
 		}
 
-		if( !_newRasterState.scissorEnable ) glDisable( GL_SCISSOR_TEST );
-		else glEnable( GL_SCISSOR_TEST );
-
-		if( _newRasterState.renderTargetWriteMask ) glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
-		else glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+		if( force || _newRasterState.renderTargetWriteMask != _curRasterState.renderTargetWriteMask )
+		{
+			if( _newRasterState.renderTargetWriteMask ) glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+			else glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+			++_appliedStates[SC_RENDERSTATES];
+		}
 		
 		_curRasterState.hash = _newRasterState.hash;
 	}
@@ -1296,19 +1473,29 @@ void RenderDevice::applyRenderStates()
 	// Blend state
 	if( _newBlendState.hash != _curBlendState.hash )
 	{
-		if( !_newBlendState.alphaToCoverageEnable ) glDisable( GL_SAMPLE_ALPHA_TO_COVERAGE );
-		else glEnable( GL_SAMPLE_ALPHA_TO_COVERAGE );
+		bool force = _curBlendState.hash == 0xFFFFFFFF;
+		
+		if( force || _newBlendState.alphaToCoverageEnable != _curBlendState.alphaToCoverageEnable )
+		{
+			if( !_newBlendState.alphaToCoverageEnable ) glDisable( GL_SAMPLE_ALPHA_TO_COVERAGE );
+			else glEnable( GL_SAMPLE_ALPHA_TO_COVERAGE );
+			++_appliedStates[SC_RENDERSTATES];
+		}
 
-		if( !_newBlendState.blendEnable )
+		if( force || _newBlendState.blendEnable != _curBlendState.blendEnable )
 		{
-			glDisable( GL_BLEND );
+			if( !_newBlendState.blendEnable ) glDisable( GL_BLEND );
+			else glEnable( GL_BLEND );
+			++_appliedStates[SC_RENDERSTATES];
 		}
-		else
+
+		if( force || _newBlendState.srcBlendFunc != _curBlendState.srcBlendFunc ||
+		    _newBlendState.destBlendFunc != _curBlendState.destBlendFunc )
 		{
 			uint32 oglBlendFuncs[8] = { GL_ZERO, GL_ONE, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_DST_COLOR, GL_ZERO, GL_ZERO };
 			
-			glEnable( GL_BLEND );
 			glBlendFunc( oglBlendFuncs[_newBlendState.srcBlendFunc], oglBlendFuncs[_newBlendState.destBlendFunc] );
+			++_appliedStates[SC_RENDERSTATES];
 		}
 		
 		_curBlendState.hash = _newBlendState.hash;
@@ -1317,19 +1504,28 @@ void RenderDevice::applyRenderStates()
 	// Depth-stencil state
 	if( _newDepthStencilState.hash != _curDepthStencilState.hash )
 	{
-		if( _newDepthStencilState.depthWriteMask ) glDepthMask( GL_TRUE );
-		else glDepthMask( GL_FALSE);
+		bool force = _curDepthStencilState.hash == 0xFFFFFFFF;
+		
+		if( force || _newDepthStencilState.depthWriteMask != _curDepthStencilState.depthWriteMask )
+		{
+			if( _newDepthStencilState.depthWriteMask ) glDepthMask( GL_TRUE );
+			else glDepthMask( GL_FALSE);
+			++_appliedStates[SC_RENDERSTATES];
+		}
+
+		if( force || _newDepthStencilState.depthEnable != _curDepthStencilState.depthEnable )
+		{
+			if( _newDepthStencilState.depthEnable ) glEnable( GL_DEPTH_TEST );
+			else glDisable( GL_DEPTH_TEST );
+			++_appliedStates[SC_RENDERSTATES];
+		}
 
-		if( _newDepthStencilState.depthEnable )
+		if( force || _newDepthStencilState.depthFunc != _curDepthStencilState.depthFunc )
 		{
 			uint32 oglDepthFuncs[8] = { GL_LEQUAL, GL_LESS, GL_EQUAL, GL_GREATER, GL_GEQUAL, GL_ALWAYS, GL_ALWAYS, GL_ALWAYS };
 			
-			glEnable( GL_DEPTH_TEST );
 			glDepthFunc( oglDepthFuncs[_newDepthStencilState.depthFunc] );
-		}
-		else
-		{
-			glDisable( GL_DEPTH_TEST );
+			++_appliedStates[SC_RENDERSTATES];
 		}
 		
 		_curDepthStencilState.hash = _newDepthStencilState.hash;
@@ -1346,7 +1542,14 @@ bool RenderDevice::commitStates( uint32 filter )
 		// Set viewport
 		if( mask & PM_VIEWPORT )
 		{
-			glViewport( _vpX, _vpY, _vpWidth, _vpHeight );
+			if( _vpX != _curViewport[0] || _vpY != _curViewport[1] ||
+			    _vpWidth != _curViewport[2] || _vpHeight != _curViewport[3] )
+			{
+				glViewport( _vpX, _vpY, _vpWidth, _vpHeight );
+				_curViewport[0] = _vpX; _curViewport[1] = _vpY;
+				_curViewport[2] = _vpWidth; _curViewport[3] = _vpHeight;
+				++_appliedStates[SC_VIEWPORT];
+			}
 			_pendingMask &= ~PM_VIEWPORT;
 		}
 
@@ -1359,7 +1562,14 @@ bool RenderDevice::commitStates( uint32 filter )
 		// Set scissor rect
 		if( mask & PM_SCISSOR )
 		{
-			glScissor( _scX, _scY, _scWidth, _scHeight );
+			if( _scX != _curScissor[0] || _scY != _curScissor[1] ||
+			    _scWidth != _curScissor[2] || _scHeight != _curScissor[3] )
+			{
+				glScissor( _scX, _scY, _scWidth, _scHeight );
+				_curScissor[0] = _scX; _curScissor[1] = _scY;
+				_curScissor[2] = _scWidth; _curScissor[3] = _scHeight;
+				++_appliedStates[SC_VIEWPORT];
+			}
 			_pendingMask &= ~PM_SCISSOR;
 		}
 		
@@ -1374,8 +1584,9 @@ bool RenderDevice::commitStates( uint32 filter )
 					glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
 				
 				_curIndexBuf = _newIndexBuf;
-				_pendingMask &= ~PM_INDEXBUF;
+				++_appliedStates[SC_INDEXBUF];
 			}
+			_pendingMask &= ~PM_INDEXBUF;
 		}
 
 		// Bind textures and set sampler state
@@ -1383,25 +1594,37 @@ bool RenderDevice::commitStates( uint32 filter )
 		{
 			for( uint32 i = 0; i < 16; ++i )
 			{
-				glActiveTexture( GL_TEXTURE0 + i );
-
+				RDITexUnit &unit = _curTexUnits[i];
+				RDITexture *tex = 0x0;
+				uint32 glObj = 0, type = unit.type;
+				
 				if( _texSlots[i].texObj != 0 )
 				{
-					RDITexture &tex = _textures.getRef( _texSlots[i].texObj );
-					glBindTexture( tex.type, tex.glObj );
-
-					// Apply sampler state
-					if( tex.samplerState != _texSlots[i].samplerState )
-					{
-						tex.samplerState = _texSlots[i].samplerState;
-						applySamplerState( tex );
-					}
+					tex = &_textures.getRef( _texSlots[i].texObj );
+					glObj = tex->glObj;
+					type = tex->type;
 				}
-				else
+
+				if( glObj != unit.glObj || type != unit.type )
+				{
+					activateTexUnit( i );
+					
+					// Unbind previous target so that each unit has at most one texture bound
+					if( unit.glObj != 0 && unit.type != type ) glBindTexture( unit.type, 0 );
+					glBindTexture( type, glObj );
+					
+					unit.glObj = glObj;
+					unit.type = type;
+					++_appliedStates[SC_TEXTURES];
+				}
+
+				// Apply sampler state
+				if( tex != 0x0 && tex->samplerState != _texSlots[i].samplerState )
 				{
-					glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
-					glBindTexture( GL_TEXTURE_3D, 0 );
-					glBindTexture( GL_TEXTURE_2D, 0 );
+					activateTexUnit( i );
+					tex->samplerState = _texSlots[i].samplerState;
+					applySamplerState( *tex );
+					++_appliedStates[SC_SAMPLERS];
 				}
 			}
 			
@@ -1411,14 +1634,11 @@ bool RenderDevice::commitStates( uint32 filter )
 		// Bind vertex buffers
 		if( mask & PM_VERTLAYOUT )
 		{
-			//if( _newVertLayout != _curVertLayout || _curShader != _prevShader )
-			{
-				if( !applyVertexLayout() )
-					return false;
-				_curVertLayout = _newVertLayout;
-				_prevShaderId = _curShaderId;
-				_pendingMask &= ~PM_VERTLAYOUT;
-			}
+			if( !applyVertexLayout() )
+				return false;
+			_curVertLayout = _newVertLayout;
+			_prevShaderId = _curShaderId;
+			_pendingMask &= ~PM_VERTLAYOUT;
 		}
 
 		CHECK_GL_ERROR
@@ -1430,14 +1650,28 @@ bool RenderDevice::commitStates( uint32 filter )
 
 void RenderDevice::resetStates()
 {
+	// Invalidate shadow copies since the GL state may have been changed outside of the engine
 	_curIndexBuf = 1; _newIndexBuf = 0;
 	_curVertLayout = 1; _newVertLayout = 0;
 	_curRasterState.hash = 0xFFFFFFFF; _newRasterState.hash = 0;
 	_curBlendState.hash = 0xFFFFFFFF; _newBlendState.hash = 0;
 	_curDepthStencilState.hash = 0xFFFFFFFF; _newDepthStencilState.hash = 0;
+	for( uint32 i = 0; i < 4; ++i ) _curViewport[i] = _curScissor[i] = -1;
 
 	for( uint32 i = 0; i < 16; ++i )
+	{
+		glActiveTexture( GL_TEXTURE0 + i );
+		glBindTexture( GL_TEXTURE_CUBE_MAP, 0 );
+		glBindTexture( GL_TEXTURE_3D, 0 );
+		glBindTexture( GL_TEXTURE_2D, 0 );
+		_curTexUnits[i] = RDITexUnit();
+		
 		setTexture( i, 0, 0 );
+	}
+	_curTexUnit = 15;
+
+	if( _curShaderId != 0 ) glUseProgram( _shaders.getRef( _curShaderId ).oglProgramObj );
+	else glUseProgram( 0 );
 
 	setColorWriteMask( true );
 	_pendingMask = 0xFFFFFFFF;
@@ -1448,6 +1682,18 @@ void RenderDevice::resetStates()
 }
 
 
+uint32 RenderDevice::getStateChangeCount( RDIStateCategory category, bool applied, bool reset )
+{
+	ASSERT( category < SC_COUNT );
+	
+	uint32 &count = applied ? _appliedStates[category] : _submittedStates[category];
+	uint32 value = count;
+	if( reset ) count = 0;
+	
+	return value;
+}
+
+
 // =================================================================================================
 // Draw calls and clears
 // =================================================================================================
@@ -1518,6 +1764,25 @@ void RenderDevice::draw( RDIPrimType primType, uint32 firstVert, uint32 numVerts
 }
 
 
+void RenderDevice::drawFeedback( uint32 bufObj, uint32 firstVert, uint32 numVerts )
+{
+	const RDIBuffer &buf = _buffers.getRef( bufObj );
+	
+	if( commitStates() )
+	{
+		glBindBufferBaseEXT( GL_TRANSFORM_FEEDBACK_BUFFER_EXT, 0, buf.glObj );
+		glEnable( GL_RASTERIZER_DISCARD_EXT );
+		glBeginTransformFeedbackEXT( GL_POINTS );
+		glDrawArrays( GL_POINTS, firstVert, numVerts );
+		glEndTransformFeedbackEXT();
+		glDisable( GL_RASTERIZER_DISCARD_EXT );
+		glBindBufferBaseEXT( GL_TRANSFORM_FEEDBACK_BUFFER_EXT, 0, 0 );
+	}
+
+	CHECK_GL_ERROR
+}
+
+
 void RenderDevice::drawIndexed( RDIPrimType primType, uint32 firstIndex, uint32 numIndices,
                                 uint32 firstVert, uint32 numVerts )
 {
@@ -107,6 +107,8 @@ struct DeviceCaps
 	bool  texFloat;
 	bool  texNPOT;
 	bool  rtMultisampling;
+	bool  texVertexFetch;  // Float textures can be sampled in vertex shaders
+	bool  transformFeedback;
 };
 
 
@@ -204,6 +206,14 @@ struct RDITexSlot
 		texObj( texObj ), samplerState( samplerState ) {}
 };
 
+struct RDITexUnit
+{
+	uint32  glObj;
+	uint32  type;  // Only a single target is bound per unit at a time
+
+	RDITexUnit() : glObj( 0 ), type( GL_TEXTURE_2D ) {}
+};
+
 
 // ---------------------------------------------------------
 // Shaders
@@ -377,6 +387,22 @@ struct RDIDepthStencilState
 	};
 };
 
+// ---------------------------------------------------------
+// State change statistics
+// ---------------------------------------------------------
+
+enum RDIStateCategory
+{
+	SC_SHADER = 0,
+	SC_RENDERSTATES,
+	SC_TEXTURES,
+	SC_SAMPLERS,
+	SC_VERTLAYOUT,
+	SC_INDEXBUF,
+	SC_VIEWPORT,
+	SC_COUNT
+};
+
 // ---------------------------------------------------------
 // Draw calls and clears
 // ---------------------------------------------------------
@@ -398,6 +424,7 @@ enum RDIIndexFormat
 
 enum RDIPrimType
 {
+	PRIM_POINTS = GL_POINTS,
 	PRIM_TRILIST = GL_TRIANGLES,
 	PRIM_TRISTRIP = GL_TRIANGLE_STRIP
 };
@@ -428,6 +455,7 @@ public:
 	uint32 createIndexBuffer( uint32 size, const void *data );
 	void destroyBuffer( uint32 bufObj );
 	void updateBufferData( uint32 bufObj, uint32 offset, uint32 size, void *data );
+	bool getBufferData( uint32 bufObj, uint32 offset, uint32 size, void *data );
 	uint32 getBufferMem() { return _bufferMem; }
 
 	// Textures
@@ -437,18 +465,21 @@ public:
 	void uploadTextureData( uint32 texObj, int slice, int mipLevel, const void *pixels );
 	void destroyTexture( uint32 texObj );
 	void updateTextureData( uint32 texObj, int slice, int mipLevel, const void *pixels );
+	void updateTextureRows( uint32 texObj, int firstRow, int numRows, const void *pixels );
+	void updateTextureRowsFromBuffer( uint32 texObj, int firstRow, int numRows, uint32 bufObj );
 	bool getTextureData( uint32 texObj, int slice, int mipLevel, void *buffer );
 	uint32 getTextureMem() { return _textureMem; }
 	uint32 getTextureNativeReference( uint32 texObj );
 
 	// Shaders
 	uint32 createShader( const char *vertexShaderSrc, const char *fragmentShaderSrc );
+	uint32 createFeedbackShader( const char *vertexShaderSrc, const char **varyings, uint32 numVaryings );
 	void destroyShader( uint32 shaderId );
 	void bindShader( uint32 shaderId );
 	std::string &getShaderLog() { return _shaderLog; }
 	int getShaderConstLoc( uint32 shaderId, const char *name );
 	int getShaderSamplerLoc( uint32 shaderId, const char *name );
-	void setShaderConst( int loc, RDIShaderConstType type, void *values, uint32 count = 1 );
+	void setShaderConst( int loc, RDIShaderConstType type, const void *values, uint32 count = 1 );
 	void setShaderSampler( int loc, uint32 texUnit );
 	const char *getDefaultVSCode();
 	const char *getDefaultFSCode();
@@ -474,11 +505,14 @@ public:
 // -----------------------------------------------------------------------------
 	
 	void setViewport( int x, int y, int width, int height )
-		{ _vpX = x; _vpY = y; _vpWidth = width; _vpHeight = height; _pendingMask |= PM_VIEWPORT; }
+		{ _vpX = x; _vpY = y; _vpWidth = width; _vpHeight = height; _pendingMask |= PM_VIEWPORT;
+		  ++_submittedStates[SC_VIEWPORT]; }
 	void setScissorRect( int x, int y, int width, int height )
-		{ _scX = x; _scY = y; _scWidth = width; _scHeight = height; _pendingMask |= PM_SCISSOR; }
+		{ _scX = x; _scY = y; _scWidth = width; _scHeight = height; _pendingMask |= PM_SCISSOR;
+		  ++_submittedStates[SC_VIEWPORT]; }
 	void setIndexBuffer( uint32 bufObj, RDIIndexFormat idxFmt )
-		{ _indexFormat = (uint32)idxFmt; _newIndexBuf = bufObj; _pendingMask |= PM_INDEXBUF; }
+		{ _indexFormat = (uint32)idxFmt; _newIndexBuf = bufObj; _pendingMask |= PM_INDEXBUF;
+		  ++_submittedStates[SC_INDEXBUF]; }
 	void setVertexBuffer( uint32 slot, uint32 vbObj, uint32 offset, uint32 stride )
 		{ ASSERT( slot < 16 ); _vertBufSlots[slot] = RDIVertBufSlot( vbObj, offset, stride );
 	      _pendingMask |= PM_VERTLAYOUT; }
@@ -486,49 +520,60 @@ public:
 		{ _newVertLayout = vlObj; }
 	void setTexture( uint32 slot, uint32 texObj, uint16 samplerState )
 		{ ASSERT( slot < 16 ); _texSlots[slot] = RDITexSlot( texObj, samplerState );
-	      _pendingMask |= PM_TEXTURES; }
+	      _pendingMask |= PM_TEXTURES; ++_submittedStates[SC_TEXTURES];
+		  if( texObj != 0 ) ++_submittedStates[SC_SAMPLERS]; }
 	
 	// Render states
 	void setColorWriteMask( bool enabled )
-		{ _newRasterState.renderTargetWriteMask = enabled; _pendingMask |= PM_RENDERSTATES; }
+		{ _newRasterState.renderTargetWriteMask = enabled; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getColorWriteMask( bool &enabled )
 		{ enabled = _newRasterState.renderTargetWriteMask; }
 	void setFillMode( RDIFillMode fillMode )
-		{ _newRasterState.fillMode = fillMode; _pendingMask |= PM_RENDERSTATES; }
+		{ _newRasterState.fillMode = fillMode; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getFillMode( RDIFillMode &fillMode )
 		{ fillMode = (RDIFillMode)_newRasterState.fillMode; }
 	void setCullMode( RDICullMode cullMode )
-		{ _newRasterState.cullMode = cullMode; _pendingMask |= PM_RENDERSTATES; }
+		{ _newRasterState.cullMode = cullMode; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getCullMode( RDICullMode &cullMode )
 		{ cullMode = (RDICullMode)_newRasterState.cullMode; }
 	void setScissorTest( bool enabled )
-		{ _newRasterState.scissorEnable = enabled; _pendingMask |= PM_RENDERSTATES; }
+		{ _newRasterState.scissorEnable = enabled; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getScissorTest( bool &enabled )
 		{ enabled = _newRasterState.scissorEnable; }
 	void setMulisampling( bool enabled )
-		{ _newRasterState.multisampleEnable = enabled; _pendingMask |= PM_RENDERSTATES; }
+		{ _newRasterState.multisampleEnable = enabled; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getMulisampling( bool &enabled )
 		{ enabled = _newRasterState.multisampleEnable; }
 	void setAlphaToCoverage( bool enabled )
-		{ _newBlendState.alphaToCoverageEnable = enabled; _pendingMask |= PM_RENDERSTATES; }
+		{ _newBlendState.alphaToCoverageEnable = enabled; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getAlphaToCoverage( bool &enabled )
 		{ enabled = _newBlendState.alphaToCoverageEnable; }
 	void setBlendMode( bool enabled, RDIBlendFunc srcBlendFunc = BS_BLEND_ZERO, RDIBlendFunc destBlendFunc = BS_BLEND_ZERO )
 		{ _newBlendState.blendEnable = enabled; _newBlendState.srcBlendFunc = srcBlendFunc;
-		  _newBlendState.destBlendFunc = destBlendFunc; _pendingMask |= PM_RENDERSTATES; }
+		  _newBlendState.destBlendFunc = destBlendFunc; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getBlendMode( bool &enabled, RDIBlendFunc &srcBlendFunc, RDIBlendFunc &destBlendFunc )
 		{ enabled = _newBlendState.blendEnable; srcBlendFunc = (RDIBlendFunc)_newBlendState.srcBlendFunc;
 		  destBlendFunc = (RDIBlendFunc)_newBlendState.destBlendFunc; }
 	void setDepthMask( bool enabled )
-		{ _newDepthStencilState.depthWriteMask = enabled; _pendingMask |= PM_RENDERSTATES; }
+		{ _newDepthStencilState.depthWriteMask = enabled; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getDepthMask( bool &enabled )
 		{ enabled = _newDepthStencilState.depthWriteMask; }
 	void setDepthTest( bool enabled )
-		{ _newDepthStencilState.depthEnable = enabled; _pendingMask |= PM_RENDERSTATES; }
+		{ _newDepthStencilState.depthEnable = enabled; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getDepthTest( bool &enabled )
 		{ enabled = _newDepthStencilState.depthEnable; }
 	void setDepthFunc( RDIDepthFunc depthFunc )
-		{ _newDepthStencilState.depthFunc = depthFunc; _pendingMask |= PM_RENDERSTATES; }
+		{ _newDepthStencilState.depthFunc = depthFunc; _pendingMask |= PM_RENDERSTATES;
+		  ++_submittedStates[SC_RENDERSTATES]; }
 	void getDepthFunc( RDIDepthFunc &depthFunc )
 		{ depthFunc = (RDIDepthFunc)_newDepthStencilState.depthFunc; }
 
@@ -540,6 +585,8 @@ public:
 	void draw( RDIPrimType primType, uint32 firstVert, uint32 numVerts );
 	void drawIndexed( RDIPrimType primType, uint32 firstIndex, uint32 numIndices,
 	                  uint32 firstVert, uint32 numVerts );
+	// Runs the vertex stage of a feedback shader over points, writes the varyings to a buffer
+	void drawFeedback( uint32 bufObj, uint32 firstVert, uint32 numVerts );
 
 // -----------------------------------------------------------------------------
 // Getters
@@ -549,6 +596,7 @@ public:
 	const RDIBuffer &getBuffer( uint32 bufObj ) { return _buffers.getRef( bufObj ); }
 	const RDITexture &getTexture( uint32 texObj ) { return _textures.getRef( texObj ); }
 	const RDIRenderBuffer &getRenderBuffer( uint32 rbObj ) { return _rendBufs.getRef( rbObj ); }
+	uint32 getStateChangeCount( RDIStateCategory category, bool applied, bool reset );
 
 	friend class Renderer;
 
@@ -568,9 +616,12 @@ protected:
 
 	uint32 createShaderProgram( const char *vertexShaderSrc, const char *fragmentShaderSrc );
 	bool linkShaderProgram( uint32 programObj );
+	uint32 addShader( uint32 programObj );
 	void resolveRenderBuffer( uint32 rbObj );
 
 	void checkGLError();
+	void activateTexUnit( uint32 unit )
+		{ if( unit != _curTexUnit ) { glActiveTexture( GL_TEXTURE0 + unit ); _curTexUnit = unit; } }
 	bool applyVertexLayout();
 	void applySamplerState( RDITexture &tex );
 	void applyRenderStates();
@@ -596,8 +647,11 @@ protected:
 	RDIObjects< RDIShader >        _shaders;
 	RDIObjects< RDIRenderBuffer >  _rendBufs;
 
-	RDIVertBufSlot        _vertBufSlots[16];
+	RDIVertBufSlot        _vertBufSlots[16], _curVertBufSlots[16];
 	RDITexSlot            _texSlots[16];
+	RDITexUnit            _curTexUnits[16];  // Shadow copy of GL texture bindings
+	uint32                _curTexUnit;
+	int                   _curViewport[4], _curScissor[4];
 	RDIRasterState        _curRasterState, _newRasterState;
 	RDIBlendState         _curBlendState, _newBlendState;
 	RDIDepthStencilState  _curDepthStencilState, _newDepthStencilState;
@@ -607,6 +661,8 @@ protected:
 	uint32                _indexFormat;
 	uint32                _activeVertexAttribsMask;
 	uint32                _pendingMask;
+
+	uint32                _submittedStates[SC_COUNT], _appliedStates[SC_COUNT];
 };
 
 }
@@ -13,6 +13,7 @@
 #include "egResource.h"
 #include "egModules.h"
 #include "egCom.h"
+#include "utXML.h"
 #include <sstream>
 #include <cstring>
 
@@ -27,6 +28,14 @@ using namespace std;
 // Class Resource
 // **********************************************************************************
 
+struct DecodedXMLData : public DecodedResData
+{
+	XMLDoc  doc;
+
+	DecodedXMLData( int type ) : DecodedResData( type ) {}
+};
+
+
 Resource::Resource( int type, const string &name, int flags )
 {
 	_type = type;
@@ -85,6 +94,32 @@ bool Resource::load( const char *data, int size )
 }
 
 
+bool Resource::loadDecoded( DecodedResData &resData )
+{
+	// Like file data, decoded data can only be loaded into an unloaded resource of its type, and
+	// since it is taken over by the resource, it can only be loaded once
+	if( _loaded || resData.consumed || resData.type != _type ) return false;
+
+	resData.consumed = true;
+	_loaded = true;
+
+	return loadDecodedData( resData );
+}
+
+
+bool Resource::loadDecodedData( DecodedResData &resData )
+{
+	// Only XML documents are decoded for types that do not override this
+	return loadXML( ((DecodedXMLData &)resData).doc );
+}
+
+
+bool Resource::loadXML( const XMLDoc &doc )
+{
+	return false;
+}
+
+
 void Resource::unload()
 {
 	release();
@@ -93,6 +128,24 @@ void Resource::unload()
 }
 
 
+DecodedResData *Resource::decodeXML( int type, const char *data, int size )
+{
+	// Must not access any engine state since this can be called from any thread
+	if( data == 0x0 || size <= 0 ) return 0x0;
+
+	DecodedXMLData *xmlData = new DecodedXMLData( type );
+	xmlData->doc.parseBuffer( data, size );
+	if( xmlData->doc.hasError() )
+	{
+		// The error is reported when the original data is loaded
+		delete xmlData;
+		return 0x0;
+	}
+
+	return xmlData;
+}
+
+
 int Resource::findElem( int elem, int param, const char *value )
 {
 	for( int i = 0, s = getElemCount( elem ); i < s; ++i )
@@ -314,16 +367,22 @@ ResHandle ResourceManager::cloneResource( Resource &sourceRes, const string &nam
 	Resource *newRes = sourceRes.clone();
 	if( newRes == 0x0 ) return 0;
 
-	newRes->_name = name != "" ? name : "|tmp|";
-	newRes->_userRefCount = 1;
-	newRes->_refCount = 0;
-	int handle = addResource( *newRes );
+	return addClonedResource( *newRes, sourceRes, name );
+}
+
+
+ResHandle ResourceManager::addClonedResource( Resource &newRes, Resource &sourceRes, const string &name )
+{
+	newRes._name = name != "" ? name : "|tmp|";
+	newRes._userRefCount = 1;
+	newRes._refCount = 0;
+	int handle = addResource( newRes );
 	
 	if( name == "" )
 	{
 		stringstream ss;
 		ss << sourceRes._name << "|" << handle;
-		newRes->_name = ss.str();
+		newRes._name = ss.str();
 	}
 
 	return handle;
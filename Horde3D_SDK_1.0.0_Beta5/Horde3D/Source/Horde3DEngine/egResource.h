@@ -59,6 +59,22 @@ struct ResourceFlags
 
 // =================================================================================================
 
+class XMLDoc;
+
+// Contents of a resource file that were parsed in advance without OpenGL, possibly on another
+// thread (see h3dDecodeResourceData); they are taken over by loadDecoded and can only be loaded once
+class DecodedResData
+{
+public:
+	DecodedResData( int type ) : type( type ), consumed( false ) {}
+	virtual ~DecodedResData() {}
+
+	int   type;
+	bool  consumed;
+};
+
+// =================================================================================================
+
 class Resource
 {
 public:
@@ -69,7 +85,9 @@ public:
 	virtual void initDefault();
 	virtual void release();
 	virtual bool load( const char *data, int size );
+	bool loadDecoded( DecodedResData &resData );
 	void unload();
+	static DecodedResData *decodeXML( int type, const char *data, int size );
 	
 	int findElem( int elem, int param, const char *value );
 	virtual int getElemCount( int elem );
@@ -90,6 +108,10 @@ public:
 	void addRef() { ++_refCount; }
 	void subRef() { --_refCount; }
 
+protected:
+	virtual bool loadDecodedData( DecodedResData &resData );
+	virtual bool loadXML( const XMLDoc &doc );
+
 protected:
 	int                  _type;
 	std::string          _name;
@@ -171,6 +193,7 @@ public:
 	ResHandle addResource( int type, const std::string &name, int flags, bool userCall );
 	ResHandle addNonExistingResource( Resource &resource, bool userCall );
 	ResHandle cloneResource( Resource &sourceRes, const std::string &name );
+	ResHandle addClonedResource( Resource &newRes, Resource &sourceRes, const std::string &name );
 	int removeResource( Resource &resource, bool userCall );
 	void clear();
 	ResHandle queryUnloadedResource( int index );
@@ -18,6 +18,8 @@
 #include "egModules.h"
 #include "egCom.h"
 #include "egRenderer.h"
+#include "egOcclusion.h"
+#include "egFrame.h"
 
 #include "utDebug.h"
 
@@ -32,7 +34,7 @@ using namespace std;
 
 SceneNode::SceneNode( const SceneNodeTpl &tpl ) :
 	_parent( 0x0 ), _type( tpl.type ), _handle( 0 ), _sgHandle( 0 ), _flags( 0 ), _sortKey( 0 ),
-	_dirty( true ), _transformed( true ), _renderable( false ),
+	_dirty( true ), _transformed( true ), _renderable( false ), _inSnapshot( false ),
 	_name( tpl.name ), _attachment( tpl.attachmentString )
 {
 	_relTrans = Matrix4f::ScaleMat( tpl.scale.x, tpl.scale.y, tpl.scale.z );
@@ -196,18 +198,23 @@ void SceneNode::markChildrenDirty()
 }
 
 
-void SceneNode::markDirty()
+void SceneNode::markParentsDirty()
 {
-	_dirty = true;
-	_transformed = true;
-	
 	SceneNode *node = _parent;
 	while( node != 0x0 )
 	{
 		node->_dirty = true;
 		node = node->_parent;
 	}
+}
+
 
+void SceneNode::markDirty()
+{
+	_dirty = true;
+	_transformed = true;
+	
+	markParentsDirty();
 	markChildrenDirty();
 }
 
@@ -238,6 +245,21 @@ void SceneNode::updateTree()
 }
 
 
+void SceneNode::captureRenderState()
+{
+	// The renderer uses the copies until the background update has finished
+	_snapAbsTrans = _absTrans;
+	_snapBBox = _bBox;
+	_inSnapshot = true;
+}
+
+
+void SceneNode::releaseRenderState()
+{
+	_inSnapshot = false;
+}
+
+
 bool SceneNode::checkIntersection( const Vec3f &/*rayOrig*/, const Vec3f &/*rayDir*/, Vec3f &/*intsPos*/ ) const
 {
 	return false;
@@ -332,9 +354,12 @@ struct RenderQueueItemCompFunc
 
 
 void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum2, RenderingOrder::List order,
-                                 uint32 filterIgnore, bool lightQueue, bool renderQueue )
+                                 uint32 filterIgnore, bool lightQueue, bool renderQueue,
+                                 const OcclusionBuffer *occBuffer )
 {
-	Modules::sceneMan().updateNodes();
+	// While the scene is updated in the background, the nodes are up to date apart from those that
+	// are rendered from the snapshot
+	if( !Modules::frameMan().isUpdatePending() ) Modules::sceneMan().updateNodes();
 	
 	Vec3f camPos( frustum1.getOrigin() );
 	if( Modules::renderer().getCurCamera() != 0x0 )
@@ -343,6 +368,9 @@ void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum
 	// Clear without affecting capacity
 	if( lightQueue ) _lightQueue.resize( 0 );
 	if( renderQueue ) _renderQueue.resize( 0 );
+	
+	if( occBuffer != 0x0 && !occBuffer->isActive() ) occBuffer = 0x0;
+	uint32 occludedCount = 0;
 
 	// Culling
 	for( size_t i = 0, s = _nodes.size(); i < s; ++i )
@@ -352,14 +380,36 @@ void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum
 
 		if( renderQueue && node->_renderable )
 		{
-			if( !frustum1.cullBox( node->_bBox ) &&
-				(frustum2 == 0x0 || !frustum2->cullBox( node->_bBox )) )
+			const BoundingBox &bBox = node->getRenderBBox();
+			
+			if( !frustum1.cullBox( bBox ) &&
+				(frustum2 == 0x0 || !frustum2->cullBox( bBox )) )
 			{
 				if( node->_type == SceneNodeTypes::Mesh )  // TODO: Generalize and optimize this
 				{
+					// Lazily animated models are evaluated once they are visible with their predicted
+					// bounds; the exact bounds are tested again afterwards. Models in the snapshot were
+					// evaluated before the background update started.
+					ModelNode *model = ((MeshNode *)node)->getParentModel();
+					if( !model->isInSnapshot() && model->evaluatePendingAnim() )
+					{
+						model->markParentsDirty();
+						if( frustum1.cullBox( bBox ) ||
+						    (frustum2 != 0x0 && frustum2->cullBox( bBox )) ) continue;
+					}
+					
 					uint32 curLod = ((MeshNode *)node)->getParentModel()->calcLodLevel( camPos );
 					if( ((MeshNode *)node)->getLodLevel() != curLod ) continue;
 				}
+
+				if( occBuffer != 0x0 && !occBuffer->testAABB( bBox ) )
+				{
+					++occludedCount;
+					continue;
+				}
+
+				if( node->_type == SceneNodeTypes::Emitter )
+					((EmitterNode *)node)->markVisible( camPos );
 				
 				float sortKey = 0;
 
@@ -369,10 +419,10 @@ void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum
 					sortKey = node->_sortKey;
 					break;
 				case RenderingOrder::FrontToBack:
-					sortKey = nearestDistToAABB( frustum1.getOrigin(), node->_bBox.min, node->_bBox.max );
+					sortKey = nearestDistToAABB( frustum1.getOrigin(), bBox.min, bBox.max );
 					break;
 				case RenderingOrder::BackToFront:
-					sortKey = -nearestDistToAABB( frustum1.getOrigin(), node->_bBox.min, node->_bBox.max );
+					sortKey = -nearestDistToAABB( frustum1.getOrigin(), bBox.min, bBox.max );
 					break;
 				}
 				
@@ -385,6 +435,9 @@ void SpatialGraph::updateQueues( const Frustum &frustum1, const Frustum *frustum
 		}
 	}
 
+	if( occludedCount > 0 )
+		Modules::stats().incStat( EngineStats::SWOccCulledCount, (float)occludedCount );
+
 	// Sort
 	if( order != RenderingOrder::None )
 		std::sort( _renderQueue.begin(), _renderQueue.end(), RenderQueueItemCompFunc() );
@@ -458,9 +511,10 @@ void SceneManager::updateNodes()
 
 
 void SceneManager::updateQueues( const Frustum &frustum1, const Frustum *frustum2, RenderingOrder::List order,
-                                 uint32 filterIgnore, bool lightQueue, bool renderableQueue )
+                                 uint32 filterIgnore, bool lightQueue, bool renderableQueue,
+                                 const OcclusionBuffer *occBuffer )
 {
-	_spatialGraph->updateQueues( frustum1, frustum2, order, filterIgnore, lightQueue, renderableQueue );
+	_spatialGraph->updateQueues( frustum1, frustum2, order, filterIgnore, lightQueue, renderableQueue, occBuffer );
 }
 
 
@@ -748,9 +802,10 @@ int SceneManager::checkNodeVisibility( SceneNode &node, CameraNode &cam, bool ch
 			if( gRDI->getQueryResult( ((MeshNode *)&node)->_occQueries[cam._occSet] ) < 1 )
 				return -1;
 		}
-		else if( node.getType() == SceneNodeTypes::Emitter && cam._occSet < (int)((EmitterNode *)&node)->_occQueries.size() )
+		else if( (node.getType() == SceneNodeTypes::Emitter || node.getType() == SceneNodeTypes::DotField) &&
+		         cam._occSet < (int)((ParticleNode *)&node)->_occQueries.size() )
 		{
-			if( gRDI->getQueryResult( ((EmitterNode *)&node)->_occQueries[cam._occSet] ) < 1 )
+			if( gRDI->getQueryResult( ((ParticleNode *)&node)->_occQueries[cam._occSet] ) < 1 )
 				return -1;
 		}
 		else if( node.getType() == SceneNodeTypes::Light && cam._occSet < (int)((LightNode *)&node)->_occQueries.size() )
@@ -25,6 +25,7 @@ namespace Horde3D {
 struct SceneNodeTpl;
 class CameraNode;
 class SceneGraphResource;
+class OcclusionBuffer;
 
 
 const int RootNode = 1;
@@ -45,7 +46,8 @@ struct SceneNodeTypes
 		Joint,
 		Light,
 		Camera,
-		Emitter
+		Emitter,
+		DotField
 	};
 };
 
@@ -65,7 +67,8 @@ struct SceneNodeFlags
 		NoDraw = 0x1,
 		NoCastShadow = 0x2,
 		NoRayQuery = 0x4,
-		Inactive = 0x7  // NoDraw | NoCastShadow | NoRayQuery
+		Inactive = 0x7,  // NoDraw | NoCastShadow | NoRayQuery
+		Occluder = 0x8
 	};
 };
 
@@ -135,7 +138,15 @@ public:
 	bool checkTransformFlag( bool reset )
 		{ bool b = _transformed; if( reset ) _transformed = false; return b; }
 
+	// Render state while the node is updated in the background, see FrameManager::captureSnapshot
+	virtual void captureRenderState();
+	virtual void releaseRenderState();
+	bool isInSnapshot() const { return _inSnapshot; }
+	const Matrix4f &getRenderTrans() const { return _inSnapshot ? _snapAbsTrans : _absTrans; }
+	const BoundingBox &getRenderBBox() const { return _inSnapshot ? _snapBBox : _bBox; }
+
 protected:
+	void markParentsDirty();
 	void markChildrenDirty();
 
 	virtual void onPostUpdate() {}  // Called after absolute transformation has been updated
@@ -157,6 +168,10 @@ protected:
 
 	BoundingBox                 _bBox;  // AABB in world space
 
+	Matrix4f                    _snapAbsTrans;  // Copies that are rendered while _inSnapshot is set
+	BoundingBox                 _snapBBox;
+	bool                        _inSnapshot;
+
 	std::vector< SceneNode * >  _children;  // Child nodes
 	std::string                 _name;
 	std::string                 _attachment;  // User defined data
@@ -164,6 +179,7 @@ protected:
 	friend class SceneManager;
 	friend class SpatialGraph;
 	friend class Renderer;
+	friend class FrameManager;
 };
 
 
@@ -223,7 +239,8 @@ public:
 	void updateNode( uint32 sgHandle );
 
 	void updateQueues( const Frustum &frustum1, const Frustum *frustum2,
-	                   RenderingOrder::List order, uint32 filterIgnore, bool lightQueue, bool renderQueue );
+	                   RenderingOrder::List order, uint32 filterIgnore, bool lightQueue, bool renderQueue,
+	                   const OcclusionBuffer *occBuffer = 0x0 );
 
 	std::vector< SceneNode * > &getLightQueue() { return _lightQueue; }
 	RenderQueue &getRenderQueue() { return _renderQueue; }
@@ -273,7 +290,8 @@ public:
 	void updateNodes();
 	void updateSpatialNode( uint32 sgHandle ) { _spatialGraph->updateNode( sgHandle ); }
 	void updateQueues( const Frustum &frustum1, const Frustum *frustum2,
-	                   RenderingOrder::List order, uint32 filterIgnore, bool lightQueue, bool renderableQueue );
+	                   RenderingOrder::List order, uint32 filterIgnore, bool lightQueue, bool renderableQueue,
+	                   const OcclusionBuffer *occBuffer = 0x0 );
 	
 	NodeHandle addNode( SceneNode *node, SceneNode &parent );
 	NodeHandle addNodes( SceneNode &parent, SceneGraphResource &sgRes );
@@ -162,6 +162,13 @@ bool SceneGraphResource::load( const char *data, int size )
 	
 	XMLDoc doc;
 	doc.parseBuffer( data, size );
+
+	return loadXML( doc );
+}
+
+
+bool SceneGraphResource::loadXML( const XMLDoc &doc )
+{
 	if( doc.hasError() )
 	{
 		return false;
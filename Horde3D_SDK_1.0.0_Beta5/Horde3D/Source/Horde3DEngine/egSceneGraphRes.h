@@ -44,6 +44,7 @@ public:
 	SceneNodeTpl *getRootNode() { return _rootNode; }
 
 private:
+	bool loadXML( const XMLDoc &doc );
 	void parseBaseAttributes( XMLNode &xmlNode, SceneNodeTpl &nodeTpl );
 	void parseNode( XMLNode &xmlNode, SceneNodeTpl *parentTpl );
 
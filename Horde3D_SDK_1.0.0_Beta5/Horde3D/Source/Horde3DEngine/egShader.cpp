@@ -814,6 +814,12 @@ void ShaderResource::compileCombination( ShaderContext &context, ShaderCombinati
 	_tmpCode0 = _vertPreamble;
 	_tmpCode1 = _fragPreamble;
 
+	// Let the shader library know where skinning matrices come from
+	if( Modules::renderer().hasSkinPalette() )
+		_tmpCode0 += "\r\n#define _H3D_SKIN_PALETTE_\r\n";
+	if( Modules::renderer().hasParticleTex() )
+		_tmpCode0 += "\r\n#define _H3D_PARTICLE_TEX_\r\n";
+
 	// Insert defines for flags
 	if( combMask != 0 )
 	{
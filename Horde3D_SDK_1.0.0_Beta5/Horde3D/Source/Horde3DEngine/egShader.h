@@ -131,10 +131,11 @@ struct ShaderCombination
 	int                 uni_frameBufSize;
 	int                 uni_viewMat, uni_viewMatInv, uni_projMat, uni_viewProjMat, uni_viewProjMatInv, uni_viewerPos;
 	int                 uni_worldMat, uni_worldNormalMat, uni_nodeId, uni_customInstData;
-	int                 uni_skinMatRows;
+	int                 uni_skinMatRows, uni_skinPalette;
 	int                 uni_lightPos, uni_lightDir, uni_lightColor;
 	int                 uni_shadowSplitDists, uni_shadowMats, uni_shadowMapSize, uni_shadowBias;
-	int                 uni_parPosArray, uni_parSizeAndRotArray, uni_parColorArray;
+	int                 uni_clusterDims, uni_clusterDepthParams, uni_clusterViewport;
+	int                 uni_parPosArray, uni_parSizeAndRotArray, uni_parColorArray, uni_parTexParams;
 	int                 uni_olayColor;
 
 	std::vector< int >  customSamplers;
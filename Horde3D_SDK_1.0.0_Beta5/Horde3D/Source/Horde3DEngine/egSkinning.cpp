@@ -0,0 +1,271 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "egSkinning.h"
+#include "egGeometry.h"
+#include "utSIMD.h"
+
+#include "utDebug.h"
+
+
+namespace Horde3D {
+
+// Note: The kernels skip the normalization of the tangent space basis for performance reasons;
+//       the error is usually not huge and should be hardly noticable
+
+// =================================================================================================
+// Scalar kernels
+// =================================================================================================
+
+void skinVerticesStatic( const Vec4f *jointRows, const VertexDataStatic *staticData,
+                         Vec3f *posData, VertexDataTan *tanData, uint32 count )
+{
+	Matrix4f skinningMat;
+
+	for( uint32 i = 0; i < count; ++i )
+	{
+		const Vec4f *row0 = &jointRows[ftoi_r( staticData[i].jointVec[0] ) * 3];
+		const Vec4f *row1 = &jointRows[ftoi_r( staticData[i].jointVec[1] ) * 3];
+		const Vec4f *row2 = &jointRows[ftoi_r( staticData[i].jointVec[2] ) * 3];
+		const Vec4f *row3 = &jointRows[ftoi_r( staticData[i].jointVec[3] ) * 3];
+
+		Vec4f weights = *((Vec4f *)&staticData[i].weightVec[0]);
+
+		skinningMat.x[0] = (row0)->x * weights.x + (row1)->x * weights.y + (row2)->x * weights.z + (row3)->x * weights.w;
+		skinningMat.x[1] = (row0+1)->x * weights.x + (row1+1)->x * weights.y + (row2+1)->x * weights.z + (row3+1)->x * weights.w;
+		skinningMat.x[2] = (row0+2)->x * weights.x + (row1+2)->x * weights.y + (row2+2)->x * weights.z + (row3+2)->x * weights.w;
+		skinningMat.x[4] = (row0)->y * weights.x + (row1)->y * weights.y + (row2)->y * weights.z + (row3)->y * weights.w;
+		skinningMat.x[5] = (row0+1)->y * weights.x + (row1+1)->y * weights.y + (row2+1)->y * weights.z + (row3+1)->y * weights.w;
+		skinningMat.x[6] = (row0+2)->y * weights.x + (row1+2)->y * weights.y + (row2+2)->y * weights.z + (row3+2)->y * weights.w;
+		skinningMat.x[8] = (row0)->z * weights.x + (row1)->z * weights.y + (row2)->z * weights.z + (row3)->z * weights.w;
+		skinningMat.x[9] = (row0+1)->z * weights.x + (row1+1)->z * weights.y + (row2 + 1)->z * weights.z + (row3+1)->z * weights.w;
+		skinningMat.x[10] = (row0+2)->z * weights.x + (row1+2)->z * weights.y + (row2+2)->z * weights.z + (row3+2)->z * weights.w;
+		skinningMat.x[12] = (row0)->w * weights.x + (row1)->w * weights.y + (row2)->w * weights.z + (row3)->w * weights.w;
+		skinningMat.x[13] = (row0+1)->w * weights.x + (row1+1)->w * weights.y + (row2+1)->w * weights.z + (row3+1)->w * weights.w;
+		skinningMat.x[14] = (row0+2)->w * weights.x + (row1+2)->w * weights.y + (row2+2)->w * weights.z + (row3+2)->w * weights.w;
+
+		posData[i] = skinningMat * posData[i];
+		tanData[i].normal = skinningMat.mult33Vec( tanData[i].normal );
+		tanData[i].tangent = skinningMat.mult33Vec( tanData[i].tangent );
+	}
+}
+
+
+static void skinVerticesScalar( const Vec4f *jointRows, const VertexDataSkin *skinData,
+                                Vec3f *posData, VertexDataTan *tanData, uint32 count )
+{
+	for( uint32 i = 0; i < count; ++i )
+	{
+		const VertexDataSkin &skin = skinData[i];
+		const Vec4f *row0 = &jointRows[skin.joints[0] * 3];
+		const Vec4f *row1 = &jointRows[skin.joints[1] * 3];
+		const Vec4f *row2 = &jointRows[skin.joints[2] * 3];
+		const Vec4f *row3 = &jointRows[skin.joints[3] * 3];
+
+		// Blend rows of joint matrices
+		Vec4f m[3];
+		for( uint32 j = 0; j < 3; ++j )
+		{
+			m[j] = row0[j] * skin.weights[0] + row1[j] * skin.weights[1] +
+			       row2[j] * skin.weights[2] + row3[j] * skin.weights[3];
+		}
+
+		Vec3f &pos = posData[i];
+		Vec3f &normal = tanData[i].normal;
+		Vec3f &tangent = tanData[i].tangent;
+
+		pos = Vec3f( m[0].x * pos.x + m[0].y * pos.y + m[0].z * pos.z + m[0].w,
+		             m[1].x * pos.x + m[1].y * pos.y + m[1].z * pos.z + m[1].w,
+		             m[2].x * pos.x + m[2].y * pos.y + m[2].z * pos.z + m[2].w );
+		normal = Vec3f( m[0].x * normal.x + m[0].y * normal.y + m[0].z * normal.z,
+		                m[1].x * normal.x + m[1].y * normal.y + m[1].z * normal.z,
+		                m[2].x * normal.x + m[2].y * normal.y + m[2].z * normal.z );
+		tangent = Vec3f( m[0].x * tangent.x + m[0].y * tangent.y + m[0].z * tangent.z,
+		                 m[1].x * tangent.x + m[1].y * tangent.y + m[1].z * tangent.z,
+		                 m[2].x * tangent.x + m[2].y * tangent.y + m[2].z * tangent.z );
+	}
+}
+
+
+// =================================================================================================
+// SSE2 kernel
+// =================================================================================================
+
+#if defined( SIMD_SSE2 )
+
+SIMD_SSE2_FUNC static inline __m128 blendRowsSSE2( const float *row0, const float *row1, const float *row2,
+                                                   const float *row3, __m128 w0, __m128 w1, __m128 w2, __m128 w3 )
+{
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( row0 ), w0 ), _mm_mul_ps( _mm_loadu_ps( row1 ), w1 ) ),
+	                   _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( row2 ), w2 ), _mm_mul_ps( _mm_loadu_ps( row3 ), w3 ) ) );
+}
+
+
+SIMD_SSE2_FUNC static inline __m128 transformSSE2( const Vec3f &v, __m128 col0, __m128 col1, __m128 col2 )
+{
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( col0, _mm_set1_ps( v.x ) ), _mm_mul_ps( col1, _mm_set1_ps( v.y ) ) ),
+	                   _mm_mul_ps( col2, _mm_set1_ps( v.z ) ) );
+}
+
+
+SIMD_SSE2_FUNC static inline void storeVec3SSE2( Vec3f &v, __m128 data )
+{
+	_mm_storel_pi( (__m64 *)&v.x, data );
+	_mm_store_ss( &v.z, _mm_movehl_ps( data, data ) );
+}
+
+
+SIMD_SSE2_FUNC static void skinVerticesSSE2( const Vec4f *jointRows, const VertexDataSkin *skinData,
+                                             Vec3f *posData, VertexDataTan *tanData, uint32 count )
+{
+	const float *rows = &jointRows[0].x;
+
+	for( uint32 i = 0; i < count; ++i )
+	{
+		const VertexDataSkin &skin = skinData[i];
+		const float *row0 = rows + skin.joints[0] * 12;
+		const float *row1 = rows + skin.joints[1] * 12;
+		const float *row2 = rows + skin.joints[2] * 12;
+		const float *row3 = rows + skin.joints[3] * 12;
+
+		__m128 weights = _mm_loadu_ps( skin.weights );
+		__m128 w0 = _mm_shuffle_ps( weights, weights, _MM_SHUFFLE( 0, 0, 0, 0 ) );
+		__m128 w1 = _mm_shuffle_ps( weights, weights, _MM_SHUFFLE( 1, 1, 1, 1 ) );
+		__m128 w2 = _mm_shuffle_ps( weights, weights, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+		__m128 w3 = _mm_shuffle_ps( weights, weights, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+
+		// Blend rows of joint matrices and transpose them to columns
+		__m128 m0 = blendRowsSSE2( row0, row1, row2, row3, w0, w1, w2, w3 );
+		__m128 m1 = blendRowsSSE2( row0 + 4, row1 + 4, row2 + 4, row3 + 4, w0, w1, w2, w3 );
+		__m128 m2 = blendRowsSSE2( row0 + 8, row1 + 8, row2 + 8, row3 + 8, w0, w1, w2, w3 );
+		__m128 m3 = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS( m0, m1, m2, m3 );
+
+		storeVec3SSE2( posData[i], _mm_add_ps( transformSSE2( posData[i], m0, m1, m2 ), m3 ) );
+		storeVec3SSE2( tanData[i].normal, transformSSE2( tanData[i].normal, m0, m1, m2 ) );
+		storeVec3SSE2( tanData[i].tangent, transformSSE2( tanData[i].tangent, m0, m1, m2 ) );
+	}
+}
+
+#endif
+
+
+// =================================================================================================
+// NEON kernel
+// =================================================================================================
+
+#if defined( SIMD_NEON )
+
+static inline float dotNEON( float32x4_t a, float32x4_t b )
+{
+	float32x4_t prod = vmulq_f32( a, b );
+	float32x2_t sum = vadd_f32( vget_low_f32( prod ), vget_high_f32( prod ) );
+	return vget_lane_f32( vpadd_f32( sum, sum ), 0 );
+}
+
+
+static void skinVerticesNEON( const Vec4f *jointRows, const VertexDataSkin *skinData,
+                              Vec3f *posData, VertexDataTan *tanData, uint32 count )
+{
+	const float *rows = &jointRows[0].x;
+
+	for( uint32 i = 0; i < count; ++i )
+	{
+		const VertexDataSkin &skin = skinData[i];
+		const float *row0 = rows + skin.joints[0] * 12;
+		const float *row1 = rows + skin.joints[1] * 12;
+		const float *row2 = rows + skin.joints[2] * 12;
+		const float *row3 = rows + skin.joints[3] * 12;
+
+		// Blend rows of joint matrices
+		float32x4_t m[3];
+		for( uint32 j = 0; j < 3; ++j )
+		{
+			m[j] = vmulq_n_f32( vld1q_f32( row0 + j * 4 ), skin.weights[0] );
+			m[j] = vmlaq_n_f32( m[j], vld1q_f32( row1 + j * 4 ), skin.weights[1] );
+			m[j] = vmlaq_n_f32( m[j], vld1q_f32( row2 + j * 4 ), skin.weights[2] );
+			m[j] = vmlaq_n_f32( m[j], vld1q_f32( row3 + j * 4 ), skin.weights[3] );
+		}
+
+		Vec3f &pos = posData[i];
+		Vec3f &normal = tanData[i].normal;
+		Vec3f &tangent = tanData[i].tangent;
+		float v[4];
+
+		v[0] = pos.x; v[1] = pos.y; v[2] = pos.z; v[3] = 1.0f;
+		float32x4_t vec = vld1q_f32( v );
+		pos = Vec3f( dotNEON( m[0], vec ), dotNEON( m[1], vec ), dotNEON( m[2], vec ) );
+
+		v[0] = normal.x; v[1] = normal.y; v[2] = normal.z; v[3] = 0.0f;
+		vec = vld1q_f32( v );
+		normal = Vec3f( dotNEON( m[0], vec ), dotNEON( m[1], vec ), dotNEON( m[2], vec ) );
+
+		v[0] = tangent.x; v[1] = tangent.y; v[2] = tangent.z;
+		vec = vld1q_f32( v );
+		tangent = Vec3f( dotNEON( m[0], vec ), dotNEON( m[1], vec ), dotNEON( m[2], vec ) );
+	}
+}
+
+#endif
+
+
+// =================================================================================================
+// Kernel selection
+// =================================================================================================
+
+SkinningFunc getSkinningFunc( int kernel )
+{
+	switch( kernel )
+	{
+	case SkinningKernels::Scalar:
+		return skinVerticesScalar;
+#if defined( SIMD_SSE2 )
+	case SkinningKernels::SSE2:
+		return (getCPUFeatures() & CPUFeatures::SSE2) ? skinVerticesSSE2 : 0x0;
+#endif
+#if defined( SIMD_NEON )
+	case SkinningKernels::NEON:
+		return (getCPUFeatures() & CPUFeatures::NEON) ? skinVerticesNEON : 0x0;
+#endif
+	default:
+		return 0x0;
+	}
+}
+
+
+int getBestSkinningKernel()
+{
+	for( int i = SkinningKernels::Count - 1; i > SkinningKernels::Scalar; --i )
+	{
+		if( getSkinningFunc( i ) != 0x0 ) return i;
+	}
+
+	return SkinningKernels::Scalar;
+}
+
+
+const char *getSkinningKernelName( int kernel )
+{
+	switch( kernel )
+	{
+	case SkinningKernels::Scalar:
+		return "scalar";
+	case SkinningKernels::SSE2:
+		return "SSE2";
+	case SkinningKernels::NEON:
+		return "NEON";
+	default:
+		return "unknown";
+	}
+}
+
+}  // namespace
@@ -0,0 +1,58 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _egSkinning_H_
+#define _egSkinning_H_
+
+#include "egPrerequisites.h"
+#include "utMath.h"
+
+
+namespace Horde3D {
+
+struct VertexDataTan;
+struct VertexDataStatic;
+struct VertexDataSkin;
+
+
+// =================================================================================================
+// Software Skinning
+// =================================================================================================
+
+struct SkinningKernels
+{
+	enum List
+	{
+		Scalar = 0,
+		SSE2,
+		NEON,
+		Count
+	};
+};
+
+// Skins positions and tangent space basis in place. jointRows holds the first three rows of
+// each joint matrix like ModelNode::_skinMatRows.
+typedef void (*SkinningFunc)( const Vec4f *jointRows, const VertexDataSkin *skinData,
+                              Vec3f *posData, VertexDataTan *tanData, uint32 count );
+
+// Returns 0x0 if the kernel was not compiled in or is not supported by the CPU
+SkinningFunc getSkinningFunc( int kernel );
+int getBestSkinningKernel();
+const char *getSkinningKernelName( int kernel );
+
+// Original implementation reading float joint indices from the static vertex stream; used for
+// geometry without skinning stream
+void skinVerticesStatic( const Vec4f *jointRows, const VertexDataStatic *staticData,
+                         Vec3f *posData, VertexDataTan *tanData, uint32 count );
+
+}
+#endif // _egSkinning_H_
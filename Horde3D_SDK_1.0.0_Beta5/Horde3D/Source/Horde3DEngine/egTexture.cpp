@@ -71,6 +71,18 @@ struct DDSHeader
 } ddsHeader;
 
 
+// Image decoded by decodeImage in the format that loadSTBI uploads
+struct DecodedImageData : public DecodedResData
+{
+	int   width, height;
+	bool  hdr;
+	void  *pixels;
+
+	DecodedImageData() : DecodedResData( ResourceTypes::Texture ), pixels( 0x0 ) {}
+	~DecodedImageData() { if( pixels != 0x0 ) stbi_image_free( pixels ); }
+};
+
+
 unsigned char *TextureResource::mappedData = 0x0;
 int TextureResource::mappedWriteImage = -1;
 uint32 TextureResource::defTex2DObject = 0;
@@ -409,29 +421,83 @@ bool TextureResource::loadDDS( const char *data, int size )
 }
 
 
-bool TextureResource::loadSTBI( const char *data, int size )
+void *TextureResource::decodeSTBI( const char *data, int size, int &width, int &height, bool &hdr )
 {
-	bool hdr = false;
+	hdr = false;
 	if( stbi_is_hdr_from_memory( (unsigned char *)data, size ) > 0 ) hdr = true;
 	
 	int comps;
 	void *pixels = 0x0;
 	if( hdr )
-		pixels = stbi_loadf_from_memory( (unsigned char *)data, size, &_width, &_height, &comps, 4 );
+		pixels = stbi_loadf_from_memory( (unsigned char *)data, size, &width, &height, &comps, 4 );
 	else
-		pixels = stbi_load_from_memory( (unsigned char *)data, size, &_width, &_height, &comps, 4 );
+		pixels = stbi_load_from_memory( (unsigned char *)data, size, &width, &height, &comps, 4 );
 
-	if( pixels == 0x0 )
-		return raiseError( "Invalid image format (" + string( stbi_failure_reason() ) + ")" );
+	if( pixels == 0x0 ) return 0x0;
 
 	// Swizzle RGBA -> BGRA
 	uint32 *ptr = (uint32 *)pixels;
-	for( uint32 i = 0, si = _width * _height; i < si; ++i )
+	for( uint32 i = 0, si = width * height; i < si; ++i )
 	{
 		uint32 col = *ptr;
 		*ptr++ = (col & 0xFF00FF00) | ((col & 0x000000FF) << 16) | ((col & 0x00FF0000) >> 16);
 	}
+
+	return pixels;
+}
+
+
+bool TextureResource::loadSTBI( const char *data, int size )
+{
+	bool hdr;
+	void *pixels = decodeSTBI( data, size, _width, _height, hdr );
+
+	if( pixels == 0x0 )
+		return raiseError( "Invalid image format (" + string( stbi_failure_reason() ) + ")" );
+
+	createImageTexture( pixels, hdr );
+	stbi_image_free( pixels );
+
+	return true;
+}
+
+
+DecodedResData *TextureResource::decodeImage( const char *data, int size )
+{
+	// Must not access any engine state since this can be called from any thread
+	if( data == 0x0 || size <= 0 || checkDDS( data, size ) ) return 0x0;
+
+	DecodedImageData *image = new DecodedImageData();
+	image->pixels = decodeSTBI( data, size, image->width, image->height, image->hdr );
+	if( image->pixels == 0x0 )
+	{
+		// The error is reported when the original data is loaded
+		delete image;
+		return 0x0;
+	}
+
+	return image;
+}
+
+
+bool TextureResource::loadDecodedData( DecodedResData &resData )
+{
+	DecodedImageData &image = (DecodedImageData &)resData;
 	
+	_width = image.width;
+	_height = image.height;
+	createImageTexture( image.pixels, image.hdr );
+
+	// The pixels are not needed anymore after the upload
+	stbi_image_free( image.pixels );
+	image.pixels = 0x0;
+
+	return true;
+}
+
+
+void TextureResource::createImageTexture( const void *pixels, bool hdr )
+{
 	_depth = 1;
 	_texType = TextureTypes::Tex2D;
 	_texFormat = hdr ? TextureFormats::RGBA16F : TextureFormats::BGRA8;
@@ -442,10 +508,6 @@ bool TextureResource::loadSTBI( const char *data, int size )
 	_texObject = gRDI->createTexture( _texType, _width, _height, _depth, _texFormat,
 		_hasMipMaps, _hasMipMaps, !(_flags & ResourceFlags::NoTexCompression), _sRGB );
 	gRDI->uploadTextureData( _texObject, 0, 0, pixels );
-
-	stbi_image_free( pixels );
-
-	return true;
 }
 
 
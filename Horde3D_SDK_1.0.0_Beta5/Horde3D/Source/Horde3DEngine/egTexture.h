@@ -60,6 +60,7 @@ public:
 	void initDefault();
 	void release();
 	bool load( const char *data, int size );
+	static DecodedResData *decodeImage( const char *data, int size );
 
 	int getElemCount( int elem );
 	int getElemParamI( int elem, int elemIdx, int param );
@@ -82,9 +83,12 @@ public:
 
 protected:
 	bool raiseError( const std::string &msg );
-	bool checkDDS( const char *data, int size );
+	static bool checkDDS( const char *data, int size );
 	bool loadDDS( const char *data, int size );
+	static void *decodeSTBI( const char *data, int size, int &width, int &height, bool &hdr );
 	bool loadSTBI( const char *data, int size );
+	bool loadDecodedData( DecodedResData &resData );
+	void createImageTexture( const void *pixels, bool hdr );
 	int getMipCount();
 	
 protected:
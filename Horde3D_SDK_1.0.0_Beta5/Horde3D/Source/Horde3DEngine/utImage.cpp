@@ -2097,7 +2097,7 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
+// Initialized at startup so that images can be decoded on several threads at once
 static uint8 default_length[288], default_distance[32];
 static void init_defaults(void)
 {
@@ -2109,6 +2109,7 @@ static void init_defaults(void)
 
    for (i=0; i <=  31; ++i)     default_distance[i] = 5;
 }
+static struct DefaultsInit { DefaultsInit() { init_defaults(); } } defaults_init;
 
 int stbi_png_partial; // a quick hack to only allow decoding some of a PNG... I should implement real streaming support instead
 static int parse_zlib(zbuf *a, int parse_header)
@@ -2128,7 +2129,6 @@ static int parse_zlib(zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!default_distance[31]) init_defaults();
             if (!zbuild_huffman(&a->z_length  , default_length  , 288)) return 0;
             if (!zbuild_huffman(&a->z_distance, default_distance,  32)) return 0;
          } else {
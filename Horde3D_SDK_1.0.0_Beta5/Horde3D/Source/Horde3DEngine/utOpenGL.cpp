@@ -26,6 +26,7 @@ namespace glExt
 	bool ARB_texture_float = false;
 	bool ARB_texture_non_power_of_two = false;
 	bool ARB_timer_query = false;
+	bool EXT_transform_feedback = false;
 
 	int	majorVersion = 1, minorVersion = 0;
 }
@@ -181,6 +182,12 @@ PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT =
 PFNGLQUERYCOUNTERPROC glQueryCounter = 0x0;
 PFNGLGETQUERYOBJECTI64VPROC glGetQueryObjecti64v = 0x0;
 PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = 0x0;
+
+// GL_EXT_transform_feedback
+PFNGLBEGINTRANSFORMFEEDBACKEXTPROC glBeginTransformFeedbackEXT = 0x0;
+PFNGLENDTRANSFORMFEEDBACKEXTPROC glEndTransformFeedbackEXT = 0x0;
+PFNGLBINDBUFFERBASEEXTPROC glBindBufferBaseEXT = 0x0;
+PFNGLTRANSFORMFEEDBACKVARYINGSEXTPROC glTransformFeedbackVaryingsEXT = 0x0;
 }  // namespace h3dGL
 
 
@@ -437,5 +444,14 @@ bool initOpenGLExtensions()
 		r &= (glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC) platGetProcAddress( "glGetQueryObjectui64v" )) != 0x0;
 	}
 
+	glExt::EXT_transform_feedback = isExtensionSupported( "GL_EXT_transform_feedback" );
+	if( glExt::EXT_transform_feedback )
+	{
+		r &= (glBeginTransformFeedbackEXT = (PFNGLBEGINTRANSFORMFEEDBACKEXTPROC) platGetProcAddress( "glBeginTransformFeedbackEXT" )) != 0x0;
+		r &= (glEndTransformFeedbackEXT = (PFNGLENDTRANSFORMFEEDBACKEXTPROC) platGetProcAddress( "glEndTransformFeedbackEXT" )) != 0x0;
+		r &= (glBindBufferBaseEXT = (PFNGLBINDBUFFERBASEEXTPROC) platGetProcAddress( "glBindBufferBaseEXT" )) != 0x0;
+		r &= (glTransformFeedbackVaryingsEXT = (PFNGLTRANSFORMFEEDBACKVARYINGSEXTPROC) platGetProcAddress( "glTransformFeedbackVaryingsEXT" )) != 0x0;
+	}
+
 	return r;
 }
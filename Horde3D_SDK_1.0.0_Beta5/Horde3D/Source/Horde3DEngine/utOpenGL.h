@@ -55,6 +55,7 @@ namespace glExt
 	extern bool ARB_texture_float;
 	extern bool ARB_texture_non_power_of_two;
 	extern bool ARB_timer_query;
+	extern bool EXT_transform_feedback;
 
 	extern int  majorVersion, minorVersion;
 }
@@ -1137,6 +1138,27 @@ extern PFNGLQUERYCOUNTERPROC glQueryCounter;
 extern PFNGLGETQUERYOBJECTI64VPROC glGetQueryObjecti64v;
 extern PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
 
+#endif
+
+
+// EXT_transform_feedback
+#ifndef GL_EXT_transform_feedback
+#define GL_EXT_transform_feedback 1
+
+#define GL_TRANSFORM_FEEDBACK_BUFFER_EXT  0x8C8E
+#define GL_INTERLEAVED_ATTRIBS_EXT        0x8C8C
+#define GL_SEPARATE_ATTRIBS_EXT           0x8C8D
+#define GL_RASTERIZER_DISCARD_EXT         0x8C89
+
+typedef void (GLAPIENTRYP PFNGLBEGINTRANSFORMFEEDBACKEXTPROC) (GLenum primitiveMode);
+typedef void (GLAPIENTRYP PFNGLENDTRANSFORMFEEDBACKEXTPROC) (void);
+typedef void (GLAPIENTRYP PFNGLBINDBUFFERBASEEXTPROC) (GLenum target, GLuint index, GLuint buffer);
+typedef void (GLAPIENTRYP PFNGLTRANSFORMFEEDBACKVARYINGSEXTPROC) (GLuint program, GLsizei count, const GLchar **varyings, GLenum bufferMode);
+extern PFNGLBEGINTRANSFORMFEEDBACKEXTPROC glBeginTransformFeedbackEXT;
+extern PFNGLENDTRANSFORMFEEDBACKEXTPROC glEndTransformFeedbackEXT;
+extern PFNGLBINDBUFFERBASEEXTPROC glBindBufferBaseEXT;
+extern PFNGLTRANSFORMFEEDBACKVARYINGSEXTPROC glTransformFeedbackVaryingsEXT;
+
 #endif
 }  // namespace h3dGL
 
@@ -0,0 +1,78 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _utSIMD_H_
+#define _utSIMD_H_
+
+#include "utPlatform.h"
+
+// Instruction sets for which code can be generated; whether the CPU actually supports
+// them has to be checked at runtime with getCPUFeatures
+#if defined( _M_IX86 ) || defined( _M_X64 ) || defined( __i386__ ) || defined( __x86_64__ )
+#	if defined( _MSC_VER ) || defined( __SSE2__ )
+#		define SIMD_SSE2
+#		define SIMD_SSE2_FUNC
+#	elif defined( __clang__ ) || (defined( __GNUC__ ) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#		define SIMD_SSE2
+#		define SIMD_SSE2_FUNC __attribute__(( target( "sse2" ) ))
+#	endif
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+#	define SIMD_NEON
+#endif
+
+#if defined( SIMD_SSE2 )
+#	include <emmintrin.h>
+#	if defined( _MSC_VER )
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#elif defined( SIMD_NEON )
+#	include <arm_neon.h>
+#endif
+
+
+namespace Horde3D {
+
+struct CPUFeatures
+{
+	enum List
+	{
+		SSE2 = 0x1,
+		NEON = 0x2
+	};
+};
+
+
+inline int getCPUFeatures()
+{
+	int features = 0;
+
+#if defined( SIMD_SSE2 )
+#	if defined( _MSC_VER )
+	int info[4];
+	__cpuid( info, 1 );
+	if( info[3] & (1 << 26) ) features |= CPUFeatures::SSE2;
+#	else
+	unsigned int eax, ebx, ecx, edx;
+	if( __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) && (edx & (1 << 26)) ) features |= CPUFeatures::SSE2;
+#	endif
+#elif defined( SIMD_NEON )
+	// Code is only built with NEON when the target ABI guarantees it
+	features |= CPUFeatures::NEON;
+#endif
+
+	return features;
+}
+
+}
+#endif // _utSIMD_H_
@@ -0,0 +1,211 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#include "utThreadPool.h"
+
+
+namespace Horde3D {
+
+using namespace std;
+
+
+// *************************************************************************************************
+// Class ThreadPool
+// *************************************************************************************************
+
+ThreadPool::ThreadPool() :
+	_workerCount( 0 ), _func( 0x0 ), _userData( 0x0 ), _generation( 0 ), _busyWorkers( 0 ),
+	_inUse( false ), _quit( false )
+{
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	stopWorkers();
+}
+
+
+void ThreadPool::setWorkerCount( unsigned int count )
+{
+	// Wait for a running loop, e.g. one started by the background scene update
+	_mutex.lock();
+	while( _inUse ) _idleCond.wait( _mutex );
+	if( count == _workerCount )
+	{
+		_mutex.unlock();
+		return;
+	}
+	_inUse = true;
+	_mutex.unlock();
+
+	// Threads are started lazily by the next parallelFor
+	stopWorkers();
+
+	_mutex.lock();
+	_workerCount = count;
+	_inUse = false;
+	_mutex.unlock();
+	_idleCond.broadcast();
+}
+
+
+bool ThreadPool::startWorkers()
+{
+	_quit = false;
+	_contexts.resize( _workerCount );
+	
+	for( unsigned int i = 0; i <= _workerCount; ++i ) _queues.push_back( new JobQueue() );
+	for( unsigned int i = 0; i < _workerCount; ++i )
+	{
+		_contexts[i].pool = this;
+		_contexts[i].queueIndex = i + 1;
+		_contexts[i].generation = _generation;
+		
+		_threads.push_back( new Thread() );
+		if( !_threads.back()->start( workerFunc, &_contexts[i] ) )
+		{
+			stopWorkers();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void ThreadPool::stopWorkers()
+{
+	_mutex.lock();
+	_quit = true;
+	_mutex.unlock();
+	_jobCond.broadcast();
+
+	for( size_t i = 0; i < _threads.size(); ++i ) delete _threads[i];  // Joins thread
+	for( size_t i = 0; i < _queues.size(); ++i ) delete _queues[i];
+	_threads.clear();
+	_queues.clear();
+}
+
+
+void ThreadPool::workerFunc( void *userData )
+{
+	WorkerContext *context = (WorkerContext *)userData;
+	ThreadPool *pool = context->pool;
+
+	pool->_mutex.lock();
+	for(;;)
+	{
+		while( pool->_generation == context->generation && !pool->_quit ) pool->_jobCond.wait( pool->_mutex );
+		if( pool->_quit ) break;
+		context->generation = pool->_generation;
+		pool->_mutex.unlock();
+
+		pool->runJobs( context->queueIndex );
+
+		pool->_mutex.lock();
+		if( --pool->_busyWorkers == 0 ) pool->_doneCond.signal();
+	}
+	pool->_mutex.unlock();
+}
+
+
+bool ThreadPool::takeJob( unsigned int queueIndex, unsigned int &index )
+{
+	// Take next iteration from own queue
+	{
+		JobQueue &queue = *_queues[queueIndex];
+		ScopedLock lock( queue.mutex );
+		if( queue.begin < queue.end )
+		{
+			index = queue.begin++;
+			return true;
+		}
+	}
+
+	// Steal from the back of another queue so that the owner keeps working on contiguous data
+	for( unsigned int i = 1, s = (unsigned int)_queues.size(); i < s; ++i )
+	{
+		JobQueue &queue = *_queues[(queueIndex + i) % s];
+		ScopedLock lock( queue.mutex );
+		if( queue.begin < queue.end )
+		{
+			index = --queue.end;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void ThreadPool::runJobs( unsigned int queueIndex )
+{
+	unsigned int index;
+	while( takeJob( queueIndex, index ) ) _func( _userData, index );
+}
+
+
+void ThreadPool::parallelFor( unsigned int count, ParallelForFunc func, void *userData )
+{
+	// Nested or concurrent calls are executed serially on the calling thread
+	bool serial = count < 2;
+	if( !serial )
+	{
+		ScopedLock lock( _mutex );
+		if( _inUse || _workerCount == 0 ) serial = true;
+		else _inUse = true;
+	}
+
+	if( !serial && _threads.empty() && !startWorkers() )
+	{
+		_mutex.lock();
+		_inUse = false;
+		_mutex.unlock();
+		_idleCond.broadcast();
+		serial = true;
+	}
+
+	if( serial )
+	{
+		for( unsigned int i = 0; i < count; ++i ) func( userData, i );
+		return;
+	}
+
+	// Distribute index range evenly
+	unsigned int numQueues = (unsigned int)_queues.size();
+	for( unsigned int i = 0; i < numQueues; ++i )
+	{
+		JobQueue &queue = *_queues[i];
+		ScopedLock lock( queue.mutex );
+		queue.begin = (unsigned int)((unsigned long long)count * i / numQueues);
+		queue.end = (unsigned int)((unsigned long long)count * (i + 1) / numQueues);
+	}
+
+	_mutex.lock();
+	_func = func;
+	_userData = userData;
+	_busyWorkers = _workerCount;
+	++_generation;
+	_mutex.unlock();
+	_jobCond.broadcast();
+
+	runJobs( 0 );
+
+	_mutex.lock();
+	while( _busyWorkers > 0 ) _doneCond.wait( _mutex );
+	_inUse = false;
+	_mutex.unlock();
+	_idleCond.broadcast();
+}
+
+}  // namespace
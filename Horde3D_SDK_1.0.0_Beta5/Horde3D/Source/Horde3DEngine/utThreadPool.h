@@ -0,0 +1,82 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _utThreadPool_H_
+#define _utThreadPool_H_
+
+#include "utThreading.h"
+#include <vector>
+
+
+namespace Horde3D {
+
+// =================================================================================================
+// Thread Pool
+// =================================================================================================
+
+// Executes the iterations of a parallel loop on a set of persistent worker threads. The index
+// range is split evenly into one queue per thread; a thread that runs out of work steals
+// single iterations from the back of the other queues. The calling thread takes part in the
+// work and parallelFor only returns when all iterations are done.
+
+typedef void (*ParallelForFunc)( void *userData, unsigned int index );
+
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	void setWorkerCount( unsigned int count );
+	unsigned int getWorkerCount() const { return _workerCount; }
+	
+	void parallelFor( unsigned int count, ParallelForFunc func, void *userData );
+
+protected:
+	struct JobQueue
+	{
+		Mutex         mutex;
+		unsigned int  begin, end;
+	};
+
+	struct WorkerContext
+	{
+		ThreadPool    *pool;
+		unsigned int  queueIndex;
+		unsigned int  generation;
+	};
+
+protected:
+	static void workerFunc( void *userData );
+	
+	bool startWorkers();
+	void stopWorkers();
+	bool takeJob( unsigned int queueIndex, unsigned int &index );
+	void runJobs( unsigned int queueIndex );
+
+protected:
+	unsigned int                   _workerCount;
+	std::vector< Thread * >        _threads;
+	std::vector< WorkerContext >   _contexts;
+	std::vector< JobQueue * >      _queues;  // Queue 0 belongs to the calling thread
+
+	Mutex                          _mutex;
+	Condition                      _jobCond, _doneCond, _idleCond;
+	ParallelForFunc                _func;
+	void                           *_userData;
+	unsigned int                   _generation;
+	unsigned int                   _busyWorkers;
+	bool                           _inUse, _quit;  // _inUse is also set while the threads are replaced
+};
+
+}
+#endif  // _utThreadPool_H_
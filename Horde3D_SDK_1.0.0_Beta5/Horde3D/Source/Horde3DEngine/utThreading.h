@@ -0,0 +1,252 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+#ifndef _utThreading_H_
+#define _utThreading_H_
+
+#include "utPlatform.h"
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+#   define WIN32_LEAN_AND_MEAN 1
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#   include <windows.h>
+#else
+#	include <pthread.h>
+#	include <unistd.h>
+#endif
+
+
+namespace Horde3D {
+
+inline unsigned int getProcessorCount()
+{
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo( &sysInfo );
+	return sysInfo.dwNumberOfProcessors > 0 ? (unsigned int)sysInfo.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+	return count > 0 ? (unsigned int)count : 1;
+#endif
+}
+
+
+// =================================================================================================
+// Mutex
+// =================================================================================================
+
+class Mutex
+{
+public:
+	Mutex()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		InitializeCriticalSection( &_mutex );
+	#else
+		pthread_mutex_init( &_mutex, 0x0 );
+	#endif
+	}
+
+	~Mutex()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		DeleteCriticalSection( &_mutex );
+	#else
+		pthread_mutex_destroy( &_mutex );
+	#endif
+	}
+
+	void lock()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		EnterCriticalSection( &_mutex );
+	#else
+		pthread_mutex_lock( &_mutex );
+	#endif
+	}
+
+	void unlock()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		LeaveCriticalSection( &_mutex );
+	#else
+		pthread_mutex_unlock( &_mutex );
+	#endif
+	}
+
+private:
+	// Not copyable
+	Mutex( const Mutex & );
+	Mutex &operator=( const Mutex & );
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	CRITICAL_SECTION  _mutex;
+#else
+	pthread_mutex_t   _mutex;
+#endif
+
+	friend class Condition;
+};
+
+
+class ScopedLock
+{
+public:
+	explicit ScopedLock( Mutex &mutex ) : _mutex( mutex ) { _mutex.lock(); }
+	~ScopedLock() { _mutex.unlock(); }
+
+private:
+	ScopedLock( const ScopedLock & );
+	ScopedLock &operator=( const ScopedLock & );
+
+private:
+	Mutex  &_mutex;
+};
+
+
+// =================================================================================================
+// Condition
+// =================================================================================================
+
+class Condition
+{
+public:
+	Condition()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		InitializeConditionVariable( &_cond );
+	#else
+		pthread_cond_init( &_cond, 0x0 );
+	#endif
+	}
+
+	~Condition()
+	{
+	#if !defined( PLATFORM_WIN ) && !defined( PLATFORM_WIN_CE )
+		pthread_cond_destroy( &_cond );
+	#endif
+	}
+
+	// Mutex must be locked by the caller; spurious wakeups are possible
+	void wait( Mutex &mutex )
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		SleepConditionVariableCS( &_cond, &mutex._mutex, INFINITE );
+	#else
+		pthread_cond_wait( &_cond, &mutex._mutex );
+	#endif
+	}
+
+	void signal()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		WakeConditionVariable( &_cond );
+	#else
+		pthread_cond_signal( &_cond );
+	#endif
+	}
+
+	void broadcast()
+	{
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		WakeAllConditionVariable( &_cond );
+	#else
+		pthread_cond_broadcast( &_cond );
+	#endif
+	}
+
+private:
+	Condition( const Condition & );
+	Condition &operator=( const Condition & );
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	CONDITION_VARIABLE  _cond;
+#else
+	pthread_cond_t      _cond;
+#endif
+};
+
+
+// =================================================================================================
+// Thread
+// =================================================================================================
+
+typedef void (*ThreadFunc)( void *userData );
+
+class Thread
+{
+public:
+	Thread() : _func( 0x0 ), _userData( 0x0 ), _running( false ) {}
+	~Thread() { join(); }
+
+	bool start( ThreadFunc func, void *userData )
+	{
+		if( _running ) return false;
+
+		_func = func;
+		_userData = userData;
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		_handle = CreateThread( 0x0, 0, entryPoint, this, 0, 0x0 );
+		_running = (_handle != 0x0);
+	#else
+		_running = (pthread_create( &_handle, 0x0, entryPoint, this ) == 0);
+	#endif
+		return _running;
+	}
+
+	void join()
+	{
+		if( !_running ) return;
+
+	#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+		WaitForSingleObject( _handle, INFINITE );
+		CloseHandle( _handle );
+	#else
+		pthread_join( _handle, 0x0 );
+	#endif
+		_running = false;
+	}
+
+	bool isRunning() const { return _running; }
+
+private:
+	Thread( const Thread & );
+	Thread &operator=( const Thread & );
+
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	static DWORD WINAPI entryPoint( LPVOID param )
+#else
+	static void *entryPoint( void *param )
+#endif
+	{
+		Thread *thread = (Thread *)param;
+		thread->_func( thread->_userData );
+		return 0;
+	}
+
+private:
+#if defined( PLATFORM_WIN ) || defined( PLATFORM_WIN_CE )
+	HANDLE      _handle;
+#else
+	pthread_t   _handle;
+#endif
+	ThreadFunc  _func;
+	void        *_userData;
+	bool        _running;
+};
+
+}
+#endif  // _utThreading_H_
@@ -14,6 +14,8 @@
 #include "Horde3D.h"
 #include "utPlatform.h"
 #include "utMath.h"
+#include "utThreading.h"
+#include "utTimer.h"
 #include <math.h>
 #ifdef PLATFORM_WIN
 #	define WIN32_LEAN_AND_MEAN 1
@@ -28,6 +30,9 @@
 #include <sstream>
 #include <vector>
 #include <map>
+#include <set>
+#include <algorithm>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 
@@ -77,110 +82,391 @@ string cleanPath( string path )
 	return path;
 }
 
-}  // namespace
+
+vector< string > splitContentDir( const char *contentDir )
+{
+	string dir;
+	vector< string > dirs;
+
+	// Split path string
+	char *c = (char *)contentDir;
+	do
+	{
+		if( *c != '|' && *c != '\0' )
+			dir += *c;
+		else
+		{
+			dir = cleanPath( dir );
+			if( dir != "" ) dir += '/';
+			dirs.push_back( dir );
+			dir = "";
+		}
+	} while( *c++ != '\0' );
+
+	return dirs;
+}
 
 
 // =================================================================================================
-// Exported API functions
+// Resource Loader
 // =================================================================================================
 
-using namespace Horde3DUtils;
+// Files are read and decoded on the loader threads. Everything else that calls into the engine,
+// including the upload of the data, is done by the thread that polls the loader, which is the one
+// that owns the OpenGL context.
 
+struct LoadJob
+{
+	H3DRes            res;
+	int               type;
+	vector< string >  fileNames;  // Candidates in the order of the search paths
+	char              *data;
+	int               size;
+	H3DDecodedRes     decoded;  // Replaces the file data if the engine could decode it
+	bool              found;
+};
 
-DLLEXP const char *h3dutGetResourcePath( int type )
+
+class ResourceLoader
+{
+public:
+	ResourceLoader();
+	~ResourceLoader();
+
+	void start( const char *contentDir );
+	float poll( float maxTimeMS );
+	bool finish();
+	bool isActive() const { return _active; }
+	void getCounts( int *loaded, int *total ) const;
+
+protected:
+	static void threadFunc( void *userData );
+	static void readJob( LoadJob &job );
+	void queueUnloadedResources();
+	void loadJob( LoadJob &job );
+	void stopThreads();
+
+protected:
+	vector< string >    _dirs;
+	vector< Thread * >  _threads;
+	set< H3DRes >       _queuedRes;  // All resources handed to the threads in this run
+	int                 _loadedCount;
+	bool                _result;
+	bool                _active;
+
+	Mutex               _mutex;  // Protects the members below
+	Condition           _jobCond, _doneCond;
+	deque< LoadJob * >  _jobs, _doneJobs;
+	bool                _quit;
+} loader;
+
+
+ResourceLoader::ResourceLoader() :
+	_loadedCount( 0 ), _result( true ), _active( false ), _quit( false )
 {
-	return resourcePaths[type].c_str();
 }
 
 
-DLLEXP void h3dutSetResourcePath( int type, const char *path )
+ResourceLoader::~ResourceLoader()
 {
-	string s = path != 0x0 ? path : "";
+	stopThreads();
+}
 
-	resourcePaths[type] = cleanPath( s );
+
+void ResourceLoader::start( const char *contentDir )
+{
+	// An unfinished run is cancelled; its remaining resources are queued again below
+	if( _active ) stopThreads();
+
+	_dirs = splitContentDir( contentDir );
+	_queuedRes.clear();
+	_loadedCount = 0;
+	_result = true;
+	_active = true;
+
+	int threadCount = std::max( (int)h3dGetOption( H3DOptions::WorkerThreads ), 1 );
+	_quit = false;
+	for( int i = 0; i < threadCount; ++i )
+	{
+		Thread *thread = new Thread();
+		if( !thread->start( threadFunc, this ) )
+		{
+			delete thread;
+			break;
+		}
+		_threads.push_back( thread );
+	}
+
+	// Without threads, the files are read when the loader is polled
+	queueUnloadedResources();
+	if( _queuedRes.empty() ) stopThreads();
 }
 
 
-DLLEXP bool h3dutLoadResourcesFromDisk( const char *contentDir )
+void ResourceLoader::stopThreads()
 {
-	bool result = true;
-	string dir;
-	vector< string > dirs;
+	{
+		ScopedLock lock( _mutex );
+		_quit = true;
+		_jobCond.broadcast();
+	}
+	
+	for( size_t i = 0; i < _threads.size(); ++i )
+	{
+		_threads[i]->join();
+		delete _threads[i];
+	}
+	_threads.clear();
 
-	// Split path string
-	char *c = (char *)contentDir;
-	do
+	// Jobs are only left if the loading was not finished
+	for( size_t i = 0; i < _jobs.size(); ++i ) delete _jobs[i];
+	for( size_t i = 0; i < _doneJobs.size(); ++i )
 	{
-		if( *c != '|' && *c != '\0' )
-			dir += *c;
-		else
+		h3dFreeDecodedResourceData( _doneJobs[i]->decoded );
+		delete[] _doneJobs[i]->data;
+		delete _doneJobs[i];
+	}
+	_jobs.clear();
+	_doneJobs.clear();
+
+	_active = false;
+}
+
+
+void ResourceLoader::threadFunc( void *userData )
+{
+	ResourceLoader *loader = (ResourceLoader *)userData;
+
+	for(;;)
+	{
+		LoadJob *job;
 		{
-			dir = cleanPath( dir );
-			if( dir != "" ) dir += '/';
-			dirs.push_back( dir );
-			dir = "";
+			ScopedLock lock( loader->_mutex );
+			while( loader->_jobs.empty() && !loader->_quit ) loader->_jobCond.wait( loader->_mutex );
+			if( loader->_quit ) return;
+			job = loader->_jobs.front();
+			loader->_jobs.pop_front();
 		}
-	} while( *c++ != '\0' );
+
+		readJob( *job );
+
+		ScopedLock lock( loader->_mutex );
+		loader->_doneJobs.push_back( job );
+		loader->_doneCond.signal();
+	}
+}
+
+
+void ResourceLoader::readJob( LoadJob &job )
+{
+	ifstream inf;
+	
+	// Loop over search paths and try to open files
+	for( unsigned int i = 0; i < job.fileNames.size(); ++i )
+	{
+		inf.clear();
+		inf.open( job.fileNames[i].c_str(), ios::binary );
+		if( inf.good() ) break;
+	}
+
+	if( !inf.good() ) return;
+
+	// Copy resource file to memory
+	inf.seekg( 0, ios::end );
+	int fileSize = (int)inf.tellg();
+	if( fileSize <= 0 ) return;
 	
-	// Get the first resource that needs to be loaded
-	int res = h3dQueryUnloadedResource( 0 );
+	job.data = new char[fileSize];
+	inf.seekg( 0 );
+	inf.read( job.data, fileSize );
+	job.size = fileSize;
+	job.found = true;
+
+	job.decoded = h3dDecodeResourceData( job.type, job.data, job.size );
+	if( job.decoded != 0x0 )
+	{
+		delete[] job.data;
+		job.data = 0x0;
+		job.size = 0;
+	}
+}
+
+
+void ResourceLoader::queueUnloadedResources()
+{
+	// Loaded resources can reference further resources which are only now added as unloaded ones
+	vector< LoadJob * > jobs;
+	H3DRes res;
+	for( int i = 0; (res = h3dQueryUnloadedResource( i )) != 0; ++i )
+	{
+		if( !_queuedRes.insert( res ).second ) continue;
+
+		LoadJob *job = new LoadJob();
+		job->res = res;
+		job->type = h3dGetResType( res );
+		job->data = 0x0;
+		job->size = 0;
+		job->decoded = 0x0;
+		job->found = false;
+		for( unsigned int j = 0; j < _dirs.size(); ++j )
+			job->fileNames.push_back( _dirs[j] + resourcePaths[job->type] + "/" + h3dGetResName( res ) );
+		jobs.push_back( job );
+	}
+
+	if( jobs.empty() ) return;
 	
-	char *dataBuf = 0;
-	int bufSize = 0;
+	if( _threads.empty() )
+	{
+		for( size_t i = 0; i < jobs.size(); ++i ) readJob( *jobs[i] );
+		_doneJobs.insert( _doneJobs.end(), jobs.begin(), jobs.end() );
+		return;
+	}
+
+	ScopedLock lock( _mutex );
+	_jobs.insert( _jobs.end(), jobs.begin(), jobs.end() );
+	_jobCond.broadcast();
+}
 
-	while( res != 0 )
+
+void ResourceLoader::loadJob( LoadJob &job )
+{
+	if( job.found )
 	{
-		ifstream inf;
-		
-		// Loop over search paths and try to open files
-		for( unsigned int i = 0; i < dirs.size(); ++i )
-		{
-			string fileName = dirs[i] + resourcePaths[h3dGetResType( res )] + "/" + h3dGetResName( res );
-			inf.clear();
-			inf.open( fileName.c_str(), ios::binary );
-			if( inf.good() ) break;
-		}
+		// Send resource data to engine
+		if( job.decoded != 0x0 ) _result &= h3dLoadDecodedResource( job.res, job.decoded );
+		else _result &= h3dLoadResource( job.res, job.data, job.size );
+	}
+	else
+	{
+		// Tell engine to use the dafault resource by using NULL as data pointer
+		h3dLoadResource( job.res, 0x0, 0 );
+		_result = false;
+	}
+
+	h3dFreeDecodedResourceData( job.decoded );
+	delete[] job.data;
+	++_loadedCount;
+}
+
 
-		// Open resource file
-		if( inf.good() ) // Resource file found
+float ResourceLoader::poll( float maxTimeMS )
+{
+	if( !_active ) return 1.0f;
+
+	Timer timer;
+	timer.setEnabled( true );
+
+	// At least one resource is loaded per call so that loading always progresses
+	int count = 0;
+	for(;;)
+	{
+		LoadJob *job = 0x0;
 		{
-			// Find size of resource file
-			inf.seekg( 0, ios::end );
-			int fileSize = inf.tellg();
-			if( bufSize < fileSize  )
+			ScopedLock lock( _mutex );
+			if( !_doneJobs.empty() )
 			{
-				delete[] dataBuf;				
-				dataBuf = new char[fileSize];
-				if( !dataBuf )
-				{
-					bufSize = 0;
-					continue;
-				}
-				bufSize = fileSize;
+				job = _doneJobs.front();
+				_doneJobs.pop_front();
 			}
-			if( fileSize == 0 )	continue;
-			// Copy resource file to memory
-			inf.seekg( 0 );
-			inf.read( dataBuf, fileSize );
-			inf.close();
-			// Send resource data to engine
-			result &= h3dLoadResource( res, dataBuf, fileSize );
 		}
-		else // Resource file not found
+		if( job == 0x0 ) break;
+
+		loadJob( *job );
+		delete job;
+		++count;
+		
+		if( maxTimeMS >= 0 && timer.getElapsedTimeMS() >= maxTimeMS ) break;
+	}
+
+	if( count > 0 ) queueUnloadedResources();
+	if( _loadedCount == (int)_queuedRes.size() )
+	{
+		stopThreads();
+		return 1.0f;
+	}
+	
+	return (float)_loadedCount / (float)_queuedRes.size();
+}
+
+
+bool ResourceLoader::finish()
+{
+	while( _active )
+	{
 		{
-			// Tell engine to use the dafault resource by using NULL as data pointer
-			h3dLoadResource( res, 0x0, 0 );
-			result = false;
+			ScopedLock lock( _mutex );
+			while( _doneJobs.empty() ) _doneCond.wait( _mutex );
 		}
-		// Get next unloaded resource
-		res = h3dQueryUnloadedResource( 0 );
+		poll( -1 );
 	}
-	delete[] dataBuf;
+
+	return _result;
+}
+
+
+void ResourceLoader::getCounts( int *loaded, int *total ) const
+{
+	if( loaded != 0x0 ) *loaded = _loadedCount;
+	if( total != 0x0 ) *total = (int)_queuedRes.size();
+}
+
+}  // namespace
+
+
+// =================================================================================================
+// Exported API functions
+// =================================================================================================
+
+using namespace Horde3DUtils;
+
+
+DLLEXP const char *h3dutGetResourcePath( int type )
+{
+	return resourcePaths[type].c_str();
+}
+
+
+DLLEXP void h3dutSetResourcePath( int type, const char *path )
+{
+	string s = path != 0x0 ? path : "";
+
+	resourcePaths[type] = cleanPath( s );
+}
+
+
+DLLEXP bool h3dutLoadResourcesFromDisk( const char *contentDir )
+{
+	// Complete a run that was started asynchronously before
+	bool result = loader.isActive() ? loader.finish() : true;
+
+	loader.start( contentDir );
+	result &= loader.finish();
 
 	return result;
 }
 
 
+DLLEXP void h3dutStartLoadingResourcesFromDisk( const char *contentDir )
+{
+	loader.start( contentDir );
+}
+
+
+DLLEXP float h3dutPollResourceLoading( float maxTimeMS, int *loadedCount, int *totalCount )
+{
+	float progress = loader.poll( maxTimeMS );
+	loader.getCounts( loadedCount, totalCount );
+
+	return progress;
+}
+
+
+DLLEXP bool h3dutFinishLoadingResources()
+{
+	return loader.finish();
+}
+
+
 DLLEXP bool h3dutDumpMessages()
 {
 	if( !outf.is_open() )
@@ -0,0 +1,286 @@
+// *************************************************************************************************
+//
+// Horde3D
+//   Next-Generation Graphics Engine
+// --------------------------------------
+// Copyright (C) 2006-2011 Nicolas Schulz
+//
+// This software is distributed under the terms of the Eclipse Public License v1.0.
+// A copy of the license may be obtained at: http://www.eclipse.org/legal/epl-v10.html
+//
+// *************************************************************************************************
+
+// -------------------------------------------------------------------------------------------------
+//
+// Animation key compression
+//
+// Shared by the engine and the converter. Rotations are stored as smallest-three quantized
+// quaternions and all channels are reduced to the keys needed to reconstruct every frame by
+// linear interpolation within a given error bound.
+//
+// -------------------------------------------------------------------------------------------------
+
+#ifndef _utAnimCompression_H_
+#define _utAnimCompression_H_
+
+#include "utPlatform.h"
+#include "utMath.h"
+#include <vector>
+#include <algorithm>
+
+
+namespace Horde3D {
+
+namespace AnimCompression
+{
+	// Maximum reconstruction errors used when no explicit tolerances are given
+	const float DefaultRotTolerance = 0.001f;      // Radians
+	const float DefaultTransTolerance = 0.0001f;   // Scene units
+	const float DefaultScaleTolerance = 0.0001f;
+}
+
+
+// =================================================================================================
+// Quantized Quaternion
+// =================================================================================================
+
+// Smallest-three encoding: the largest component is dropped and recovered from the unit length,
+// the other three are quantized to 15 bits in [-1/sqrt(2), 1/sqrt(2)]; the index of the dropped
+// component is stored in the high bits of the first two values
+struct PackedQuaternion
+{
+	uint16  v[3];
+};
+
+
+inline PackedQuaternion packQuaternion( const Quaternion &q )
+{
+	const float range = 0.70710678f;
+	float c[4] = { q.x, q.y, q.z, q.w };
+
+	uint32 largest = 0;
+	for( uint32 i = 1; i < 4; ++i )
+	{
+		if( fabsf( c[i] ) > fabsf( c[largest] ) ) largest = i;
+	}
+	// q and -q describe the same rotation, so the dropped component can always be positive
+	float sign = c[largest] < 0 ? -1.0f : 1.0f;
+
+	PackedQuaternion pq;
+	for( uint32 i = 0, j = 0; i < 4; ++i )
+	{
+		if( i == largest ) continue;
+		float f = (c[i] * sign + range) / (2 * range);
+		pq.v[j++] = (uint16)ftoi_r( clamp( f, 0, 1 ) * 32767.0f );
+	}
+	pq.v[0] |= (uint16)((largest & 1) << 15);
+	pq.v[1] |= (uint16)((largest >> 1) << 15);
+
+	return pq;
+}
+
+
+inline Quaternion unpackQuaternion( const PackedQuaternion &pq )
+{
+	const float range = 0.70710678f;
+	const float scale = 2 * range / 32767.0f;
+	uint32 largest = (pq.v[0] >> 15) | ((pq.v[1] >> 15) << 1);
+
+	float a = (pq.v[0] & 0x7FFF) * scale - range;
+	float b = (pq.v[1] & 0x7FFF) * scale - range;
+	float c = (pq.v[2] & 0x7FFF) * scale - range;
+	float d = sqrtf( maxf( 1 - a * a - b * b - c * c, 0 ) );
+
+	switch( largest )
+	{
+	case 0: return Quaternion( d, a, b, c );
+	case 1: return Quaternion( a, d, b, c );
+	case 2: return Quaternion( a, b, d, c );
+	default: return Quaternion( a, b, c, d );
+	}
+}
+
+
+// =================================================================================================
+// Key Tracks
+// =================================================================================================
+
+template< class T > struct AnimKeyTrack
+{
+	std::vector< uint32 >  keyFrames;  // Ascending frame indices, starting with 0
+	std::vector< T >       keys;
+
+	// Returns the last key that is not after the specified frame
+	uint32 findKey( uint32 frame ) const
+	{
+		// Since key frames are distinct and ascending, the key index can differ from the frame
+		// index at most by the number of dropped frames; this narrows the search a lot for
+		// tracks where only few frames could be removed
+		uint32 numKeys = (uint32)keyFrames.size();
+		uint32 numDropped = keyFrames[numKeys - 1] - (numKeys - 1);
+		uint32 last = std::min( frame, numKeys - 1 );
+		uint32 first = std::min( frame > numDropped ? frame - numDropped : 0, last );
+		while( first < last )
+		{
+			uint32 mid = (first + last + 1) / 2;
+			if( keyFrames[mid] <= frame ) first = mid;
+			else last = mid - 1;
+		}
+		return first;
+	}
+
+	size_t getMemSize() const
+	{
+		return keyFrames.size() * sizeof( uint32 ) + keys.size() * sizeof( T );
+	}
+};
+
+
+inline Vec3f sampleKeyTrack( const AnimKeyTrack< Vec3f > &track, float frame )
+{
+	uint32 k = track.findKey( (uint32)frame );
+	if( k + 1 >= (uint32)track.keys.size() ) return track.keys[k];
+
+	float amount = (frame - track.keyFrames[k]) / (float)(track.keyFrames[k + 1] - track.keyFrames[k]);
+	return track.keys[k].lerp( track.keys[k + 1], amount );
+}
+
+
+inline Quaternion sampleKeyTrack( const AnimKeyTrack< PackedQuaternion > &track, float frame )
+{
+	uint32 k = track.findKey( (uint32)frame );
+	if( k + 1 >= (uint32)track.keys.size() ) return unpackQuaternion( track.keys[k] );
+
+	float amount = (frame - track.keyFrames[k]) / (float)(track.keyFrames[k + 1] - track.keyFrames[k]);
+	return unpackQuaternion( track.keys[k] ).nlerp( unpackQuaternion( track.keys[k + 1] ), amount );
+}
+
+
+// =================================================================================================
+// Key Reduction
+// =================================================================================================
+
+struct Vec3fKeyMetric
+{
+	float  maxDistSq;
+
+	explicit Vec3fKeyMetric( float tolerance ) : maxDistSq( tolerance * tolerance ) {}
+
+	Vec3f interpolate( const Vec3f &a, const Vec3f &b, float t ) const { return a.lerp( b, t ); }
+	bool isWithinTolerance( const Vec3f &a, const Vec3f &b ) const
+	{
+		Vec3f d = a - b;
+		return d.x * d.x + d.y * d.y + d.z * d.z <= maxDistSq;
+	}
+};
+
+struct QuaternionKeyMetric
+{
+	float  maxDistSq;
+
+	// The rotation angle between two unit quaternions is 4 * asin( |a - b| / 2 ); the distance is
+	// compared instead of the dot product since cos is too flat around 0 for float precision
+	explicit QuaternionKeyMetric( float tolerance ) :
+		maxDistSq( 4 * sinf( tolerance * 0.25f ) * sinf( tolerance * 0.25f ) ) {}
+
+	Quaternion interpolate( const Quaternion &a, const Quaternion &b, float t ) const { return a.nlerp( b, t ); }
+	bool isWithinTolerance( const Quaternion &a, const Quaternion &b ) const
+	{
+		float s = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1.0f : 1.0f;
+		float dx = a.x - b.x * s, dy = a.y - b.y * s, dz = a.z - b.z * s, dw = a.w - b.w * s;
+		return dx * dx + dy * dy + dz * dz + dw * dw <= maxDistSq;
+	}
+};
+
+
+template< class T, class Metric >
+bool isKeySegmentValid( const std::vector< T > &values, const std::vector< T > &reference, const Metric &metric,
+                        uint32 first, uint32 last )
+{
+	float invSpan = 1.0f / (float)(last - first);
+	for( uint32 i = first + 1; i < last; ++i )
+	{
+		T v = metric.interpolate( values[first], values[last], (i - first) * invSpan );
+		if( !metric.isWithinTolerance( v, reference[i] ) ) return false;
+	}
+	return true;
+}
+
+
+// Selects the frames that need to be kept as keys. values holds the frames as they will be decoded
+// (e.g. after quantization) and reference the original frames the error is measured against.
+template< class T, class Metric >
+void reduceKeys( const std::vector< T > &values, const std::vector< T > &reference, const Metric &metric,
+                 std::vector< uint32 > &keyFrames )
+{
+	uint32 count = (uint32)values.size();
+	keyFrames.resize( 0 );
+	keyFrames.push_back( 0 );
+
+	// Constant track
+	bool constant = true;
+	for( uint32 i = 1; i < count && constant; ++i )
+		constant = metric.isWithinTolerance( values[0], reference[i] );
+	if( constant ) return;
+
+	// Greedy fitting of the longest segment starting at the previous key; the span is grown
+	// exponentially and then refined by bisection, so the cost stays O(n log n) for long clips.
+	// Every accepted segment is verified, so the error bound holds even where the error does not
+	// grow monotonically with the span.
+	uint32 first = 0;
+	while( first + 1 < count )
+	{
+		uint32 good = 1, bad = 0;
+		while( first + good * 2 < count && isKeySegmentValid( values, reference, metric, first, first + good * 2 ) )
+			good *= 2;
+		if( first + good * 2 < count ) bad = good * 2;
+		else if( good < count - 1 - first )
+		{
+			if( isKeySegmentValid( values, reference, metric, first, count - 1 ) ) good = count - 1 - first;
+			else bad = count - 1 - first;
+		}
+
+		while( bad > good + 1 )
+		{
+			uint32 mid = (good + bad) / 2;
+			if( isKeySegmentValid( values, reference, metric, first, first + mid ) ) good = mid;
+			else bad = mid;
+		}
+
+		first += good;
+		keyFrames.push_back( first );
+	}
+}
+
+
+inline void compressKeyTrack( const std::vector< Vec3f > &values, float tolerance, AnimKeyTrack< Vec3f > &track )
+{
+	reduceKeys( values, values, Vec3fKeyMetric( tolerance ), track.keyFrames );
+
+	track.keys.resize( track.keyFrames.size() );
+	for( size_t i = 0; i < track.keyFrames.size(); ++i )
+		track.keys[i] = values[track.keyFrames[i]];
+}
+
+
+inline void compressKeyTrack( const std::vector< Quaternion > &values, float tolerance,
+                              AnimKeyTrack< PackedQuaternion > &track )
+{
+	// Keys are fitted against the quantized values so that the tolerance includes quantization error
+	std::vector< PackedQuaternion > packed( values.size() );
+	std::vector< Quaternion > decoded( values.size() );
+	for( size_t i = 0; i < values.size(); ++i )
+	{
+		packed[i] = packQuaternion( values[i] );
+		decoded[i] = unpackQuaternion( packed[i] );
+	}
+
+	reduceKeys( decoded, values, QuaternionKeyMetric( tolerance ), track.keyFrames );
+
+	track.keys.resize( track.keyFrames.size() );
+	for( size_t i = 0; i < track.keyFrames.size(); ++i )
+		track.keys[i] = packed[track.keyFrames[i]];
+}
+
+}
+#endif // _utAnimCompression_H_
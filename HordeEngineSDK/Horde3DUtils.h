@@ -123,6 +123,10 @@ DLL void h3dutSetResourcePath( int type, const char *path );
 		directories on a data drive. Several search paths can be specified using the pipe character (|)
 		as separator. All resource names are directly converted to filenames and the function tries to
 		find them in the specified directories using the given order of the search paths.
+		
+		The files are read and decoded in parallel as described for h3dutStartLoadingResourcesFromDisk;
+		the function returns when all resources, including the ones referenced by loaded resources, are
+		loaded. A run that was started with h3dutStartLoadingResourcesFromDisk is completed first.
 	
 	Parameters:
 		contentDir  - directories where data is located on the drive ((back-)slashes at end are removed)
@@ -132,6 +136,62 @@ DLL void h3dutSetResourcePath( int type, const char *path );
 */
 DLL bool h3dutLoadResourcesFromDisk( const char *contentDir );
 
+/* Function: h3dutStartLoadingResourcesFromDisk
+		Starts loading previously added resources from a data drive in the background.
+	
+	Details:
+		This utility function starts loading the unloaded resources like h3dutLoadResourcesFromDisk but
+		returns immediately. The files are read and decoded (see h3dDecodeResourceData) on as many loader
+		threads as the engine uses worker threads (see option WorkerThreads), but at least one. The data
+		is passed to the engine when h3dutPollResourceLoading or h3dutFinishLoadingResources is called,
+		so these have to be called by the thread that owns the OpenGL context until the loading is done.
+		Resources must not be removed while they are loaded. An unfinished run is cancelled; the resources
+		it did not load yet are loaded by the new run.
+	
+	Parameters:
+		contentDir  - directories where data is located on the drive ((back-)slashes at end are removed)
+		
+	Returns:
+		nothing
+*/
+DLL void h3dutStartLoadingResourcesFromDisk( const char *contentDir );
+
+/* Function: h3dutPollResourceLoading
+		Passes the resources loaded in the background to the engine and returns the progress.
+	
+	Details:
+		This utility function loads the resources that were read by the loader threads since the last call
+		into the engine, until no more are ready or maxTimeMS is exceeded, and queues the resources that they
+		reference. The progress is the fraction of the resources known so far that are loaded; since the
+		referenced resources are only known once the referencing ones are loaded, it can decrease. The
+		function does not block and can be called once per frame to keep an animation running while loading.
+	
+	Parameters:
+		maxTimeMS    - time after which no further resources are loaded; at least one ready resource is
+		               loaded per call; a negative value loads all ready resources
+		loadedCount  - pointer to variable where the number of loaded resources will be stored (can be NULL)
+		totalCount   - pointer to variable where the number of known resources will be stored (can be NULL)
+		
+	Returns:
+		progress between 0 and 1, where 1 means that all resources are loaded and the loader threads stopped
+*/
+DLL float h3dutPollResourceLoading( float maxTimeMS, int *loadedCount, int *totalCount );
+
+/* Function: h3dutFinishLoadingResources
+		Waits until the resources loaded in the background are completely loaded.
+	
+	Details:
+		This utility function completes a run of h3dutStartLoadingResourcesFromDisk like repeated calls
+		of h3dutPollResourceLoading would do, but waits for the loader threads instead of returning.
+	
+	Parameters:
+		none
+		
+	Returns:
+		false if at least one resource of the last run could not be loaded, otherwise true
+*/
+DLL bool h3dutFinishLoadingResources();
+
 /* Function: h3dutCreateGeometryRes
 		Creates a Geometry resource from specified vertex data.
 	
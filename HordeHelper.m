@@ -85,6 +85,10 @@ if strcmpi(cmd, 'Initialize')
     HE.H3DOptions.WireframeMode       = 10;
     HE.H3DOptions.DebugViewMode       = 11;
     HE.H3DOptions.DumpFailedShaders   = 12;
+    HE.H3DOptions.ThreadedUpdate      = 15;
+    HE.H3DOptions.WorkerThreads       = 16;
+    HE.H3DOptions.AnimCompression     = 17;
+    HE.H3DOptions.AnimPoseCache       = 18;
     
     HE.H3DNodeTypes.Undefined = 0;
     HE.H3DNodeTypes.Group     = 1;
@@ -95,6 +99,9 @@ if strcmpi(cmd, 'Initialize')
     HE.H3DNodeTypes.Camera    = 6;
     HE.H3DNodeTypes.Emitter   = 7;
 
+    HE.H3DModelUpdateFlags.Animation = 1;
+    HE.H3DModelUpdateFlags.Geometry  = 2;
+
     HE.H3DStats.TriCount            = 100;
     HE.H3DStats.BatchCount          = 101;
     HE.H3DStats.LightPassCount      = 102;
@@ -108,6 +115,23 @@ if strcmpi(cmd, 'Initialize')
     HE.H3DStats.ParticleGPUTime     = 110;
     HE.H3DStats.TextureVMem         = 111;
     HE.H3DStats.GeometryVMem        = 112;
+    HE.H3DStats.SWOccCulledCount    = 113;
+    HE.H3DStats.ShaderChangesSubmitted = 114;
+    HE.H3DStats.ShaderChangesApplied = 115;
+    HE.H3DStats.RenderStateChangesSubmitted = 116;
+    HE.H3DStats.RenderStateChangesApplied = 117;
+    HE.H3DStats.TextureChangesSubmitted = 118;
+    HE.H3DStats.TextureChangesApplied = 119;
+    HE.H3DStats.SamplerChangesSubmitted = 120;
+    HE.H3DStats.SamplerChangesApplied = 121;
+    HE.H3DStats.VertLayoutChangesSubmitted = 122;
+    HE.H3DStats.VertLayoutChangesApplied = 123;
+    HE.H3DStats.IndexBufChangesSubmitted = 124;
+    HE.H3DStats.IndexBufChangesApplied = 125;
+    HE.H3DStats.ViewportChangesSubmitted = 126;
+    HE.H3DStats.ViewportChangesApplied = 127;
+    HE.H3DStats.PoseCacheHitCount = 128;
+    HE.H3DStats.PoseCacheMissCount = 129;
 
     HE.H3DLight.MatResI     = 500;
     HE.H3DLight.RadiusF     = 501;
@@ -135,6 +159,7 @@ if strcmpi(cmd, 'Initialize')
 
     HE.H3DCamera.OrthoI       = 613;
     HE.H3DCamera.OccCullingI   = 614;
+    HE.H3DCamera.SWOccCullingI = 615;
 
     HE.H3DModel.GeoResI              = 200;
     HE.H3DModel.SWSkinningI          = 201;
@@ -142,11 +167,34 @@ if strcmpi(cmd, 'Initialize')
     HE.H3DModel.LodDist2F            = 203;
     HE.H3DModel.LodDist3F            = 204;
     HE.H3DModel.LodDist4F            = 205;
+    HE.H3DModel.AnimCountI           = 206;
+    HE.H3DModel.LazyAnimI            = 207;
+
+    % RespawnCountI is a budget of the whole emitter: it creates at most
+    % MaxCountI * RespawnCountI particles in total, and any free slot may
+    % be reused while budget is left. Older versions counted the respawns of
+    % every slot separately, which could leave slots unused near the end.
+    HE.H3DEmitter.MatResI            = 700;
+    HE.H3DEmitter.PartEffResI        = 701;
+    HE.H3DEmitter.MaxCountI          = 702;
+    HE.H3DEmitter.RespawnCountI      = 703;
+    HE.H3DEmitter.DelayF             = 704;
+    HE.H3DEmitter.EmissionRateF      = 705;
+    HE.H3DEmitter.SpreadAngleF       = 706;
+    HE.H3DEmitter.ForceF3            = 707;
+    HE.H3DEmitter.SeedI              = 708;
+    HE.H3DEmitter.GPUSimulationI     = 709;
+    HE.H3DEmitter.DepthSortI         = 710;
+    HE.H3DEmitter.LodDistF           = 711;
+    HE.H3DEmitter.LodUpdateIntervalI = 712;
+    HE.H3DEmitter.LodCountScaleF     = 713;
+    HE.H3DEmitter.CullFramesI        = 714;
 
     HE.H3DNodeFlags.NoDraw           = 1;
     HE.H3DNodeFlags.NoCastShadow     = 2;
     HE.H3DNodeFlags.NoRayQuery       = 4;
     HE.H3DNodeFlags.Inactive         = 7;
+    HE.H3DNodeFlags.Occluder         = 8;
 
     % Ready to rock!
     return;